@@ -94,5 +94,10 @@ int main(int argc, const char * argv[]) {
     runSyncTest (ethNetworkMainnet,  account, mode, timestamp,  5 * 60, path);
 //    runSyncMany(ethereumMainnet, mode, 10 * 60, 1000);
 #endif
+
+    runSupPerfTestsFileService (1000);
+    runBRTransactionPerfTestsSign (1000);
+    runBRTransactionPerfTestsSign (2000);
+    runBRWalletPerfTestsCoinSelection (10000);
     return 0;
 }
@@ -2177,6 +2177,17 @@ int BRBIP32SequenceTests()
                     uint256("7b6a7dd645507d775215a9035be06700e1ed8c541da9351b4bd14bd50ab61428")))
         r = 0, fprintf(stderr, "***FAILED*** %s: BRBIP32PubKey() test\n", __func__);
 
+    BRECPoint pubKeys[100];
+
+    BRBIP32ChainPubKeyList(pubKeys, 100, BRBIP32ChainPubKey(mpk, SEQUENCE_INTERNAL_CHAIN), 10, 4);
+
+    for (uint32_t i = 0; i < 100; i++) {
+        BRBIP32PubKey(pubKey, sizeof(pubKey), mpk, SEQUENCE_INTERNAL_CHAIN, 10 + i);
+        if (memcmp(pubKey, pubKeys[i].p, sizeof(pubKey)) == 0) continue;
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRBIP32ChainPubKeyList() test\n", __func__);
+        break;
+    }
+
     UInt512 dk;
     BRAddress addr;
 
@@ -2538,6 +2549,42 @@ static void walletTxDeleted(void *info, UInt256 txHash, int notifyUser, int reco
     printf("tx deleted: %s\n", u256hex(txHash));
 }
 
+// true if wallet1 and wallet2 have equal balances, UTXOs, transaction order and addresses
+static int BRWalletStateEqual (BRWallet *wallet1, BRWallet *wallet2) {
+    size_t utxoCount = BRWalletUTXOs(wallet1, NULL, 0), txCount = BRWalletTransactions(wallet1, NULL, 0),
+           addrCount = BRWalletAllAddrs(wallet1, NULL, 0);
+
+    if (BRWalletBalance(wallet1) != BRWalletBalance(wallet2)
+        || BRWalletTotalSent(wallet1) != BRWalletTotalSent(wallet2)
+        || BRWalletTotalReceived(wallet1) != BRWalletTotalReceived(wallet2)
+        || utxoCount != BRWalletUTXOs(wallet2, NULL, 0)
+        || txCount != BRWalletTransactions(wallet2, NULL, 0)
+        || addrCount != BRWalletAllAddrs(wallet2, NULL, 0)
+        || ! BRAddressEq(BRWalletReceiveAddress(wallet1).s, BRWalletReceiveAddress(wallet2).s))
+        return 0;
+
+    BRUTXO utxos1[utxoCount + 1], utxos2[utxoCount + 1];
+    BRTransaction *txs1[txCount + 1], *txs2[txCount + 1];
+    BRAddress *addrs1 = calloc(addrCount + 1, sizeof(BRAddress)), *addrs2 = calloc(addrCount + 1, sizeof(BRAddress));
+    int r = 1;
+
+    BRWalletUTXOs(wallet1, utxos1, utxoCount);
+    BRWalletUTXOs(wallet2, utxos2, utxoCount);
+    for (size_t i = 0; r && i < utxoCount; i++) r = BRUTXOEq(&utxos1[i], &utxos2[i]);
+
+    BRWalletTransactions(wallet1, txs1, txCount);
+    BRWalletTransactions(wallet2, txs2, txCount);
+    for (size_t i = 0; r && i < txCount; i++) r = UInt256Eq(txs1[i]->txHash, txs2[i]->txHash);
+
+    BRWalletAllAddrs(wallet1, addrs1, addrCount);
+    BRWalletAllAddrs(wallet2, addrs2, addrCount);
+    for (size_t i = 0; r && i < addrCount; i++) r = BRAddressEq(addrs1[i].s, addrs2[i].s);
+
+    free(addrs1);
+    free(addrs2);
+    return r;
+}
+
 // TODO: test standard free transaction no change
 // TODO: test free transaction who's inputs are too new to hit min free priority
 // TODO: test transaction with change below min allowable output
@@ -2589,6 +2636,8 @@ int BRWalletTests()
     if (BRWalletTransactions(w, NULL, 0) != 0)
         r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletTransactions() test 1\n", __func__);
 
+    BRWalletView *view = BRWalletCurrentView(w);
+
     BRTransactionSign(tx, 0, &k, 1);
     BRWalletRegisterTransaction(w, tx);
     if (BRWalletBalance(w) != SATOSHIS)
@@ -2597,6 +2646,29 @@ int BRWalletTests()
     if (BRWalletTransactions(w, NULL, 0) != 1)
         r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletTransactions() test 2\n", __func__);
 
+    if (BRWalletViewBalance(view) != 0 || BRWalletViewTransactions(view, NULL, 0) != 0 ||
+        BRWalletViewUTXOs(view, NULL, 0) != 0) // a view should be unaffected by later changes
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletCurrentView() test 1\n", __func__);
+
+    BRWalletViewRelease(view);
+    view = BRWalletCurrentView(w);
+
+    BRTransaction *viewTx = NULL;
+    BRUTXO viewUTXO = { UINT256_ZERO, 0 };
+
+    if (BRWalletViewBalance(view) != SATOSHIS || BRWalletViewTransactions(view, &viewTx, 1) != 1 || viewTx != tx ||
+        BRWalletViewUTXOs(view, &viewUTXO, 1) != 1 || ! UInt256Eq(viewUTXO.hash, tx->txHash) ||
+        BRWalletViewAllAddrs(view, NULL, 0) != BRWalletAllAddrs(w, NULL, 0))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletCurrentView() test 2\n", __func__);
+
+    BRWalletView *sharedView = BRWalletCurrentView(w);
+
+    if (sharedView != view) // a view should be shared until the wallet changes
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletCurrentView() test 3\n", __func__);
+
+    BRWalletViewRelease(sharedView);
+    BRWalletViewRelease(view);
+
     BRWalletRegisterTransaction(w, tx); // test adding same tx twice
     if (BRWalletBalance(w) != SATOSHIS)
         r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletRegisterTransaction() test 3\n", __func__);
@@ -2653,6 +2725,11 @@ int BRWalletTests()
     if (BRWalletTransactions(w, NULL, 0) != 2)
         r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletTransactions() test 3\n", __func__);
     
+    BRUTXO changeUTXO = { UINT256_ZERO, 0 };
+    
+    if (tx && (BRWalletUTXOs(w, &changeUTXO, 1) != 1 || ! UInt256Eq(changeUTXO.hash, tx->txHash))) // spent, then change
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletUTXOs() test 2\n", __func__);
+    
     if (tx && BRWalletTransactionForHash(w, tx->txHash) != tx)
         r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletTransactionForHash() test\n", __func__);
 
@@ -2664,7 +2741,21 @@ int BRWalletTests()
 
     if (tx && BRWalletTransactionIsPending(w, tx))
         r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletTransactionIsPending() test 2\n", __func__);
+
+    BRWalletUpdateTransactions(w, &hash, 1, TX_UNCONFIRMED, 0); // an unverified input should make tx unverified
+    if (tx && BRWalletTransactionIsVerified(w, tx))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletTransactionIsVerified() test 2\n", __func__);
+
+    BRWalletUpdateTransactions(w, &hash, 1, TX_UNCONFIRMED, 1);
+    if (tx && ! BRWalletTransactionIsVerified(w, tx))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletTransactionIsVerified() test 3\n", __func__);
     
+    tx = BRWalletCreateTransaction(w, SATOSHIS/4, addr.s); // spends the change output, from the internal chain
+    if (tx) BRWalletSignTransaction(w, tx, 0x00, &seed, sizeof(seed));
+    if (! tx || ! BRTransactionIsSigned(tx))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletSignTransaction() test 2\n", __func__);
+    
+    if (tx) BRTransactionFree(tx);
     BRWalletRemoveTransaction(w, hash); // removing first tx should recursively remove second, leaving none
     if (BRWalletTransactions(w, NULL, 0) != 0)
         r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletRemoveTransaction() test\n", __func__);
@@ -2708,6 +2799,230 @@ int BRWalletTests()
     BRTransactionFree(tx);
     BRWalletFree(w);
     
+    BRTransaction *txs[2];
+    
+    txs[0] = BRTransactionNew();
+    BRTransactionAddInput(txs[0], inHash, 2, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+    BRTransactionAddOutput(txs[0], 740000, outScript, outScriptLen);
+    BRTransactionSign(txs[0], 0, &k, 1);
+    txs[0]->blockHeight = 100;
+    w = BRWalletNew(BRMainNetParams->addrParams, txs, 1, mpk);
+    txs[1] = BRWalletCreateTransaction(w, 100000, addr.s);
+    if (txs[1]) BRWalletSignTransaction(w, txs[1], 0x00, &seed, sizeof(seed));
+    if (txs[1]) txs[1]->blockHeight = 101, BRWalletRegisterTransaction(w, txs[1]);
+    
+    size_t snapshotLen = BRWalletSnapshot(w, NULL, 0), chainsLen = BRWalletAddressChains(w, NULL, 0),
+           txCount = (txs[1]) ? 2 : 1;
+    uint8_t *snapshot = malloc(snapshotLen), *chains = malloc(chainsLen);
+    BRTransaction *txsCopy[2] = { BRTransactionCopy(txs[0]), (txs[1]) ? BRTransactionCopy(txs[1]) : NULL };
+    BRWallet *wn, *ws;
+    
+    if (! txs[1] || BRWalletSnapshot(w, snapshot, snapshotLen) != snapshotLen)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletSnapshot() test\n", __func__);
+    
+    if (BRWalletAddressChains(w, chains, chainsLen) != chainsLen)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletAddressChains() test\n", __func__);
+    
+    wn = BRWalletNew(BRMainNetParams->addrParams, txsCopy, txCount, mpk);
+    txsCopy[0] = BRTransactionCopy(txs[0]), txsCopy[1] = (txs[1]) ? BRTransactionCopy(txs[1]) : NULL;
+    ws = BRWalletNewWithSnapshot(BRMainNetParams->addrParams, txsCopy, txCount, mpk, chains, chainsLen,
+                                 snapshot, snapshotLen);
+    if (! ws || ! BRWalletStateEqual(wn, ws))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletNewWithSnapshot() test 1\n", __func__);
+    
+    if (ws) BRWalletFree(ws);
+    txsCopy[0] = BRTransactionCopy(txs[0]), txsCopy[1] = (txs[1]) ? BRTransactionCopy(txs[1]) : NULL;
+    ws = BRWalletNewWithSnapshot(BRMainNetParams->addrParams, txsCopy, txCount, mpk, chains, chainsLen, NULL, 0);
+    if (! ws || ! BRWalletStateEqual(wn, ws)) // chains alone
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletNewWithSnapshot() test 2\n", __func__);
+    
+    if (ws) BRWalletFree(ws);
+    snapshot[snapshotLen/2] ^= 0x01; // a corrupt snapshot and corrupt chains are ignored
+    chains[chainsLen/2] ^= 0x01;
+    txsCopy[0] = BRTransactionCopy(txs[0]), txsCopy[1] = (txs[1]) ? BRTransactionCopy(txs[1]) : NULL;
+    ws = BRWalletNewWithSnapshot(BRMainNetParams->addrParams, txsCopy, txCount, mpk, chains, chainsLen,
+                                 snapshot, snapshotLen);
+    if (! ws || ! BRWalletStateEqual(wn, ws))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletNewWithSnapshot() test 3\n", __func__);
+    
+    if (ws) BRWalletFree(ws);
+    snapshot[snapshotLen/2] ^= 0x01;
+    chains[chainsLen/2] ^= 0x01;
+    txsCopy[0] = BRTransactionCopy(txs[0]); // a snapshot of other transactions is ignored
+    ws = BRWalletNewWithSnapshot(BRMainNetParams->addrParams, txsCopy, 1, mpk, chains, chainsLen,
+                                 snapshot, snapshotLen);
+    if (! ws || BRWalletBalance(ws) != 740000 || BRWalletTransactions(ws, NULL, 0) != 1)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletNewWithSnapshot() test 4\n", __func__);
+    
+    if (ws) BRWalletFree(ws);
+    free(chains);
+    free(snapshot);
+    BRWalletFree(wn);
+    BRWalletFree(w);
+    
+    BRTransaction *txs3[3];
+    BRUTXO utxos[2], utxosn[2];
+    
+    w = BRWalletNew(BRMainNetParams->addrParams, NULL, 0, mpk); // tx registered in order are applied incrementally
+    txs3[0] = BRTransactionNew();
+    BRTransactionAddInput(txs3[0], inHash, 3, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+    BRTransactionAddOutput(txs3[0], 740000, outScript, outScriptLen);
+    BRTransactionSign(txs3[0], 0, &k, 1);
+    BRWalletRegisterTransaction(w, txs3[0]);
+    txs3[1] = BRWalletCreateTransaction(w, 100000, addr.s);
+    txs3[2] = BRWalletCreateTransaction(w, 200000, addr.s); // double spends txs3[1]
+    if (txs3[1]) BRWalletSignTransaction(w, txs3[1], 0x00, &seed, sizeof(seed));
+    if (txs3[1]) BRWalletRegisterTransaction(w, txs3[1]);
+    if (txs3[2]) BRWalletSignTransaction(w, txs3[2], 0x00, &seed, sizeof(seed));
+    if (txs3[2]) BRWalletRegisterTransaction(w, txs3[2]);
+    
+    txCount = (txs3[1] && txs3[2]) ? 3 : 1;
+    txsCopy[0] = BRTransactionCopy(txs3[0]), txsCopy[1] = (txs3[1]) ? BRTransactionCopy(txs3[1]) : NULL;
+    wn = BRWalletNew(BRMainNetParams->addrParams, txsCopy, (txCount == 3) ? 2 : 1, mpk);
+    if (txCount != 3 || BRWalletBalance(w) != BRWalletBalance(wn) || BRWalletTotalSent(w) != BRWalletTotalSent(wn) ||
+        BRWalletTotalReceived(w) != BRWalletTotalReceived(wn) || BRWalletUTXOs(w, utxos, 2) != 1 ||
+        BRWalletUTXOs(wn, utxosn, 2) != 1 || ! BRUTXOEq(&utxos[0], &utxosn[0]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletRegisterTransaction() test 6\n", __func__);
+    
+    if (txCount == 3 && BRWalletTransactionIsValid(w, txs3[2]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletTransactionIsValid() test 2\n", __func__);
+    
+    if (txCount == 3) BRWalletRemoveTransaction(w, txs3[2]->txHash); // removing the last, invalid tx
+    if (BRWalletBalance(w) != BRWalletBalance(wn) || BRWalletTransactions(w, NULL, 0) != 2 ||
+        BRWalletUTXOs(w, utxos, 2) != 1 || ! BRUTXOEq(&utxos[0], &utxosn[0]))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletRemoveTransaction() test 2\n", __func__);
+    
+    BRWalletFree(wn);
+    BRWalletFree(w);
+    
+    uint8_t pubKey[33], extScript[2][25];
+    size_t extScriptLen[2];
+    uint32_t extIdx[2] = { SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED - 5, SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED + 2 };
+    BRAddress extAddr;
+    BRKey extKey;
+    
+    for (size_t i = 0; i < 2; i++) {
+        BRKeySetPubKey(&extKey, pubKey, BRBIP32PubKey(pubKey, sizeof(pubKey), mpk, SEQUENCE_EXTERNAL_CHAIN, extIdx[i]));
+        BRKeyLegacyAddr(&extKey, extAddr.s, sizeof(extAddr), BRMainNetParams->addrParams);
+        extScriptLen[i] = BRAddressScriptPubKey(extScript[i], sizeof(extScript[i]), BRMainNetParams->addrParams,
+                                                extAddr.s);
+    }
+    
+    w = BRWalletNew(BRMainNetParams->addrParams, NULL, 0, mpk); // tx paying to an address not generated yet
+    tx = BRTransactionNew();
+    BRTransactionAddInput(tx, inHash, 7, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+    BRTransactionAddOutput(tx, 100000, extScript[0], extScriptLen[0]);
+    BRTransactionAddOutput(tx, 200000, extScript[1], extScriptLen[1]);
+    BRTransactionSign(tx, 0, &k, 1);
+    BRWalletRegisterTransaction(w, tx);
+    if (BRWalletBalance(w) != 300000 || BRWalletUTXOs(w, NULL, 0) != 2)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletRegisterTransaction() test 7\n", __func__);
+    
+    BRWalletFree(w);
+    
+    w = BRWalletNew(BRMainNetParams->addrParams, NULL, 0, mpk); // tx registered as a batch
+    BRWalletSetCallbacks(w, w, walletBalanceChanged, walletTxAdded, walletTxUpdated, walletTxDeleted);
+    
+    for (size_t i = 0; i < 3; i++) {
+        txs3[i] = BRTransactionNew();
+        BRTransactionAddInput(txs3[i], inHash, 8 + i, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+        BRTransactionAddOutput(txs3[i], 100000*(i + 1), extScript[1 - i % 2], extScriptLen[1 - i % 2]);
+        BRTransactionSign(txs3[i], 0, &k, 1);
+    }
+    
+    // txs3[0] and txs3[2] are only associated with the wallet through an address generated after adding txs3[1]
+    if (BRWalletRegisterTransactions(w, txs3, 3) != 3 || BRWalletBalance(w) != 600000 ||
+        BRWalletUTXOs(w, NULL, 0) != 3 || BRWalletTransactions(w, NULL, 0) != 3)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletRegisterTransactions() test 1\n", __func__);
+    
+    BRWalletFree(w);
+    
+    w = BRWalletNew(BRMainNetParams->addrParams, NULL, 0, mpk); // tx registered as a batch after a pending tx
+    tx = BRTransactionNew();
+    BRTransactionAddInput(tx, inHash, 12, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE - 2);
+    BRTransactionAddOutput(tx, 100000, outScript, outScriptLen);
+    BRTransactionSign(tx, 0, &k, 1);
+    BRWalletRegisterTransaction(w, tx);
+    
+    for (size_t i = 0; i < 3; i++) {
+        txs3[i] = BRTransactionNew();
+        BRTransactionAddInput(txs3[i], inHash, 8 + i, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+        BRTransactionAddOutput(txs3[i], 100000*(i + 1), extScript[1 - i % 2], extScriptLen[1 - i % 2]);
+        BRTransactionSign(txs3[i], 0, &k, 1);
+    }
+    
+    // the pending tx keeps the batch from being applied incrementally
+    if (! BRWalletTransactionIsPending(w, tx) || BRWalletRegisterTransactions(w, txs3, 3) != 3 ||
+        BRWalletBalance(w) != 600000 || BRWalletUTXOs(w, NULL, 0) != 3 || BRWalletTransactions(w, NULL, 0) != 4)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletRegisterTransactions() test 2\n", __func__);
+    
+    BRWalletFree(w);
+    
+    BRTransaction *sorted[2];
+    
+    w = BRWalletNew(BRMainNetParams->addrParams, NULL, 0, mpk); // tx registered before the tx it spends
+    txs3[0] = BRTransactionNew();
+    BRTransactionAddInput(txs3[0], inHash, 11, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+    BRTransactionAddOutput(txs3[0], 100000, outScript, outScriptLen);
+    BRTransactionAddOutput(txs3[0], 60000, inScript, inScriptLen);
+    BRTransactionSign(txs3[0], 0, &k, 1);
+    txs3[1] = BRTransactionNew();
+    BRTransactionAddInput(txs3[1], txs3[0]->txHash, 1, 60000, inScript, inScriptLen, NULL, 0, NULL, 0,
+                          TXIN_SEQUENCE);
+    BRTransactionAddOutput(txs3[1], 50000, outScript, outScriptLen);
+    BRTransactionSign(txs3[1], 0, &k, 1);
+    BRWalletRegisterTransaction(w, txs3[1]);
+    BRWalletRegisterTransaction(w, txs3[0]);
+    if (BRWalletTransactions(w, sorted, 2) != 2 || sorted[0] != txs3[0] || sorted[1] != txs3[1] ||
+        BRWalletBalanceAfterTx(w, txs3[0]) != 100000 || BRWalletBalanceAfterTx(w, txs3[1]) != 150000)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletRegisterTransaction() test 8\n", __func__);
+    
+    UInt256 txHashes[2] = { txs3[1]->txHash, txs3[0]->txHash };
+    
+    BRWalletUpdateTransactions(w, txHashes, 2, 100, 1);
+    if (BRWalletTransactions(w, sorted, 2) != 2 || sorted[0] != txs3[0] || sorted[1] != txs3[1])
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletUpdateTransactions() test\n", __func__);
+    
+    BRWalletFree(w);
+    
+    BRUTXO utxos3[3];
+    uint64_t amounts[3] = { 300000, 900000, 500000 };
+    
+    for (size_t i = 0; i < 3; i++) {
+        txs3[i] = BRTransactionNew();
+        BRTransactionAddInput(txs3[i], inHash, 4 + i, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+        BRTransactionAddOutput(txs3[i], amounts[i], outScript, outScriptLen);
+        BRTransactionSign(txs3[i], 0, &k, 1);
+    }
+    
+    w = BRWalletNew(BRMainNetParams->addrParams, txs3, 3, mpk);
+    if (BRWalletUTXOs(w, utxos3, 3) != 3 || ! UInt256Eq(utxos3[0].hash, txs3[0]->txHash) ||
+        ! UInt256Eq(utxos3[1].hash, txs3[1]->txHash) || ! UInt256Eq(utxos3[2].hash, txs3[2]->txHash))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletUTXOs() test\n", __func__);
+    
+    if (BRWalletUTXOsByAmount(w, utxos3, 3) != 3 || ! UInt256Eq(utxos3[0].hash, txs3[1]->txHash) ||
+        ! UInt256Eq(utxos3[1].hash, txs3[2]->txHash) || ! UInt256Eq(utxos3[2].hash, txs3[0]->txHash))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletUTXOsByAmount() test\n", __func__);
+    
+    // 192 bytes is the size of a transaction with one input and one output
+    tx = BRWalletCreateTransaction(w, 500000 - BRWalletFeeForTxSize(w, 192), addr.s);
+    if (! tx || tx->inCount != 2 || tx->outCount != 2)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletCreateTransaction() coin selection test 1\n", __func__);
+    
+    if (tx) BRTransactionFree(tx);
+    BRWalletSetCoinSelection(w, BRWalletCoinSelectionBranchAndBound);
+    tx = BRWalletCreateTransaction(w, 500000 - BRWalletFeeForTxSize(w, 192), addr.s);
+    if (! tx || tx->inCount != 1 || tx->outCount != 1 || ! UInt256Eq(tx->inputs[0].txHash, txs3[2]->txHash))
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletCreateTransaction() coin selection test 2\n", __func__);
+    
+    if (tx) BRTransactionFree(tx);
+    tx = BRWalletCreateTransaction(w, 600000, addr.s); // 300000 + 500000 leaves less change than 900000
+    if (! tx || tx->inCount != 2 || tx->outCount != 2 || tx->inputs[0].amount + tx->inputs[1].amount != 800000)
+        r = 0, fprintf(stderr, "***FAILED*** %s: BRWalletCreateTransaction() coin selection test 3\n", __func__);
+    
+    if (tx) BRTransactionFree(tx);
+    BRWalletFree(w);
+    
     amt = BRBitcoinAmount(50000, 50000);
     if (amt != SATOSHIS) r = 0, fprintf(stderr, "***FAILED*** %s: BRBitcoinAmount() test 1\n", __func__);
 
@@ -3537,6 +3852,105 @@ extern int BRRunTestsSync (const char *paperKey,
     return 1;
 }
 
+// signs a transaction spending inputCount synthetic UTXOs, once with segwit and once with the b-cash fork id, each input
+// signed with the hashPrevouts, hashSequence and hashOutputs digests that are computed once per transaction
+void runBRTransactionPerfTestsSign(size_t inputCount)
+{
+    UInt256 secret = uint256("0000000000000000000000000000000000000000000000000000000000000001"),
+            inHash = uint256("0000000000000000000000000000000000000000000000000000000000000001");
+    BRKey k;
+    BRAddress addr;
+    BRTransaction *tx;
+    clock_t start;
+    double ms;
+
+    BRKeySetSecret(&k, &secret, 1);
+
+    for (int forkId = 0; forkId <= 0x40; forkId += 0x40) { // segwit for bitcoin, pay-to-pubkey-hash for b-cash
+        if (forkId) BRKeyLegacyAddr(&k, addr.s, sizeof(addr), BRMainNetParams->addrParams);
+        else BRKeyAddress(&k, addr.s, sizeof(addr), BRMainNetParams->addrParams);
+
+        uint8_t script[BRAddressScriptPubKey(NULL, 0, BRMainNetParams->addrParams, addr.s)];
+        size_t scriptLen = BRAddressScriptPubKey(script, sizeof(script), BRMainNetParams->addrParams, addr.s);
+
+        tx = BRTransactionNew();
+
+        for (size_t i = 0; i < inputCount; i++) { // consolidate inputCount UTXOs into one output
+            BRTransactionAddInput(tx, inHash, (uint32_t)i, 10000, script, scriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+        }
+
+        BRTransactionAddOutput(tx, 5000*inputCount, script, scriptLen);
+        start = clock();
+        BRTransactionSign(tx, forkId, &k, 1);
+        ms = 1000.0*(clock() - start)/CLOCKS_PER_SEC;
+        printf("BTC: Perf: Sign: forkId 0x%02x: %zu inputs: %8.3f ms/tx, %6.3f ms/input%s\n", forkId, inputCount,
+               ms, ms/inputCount, BRTransactionIsSigned(tx) ? "" : " UNSIGNED");
+        BRTransactionFree(tx);
+    }
+}
+
+void runBRWalletPerfTestsCoinSelection(size_t count)
+{
+    const char *names[] = { "OldestFirst", "BranchAndBound" };
+    UInt512 seed;
+    UInt256 secret = uint256("0000000000000000000000000000000000000000000000000000000000000001"),
+            inHash = uint256("0000000000000000000000000000000000000000000000000000000000000001");
+    BRKey k;
+    BRAddress addr, recvAddr;
+    BRWallet *w;
+    BRTransaction *tx, **txs = calloc(count, sizeof(*txs));
+    uint64_t amounts[100], fee;
+    size_t inputs, changeless, created;
+    clock_t start;
+
+    BRBIP39DeriveKey(&seed, "a random seed", NULL);
+    w = BRWalletNew(BRMainNetParams->addrParams, NULL, 0, BRBIP32MasterPubKey(&seed, sizeof(seed)));
+    recvAddr = BRWalletReceiveAddress(w);
+    BRKeySetSecret(&k, &secret, 1);
+    BRKeyAddress(&k, addr.s, sizeof(addr), BRMainNetParams->addrParams);
+
+    uint8_t inScript[BRAddressScriptPubKey(NULL, 0, BRMainNetParams->addrParams, addr.s)];
+    size_t inScriptLen = BRAddressScriptPubKey(inScript, sizeof(inScript), BRMainNetParams->addrParams, addr.s);
+    uint8_t outScript[BRAddressScriptPubKey(NULL, 0, BRMainNetParams->addrParams, recvAddr.s)];
+    size_t outScriptLen = BRAddressScriptPubKey(outScript, sizeof(outScript), BRMainNetParams->addrParams, recvAddr.s);
+
+    for (size_t i = 0; i < count; i++) { // UTXOs of 0.0001 to 0.01 btc
+        txs[i] = BRTransactionNew();
+        BRTransactionAddInput(txs[i], inHash, (uint32_t)i, 1, inScript, inScriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
+        BRTransactionAddOutput(txs[i], 10000 + BRRand(990000), outScript, outScriptLen);
+        BRTransactionSign(txs[i], 0, &k, 1);
+    }
+
+    BRWalletRegisterTransactions(w, txs, count);
+    for (size_t i = 0; i < 100; i++) amounts[i] = 5000 + BRRand(1995000); // payouts of 0.00005 to 0.02 btc
+
+    for (BRWalletCoinSelection selection = BRWalletCoinSelectionOldestFirst;
+         selection <= BRWalletCoinSelectionBranchAndBound; selection++) {
+        BRWalletSetCoinSelection(w, selection);
+        inputs = changeless = created = 0;
+        fee = 0;
+        start = clock();
+
+        for (size_t i = 0; i < 100; i++) {
+            tx = BRWalletCreateTransaction(w, amounts[i], addr.s);
+            if (! tx) continue;
+            created++;
+            inputs += tx->inCount;
+            if (tx->outCount == 1) changeless++;
+            fee += BRWalletFeeForTx(w, tx);
+            BRTransactionFree(tx);
+        }
+
+        printf("BTC: Perf: CoinSelection: %-14s: %zu UTXOs: %8.3f ms/tx, %6.2f inputs/tx, %zu/%zu changeless, "
+               "fee: %"PRIu64"\n", names[selection], count,
+               (created > 0) ? 1000.0*(clock() - start)/CLOCKS_PER_SEC/created : 0.0,
+               (created > 0) ? (double)inputs/created : 0.0, changeless, created, fee);
+    }
+
+    BRWalletFree(w);
+    free(txs);
+}
+
 #ifndef BITCOIN_TEST_NO_MAIN
 void syncStarted(void *info)
 {
@@ -874,7 +874,8 @@ BRCryptoWalletManagerSetupForLifecycleTest (CWMEventRecordingState *state,
         _CWMNopEstimateTransactionFeeCallback
     };
 
-    BRCryptoSystem system = cryptoSystemCreate (client, listener, account, storagePath, cryptoNetworkIsMainnet(network));
+    BRCryptoSystem system = cryptoSystemCreate (client, listener, account, storagePath, cryptoNetworkIsMainnet(network),
+                                                CRYPTO_PERSISTENCE_PROFILE_DURABLE);
 
     return cryptoWalletManagerCreate (cryptoListenerCreateWalletManagerListener (listener, system),
                                       client,
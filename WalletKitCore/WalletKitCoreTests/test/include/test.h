@@ -85,6 +85,12 @@ getChainName (BRBitcoinChain chain);
 
 extern int BRRunSupTests (void);
 
+extern void runSupPerfTestsFileService (size_t count);
+
+extern void runBRTransactionPerfTestsSign (size_t inputCount);
+
+extern void runBRWalletPerfTestsCoinSelection (size_t count);
+
 extern int BRRunTests();
 
 extern int BRRunTestsSync (const char *paperKey,
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #define __USE_XOPEN_EXTENDED
 #include <ftw.h>
 #undef __USE_XOPEN_EXTENDED
@@ -18,8 +19,11 @@
 #include <string.h>
 
 #include "support/BRFileService.h"
+#include "support/BRCompress.h"
+#include "support/BRCrypto.h"
 #include "support/BRAssert.h"
 #include "support/BROSCompat.h"
+#include "../vendor/sqlite3/sqlite3.h"
 
 /// MARK: - File Service Tests
 
@@ -228,6 +232,1341 @@ static int runSupFileServiceMultiTests (void) {
     return fileServiceTestDone(path, success);
 }
 
+/// MARK: - File Service Entity Tests
+
+#define SUP_ENTITY_TYPE             "bar"
+#define SUP_ENTITY_BYTES_COUNT      (sizeof (UInt256) + sizeof (uint64_t))
+
+typedef struct {
+    UInt256 identifier;
+    uint64_t value;
+} SupEntity;
+
+static SupEntity *
+supEntityCreate (uint64_t value) {
+    SupEntity *entity = calloc (1, sizeof (SupEntity));
+    entity->identifier.u64[0] = value + 1;   // never UINT256_ZERO
+    entity->value = value;
+    return entity;
+}
+
+static size_t
+supEntityHash (const void *entity) {
+    return (size_t) ((const SupEntity *) entity)->identifier.u64[0];
+}
+
+static int
+supEntityEq (const void *entity1, const void *entity2) {
+    return UInt256Eq (((const SupEntity *) entity1)->identifier,
+                      ((const SupEntity *) entity2)->identifier);
+}
+
+static UInt256
+supEntityIdentifier (BRFileServiceContext context,
+                     BRFileService fs,
+                     const void *entity) {
+    return ((const SupEntity *) entity)->identifier;
+}
+
+static int64_t
+supEntitySortKey (BRFileServiceContext context,
+                  BRFileService fs,
+                  const void *entity) {
+    return (int64_t) ((const SupEntity *) entity)->value;
+}
+
+static void *
+supEntityReader (BRFileServiceContext context,
+                 BRFileService fs,
+                 uint8_t *bytes,
+                 uint32_t bytesCount) {
+    if (SUP_ENTITY_BYTES_COUNT != bytesCount) return NULL;
+
+    SupEntity *entity = calloc (1, sizeof (SupEntity));
+    memcpy (entity->identifier.u8, bytes, sizeof (UInt256));
+    entity->value = UInt64GetBE (&bytes[sizeof (UInt256)]);
+    return entity;
+}
+
+static uint8_t *
+supEntityWriter (BRFileServiceContext context,
+                 BRFileService fs,
+                 const void* entity,
+                 uint32_t *bytesCount) {
+    const SupEntity *supEntity = entity;
+
+    *bytesCount = SUP_ENTITY_BYTES_COUNT;
+    uint8_t *bytes = malloc (SUP_ENTITY_BYTES_COUNT);
+    memcpy (bytes, supEntity->identifier.u8, sizeof (UInt256));
+    UInt64SetBE (&bytes[sizeof (UInt256)], supEntity->value);
+    return bytes;
+}
+
+static BRFileService
+fileServiceEntityDefine (const char *path, BRFileService fs) {
+    if (NULL == fs) return fileServiceSetupError (path, fs);
+
+    if (1 != fileServiceDefineType (fs, SUP_ENTITY_TYPE, 0, NULL,
+                                    supEntityIdentifier,
+                                    supEntityReader,
+                                    supEntityWriter))
+        return fileServiceSetupError (path, fs);
+
+    if (1 != fileServiceDefineCurrentVersion(fs, SUP_ENTITY_TYPE, 0))
+        return fileServiceSetupError (path, fs);
+
+    if (1 != fileServiceDefineSortKey (fs, SUP_ENTITY_TYPE, NULL, supEntitySortKey))
+        return fileServiceSetupError (path, fs);
+
+    return fs;
+}
+
+static BRFileService
+fileServiceEntitySetup (const char *path, const char *currency, const char *network,
+                        BRFileServiceBackendType backendType) {
+    return fileServiceEntityDefine (path, fileServiceCreateWithBackend (path, currency, network, backendType,
+                                                                        NULL, fileServiceErrorHandler));
+}
+
+static BRFileService
+fileServiceEntitySetupInStore (BRFileServiceStore store, const char *path, const char *currency, const char *network) {
+    return fileServiceEntityDefine (path, fileServiceCreateInStore (store, currency, network,
+                                                                    NULL, fileServiceErrorHandler));
+}
+
+/// Load all SupEntity and confirm `count` values of {0, ..., count - 1}
+static int
+fileServiceEntityLoadAndCheck (BRFileService fs, size_t count) {
+    BRSetOf(SupEntity*) entities = BRSetNew (supEntityHash, supEntityEq, count);
+    int success = (1 == fileServiceLoad (fs, entities, SUP_ENTITY_TYPE, 1) &&
+                   count == BRSetCount (entities));
+
+    for (uint64_t value = 0; success && value < count; value++) {
+        SupEntity *entity  = supEntityCreate (value);
+        SupEntity *loaded  = BRSetGet (entities, entity);
+        success = (NULL != loaded && value == loaded->value);
+        free (entity);
+    }
+
+    BRSetFreeAll (entities, free);
+    return success;
+}
+
+static int
+supEntityCompareByValue (const void *e1, const void *e2) {
+    const SupEntity *entity1 = * (SupEntity **) e1;
+    const SupEntity *entity2 = * (SupEntity **) e2;
+    return (entity1->value < entity2->value ? -1 : (entity1->value > entity2->value ? +1 : 0));
+}
+
+static int
+supEntityLoadedInOrder (BRFileServiceContext context,
+                        BRFileService fs,
+                        void *entity) {
+    uint64_t *expected = context;
+    int success = (*expected == ((SupEntity *) entity)->value);
+    *expected += 1;
+    free (entity);
+    return success;
+}
+
+/// Load, by sort key, SupEntity in [lower, upper] and confirm values of {lower, ..., upper}
+static int
+fileServiceEntityRangeAndCheck (BRFileService fs, uint64_t lower, uint64_t upper) {
+    uint64_t expected = lower;
+    return (1 == fileServiceLoadRange (fs, SUP_ENTITY_TYPE, 1,
+                                       (int64_t) lower,
+                                       (int64_t) upper,
+                                       &expected,
+                                       supEntityLoadedInOrder) &&
+            upper + 1 == expected);
+}
+
+/// Load, ordered by value, all SupEntity and confirm `count` values of {0, ..., count - 1}
+static int
+fileServiceEntityIterateAndCheck (BRFileService fs, size_t count) {
+    uint64_t expected = 0;
+    return (1 == fileServiceLoadIterate (fs, SUP_ENTITY_TYPE, 1,
+                                         supEntityCompareByValue,
+                                         &expected,
+                                         supEntityLoadedInOrder) &&
+            count == expected);
+}
+
+/// Count the Entity rows, with `Data` stored as `dataType`, directly from the sqlite3 DB.
+static int
+fileServiceEntityCountRows (const char *dbpath, const char *dataType) {
+    sqlite3 *sdb;
+    sqlite3_stmt *stmt;
+    int count = -1;
+
+    if (SQLITE_OK != sqlite3_open (dbpath, &sdb)) return -1;
+    if (SQLITE_OK == sqlite3_prepare_v2 (sdb, "SELECT COUNT(*) FROM Entity WHERE Type = ? AND typeof(Data) = ?;", -1, &stmt, NULL)) {
+        sqlite3_bind_text (stmt, 1, SUP_ENTITY_TYPE, -1, SQLITE_STATIC);
+        sqlite3_bind_text (stmt, 2, dataType,        -1, SQLITE_STATIC);
+        if (SQLITE_ROW == sqlite3_step (stmt))
+            count = sqlite3_column_int (stmt, 0);
+        sqlite3_finalize (stmt);
+    }
+    sqlite3_close (sdb);
+    return count;
+}
+
+/// Count the Entity rows without a SortKey, directly from the sqlite3 DB.
+static int
+fileServiceEntityCountUnkeyedRows (const char *dbpath) {
+    sqlite3 *sdb;
+    sqlite3_stmt *stmt;
+    int count = -1;
+
+    if (SQLITE_OK != sqlite3_open (dbpath, &sdb)) return -1;
+    if (SQLITE_OK == sqlite3_prepare_v2 (sdb, "SELECT COUNT(*) FROM Entity WHERE Type = ? AND SortKey IS NULL;", -1, &stmt, NULL)) {
+        sqlite3_bind_text (stmt, 1, SUP_ENTITY_TYPE, -1, SQLITE_STATIC);
+        if (SQLITE_ROW == sqlite3_step (stmt))
+            count = sqlite3_column_int (stmt, 0);
+        sqlite3_finalize (stmt);
+    }
+    sqlite3_close (sdb);
+    return count;
+}
+
+/// Get the sqlite3 rowid of `entity`, directly from the sqlite3 DB.  A rewritten entity gets a new rowid.
+static int64_t
+fileServiceEntityRowId (const char *dbpath, const SupEntity *entity) {
+    sqlite3 *sdb;
+    sqlite3_stmt *stmt;
+    int64_t rowId = -1;
+
+    if (SQLITE_OK != sqlite3_open (dbpath, &sdb)) return -1;
+    if (SQLITE_OK == sqlite3_prepare_v2 (sdb, "SELECT rowid FROM Entity WHERE Type = ? AND Hash = ?;", -1, &stmt, NULL)) {
+        sqlite3_bind_text (stmt, 1, SUP_ENTITY_TYPE, -1, SQLITE_STATIC);
+        sqlite3_bind_text (stmt, 2, u256hex (entity->identifier), -1, SQLITE_TRANSIENT);
+        if (SQLITE_ROW == sqlite3_step (stmt))
+            rowId = sqlite3_column_int64 (stmt, 0);
+        sqlite3_finalize (stmt);
+    }
+    sqlite3_close (sdb);
+    return rowId;
+}
+
+/// Create the Entity table as it was before the SortKey column, directly in the sqlite3 DB.
+static int
+fileServiceEntityCreateTableWithoutSortKey (const char *dbpath) {
+    sqlite3 *sdb;
+    if (SQLITE_OK != sqlite3_open (dbpath, &sdb)) return 0;
+    int success = (SQLITE_OK == sqlite3_exec (sdb,
+                                              "CREATE TABLE Entity(Type CHAR(64) NOT NULL, Hash CHAR(64) NOT NULL, "
+                                              "Data TEXT NOT NULL, PRIMARY KEY (Type, Hash));",
+                                              NULL, NULL, NULL));
+    sqlite3_close (sdb);
+    return success;
+}
+
+/// Insert `entity` as a HEADER_FORMAT_1 row - hex-encoded TEXT - directly into the sqlite3 DB.
+static int
+fileServiceEntityInsertFormat1 (const char *dbpath, const SupEntity *entity) {
+    uint8_t bytes[1 + 1 + sizeof (uint32_t) + SUP_ENTITY_BYTES_COUNT];
+    bytes[0] = 0;   // HEADER_FORMAT_1
+    bytes[1] = 0;   // Entity Version
+    UInt32SetBE (&bytes[2], SUP_ENTITY_BYTES_COUNT);
+    memcpy (&bytes[6], entity->identifier.u8, sizeof (UInt256));
+    UInt64SetBE (&bytes[6 + sizeof (UInt256)], entity->value);
+
+    char data[2 * sizeof (bytes) + 1];
+    for (size_t index = 0; index < sizeof (bytes); index++)
+        sprintf (&data[2 * index], "%02x", bytes[index]);
+
+    sqlite3 *sdb;
+    sqlite3_stmt *stmt;
+    int success = 0;
+
+    if (SQLITE_OK != sqlite3_open (dbpath, &sdb)) return 0;
+    if (SQLITE_OK == sqlite3_prepare_v2 (sdb, "INSERT OR REPLACE INTO Entity (Type, Hash, Data) VALUES (?, ?, ?);", -1, &stmt, NULL)) {
+        sqlite3_bind_text (stmt, 1, SUP_ENTITY_TYPE, -1, SQLITE_STATIC);
+        sqlite3_bind_text (stmt, 2, u256hex (entity->identifier), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text (stmt, 3, data, -1, SQLITE_STATIC);
+        success = (SQLITE_DONE == sqlite3_step (stmt));
+        sqlite3_finalize (stmt);
+    }
+    sqlite3_close (sdb);
+    return success;
+}
+
+static int
+fileServiceLatencyCheck (BRFileServiceLatency latency) {
+    uint64_t count = 0;
+    for (size_t index = 0; index < FILE_SERVICE_LATENCY_BUCKETS_COUNT; index++)
+        count += latency.buckets[index];
+    return 0 != latency.count && count == latency.count;
+}
+
+static int
+fileServiceEntityStatsCheck (BRFileService fs, size_t count) {
+    BRFileServiceTypeStats stats[2];
+    if (1 != fileServiceGetStats (fs, stats, 2)) return 0;
+
+    return (0 == strcmp (SUP_ENTITY_TYPE, stats[0].type) &&
+            count == stats[0].entitiesCount &&
+            count * (6 + SUP_ENTITY_BYTES_COUNT) == stats[0].bytesCount &&   // 6 header bytes
+            stats[0].entitiesSaved  >= count &&
+            stats[0].entitiesLoaded >= count &&
+            fileServiceLatencyCheck (stats[0].saves) &&
+            fileServiceLatencyCheck (stats[0].loads) &&
+            fileServiceLatencyCheck (stats[0].removes));
+}
+
+static int runSupFileServiceEntityTests (void) {
+    printf ("==== SUP:FileServiceEntity\n");
+
+    struct stat dirStat;
+
+    BRFileService fs;
+    char *path = "private";
+    char *currency = "btc", *network = "mainnet";
+    size_t count = 100;
+
+    char dbpath[1024];
+    sprintf (dbpath, "%s/%s-%s-entities.db", path,  currency, network);
+
+    if (0 == stat  (path, &dirStat)) _rmdir (path);
+    if (0 != mkdir (path, 0700)) return 0;
+
+    fs = fileServiceEntitySetup (path, currency, network, FILE_SERVICE_BACKEND_SQLITE);
+    if (NULL == fs) return fileServiceTestDone (path, 0);
+
+    // Save then load; the entities are stored as BLOBs
+    for (uint64_t value = 0; value < count; value++) {
+        SupEntity *entity = supEntityCreate (value);
+        int success = fileServiceSave (fs, SUP_ENTITY_TYPE, entity);
+        free (entity);
+        if (1 != success) { fileServiceRelease (fs); return fileServiceTestDone (path, 0); }
+    }
+
+    if (!fileServiceEntityLoadAndCheck (fs, count) ||
+        !fileServiceEntityIterateAndCheck (fs, count) ||
+        count != fileServiceEntityCountRows (dbpath, "blob")) {
+        fileServiceRelease (fs);
+        return fileServiceTestDone (path, 0);
+    }
+
+    // Replace one entity with a legacy, HEADER_FORMAT_1 entity and add another.
+    SupEntity *legacy1 = supEntityCreate (0);
+    SupEntity *legacy2 = supEntityCreate (count);
+    int success = (fileServiceEntityInsertFormat1 (dbpath, legacy1) &&
+                   fileServiceEntityInsertFormat1 (dbpath, legacy2) &&
+                   2 == fileServiceEntityCountRows (dbpath, "text"));
+    free (legacy1);
+    free (legacy2);
+
+    // Loading reads the legacy entities and migrates them to BLOBs, with a sort key; decode on
+    // load threads from here on
+    fileServiceSetLoadThreads (fs, 4);
+    success = (success &&
+               2 == fileServiceEntityCountUnkeyedRows (dbpath) &&
+               fileServiceEntityIterateAndCheck (fs, count + 1) &&
+               fileServiceEntityLoadAndCheck (fs, count + 1) &&
+               0         == fileServiceEntityCountUnkeyedRows (dbpath) &&
+               0         == fileServiceEntityCountRows (dbpath, "text") &&
+               count + 1 == fileServiceEntityCountRows (dbpath, "blob"));
+
+    // Save many in one transaction; then save within a batch
+    SupEntity *entities[10];
+    for (size_t index = 0; index < 10; index++)
+        entities[index] = supEntityCreate (count + 1 + index);
+
+    success = (success &&
+               fileServiceSaveMany (fs, SUP_ENTITY_TYPE, (const void **) entities, 5) &&
+               fileServiceEntityLoadAndCheck (fs, count + 6));
+
+    success = (success && fileServiceBeginBatch (fs));
+    for (size_t index = 5; success && index < 10; index++)
+        success = fileServiceSave (fs, SUP_ENTITY_TYPE, entities[index]);
+    success = (success &&
+               fileServiceCommitBatch (fs) &&
+               fileServiceEntityLoadAndCheck (fs, count + 11) &&
+               count + 11 == fileServiceEntityCountRows (dbpath, "blob"));
+
+    for (size_t index = 0; index < 10; index++)
+        free (entities[index]);
+
+    // Write-behind; saves and removes are queued and coalesced, then committed on a flush
+    fileServiceSetWriteBehind (fs, 1);
+    for (uint64_t value = count + 11; success && value < count + 22; value++) {
+        SupEntity *entity = supEntityCreate (value);
+        success = (fileServiceSave (fs, SUP_ENTITY_TYPE, entity) &&
+                   fileServiceSave (fs, SUP_ENTITY_TYPE, entity));
+        if (success && value == count + 21)
+            success = fileServiceRemove (fs, SUP_ENTITY_TYPE, entity);
+        free (entity);
+    }
+    fileServiceFlush (fs);
+
+    success = (success &&
+               count + 21 == fileServiceEntityCountRows (dbpath, "blob") &&
+               fileServiceEntityLoadAndCheck (fs, count + 21));
+
+    // Write-behind with a batch; beginning the batch completes the queued save, then saves within
+    // the batch are not queued but are written, and committed, with the batch
+    SupEntity *queued  = supEntityCreate (count + 21);
+    SupEntity *batched = supEntityCreate (count + 22);
+    success = (success &&
+               fileServiceSave (fs, SUP_ENTITY_TYPE, queued) &&
+               fileServiceBeginBatch (fs) &&
+               count + 22 == fileServiceEntityCountRows (dbpath, "blob") &&
+               fileServiceSave (fs, SUP_ENTITY_TYPE, batched) &&
+               fileServiceSaveMany (fs, SUP_ENTITY_TYPE, (const void **) &batched, 1) &&
+               count + 22 == fileServiceEntityCountRows (dbpath, "blob") &&
+               fileServiceCommitBatch (fs) &&
+               count + 23 == fileServiceEntityCountRows (dbpath, "blob") &&
+               fileServiceEntityLoadAndCheck (fs, count + 23));
+    free (queued);
+    free (batched);
+    fileServiceSetWriteBehind (fs, 0);
+
+    // Range loads, by sort key
+    success = (success &&
+               fileServiceEntityRangeAndCheck (fs, 10, 19) &&
+               fileServiceEntityRangeAndCheck (fs, count, count + 20));
+
+    // Replace only the changes; unchanged entities keep their row, the legacy one is rewritten
+    SupEntity **replacements = calloc (count + 26, sizeof (SupEntity*));
+    for (size_t index = 0; index < count + 26; index++)
+        replacements[index] = supEntityCreate (index);
+
+    int64_t rowId = fileServiceEntityRowId (dbpath, replacements[5]);
+    success = (success &&
+               fileServiceEntityInsertFormat1 (dbpath, replacements[0]) &&
+               fileServiceReplaceChanged (fs, SUP_ENTITY_TYPE, (const void **) replacements, count + 26) &&
+               0          == fileServiceEntityCountRows (dbpath, "text") &&
+               count + 26 == fileServiceEntityCountRows (dbpath, "blob") &&
+               rowId      == fileServiceEntityRowId (dbpath, replacements[5]) &&
+               fileServiceEntityLoadAndCheck (fs, count + 26));
+
+    success = (success &&
+               fileServiceReplaceChanged (fs, SUP_ENTITY_TYPE, (const void **) replacements, count) &&
+               count == fileServiceEntityCountRows (dbpath, "blob") &&
+               rowId == fileServiceEntityRowId (dbpath, replacements[5]) &&
+               fileServiceEntityLoadAndCheck (fs, count));
+
+    // A full replace rewrites every entity
+    success = (success &&
+               fileServiceReplace (fs, SUP_ENTITY_TYPE, (const void **) replacements, count) &&
+               count == fileServiceEntityCountRows (dbpath, "blob") &&
+               fileServiceEntityLoadAndCheck (fs, count));
+
+    for (size_t index = 0; index < count + 26; index++)
+        free (replacements[index]);
+    free (replacements);
+
+    // Stats; the stored entities, and a count and latency for every operation
+    success = (success && fileServiceEntityStatsCheck (fs, count));
+
+    fileServiceRelease (fs);
+
+    // An Entity table created before the SortKey column exists gets the column
+    _rmdir (path);
+    if (0 != mkdir (path, 0700)) return 0;
+
+    legacy1 = supEntityCreate (0);
+    legacy2 = supEntityCreate (1);
+    success = (success &&
+               fileServiceEntityCreateTableWithoutSortKey (dbpath) &&
+               fileServiceEntityInsertFormat1 (dbpath, legacy1) &&
+               fileServiceEntityInsertFormat1 (dbpath, legacy2));
+    free (legacy1);
+    free (legacy2);
+
+    fs = (success ? fileServiceEntitySetup (path, currency, network, FILE_SERVICE_BACKEND_SQLITE) : NULL);
+    success = (NULL != fs &&
+               2 == fileServiceEntityCountUnkeyedRows (dbpath) &&
+               fileServiceEntityLoadAndCheck (fs, 2) &&
+               0 == fileServiceEntityCountUnkeyedRows (dbpath) &&
+               fileServiceEntityRangeAndCheck (fs, 1, 1));
+
+    if (NULL != fs) fileServiceRelease (fs);
+    return fileServiceTestDone (path, success);
+}
+
+/// Load all SupEntity from a newly created file service; the log backend replays its segments.
+static int
+fileServiceEntityReopenAndCheck (BRFileService *fs, const char *path, size_t count) {
+    if (NULL != *fs) fileServiceRelease (*fs);
+
+    *fs = fileServiceEntitySetup (path, "btc", "mainnet", FILE_SERVICE_BACKEND_LOG);
+    return NULL != *fs && fileServiceEntityLoadAndCheck (*fs, count);
+}
+
+static int
+fileServiceEntitySaveRange (BRFileService fs, uint64_t lower, uint64_t upper) {
+    size_t count = (size_t) (upper - lower);
+
+    SupEntity **entities = calloc (count, sizeof (SupEntity*));
+    for (size_t index = 0; index < count; index++)
+        entities[index] = supEntityCreate (lower + index);
+
+    int success = fileServiceSaveMany (fs, SUP_ENTITY_TYPE, (const void **) entities, count);
+
+    for (size_t index = 0; index < count; index++)
+        free (entities[index]);
+    free (entities);
+
+    return success;
+}
+
+/// Append copies of the newest non-empty segment to the log until it holds at least `minSize`
+/// bytes, with at least two copies; replay then finds all but the last copy to be garbage.
+/// Return the number of the copied segment, or 0 on an error.
+static uint32_t
+fileServiceLogSegmentDuplicate (const char *logpath, size_t minSize) {
+    struct stat segStat;
+    char segpath[1024];
+
+    uint32_t copied = 0, newest = 0;
+    size_t   size   = 0;
+    for (uint32_t number = 1; ; number++) {
+        sprintf (segpath, "%s/%08u.seg", logpath, number);
+        if (0 != stat (segpath, &segStat)) {
+            if (0 != newest) break;
+            if (number > 1000) return 0;
+            continue;
+        }
+        newest = number;
+        if (0 != segStat.st_size) { copied = number; size = (size_t) segStat.st_size; }
+    }
+    if (0 == copied) return 0;
+
+    uint8_t *bytes = malloc (size);
+    sprintf (segpath, "%s/%08u.seg", logpath, copied);
+    FILE *segment = fopen (segpath, "rb");
+    int success = (NULL != segment && size == fread (bytes, 1, size, segment));
+    if (NULL != segment) fclose (segment);
+
+    size_t copies = minSize / size + 1;
+    if (copies < 2) copies = 2;
+
+    for (uint32_t number = newest + 1; success && number <= newest + copies; number++) {
+        sprintf (segpath, "%s/%08u.seg", logpath, number);
+        segment = fopen (segpath, "wb");
+        success = (NULL != segment && size == fwrite (bytes, 1, size, segment));
+        if (NULL != segment) fclose (segment);
+    }
+
+    free (bytes);
+    return success ? copied : 0;
+}
+
+static int runSupFileServiceLogTests (void) {
+    printf ("==== SUP:FileServiceLog\n");
+
+    struct stat dirStat;
+
+    BRFileService fs;
+    char *path = "private";
+    char *currency = "btc", *network = "mainnet";
+    size_t count = 100;
+
+    char segpath[1024];
+    sprintf (segpath, "%s/%s-%s-entities.log/%08u.seg", path,  currency, network, 1);
+
+    if (0 == stat  (path, &dirStat)) _rmdir (path);
+    if (0 != mkdir (path, 0700)) return 0;
+
+    fs = fileServiceEntitySetup (path, currency, network, FILE_SERVICE_BACKEND_LOG);
+    if (NULL == fs) return fileServiceTestDone (path, 0);
+
+    // Save, save many and save within a batch; then load, iterate and load ranges
+    int success = 1;
+    for (uint64_t value = 0; success && value < count; value++) {
+        SupEntity *entity = supEntityCreate (value);
+        success = fileServiceSave (fs, SUP_ENTITY_TYPE, entity);
+        free (entity);
+    }
+
+    success = (success &&
+               fileServiceEntitySaveRange (fs, count, count + 5) &&
+               fileServiceBeginBatch (fs) &&
+               fileServiceEntitySaveRange (fs, count + 5, count + 10) &&
+               fileServiceCommitBatch (fs));
+
+    success = (success &&
+               fileServiceEntityLoadAndCheck (fs, count + 10) &&
+               fileServiceEntityIterateAndCheck (fs, count + 10) &&
+               fileServiceEntityRangeAndCheck (fs, 10, 19) &&
+               fileServiceEntityRangeAndCheck (fs, count, count + 9));
+
+    // Overwrite and remove, then replace only the changes
+    SupEntity *removed = supEntityCreate (count + 9);
+    success = (success &&
+               fileServiceEntitySaveRange (fs, 0, 10) &&
+               fileServiceRemove (fs, SUP_ENTITY_TYPE, removed) &&
+               fileServiceEntityLoadAndCheck (fs, count + 9));
+    free (removed);
+
+    SupEntity **replacements = calloc (count, sizeof (SupEntity*));
+    for (size_t index = 0; index < count; index++)
+        replacements[index] = supEntityCreate (index);
+
+    success = (success &&
+               fileServiceReplaceChanged (fs, SUP_ENTITY_TYPE, (const void **) replacements, count) &&
+               fileServiceEntityLoadAndCheck (fs, count));
+
+    for (size_t index = 0; index < count; index++)
+        free (replacements[index]);
+    free (replacements);
+
+    // Reopen; replaying the log restores the entities
+    success = (success && fileServiceEntityReopenAndCheck (&fs, path, count));
+
+    // A partially written record is discarded on replay, and then overwritten
+    FILE *segment = (success ? fopen (segpath, "ab") : NULL);
+    if (NULL != segment) {
+        fileServiceRelease (fs);
+        fs = NULL;
+
+        uint8_t garbage[20] = { 0x01, 0x02, 0x03 };
+        success = (sizeof (garbage) == fwrite (garbage, 1, sizeof (garbage), segment));
+        fclose (segment);
+    }
+    else success = 0;
+
+    success = (success &&
+               fileServiceEntityReopenAndCheck (&fs, path, count) &&
+               fileServiceEntitySaveRange (fs, count, count + 1) &&
+               fileServiceEntityReopenAndCheck (&fs, path, count + 1));
+
+    // Overwrite until most of the log is garbage; compaction deletes the oldest segment
+    for (size_t round = 0; success && round < 20; round++)
+        success = fileServiceEntitySaveRange (fs, 0, 1000);
+
+    for (size_t wait = 0; success && 0 == stat (segpath, &dirStat) && wait < 50; wait++)
+        usleep (100 * 1000);
+
+    success = (success &&
+               0 != stat (segpath, &dirStat) &&
+               fileServiceEntityLoadAndCheck (fs, 1000) &&
+               fileServiceEntityReopenAndCheck (&fs, path, 1000));
+
+    // A log that needs compaction when opened is compacted after replay, without a commit
+    char logpath[1024];
+    sprintf (logpath, "%s/%s-%s-entities.log", path,  currency, network);
+
+    uint32_t copied = 0;
+    if (success) {
+        fileServiceRelease (fs);
+        fs = NULL;
+
+        copied = fileServiceLogSegmentDuplicate (logpath, 1024 * 1024);
+        sprintf (segpath, "%s/%08u.seg", logpath, copied);
+    }
+
+    success = (success && 0 != copied && fileServiceEntityReopenAndCheck (&fs, path, 1000));
+
+    for (size_t wait = 0; success && 0 == stat (segpath, &dirStat) && wait < 50; wait++)
+        usleep (100 * 1000);
+
+    success = (success &&
+               0 != stat (segpath, &dirStat) &&
+               fileServiceEntityLoadAndCheck (fs, 1000) &&
+               fileServiceEntityReopenAndCheck (&fs, path, 1000));
+
+    // Decode on load threads; entities are passed in order
+    if (NULL != fs) fileServiceSetLoadThreads (fs, 4);
+    success = (success &&
+               fileServiceEntityLoadAndCheck (fs, 1000) &&
+               fileServiceEntityIterateAndCheck (fs, 1000) &&
+               fileServiceEntityRangeAndCheck (fs, 100, 899));
+
+    // Clear, then wipe
+    success = (success &&
+               fileServiceClear (fs, SUP_ENTITY_TYPE) &&
+               fileServiceEntityReopenAndCheck (&fs, path, 0));
+
+    if (NULL != fs) fileServiceRelease (fs);
+
+    fileServiceWipe (path, currency, network);
+    success = (success && 0 != stat (logpath, &dirStat));
+
+    return fileServiceTestDone (path, success);
+}
+
+#define SUP_STORE_NETWORKS_COUNT        (4)
+
+static const char *supStoreNetworks[SUP_STORE_NETWORKS_COUNT] = {
+    "mainnet", "testnet", "ropsten", "rinkeby"
+};
+
+typedef struct {
+    BRFileService fs;
+    size_t count;
+    int success;
+} SupStoreSaver;
+
+/// Save `count` SupEntity, each as a unit of its own, concurrently with the other savers.
+static void *
+supStoreSaverThread (SupStoreSaver *saver) {
+    saver->success = 1;
+    for (uint64_t value = 0; saver->success && value < saver->count; value++) {
+        SupEntity *entity = supEntityCreate (value);
+        saver->success = fileServiceSave (saver->fs, SUP_ENTITY_TYPE, entity);
+        free (entity);
+    }
+    return NULL;
+}
+
+static int runSupFileServiceStoreTests (void) {
+    printf ("==== SUP:FileServiceStore\n");
+
+    struct stat dirStat;
+
+    BRFileServiceStore store;
+    BRFileService btc, eth;
+    char *path = "private";
+    size_t count = 100;
+
+    if (0 == stat  (path, &dirStat)) _rmdir (path);
+    if (0 != mkdir (path, 0700)) return 0;
+
+    store = fileServiceStoreCreate (path);
+    if (NULL == store) return fileServiceTestDone (path, 0);
+
+    btc = fileServiceEntitySetupInStore (store, path, "btc", "mainnet");
+    eth = fileServiceEntitySetupInStore (store, path, "eth", "mainnet");
+    int success = (NULL != btc && NULL != eth);
+
+    // Each namespace holds only its own entities, in the one shared DB
+    success = (success &&
+               fileServiceEntitySaveRange (btc, 0, count) &&
+               fileServiceBeginBatch (eth) &&
+               fileServiceEntitySaveRange (eth, 0, 5) &&
+               fileServiceEntitySaveRange (eth, 5, 10) &&
+               fileServiceCommitBatch (eth) &&
+               fileServiceEntityLoadAndCheck (btc, count) &&
+               fileServiceEntityLoadAndCheck (eth, 10) &&
+               fileServiceEntityIterateAndCheck (btc, count) &&
+               fileServiceEntityRangeAndCheck (btc, 10, 19));
+
+    char sdbpath[1024];
+    sprintf (sdbpath, "%s/entities.db", path);
+    success = (success && 0 == stat (sdbpath, &dirStat));
+
+    sprintf (sdbpath, "%s/btc-mainnet-entities.db", path);
+    success = (success && 0 != stat (sdbpath, &dirStat));
+
+    // A clear, a remove and a purge apply to one namespace
+    SupEntity *removed = supEntityCreate (count - 1);
+    success = (success &&
+               fileServiceRemove (btc, SUP_ENTITY_TYPE, removed) &&
+               fileServicePurge (btc) &&
+               fileServiceClear (eth, SUP_ENTITY_TYPE) &&
+               fileServiceEntityLoadAndCheck (btc, count - 1) &&
+               fileServiceEntityLoadAndCheck (eth, 0) &&
+               fileServiceEntitySaveRange (eth, 0, 10) &&
+               fileServiceEntityStatsCheck (eth, 10));
+    free (removed);
+
+    // Many file services save concurrently; the writer groups their saves into shared commits
+    BRFileService savers[SUP_STORE_NETWORKS_COUNT] = { NULL };
+    SupStoreSaver saverStates[SUP_STORE_NETWORKS_COUNT];
+    pthread_t saverThreads[SUP_STORE_NETWORKS_COUNT];
+
+    for (size_t index = 0; success && index < SUP_STORE_NETWORKS_COUNT; index++) {
+        savers[index] = fileServiceEntitySetupInStore (store, path, "xrp", supStoreNetworks[index]);
+        saverStates[index] = (SupStoreSaver) { savers[index], count, 0 };
+        success = (NULL != savers[index] &&
+                   0 == pthread_create (&saverThreads[index], NULL, (void* (*) (void*)) supStoreSaverThread, &saverStates[index]));
+        if (!success) savers[index] = NULL;
+    }
+
+    for (size_t index = 0; index < SUP_STORE_NETWORKS_COUNT; index++)
+        if (NULL != savers[index]) {
+            pthread_join (saverThreads[index], NULL);
+            success = (success &&
+                       saverStates[index].success &&
+                       fileServiceEntityLoadAndCheck (savers[index], count));
+            fileServiceRelease (savers[index]);
+        }
+
+    // Reopen the store; the entities of each namespace remain
+    if (NULL != btc) fileServiceRelease (btc);
+    if (NULL != eth) fileServiceRelease (eth);
+    fileServiceStoreRelease (store);
+
+    store = fileServiceStoreCreate (path);
+    btc = (NULL == store ? NULL : fileServiceEntitySetupInStore (store, path, "btc", "mainnet"));
+    eth = (NULL == store ? NULL : fileServiceEntitySetupInStore (store, path, "eth", "mainnet"));
+    success = (success &&
+               NULL != btc && NULL != eth &&
+               fileServiceEntityLoadAndCheck (btc, count - 1) &&
+               fileServiceEntityLoadAndCheck (eth, 10));
+
+    // Wipe removes one namespace from the store
+    fileServiceStoreFlush (store);
+    fileServiceWipe (path, "eth", "mainnet");
+    success = (success &&
+               fileServiceEntityLoadAndCheck (eth, 0) &&
+               fileServiceEntityLoadAndCheck (btc, count - 1));
+
+    if (NULL != btc) fileServiceRelease (btc);
+    if (NULL != eth) fileServiceRelease (eth);
+    if (NULL != store) fileServiceStoreRelease (store);
+
+    return fileServiceTestDone (path, success);
+}
+
+/// MARK: - File Service Compression Tests
+
+#define SUP_BUNDLE_TYPE             "bundle"
+
+/// A SupEntity serialized as a transfer bundle might be: mostly the same strings, with a few
+/// hashes and numbers that differ.
+static uint8_t *
+supBundleWriter (BRFileServiceContext context,
+                 BRFileService fs,
+                 const void* entity,
+                 uint32_t *bytesCount) {
+    const SupEntity *supEntity = entity;
+
+    UInt256 txid;
+    BRSHA256 (txid.u8, &supEntity->value, sizeof (supEntity->value));
+
+    char *bytes = malloc (1024);
+    *bytesCount = (uint32_t) sprintf (bytes,
+                                      "{\"hash\":\"%s\",\"txid\":\"0x%s\","
+                                      "\"from\":\"0x8d12a197cb00d4747a1fe03395095ce2a5cc6819\","
+                                      "\"to\":\"0xdac17f958d2ee523a2206206994597c13d831ec7\","
+                                      "\"amount\":\"%" PRIu64 "\",\"fee\":\"21000\","
+                                      "\"currency\":\"ethereum-mainnet:__native__\",\"status\":\"included\","
+                                      "\"blockNumber\":%" PRIu64 ",\"confirmations\":\"6\",\"attributes\":[]}",
+                                      u256hex (supEntity->identifier),
+                                      u256hex (txid),
+                                      supEntity->value,
+                                      11000000 + supEntity->value / 4);
+    return (uint8_t *) bytes;
+}
+
+static void *
+supBundleReader (BRFileServiceContext context,
+                 BRFileService fs,
+                 uint8_t *bytes,
+                 uint32_t bytesCount) {
+    char text[bytesCount + 1];
+    memcpy (text, bytes, bytesCount);
+    text[bytesCount] = '\0';
+
+    const char *amount = strstr (text, "\"amount\":\"");
+    if (0 != strncmp (text, "{\"hash\":\"", 9) || bytesCount < 9 + 64 || NULL == amount) return NULL;
+
+    SupEntity *entity = calloc (1, sizeof (SupEntity));
+    entity->identifier = uint256 (&text[9]);
+    entity->value = strtoull (&amount[10], NULL, 10);
+    return entity;
+}
+
+static BRFileService
+fileServiceBundleSetup (const char *path, BRFileServiceBackendType backendType, int compressed) {
+    BRFileService fs = fileServiceCreateWithBackend (path, "eth", "mainnet", backendType,
+                                                     NULL, fileServiceErrorHandler);
+    if (NULL == fs) return fileServiceSetupError (path, fs);
+
+    if (1 != fileServiceDefineType (fs, SUP_BUNDLE_TYPE, 0, NULL,
+                                    supEntityIdentifier,
+                                    supBundleReader,
+                                    supBundleWriter) ||
+        1 != fileServiceDefineCurrentVersion (fs, SUP_BUNDLE_TYPE, 0) ||
+        (compressed && 1 != fileServiceDefineCompression (fs, SUP_BUNDLE_TYPE)))
+        return fileServiceSetupError (path, fs);
+
+    return fs;
+}
+
+static int
+fileServiceBundleSaveRange (BRFileService fs, uint64_t lower, uint64_t upper) {
+    int success = 1;
+    for (uint64_t value = lower; success && value < upper; value++) {
+        SupEntity *entity = supEntityCreate (value);
+        success = fileServiceSave (fs, SUP_BUNDLE_TYPE, entity);
+        free (entity);
+    }
+    return success;
+}
+
+static int
+fileServiceBundleLoadAndCheck (BRFileService fs, size_t count) {
+    BRSetOf(SupEntity*) entities = BRSetNew (supEntityHash, supEntityEq, count);
+    int success = (1 == fileServiceLoad (fs, entities, SUP_BUNDLE_TYPE, 1) &&
+                   count == BRSetCount (entities));
+
+    for (uint64_t value = 0; success && value < count; value++) {
+        SupEntity *entity  = supEntityCreate (value);
+        SupEntity *loaded  = BRSetGet (entities, entity);
+        success = (NULL != loaded && value == loaded->value);
+        free (entity);
+    }
+
+    BRSetFreeAll (entities, free);
+    return success;
+}
+
+static uint64_t
+fileServiceBundleStoredBytes (BRFileService fs) {
+    BRFileServiceTypeStats stats;
+    return (1 == fileServiceGetStats (fs, &stats, 1) ? stats.bytesCount : 0);
+}
+
+static int
+runSupCompressCheck (const uint8_t *src, size_t srcCount, BRCompressDictionary dictionary, size_t *compressedCount) {
+    uint8_t *compressed   = malloc (BRCompressBound (srcCount));
+    uint8_t *decompressed = malloc (srcCount + 1);
+
+    *compressedCount = BRCompress (compressed, BRCompressBound (srcCount), src, srcCount, dictionary);
+    int success = (0 != *compressedCount &&
+                   srcCount == BRDecompress (decompressed, srcCount, compressed, *compressedCount, dictionary) &&
+                   0 == memcmp (src, decompressed, srcCount) &&
+                   // Truncated or mis-sized bytes fail
+                   0 == BRDecompress (decompressed, srcCount, compressed, *compressedCount - 1, dictionary) &&
+                   0 == BRDecompress (decompressed, srcCount - 1, compressed, *compressedCount, dictionary));
+
+    free (decompressed);
+    free (compressed);
+    return success;
+}
+
+static int runSupCompressTests (void) {
+    printf ("==== SUP:Compress\n");
+
+    size_t compressedCount, count = 200;
+    int success = 1;
+
+    // Repetitive bytes compress well
+    uint8_t repetitive[4096];
+    for (size_t index = 0; index < sizeof (repetitive); index++)
+        repetitive[index] = "0123456789abcdefghijklmnopqrstuvwxyz"[index % 37 % 36];
+    success &= runSupCompressCheck (repetitive, sizeof (repetitive), NULL, &compressedCount);
+    success &= (compressedCount < sizeof (repetitive) / 16);
+
+    // Random bytes don't, but still round trip within the bound
+    uint8_t random[1000];
+    uint32_t seed = 1;
+    for (size_t index = 0; index < sizeof (random); index++) {
+        seed = seed * 1103515245 + 12345;
+        random[index] = (uint8_t) (seed >> 24);
+    }
+    success &= runSupCompressCheck (random, sizeof (random), NULL, &compressedCount);
+
+    // A dictionary trained on bundles compresses another bundle better than no dictionary
+    const uint8_t *samples[count];
+    size_t samplesCounts[count];
+    for (size_t index = 0; index < count; index++) {
+        SupEntity *entity = supEntityCreate (index);
+        uint32_t bytesCount;
+        samples[index] = supBundleWriter (NULL, NULL, entity, &bytesCount);
+        samplesCounts[index] = bytesCount;
+        free (entity);
+    }
+
+    uint8_t dictionaryBytes[8 * 1024];
+    size_t dictionaryBytesCount = BRCompressTrain (dictionaryBytes, sizeof (dictionaryBytes), samples, samplesCounts, count);
+    BRCompressDictionary dictionary = BRCompressDictionaryNew (dictionaryBytes, dictionaryBytesCount);
+    success &= (0 != dictionaryBytesCount && dictionaryBytesCount <= sizeof (dictionaryBytes));
+
+    SupEntity *entity = supEntityCreate (count + 1);
+    uint32_t bundleCount;
+    uint8_t *bundle = supBundleWriter (NULL, NULL, entity, &bundleCount);
+    size_t compressedWithDictionaryCount;
+    success &= runSupCompressCheck (bundle, bundleCount, NULL, &compressedCount);
+    success &= runSupCompressCheck (bundle, bundleCount, dictionary, &compressedWithDictionaryCount);
+    success &= (compressedWithDictionaryCount < compressedCount && compressedCount < bundleCount);
+
+    // Nothing recurs across unrelated samples
+    const uint8_t *randomSamples[] = { random, repetitive };
+    size_t randomSamplesCounts[] = { sizeof (random), 64 };
+    success &= (0 == BRCompressTrain (dictionaryBytes, sizeof (dictionaryBytes), randomSamples, randomSamplesCounts, 2));
+
+    free (bundle);
+    free (entity);
+    BRCompressDictionaryFree (dictionary);
+    for (size_t index = 0; index < count; index++)
+        free ((void *) samples[index]);
+
+    return success;
+}
+
+static int runSupFileServiceCompressionTests (void) {
+    printf ("==== SUP:FileServiceCompression\n");
+
+    struct stat dirStat;
+    BRFileServiceBackendType backendTypes[] = { FILE_SERVICE_BACKEND_SQLITE, FILE_SERVICE_BACKEND_LOG };
+    size_t count = 100;
+    int success = 1;
+
+    for (size_t index = 0; success && index < sizeof (backendTypes) / sizeof (backendTypes[0]); index++) {
+        char *path = "private";
+
+        if (0 == stat  (path, &dirStat)) _rmdir (path);
+        if (0 != mkdir (path, 0700)) return 0;
+
+        // Uncompressed, for the stored bytes
+        BRFileService fs = fileServiceBundleSetup (path, backendTypes[index], 0);
+        success = (NULL != fs && fileServiceBundleSaveRange (fs, 0, count));
+        uint64_t uncompressedBytes = (success ? fileServiceBundleStoredBytes (fs) : 0);
+
+        // Compressed, without a dictionary, then with one; the existing entities are recompressed
+        if (NULL != fs) fileServiceRelease (fs);
+        fs = fileServiceBundleSetup (path, backendTypes[index], 1);
+        success = (success &&
+                   NULL != fs &&
+                   !fileServiceHasCompressionDictionary (fs, SUP_BUNDLE_TYPE) &&
+                   fileServiceBundleSaveRange (fs, 0, count / 2));
+        uint64_t compressedBytes = (success ? fileServiceBundleStoredBytes (fs) : 0);
+
+        success = (success &&
+                   compressedBytes < uncompressedBytes &&
+                   1 == fileServiceTrainCompression (fs, SUP_BUNDLE_TYPE) &&
+                   fileServiceHasCompressionDictionary (fs, SUP_BUNDLE_TYPE) &&
+                   fileServiceBundleStoredBytes (fs) < compressedBytes &&
+                   fileServiceBundleSaveRange (fs, count, 2 * count) &&
+                   fileServiceBundleLoadAndCheck (fs, 2 * count));
+
+        // Reopen; the dictionary is loaded, and kept by a purge
+        if (NULL != fs) fileServiceRelease (fs);
+        fs = fileServiceBundleSetup (path, backendTypes[index], 1);
+        success = (success &&
+                   NULL != fs &&
+                   fileServiceHasCompressionDictionary (fs, SUP_BUNDLE_TYPE) &&
+                   fileServiceBundleLoadAndCheck (fs, 2 * count) &&
+                   fileServicePurge (fs));
+
+        if (NULL != fs) fileServiceRelease (fs);
+        fs = fileServiceBundleSetup (path, backendTypes[index], 1);
+        success = (success &&
+                   NULL != fs &&
+                   fileServiceBundleLoadAndCheck (fs, 2 * count));
+
+        // Too few entities to train
+        success = (success &&
+                   fileServiceClear (fs, SUP_BUNDLE_TYPE) &&
+                   fileServiceBundleSaveRange (fs, 0, 2) &&
+                   0 == fileServiceTrainCompression (fs, SUP_BUNDLE_TYPE));
+
+        if (NULL != fs) fileServiceRelease (fs);
+        success = fileServiceTestDone (path, success);
+    }
+
+    return success;
+}
+
+/// MARK: - File Service Perf
+
+static double
+fileServicePerfElapsed (struct timeval start) {
+    struct timeval end;
+    gettimeofday (&end, NULL);
+    return (1000.0 * (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000.0);
+}
+
+static void
+runSupPerfFileServiceDurability (const char *label,
+                                 BRFileServiceBackendType backendType,
+                                 BRFileServiceDurability durability,
+                                 size_t count) {
+    struct stat dirStat;
+    struct timeval start;
+    char *path = "private-perf";
+
+    if (0 == stat  (path, &dirStat)) _rmdir (path);
+    if (0 != mkdir (path, 0700)) return;
+
+    BRFileService fs = fileServiceEntitySetup (path, "btc", "mainnet", backendType);
+    if (NULL == fs || !fileServiceSetDurability (fs, durability)) {
+        if (NULL != fs) fileServiceRelease (fs);
+        fileServiceTestDone (path, 0);
+        return;
+    }
+
+    SupEntity **entities = calloc (count, sizeof (SupEntity*));
+    for (size_t index = 0; index < count; index++)
+        entities[index] = supEntityCreate (index);
+
+    // One commit per save
+    gettimeofday (&start, NULL);
+    for (size_t index = 0; index < count; index++)
+        fileServiceSave (fs, SUP_ENTITY_TYPE, entities[index]);
+    double msSave = fileServicePerfElapsed (start);
+
+    // One commit for all saves
+    gettimeofday (&start, NULL);
+    fileServiceSaveMany (fs, SUP_ENTITY_TYPE, (const void **) entities, count);
+    double msSaveMany = fileServicePerfElapsed (start);
+
+    gettimeofday (&start, NULL);
+    fileServiceEntityLoadAndCheck (fs, count);
+    double msLoad = fileServicePerfElapsed (start);
+
+    printf ("SUP: Perf: FileService: %-8s: Save: %8.3f ms/commit, SaveMany: %8.3f ms (%zu), Load: %8.3f ms\n",
+            label, msSave / count, msSaveMany, count, msLoad);
+
+    for (size_t index = 0; index < count; index++)
+        free (entities[index]);
+    free (entities);
+
+    fileServiceRelease (fs);
+    fileServiceTestDone (path, 1);
+}
+
+///
+/// Replace a sliding window of `count` entities, advanced by one entity per replace - as a sync
+/// replaces its recent blocks - with a full rewrite and then with only the changes.
+///
+static void
+runSupPerfFileServiceReplace (BRFileServiceBackendType backendType, size_t count, size_t replaces) {
+    struct stat dirStat;
+    struct timeval start;
+    char *path = "private-perf";
+
+    if (0 == stat  (path, &dirStat)) _rmdir (path);
+    if (0 != mkdir (path, 0700)) return;
+
+    BRFileService fs = fileServiceEntitySetup (path, "btc", "mainnet", backendType);
+    if (NULL == fs) { fileServiceTestDone (path, 0); return; }
+
+    SupEntity **entities = calloc (count + 2 * replaces, sizeof (SupEntity*));
+    for (size_t index = 0; index < count + 2 * replaces; index++)
+        entities[index] = supEntityCreate (index);
+
+    fileServiceSaveMany (fs, SUP_ENTITY_TYPE, (const void **) entities, count);
+
+    gettimeofday (&start, NULL);
+    for (size_t index = 1; index <= replaces; index++)
+        fileServiceReplace (fs, SUP_ENTITY_TYPE, (const void **) &entities[index], count);
+    double msReplace = fileServicePerfElapsed (start);
+
+    gettimeofday (&start, NULL);
+    for (size_t index = replaces + 1; index <= 2 * replaces; index++)
+        fileServiceReplaceChanged (fs, SUP_ENTITY_TYPE, (const void **) &entities[index], count);
+    double msReplaceChanged = fileServicePerfElapsed (start);
+
+    printf ("SUP: Perf: FileService: %-6s: Replace (%zu): Full: %8.3f ms/replace, Changed: %8.3f ms/replace\n",
+            (FILE_SERVICE_BACKEND_LOG == backendType ? "Log" : "SQLite"), count, msReplace / replaces, msReplaceChanged / replaces);
+
+    for (size_t index = 0; index < count + 2 * replaces; index++)
+        free (entities[index]);
+    free (entities);
+
+    fileServiceRelease (fs);
+    fileServiceTestDone (path, 1);
+}
+
+static size_t fileServicePerfDiskBytes;
+
+static int
+fileServicePerfAddDiskBytes (const char *fpath, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
+    if (FTW_F == typeflag) fileServicePerfDiskBytes += (size_t) sb->st_size;
+    return 0;
+}
+
+/// The bytes of the files in `path`
+static size_t
+fileServicePerfDiskSize (const char *path) {
+    fileServicePerfDiskBytes = 0;
+    nftw (path, fileServicePerfAddDiskBytes, 64, FTW_PHYS);
+    return fileServicePerfDiskBytes;
+}
+
+/// The bytes written, to storage, by this process.
+static size_t
+fileServicePerfWrittenBytes (void) {
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    return 512 * (size_t) usage.ru_oublock;
+}
+
+///
+/// Compare storage engines: save `count` entities, overwrite each of them `rounds` times, and
+/// then reopen.  Reports the bytes written relative to the entity bytes saved (write
+/// amplification), the bytes stored relative to the entity bytes (space amplification) and the
+/// time to open then load every entity (startup).
+///
+static void
+runSupPerfFileServiceBackend (const char *label,
+                              BRFileServiceBackendType backendType,
+                              size_t count,
+                              size_t rounds) {
+    struct stat dirStat;
+    struct timeval start;
+    char *path = "private-perf";
+
+    if (0 == stat  (path, &dirStat)) _rmdir (path);
+    if (0 != mkdir (path, 0700)) return;
+
+    BRFileService fs = fileServiceEntitySetup (path, "btc", "mainnet", backendType);
+    if (NULL == fs) { fileServiceTestDone (path, 0); return; }
+
+    SupEntity **entities = calloc (count, sizeof (SupEntity*));
+    for (size_t index = 0; index < count; index++)
+        entities[index] = supEntityCreate (index);
+
+    size_t writtenBytes = fileServicePerfWrittenBytes ();
+
+    gettimeofday (&start, NULL);
+    for (size_t round = 0; round <= rounds; round++)
+        fileServiceSaveMany (fs, SUP_ENTITY_TYPE, (const void **) entities, count);
+    double msSave = fileServicePerfElapsed (start);
+
+    fileServiceRelease (fs);
+
+    writtenBytes = fileServicePerfWrittenBytes () - writtenBytes;
+    size_t diskBytes = fileServicePerfDiskSize (path);
+
+    // The entity bytes saved and the entity bytes stored
+    double savedBytes = (double) ((rounds + 1) * count * SUP_ENTITY_BYTES_COUNT);
+    double liveBytes  = (double) (count * SUP_ENTITY_BYTES_COUNT);
+
+    gettimeofday (&start, NULL);
+    fs = fileServiceEntitySetup (path, "btc", "mainnet", backendType);
+    int success = (NULL != fs && fileServiceEntityLoadAndCheck (fs, count));
+    double msStartup = fileServicePerfElapsed (start);
+
+    printf ("SUP: Perf: FileService: %-6s: Save: %8.3f ms/round, Written: %6.1fx, Disk: %6.1fx (%zu KiB), Startup: %8.3f ms (%zu)\n",
+            label,
+            msSave / (rounds + 1),
+            writtenBytes / savedBytes,
+            diskBytes    / liveBytes,
+            diskBytes / 1024,
+            msStartup, count);
+
+    for (size_t index = 0; index < count; index++)
+        free (entities[index]);
+    free (entities);
+
+    if (NULL != fs) fileServiceRelease (fs);
+    fileServiceTestDone (path, success);
+}
+
+///
+/// Compare the stored bytes and the save and load times of `count` bundles stored uncompressed,
+/// compressed without a dictionary and compressed with a trained dictionary.
+///
+static void
+runSupPerfFileServiceCompression (BRFileServiceBackendType backendType, size_t count) {
+    struct stat dirStat;
+    struct timeval start;
+    char *path = "private-perf";
+    const char *labels[] = { "None", "LZ", "LZ+Dict" };
+    int success = 1;
+
+    SupEntity **entities = calloc (count, sizeof (SupEntity*));
+    for (size_t index = 0; index < count; index++)
+        entities[index] = supEntityCreate (index);
+
+    for (size_t mode = 0; success && mode < 3; mode++) {
+        if (0 == stat  (path, &dirStat)) _rmdir (path);
+        if (0 != mkdir (path, 0700)) break;
+
+        BRFileService fs = fileServiceBundleSetup (path, backendType, mode > 0);
+        if (NULL == fs) { fileServiceTestDone (path, 0); break; }
+
+        // Store the bundles then, with a dictionary, train from them; time a second save of all.
+        double msTrain = 0;
+        fileServiceSaveMany (fs, SUP_BUNDLE_TYPE, (const void **) entities, count);
+        if (2 == mode) {
+            gettimeofday (&start, NULL);
+            success = fileServiceTrainCompression (fs, SUP_BUNDLE_TYPE);
+            msTrain = fileServicePerfElapsed (start);
+        }
+
+        gettimeofday (&start, NULL);
+        fileServiceSaveMany (fs, SUP_BUNDLE_TYPE, (const void **) entities, count);
+        double msSave = fileServicePerfElapsed (start);
+
+        uint64_t storedBytes = fileServiceBundleStoredBytes (fs);
+        fileServiceRelease (fs);
+
+        gettimeofday (&start, NULL);
+        fs = fileServiceBundleSetup (path, backendType, mode > 0);
+        success = (success && NULL != fs && fileServiceBundleLoadAndCheck (fs, count));
+        double msLoad = fileServicePerfElapsed (start);
+
+        printf ("SUP: Perf: FileService: %-6s: Compress: %-7s: Stored: %8" PRIu64 " bytes (%5.1f/bundle), Save: %8.3f ms, Load: %8.3f ms, Train: %8.3f ms\n",
+                (FILE_SERVICE_BACKEND_SQLITE == backendType ? "SQLite" : "Log"),
+                labels[mode],
+                storedBytes,
+                (double) storedBytes / count,
+                msSave,
+                msLoad,
+                msTrain);
+
+        if (NULL != fs) fileServiceRelease (fs);
+        success = fileServiceTestDone (path, success);
+    }
+
+    for (size_t index = 0; index < count; index++)
+        free (entities[index]);
+    free (entities);
+}
+
+///
+/// Load `count` entities decoding on 1, 2 and 4 load threads.
+///
+static void
+runSupPerfFileServiceLoadThreads (BRFileServiceBackendType backendType, size_t count) {
+    struct stat dirStat;
+    struct timeval start;
+    char *path = "private-perf";
+
+    if (0 == stat  (path, &dirStat)) _rmdir (path);
+    if (0 != mkdir (path, 0700)) return;
+
+    BRFileService fs = fileServiceEntitySetup (path, "btc", "mainnet", backendType);
+    if (NULL == fs || !fileServiceEntitySaveRange (fs, 0, count)) {
+        if (NULL != fs) fileServiceRelease (fs);
+        fileServiceTestDone (path, 0);
+        return;
+    }
+
+    int success = 1;
+    double msLoad[3];
+    size_t threadsCount[3] = { 1, 2, 4 };
+
+    for (size_t index = 0; index < 3; index++) {
+        fileServiceSetLoadThreads (fs, threadsCount[index]);
+
+        gettimeofday (&start, NULL);
+        success &= fileServiceEntityLoadAndCheck (fs, count);
+        msLoad[index] = fileServicePerfElapsed (start);
+    }
+
+    printf ("SUP: Perf: FileService: %-6s: Load (%zu): 1 Thread: %8.3f ms, 2 Threads: %8.3f ms, 4 Threads: %8.3f ms\n",
+            (FILE_SERVICE_BACKEND_LOG == backendType ? "Log" : "SQLite"), count,
+            msLoad[0], msLoad[1], msLoad[2]);
+
+    fileServiceRelease (fs);
+    fileServiceTestDone (path, success);
+}
+
+extern void
+runSupPerfTestsFileService (size_t count) {
+    printf ("==== SUP:FileServicePerf\n");
+
+    runSupPerfFileServiceDurability ("Default", FILE_SERVICE_BACKEND_SQLITE, FILE_SERVICE_DURABILITY_DEFAULT, count);
+    runSupPerfFileServiceDurability ("WAL",     FILE_SERVICE_BACKEND_SQLITE, FILE_SERVICE_DURABILITY_WAL,     count);
+    runSupPerfFileServiceDurability ("WAL+Off", FILE_SERVICE_BACKEND_SQLITE, ((BRFileServiceDurability) {
+        true, FILE_SERVICE_SYNCHRONOUS_OFF, 32 * 1024 * 1024, 8 * 1024
+    }), count);
+    runSupPerfFileServiceDurability ("Log",     FILE_SERVICE_BACKEND_LOG,    FILE_SERVICE_DURABILITY_DEFAULT, count);
+
+    runSupPerfFileServiceReplace (FILE_SERVICE_BACKEND_SQLITE, count, 20);
+    runSupPerfFileServiceReplace (FILE_SERVICE_BACKEND_LOG,    count, 20);
+
+    runSupPerfFileServiceBackend ("SQLite", FILE_SERVICE_BACKEND_SQLITE, count, 20);
+    runSupPerfFileServiceBackend ("Log",    FILE_SERVICE_BACKEND_LOG,    count, 20);
+
+    runSupPerfFileServiceLoadThreads (FILE_SERVICE_BACKEND_SQLITE, 10 * count);
+    runSupPerfFileServiceLoadThreads (FILE_SERVICE_BACKEND_LOG,    10 * count);
+
+    runSupPerfFileServiceCompression (FILE_SERVICE_BACKEND_SQLITE, 10 * count);
+    runSupPerfFileServiceCompression (FILE_SERVICE_BACKEND_LOG,    10 * count);
+}
+
 /// MARK: - Assert Tests
 
 #define DEFAULT_WORKERS     (5)
@@ -526,6 +1865,11 @@ int BRRunSupTests (void) {
 
     success &= runSupFileServiceTests();
     success &= runSupFileServiceMultiTests ();
+    success &= runSupFileServiceEntityTests ();
+    success &= runSupFileServiceLogTests ();
+    success &= runSupFileServiceStoreTests ();
+    success &= runSupCompressTests ();
+    success &= runSupFileServiceCompressionTests ();
     success &= runSupAssertTests();
 
     return success;
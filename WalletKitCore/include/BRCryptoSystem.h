@@ -23,12 +23,29 @@ extern "C" {
 
 DECLARE_CRYPTO_GIVE_TAKE (BRCryptoSystem, cryptoSystem);
 
+///
+/// The persistence profile applies to the system's and every wallet manager's file service.
+///
+///  - DURABLE:  Every write is synced to disk before it completes.
+///  - BALANCED: Writes go to a write-ahead log, synced only on checkpoints.  Writes survive an
+///              App crash but, on an OS crash or power loss, the latest might be lost (and then
+///              recovered on the next sync).  Writes have a much lower latency.
+///  - SHARED:   As BALANCED, but the system and every wallet manager share one DB.  A single
+///              writer thread groups the writes of all wallet managers into shared commits.
+///
+typedef enum {
+    CRYPTO_PERSISTENCE_PROFILE_DURABLE,
+    CRYPTO_PERSISTENCE_PROFILE_BALANCED,
+    CRYPTO_PERSISTENCE_PROFILE_SHARED
+} BRCryptoPersistenceProfile;
+
 extern BRCryptoSystem
 cryptoSystemCreate (BRCryptoClient client,
                     BRCryptoListener listener,
                     BRCryptoAccount account,
                     const char *path,
-                    BRCryptoBoolean onMainnet);
+                    BRCryptoBoolean onMainnet,
+                    BRCryptoPersistenceProfile persistenceProfile);
 
 extern BRCryptoBoolean
 cryptoSystemOnMainnet (BRCryptoSystem system);
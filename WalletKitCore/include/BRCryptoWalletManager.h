@@ -108,6 +108,57 @@ extern "C" {
     cryptoWalletManagerHasWallet (BRCryptoWalletManager cwm,
                                   BRCryptoWallet wallet);
 
+    /// The number of buckets in a `BRCryptoStorageLatency` histogram.
+    #define CRYPTO_STORAGE_LATENCY_BUCKETS_COUNT    (7)
+
+    /**
+     * The latency of a storage operation.  The histogram bucket `i` counts the operations that
+     * took less than 10^(i+1) microseconds (10us, 100us, ..., 1s); the last bucket counts the
+     * operations that took longer.
+     */
+    typedef struct {
+        uint64_t count;
+        uint64_t microseconds;
+        uint64_t buckets[CRYPTO_STORAGE_LATENCY_BUCKETS_COUNT];
+    } BRCryptoStorageLatency;
+
+    /**
+     * The storage stats of one type of persisted entity (such as "transactions" or "blocks"),
+     * since the wallet manager was created: the entities stored and their bytes, the entities
+     * saved and loaded, and the latency of saves, loads and removes.
+     */
+    typedef struct {
+        const char *type;   // Valid while the wallet manager exists; NULL for a total
+        size_t   entitiesCount;
+        uint64_t bytesCount;
+        uint64_t entitiesSaved;
+        uint64_t entitiesLoaded;
+        BRCryptoStorageLatency saves;
+        BRCryptoStorageLatency loads;
+        BRCryptoStorageLatency removes;
+    } BRCryptoStorageStats;
+
+    /**
+     * Get the storage stats of each type of entity persisted by the wallet manager.
+     *
+     * The caller is responsible for deallocating the returned array using free().
+     *
+     * @param cwm the wallet manager
+     * @param count the number of stats returned
+     *
+     * @return An array of stats or NULL if the wallet manager persists nothing.
+     */
+    extern BRCryptoStorageStats *
+    cryptoWalletManagerGetStorageStats (BRCryptoWalletManager cwm,
+                                        size_t *count);
+
+    /**
+     * Get the storage stats of the wallet manager, summed over every type of entity.  The
+     * `type` is NULL.
+     */
+    extern BRCryptoStorageStats
+    cryptoWalletManagerGetStorageStatsTotal (BRCryptoWalletManager cwm);
+
     extern void
     cryptoWalletManagerAddWallet (BRCryptoWalletManager cwm,
                                   BRCryptoWallet wallet);
@@ -184,41 +184,67 @@ static size_t _BRTransactionOutputData(const BRTransaction *tx, uint8_t *data, s
     return (! data || off <= dataLen) ? off : 0;
 }
 
+// BIP143 digests of the tx input outpoints, input sequences and outputs, which are the same in the signature pre-image
+// of every input, so that signing n inputs hashes the tx once instead of n times
+typedef struct {
+    UInt256 hashPrevouts;
+    UInt256 hashSequence;
+    UInt256 hashOutputs;
+} BRTxSigHashes;
+
+// computes the SIGHASH_ALL digests shared by all tx inputs, other hash types use either these, a zero digest, or for
+// SIGHASH_SINGLE the digest of the one output at the input index
+static void _BRTransactionSigHashes(const BRTransaction *tx, BRTxSigHashes *hashes)
+{
+    size_t i, outLen = _BRTransactionOutputData(tx, NULL, 0, SIZE_MAX),
+           bufLen = (sizeof(UInt256) + sizeof(uint32_t))*tx->inCount;
+    uint8_t _buf[0x1000], *buf;
+
+    if (outLen > bufLen) bufLen = outLen;
+    buf = (bufLen <= sizeof(_buf)) ? _buf : malloc(bufLen);
+    assert(buf != NULL);
+
+    for (i = 0; i < tx->inCount; i++) {
+        UInt256Set(&buf[(sizeof(UInt256) + sizeof(uint32_t))*i], tx->inputs[i].txHash);
+        UInt32SetLE(&buf[(sizeof(UInt256) + sizeof(uint32_t))*i + sizeof(UInt256)], tx->inputs[i].index);
+    }
+
+    BRSHA256_2(&hashes->hashPrevouts, buf, (sizeof(UInt256) + sizeof(uint32_t))*tx->inCount); // inputs hash
+    for (i = 0; i < tx->inCount; i++) UInt32SetLE(&buf[sizeof(uint32_t)*i], tx->inputs[i].sequence);
+    BRSHA256_2(&hashes->hashSequence, buf, sizeof(uint32_t)*tx->inCount); // sequence hash
+    outLen = _BRTransactionOutputData(tx, buf, bufLen, SIZE_MAX);
+    BRSHA256_2(&hashes->hashOutputs, buf, outLen); // SIGHASH_ALL outputs hash
+    if (buf != _buf) free(buf);
+}
+
 // writes the BIP143 witness program data that needs to be hashed and signed for the tx input at index
+// hashes are the digests from _BRTransactionSigHashes(), or NULL to compute them here
 // https://github.com/bitcoin/bips/blob/master/bip-0143.mediawiki
 // returns number of bytes written, or total len needed if data is NULL
-static size_t _BRTransactionWitnessData(const BRTransaction *tx, uint8_t *data, size_t dataLen, size_t index,
-                                        int hashType)
+static size_t _BRTransactionWitnessData(const BRTransaction *tx, const BRTxSigHashes *hashes, uint8_t *data,
+                                        size_t dataLen, size_t index, int hashType)
 {
     BRTxInput input;
+    BRTxSigHashes _hashes;
     int anyoneCanPay = (hashType & SIGHASH_ANYONECANPAY), sigHash = (hashType & 0x1f);
-    size_t i, off = 0;
+    size_t off = 0;
     uint8_t scriptCode[] = { OP_DUP, OP_HASH160, 20, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
                              0, 0, 0, 0, 0, 0, 0, 0, 0, OP_EQUALVERIFY, OP_CHECKSIG };
 
     if (index >= tx->inCount) return 0;
+    if (data && ! hashes) _BRTransactionSigHashes(tx, &_hashes), hashes = &_hashes;
     if (data && off + sizeof(uint32_t) <= dataLen) UInt32SetLE(&data[off], tx->version); // tx version
     off += sizeof(uint32_t);
     
     if (! anyoneCanPay) {
-        uint8_t buf[(sizeof(UInt256) + sizeof(uint32_t))*tx->inCount];
-        
-        for (i = 0; i < tx->inCount; i++) {
-            UInt256Set(&buf[(sizeof(UInt256) + sizeof(uint32_t))*i], tx->inputs[i].txHash);
-            UInt32SetLE(&buf[(sizeof(UInt256) + sizeof(uint32_t))*i + sizeof(UInt256)], tx->inputs[i].index);
-        }
-        
-        if (data && off + sizeof(UInt256) <= dataLen) BRSHA256_2(&data[off], buf, sizeof(buf)); // inputs hash
+        if (data && off + sizeof(UInt256) <= dataLen) UInt256Set(&data[off], hashes->hashPrevouts); // inputs hash
     }
     else if (data && off + sizeof(UInt256) <= dataLen) UInt256Set(&data[off], UINT256_ZERO); // anyone-can-pay
     
     off += sizeof(UInt256);
     
     if (! anyoneCanPay && sigHash != SIGHASH_SINGLE && sigHash != SIGHASH_NONE) {
-        uint8_t buf[sizeof(uint32_t)*tx->inCount];
-        
-        for (i = 0; i < tx->inCount; i++) UInt32SetLE(&buf[sizeof(uint32_t)*i], tx->inputs[i].sequence);
-        if (data && off + sizeof(UInt256) <= dataLen) BRSHA256_2(&data[off], buf, sizeof(buf)); // sequence hash
+        if (data && off + sizeof(UInt256) <= dataLen) UInt256Set(&data[off], hashes->hashSequence); // sequence hash
     }
     else if (data && off + sizeof(UInt256) <= dataLen) UInt256Set(&data[off], UINT256_ZERO);
     
@@ -236,12 +262,7 @@ static size_t _BRTransactionWitnessData(const BRTransaction *tx, uint8_t *data,
     off += _BRTxInputData(&input, (data ? &data[off] : NULL), (off <= dataLen ? dataLen - off : 0));
     
     if (sigHash != SIGHASH_SINGLE && sigHash != SIGHASH_NONE) {
-        size_t bufLen = _BRTransactionOutputData(tx, NULL, 0, SIZE_MAX);
-        uint8_t _buf[0x1000], *buf = (bufLen <= 0x1000) ? _buf : malloc(bufLen);
-        
-        bufLen = _BRTransactionOutputData(tx, buf, bufLen, SIZE_MAX);
-        if (data && off + sizeof(UInt256) <= dataLen) BRSHA256_2(&data[off], buf, bufLen); // SIGHASH_ALL outputs hash
-        if (buf != _buf) free(buf);
+        if (data && off + sizeof(UInt256) <= dataLen) UInt256Set(&data[off], hashes->hashOutputs); // outputs hash
     }
     else if (sigHash == SIGHASH_SINGLE && index < tx->outCount) {
         uint8_t buf[_BRTransactionOutputData(tx, NULL, 0, index)];
@@ -268,7 +289,7 @@ static size_t _BRTransactionData(const BRTransaction *tx, uint8_t *data, size_t
     int anyoneCanPay = (hashType & SIGHASH_ANYONECANPAY), sigHash = (hashType & 0x1f), witnessFlag = 0;
     size_t i, count, len, woff, off = 0;
     
-    if (hashType & SIGHASH_FORKID) return _BRTransactionWitnessData(tx, data, dataLen, index, hashType);
+    if (hashType & SIGHASH_FORKID) return _BRTransactionWitnessData(tx, NULL, data, dataLen, index, hashType);
     if (anyoneCanPay && index >= tx->inCount) return 0;
     
     for (i = 0; index == SIZE_MAX && ! witnessFlag && i < tx->inCount; i++) {
@@ -636,12 +657,32 @@ int BRTransactionIsSigned(const BRTransaction *tx)
     return (tx) ? 1 : 0;
 }
 
+// returns the hash to sign for the tx input at index, the BIP143 pre-image is used for segwit inputs and forkId hashes
+// hashes are the digests from _BRTransactionSigHashes(), computed once for all the inputs
+static UInt256 _BRTransactionSigHash(const BRTransaction *tx, const BRTxSigHashes *hashes, size_t index, int hashType,
+                                     int isWitness)
+{
+    int bip143 = (isWitness || (hashType & SIGHASH_FORKID));
+    size_t dataLen = (bip143) ? _BRTransactionWitnessData(tx, hashes, NULL, 0, index, hashType) :
+                                _BRTransactionData(tx, NULL, 0, index, hashType);
+    uint8_t _data[0x1000], *data = (dataLen <= sizeof(_data)) ? _data : malloc(dataLen);
+    UInt256 md = UINT256_ZERO;
+
+    assert(data != NULL);
+    dataLen = (bip143) ? _BRTransactionWitnessData(tx, hashes, data, dataLen, index, hashType) :
+                         _BRTransactionData(tx, data, dataLen, index, hashType);
+    BRSHA256_2(&md, data, dataLen);
+    if (data != _data) free(data);
+    return md;
+}
+
 // adds signatures to any inputs with NULL signatures that can be signed with any keys
 // forkId is 0 for bitcoin, 0x40 for b-cash, 0x4f for b-gold
 // returns true if tx is signed
 int BRTransactionSign(BRTransaction *tx, int forkId, BRKey keys[], size_t keysCount)
 {
     UInt160 pkh[keysCount];
+    BRTxSigHashes hashes;
     size_t i, j;
     
     assert(tx != NULL);
@@ -651,6 +692,8 @@ int BRTransactionSign(BRTransaction *tx, int forkId, BRKey keys[], size_t keysCo
         pkh[i] = BRKeyHash160(&keys[i]);
     }
     
+    if (tx) _BRTransactionSigHashes(tx, &hashes); // signing inputs doesn't change the outpoints, sequences or outputs
+
     for (i = 0; tx && i < tx->inCount; i++) {
         BRTxInput *input = &tx->inputs[i];
         const uint8_t *hash = BRScriptPKH(input->script, input->scriptLen);
@@ -668,10 +711,7 @@ int BRTransactionSign(BRTransaction *tx, int forkId, BRKey keys[], size_t keysCo
         UInt256 md = UINT256_ZERO;
         
         if (elemsCount == 2 && *elems[0] == OP_0 && *elems[1] == 20) { // pay-to-witness-pubkey-hash
-            uint8_t data[_BRTransactionWitnessData(tx, NULL, 0, i, forkId | SIGHASH_ALL)];
-            size_t dataLen = _BRTransactionWitnessData(tx, data, sizeof(data), i, forkId | SIGHASH_ALL);
-            
-            BRSHA256_2(&md, data, dataLen);
+            md = _BRTransactionSigHash(tx, &hashes, i, forkId | SIGHASH_ALL, 1);
             sigLen = BRKeySign(&keys[j], sig, sizeof(sig) - 1, md);
             sig[sigLen++] = forkId | SIGHASH_ALL;
             scriptLen = BRScriptPushData(script, sizeof(script), sig, sigLen);
@@ -680,10 +720,7 @@ int BRTransactionSign(BRTransaction *tx, int forkId, BRKey keys[], size_t keysCo
             BRTxInputSetWitness(input, script, scriptLen);
         }
         else if (elemsCount >= 2 && *elems[elemsCount - 2] == OP_EQUALVERIFY) { // pay-to-pubkey-hash
-            uint8_t data[_BRTransactionData(tx, NULL, 0, i, forkId | SIGHASH_ALL)];
-            size_t dataLen = _BRTransactionData(tx, data, sizeof(data), i, forkId | SIGHASH_ALL);
-            
-            BRSHA256_2(&md, data, dataLen);
+            md = _BRTransactionSigHash(tx, &hashes, i, forkId | SIGHASH_ALL, 0);
             sigLen = BRKeySign(&keys[j], sig, sizeof(sig) - 1, md);
             sig[sigLen++] = forkId | SIGHASH_ALL;
             scriptLen = BRScriptPushData(script, sizeof(script), sig, sigLen);
@@ -692,10 +729,7 @@ int BRTransactionSign(BRTransaction *tx, int forkId, BRKey keys[], size_t keysCo
             BRTxInputSetWitness(input, script, 0);
         }
         else { // pay-to-pubkey
-            uint8_t data[_BRTransactionData(tx, NULL, 0, i, forkId | SIGHASH_ALL)];
-            size_t dataLen = _BRTransactionData(tx, data, sizeof(data), i, forkId | SIGHASH_ALL);
-
-            BRSHA256_2(&md, data, dataLen);
+            md = _BRTransactionSigHash(tx, &hashes, i, forkId | SIGHASH_ALL, 0);
             sigLen = BRKeySign(&keys[j], sig, sizeof(sig) - 1, md);
             sig[sigLen++] = forkId | SIGHASH_ALL;
             scriptLen = BRScriptPushData(script, sizeof(script), sig, sigLen);
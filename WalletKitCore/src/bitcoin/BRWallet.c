@@ -26,13 +26,89 @@
 #include "support/BRSet.h"
 #include "support/BRAddress.h"
 #include "support/BRArray.h"
+#include "support/BRCrypto.h"
 #include <stdlib.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <float.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <assert.h>
 
+#define WALLET_CHAINS_VERSION       1
+#define WALLET_SNAPSHOT_VERSION     2
+// version, mpk digest, chain counts, balance, total sent and received, tx count
+#define WALLET_SNAPSHOT_HEADER_SIZE (1 + sizeof(UInt160) + 2*sizeof(uint32_t) + 3*sizeof(uint64_t) + sizeof(uint32_t))
+#define WALLET_SNAPSHOT_TX_SIZE     (sizeof(UInt256) + sizeof(uint32_t) + sizeof(uint64_t)) // txHash, height, balance
+#define WALLET_SNAPSHOT_UTXO_SIZE   (sizeof(UInt256) + sizeof(uint32_t))
+
+#define WALLET_ADDRESS_THREADS      4 // most threads deriving a batch of addresses
+
+#define COIN_SELECTION_MAX_TRIES    100000 // branch-and-bound search steps before giving up on a changeless selection
+#define COIN_SELECTION_PASSES       1000   // random subsets tried by the knapsack search
+#define COIN_SELECTION_MAX_STEPS    1000000 // coins tried by all the knapsack search passes, for large UTXO sets
+
+// an unspent output, indexed by outpoint in wallet->utxos and linked in the order it was added, oldest first
+typedef struct _BRWalletUTXO {
+    BRUTXO o; // must be first, entries are hashed and compared as BRUTXO
+    uint64_t amount;
+    size_t age; // position in the UTXO list as of the last amount sort
+    struct _BRWalletUTXO *prev, *next;
+} BRWalletUTXO;
+
+// the sort key of a wallet transaction, indexed by txHash in wallet->txKeys, wallet->transactions being sorted by
+// block height, then so that transactions come after any same-height transactions they spend, then by when added
+typedef struct {
+    UInt256 txHash; // must be first, keys are hashed and compared as BRTransaction
+    uint32_t blockHeight;
+    uint32_t depth; // one more than the greatest depth of the same-height transactions spent
+    uint64_t order; // the greatest seq of the transaction and the same-height transactions it spends
+    uint64_t seq; // when the transaction was first added to wallet->transactions
+} BRWalletTxKey;
+
+#define TX_STATE_VALID_KNOWN    0x01
+#define TX_STATE_VALID          0x02
+#define TX_STATE_PENDING_KNOWN  0x04
+#define TX_STATE_PENDING        0x08
+#define TX_STATE_VERIFIED_KNOWN 0x10
+#define TX_STATE_VERIFIED       0x20
+
+// the memoized validity, pending and verified status of a transaction in wallet->allTx, indexed by txHash in
+// wallet->txStates along with the entries of the transactions that spend it, entries are also kept for unknown
+// transactions that are spent, so that their spenders are cleared when they're added
+typedef struct _BRWalletTxState {
+    UInt256 txHash; // must be first, entries are hashed and compared as BRTransaction
+    uint8_t flags; // TX_STATE_* flags, cleared along with those of all spenders whenever the status could change
+    struct _BRWalletTxState **spenders;
+} BRWalletTxState;
+
+// an unspent output considered for coin selection, with the size it adds to a transaction as an unsigned input
+typedef struct {
+    BRWalletUTXO *utxo;
+    BRTransaction *tx;
+    size_t size, witSize;
+} BRWalletCoin;
+
+// refcounted items shared by the views published since they were created, each view using as many of the leading items
+// as it has; items are only ever appended after written, so a view's items don't change once it's published
+typedef struct {
+    _Atomic(unsigned int) refCount;
+    size_t capacity, written; // items before written may be in a published view
+} BRWalletViewItems; // followed by capacity items
+
+#define _viewItems(items) ((void *)((BRWalletViewItems *)(items) + 1))
+
+struct BRWalletViewStruct {
+    _Atomic(unsigned int) refCount;
+    uint64_t balance, totalSent, totalReceived;
+    BRAddressParams addrParams;
+    BRWalletViewItems *txItems, *utxoItems, *internalItems, *externalItems;
+    BRTransaction **transactions;
+    BRUTXO *utxos;
+    UInt160 *internalChain, *externalChain;
+    size_t txCount, utxoCount, internalCount, externalCount;
+};
+
 inline static size_t _pkhHash(const void *pkh)
 {
     return (size_t)UInt32GetLE(pkh);
@@ -51,84 +127,288 @@ inline static uint64_t _txFee(uint64_t feePerKb, size_t size)
     return (fee > standardFee) ? fee : standardFee;
 }
 
-// chain position of first tx output address that appears in chain
-inline static size_t _txChainIndex(const BRTransaction *tx, const UInt160 *chain)
+// adds the size of an unsigned input spending an output with the given script, as estimated by BRTransactionVSize(), to
+// size and, for a witness input, witSize
+inline static void _txAddInputSize(size_t *size, size_t *witSize, const uint8_t *script, size_t scriptLen)
 {
-    const uint8_t *pkh;
-    
-    for (size_t i = array_count(chain); i > 0; i--) {
-        for (size_t j = 0; j < tx->outCount; j++) {
-            pkh = BRScriptPKH(tx->outputs[j].script, tx->outputs[j].scriptLen);
-            if (pkh && _pkhEq(pkh, &chain[i - 1])) return i - 1;
-        }
+    if (script && scriptLen > 0 && script[0] == OP_0) { // estimated P2WPKH input size
+        *size += sizeof(UInt256) + sizeof(uint32_t) + BRVarIntSize(0) + sizeof(uint32_t);
+        *witSize += TX_INPUT_SIZE - (sizeof(UInt256) + sizeof(uint32_t) + BRVarIntSize(0) + sizeof(uint32_t));
     }
-    
-    return (size_t) -1;
+    else *size += TX_INPUT_SIZE; // estimated P2PKH input size
+}
+
+// BRTransactionVSize() of an unsigned transaction from the sizes of its inputs and outputs, added up as they're added
+// instead of re-serializing the transaction, where size is the non-witness size of all its inputs and outputs
+inline static size_t _txVSize(size_t size, size_t witSize, size_t inCount, size_t outCount)
+{
+    size += 8 + BRVarIntSize(inCount) + BRVarIntSize(outCount);
+    if (witSize > 0) witSize += 2 + inCount;
+    return (size*4 + witSize + 3)/4;
 }
 
 struct BRWalletStruct {
     uint64_t balance, totalSent, totalReceived, feePerKb, *balanceHist;
+    BRWalletCoinSelection coinSelection;
     uint32_t blockHeight;
-    BRUTXO *utxos;
+    BRSet *utxos; // BRWalletUTXO entries by outpoint
+    BRWalletUTXO *oldestUTXO, *newestUTXO, **utxosByAmount; // utxosByAmount is sorted on demand, empty when stale
+    BRUTXO *pendingSpent;
     BRTransaction **transactions;
+    BRSet *txKeys; // BRWalletTxKey entries for wallet->transactions
+    BRSet *txStates; // BRWalletTxState entries for wallet->allTx and the transactions they spend
+    uint64_t txSeq;
     BRMasterPubKey masterPubKey;
+    BRChainPubKey chainPubKeys[2]; // by SEQUENCE_EXTERNAL_CHAIN and SEQUENCE_INTERNAL_CHAIN
     BRAddressParams addrParams;
     UInt160 *internalChain, *externalChain;
     BRSet *allTx, *invalidTx, *pendingTx, *spentOutputs, *usedPKH, *allPKH;
+    BRSet *otherPKH; // output PKHs of applied transactions that aren't (yet) wallet addresses
     void *callbackInfo;
     void (*balanceChanged)(void *info, uint64_t balance);
     void (*txAdded)(void *info, BRTransaction *tx);
     void (*txUpdated)(void *info, const UInt256 txHashes[], size_t txCount, uint32_t blockHeight, uint32_t timestamp);
     void (*txDeleted)(void *info, UInt256 txHash, int notifyUser, int recommendRescan);
-    pthread_mutex_t lock;
+    BRWalletView *view; // the most recently published view, guarded by viewLock
+    BRWalletViewItems *viewTxs, *viewUTXOs, *viewInternal, *viewExternal; // the items of wallet->view
+    size_t viewTxsClean, viewUTXOsClean; // leading transactions and UTXOs unchanged since wallet->view was published
+    pthread_mutex_t lock, viewLock; // viewLock is only held to swap or retain wallet->view, and is taken after lock
 };
 
-inline static int _BRWalletTxIsAscending(BRWallet *wallet, const BRTransaction *tx1, const BRTransaction *tx2)
+inline static int _BRWalletTxKeyCompare(const BRWalletTxKey *key1, const BRWalletTxKey *key2)
 {
-    if (! tx1 || ! tx2) return 0;
-    if (tx1->blockHeight > tx2->blockHeight) return 1;
-    if (tx1->blockHeight < tx2->blockHeight) return 0;
-    
-    for (size_t i = 0; i < tx1->inCount; i++) {
-        if (UInt256Eq(tx1->inputs[i].txHash, tx2->txHash)) return 1;
+    if (key1->blockHeight != key2->blockHeight) return (key1->blockHeight > key2->blockHeight) ? 1 : -1;
+    if (key1->order != key2->order) return (key1->order > key2->order) ? 1 : -1;
+    if (key1->depth != key2->depth) return (key1->depth > key2->depth) ? 1 : -1;
+    if (key1->seq != key2->seq) return (key1->seq > key2->seq) ? 1 : -1;
+    return 0;
+}
+
+// returns the index of the first tx in wallet->transactions that doesn't sort before key (binary search)
+static size_t _BRWalletTxLowerBound(BRWallet *wallet, const BRWalletTxKey *key)
+{
+    size_t lo = 0, hi = array_count(wallet->transactions), mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo)/2;
+        if (_BRWalletTxKeyCompare(BRSetGet(wallet->txKeys, wallet->transactions[mid]), key) < 0) lo = mid + 1;
+        else hi = mid;
     }
-    
-    for (size_t i = 0; i < tx2->inCount; i++) {
-        if (UInt256Eq(tx2->inputs[i].txHash, tx1->txHash)) return 0;
+
+    return lo;
+}
+
+// returns the index of tx in wallet->transactions, or -1 if it isn't there
+static size_t _BRWalletTxIndex(BRWallet *wallet, const BRTransaction *tx)
+{
+    const BRWalletTxKey *key = BRSetGet(wallet->txKeys, tx);
+    size_t i = (key) ? _BRWalletTxLowerBound(wallet, key) : (size_t) -1;
+
+    return (key && i < array_count(wallet->transactions) && BRTransactionEq(wallet->transactions[i], tx)) ? i :
+           (size_t) -1;
+}
+
+// raises key's order and depth above those of the same-height wallet transactions that tx spends, following spent
+// non-wallet transactions back to the wallet transactions they spend
+static void _BRWalletTxKeyAfterInputs(BRWallet *wallet, BRWalletTxKey *key, const BRTransaction *tx)
+{
+    const BRWalletTxKey *k;
+    const BRTransaction *t;
+
+    for (size_t i = 0; i < tx->inCount; i++) {
+        t = BRSetGet(wallet->allTx, &tx->inputs[i].txHash);
+        if (! t || t->blockHeight != key->blockHeight) continue;
+        k = BRSetGet(wallet->txKeys, t);
+
+        if (k && k->blockHeight == key->blockHeight) {
+            if (k->order > key->order) key->order = k->order;
+            if (k->depth >= key->depth) key->depth = k->depth + 1;
+        }
+        else if (! k) _BRWalletTxKeyAfterInputs(wallet, key, t);
     }
+}
+
+// true if tx spends an output of parent, directly or through same-height non-wallet transactions
+static int _BRWalletTxSpends(BRWallet *wallet, const BRTransaction *tx, const BRTransaction *parent)
+{
+    const BRTransaction *t;
 
-    for (size_t i = 0; i < tx1->inCount; i++) {
-        if (_BRWalletTxIsAscending(wallet, BRSetGet(wallet->allTx, &(tx1->inputs[i].txHash)), tx2)) return 1;
+    for (size_t i = 0; i < tx->inCount; i++) {
+        if (UInt256Eq(tx->inputs[i].txHash, parent->txHash)) return 1;
+        t = BRSetGet(wallet->allTx, &tx->inputs[i].txHash);
+        if (t && t->blockHeight == tx->blockHeight && ! BRSetContains(wallet->txKeys, t) &&
+            _BRWalletTxSpends(wallet, t, parent)) return 1;
     }
 
     return 0;
 }
 
-inline static int _BRWalletTxCompare(BRWallet *wallet, const BRTransaction *tx1, const BRTransaction *tx2)
+// notes that wallet->transactions changed from index i on, so the next _BRWalletPublishView() copies them again
+inline static void _BRWalletTxsChanged(BRWallet *wallet, size_t i)
 {
-    size_t i = (size_t) -1, j = (size_t) -1;
+    if (i < wallet->viewTxsClean) wallet->viewTxsClean = i;
+}
 
-    if (_BRWalletTxIsAscending(wallet, tx1, tx2)) return 1;
-    if (_BRWalletTxIsAscending(wallet, tx2, tx1)) return -1;
-    if ((i = _txChainIndex(tx1, wallet->internalChain)) != -1) j = _txChainIndex(tx2, wallet->internalChain);
-    if (j == -1 && (i = _txChainIndex(tx1, wallet->externalChain)) != -1) j = _txChainIndex(tx2, wallet->externalChain);
-    if (i != -1 && j != -1 && i != j) return (i > j) ? 1 : -1;
-    return 0;
+// inserts tx into wallet->transactions, keeping wallet->transactions sorted by date, oldest first, and moves any
+// same-height tx that spends it, but was sorted before it, to after it; returns the number of transactions moved
+static size_t _BRWalletInsertTx(BRWallet *wallet, BRTransaction *tx)
+{
+    BRWalletTxKey *key = BRSetGet(wallet->txKeys, tx), start;
+    BRTransaction **spenders = NULL;
+    size_t i, moved = 0;
+
+    if (! key) {
+        key = calloc(1, sizeof(*key));
+        assert(key != NULL);
+        key->txHash = tx->txHash;
+        key->seq = ++wallet->txSeq;
+        BRSetAdd(wallet->txKeys, key);
+    }
+
+    key->blockHeight = tx->blockHeight;
+    key->order = key->seq;
+    key->depth = 0;
+    _BRWalletTxKeyAfterInputs(wallet, key, tx);
+    i = _BRWalletTxLowerBound(wallet, key);
+    array_insert(wallet->transactions, i, tx);
+    _BRWalletTxsChanged(wallet, i);
+
+    // a tx added before the tx it spends has to move, and so in turn may the transactions that spend it
+    start = (BRWalletTxKey) { UINT256_ZERO, tx->blockHeight, 0, 0, 0 };
+
+    for (size_t j = _BRWalletTxLowerBound(wallet, &start); j < i; j++) {
+        if (! _BRWalletTxSpends(wallet, wallet->transactions[j], tx)) continue;
+        if (! spenders) array_new(spenders, 10);
+        array_add(spenders, wallet->transactions[j]);
+    }
+
+    for (size_t j = 0; spenders && j < array_count(spenders); j++) {
+        size_t k = _BRWalletTxIndex(wallet, spenders[j]);
+
+        array_rm(wallet->transactions, k);
+        _BRWalletTxsChanged(wallet, k);
+        moved += 1 + _BRWalletInsertTx(wallet, spenders[j]);
+    }
+
+    if (spenders) array_free(spenders);
+    return moved;
 }
 
-// inserts tx into wallet->transactions, keeping wallet->transactions sorted by date, oldest first (insertion sort)
-inline static void _BRWalletInsertTx(BRWallet *wallet, BRTransaction *tx)
+// returns the state entry for txHash, adding an empty one if there isn't one yet
+static BRWalletTxState *_BRWalletTxStateForHash(BRWallet *wallet, UInt256 txHash)
 {
-    size_t i = array_count(wallet->transactions);
-    
-    array_set_count(wallet->transactions, i + 1);
-    
-    while (i > 0 && _BRWalletTxCompare(wallet, wallet->transactions[i - 1], tx) > 0) {
-        wallet->transactions[i] = wallet->transactions[i - 1];
-        i--;
+    BRWalletTxState *state = BRSetGet(wallet->txStates, &txHash);
+
+    if (! state) {
+        state = calloc(1, sizeof(*state));
+        assert(state != NULL);
+        state->txHash = txHash;
+        array_new(state->spenders, 1);
+        BRSetAdd(wallet->txStates, state);
     }
-    
-    wallet->transactions[i] = tx;
+
+    return state;
+}
+
+static void _BRWalletTxStateFree(BRWalletTxState *state)
+{
+    array_free(state->spenders);
+    free(state);
+}
+
+// clears the memoized status of state, and of every transaction that directly or indirectly spends it, stopping at
+// spenders that are already cleared since nothing memoized can depend on those
+static void _BRWalletTxStateClear(BRWalletTxState *state)
+{
+    if (! state) return;
+    state->flags = 0;
+
+    for (size_t i = 0; i < array_count(state->spenders); i++) {
+        if (state->spenders[i]->flags != 0) _BRWalletTxStateClear(state->spenders[i]);
+    }
+}
+
+static void _setApplyClearTxState(void *info, void *tx)
+{
+    BRWallet *wallet = info;
+
+    _BRWalletTxStateClear(BRSetGet(wallet->txStates, tx));
+}
+
+static void _setApplyResetTxState(void *info, void *state)
+{
+    ((BRWalletTxState *)state)->flags = 0;
+}
+
+// links tx, just added to wallet->allTx, to the entries of the transactions it spends, and clears the memoized status
+// of any transactions already spending it
+static void _BRWalletTxStateAdd(BRWallet *wallet, const BRTransaction *tx)
+{
+    BRWalletTxState *state = _BRWalletTxStateForHash(wallet, tx->txHash), *s;
+
+    for (size_t i = 0; i < tx->inCount; i++) {
+        s = _BRWalletTxStateForHash(wallet, tx->inputs[i].txHash);
+        if (array_count(s->spenders) == 0 || s->spenders[array_count(s->spenders) - 1] != state) {
+            array_add(s->spenders, state);
+        }
+    }
+
+    state->flags = 0;
+
+    for (size_t i = 0; i < array_count(state->spenders); i++) { // spenders were checked while tx was unknown
+        _BRWalletTxStateClear(state->spenders[i]);
+    }
+}
+
+// unlinks tx, about to be removed from wallet->allTx, from the entries of the transactions it spends, and clears the
+// memoized status of any transactions spending it
+static void _BRWalletTxStateRemove(BRWallet *wallet, const BRTransaction *tx)
+{
+    BRWalletTxState *state = BRSetGet(wallet->txStates, tx), *s;
+
+    if (! state) return;
+    _BRWalletTxStateClear(state);
+
+    for (size_t i = 0; i < tx->inCount; i++) {
+        s = BRSetGet(wallet->txStates, &tx->inputs[i].txHash);
+        if (! s) continue; // an earlier input spending the same tx already removed it
+
+        for (size_t j = array_count(s->spenders); j > 0; j--) {
+            if (s->spenders[j - 1] == state) array_rm(s->spenders, j - 1);
+        }
+
+        if (array_count(s->spenders) == 0 && ! BRSetContains(wallet->allTx, s)) {
+            _BRWalletTxStateFree(BRSetRemove(wallet->txStates, s));
+        }
+    }
+
+    if (array_count(state->spenders) == 0) _BRWalletTxStateFree(BRSetRemove(wallet->txStates, state));
+}
+
+// returns the state entry for tx if it's the transaction in wallet->allTx, so its status can be memoized, or NULL
+inline static BRWalletTxState *_BRWalletTxState(BRWallet *wallet, const BRTransaction *tx)
+{
+    return (BRSetGet(wallet->allTx, tx) == tx) ? BRSetGet(wallet->txStates, tx) : NULL;
+}
+
+// returns the index of wallet address pkh in its address chain, internal or external as set in *chain, or -1 if it
+// isn't a wallet address, with a single lookup, as the entries of wallet->allPKH point into the chains
+static size_t _BRWalletPKHIndex(BRWallet *wallet, const void *pkh, uint32_t *chain)
+{
+    uintptr_t p = (uintptr_t)BRSetGet(wallet->allPKH, pkh),
+              internal = (uintptr_t)wallet->internalChain, external = (uintptr_t)wallet->externalChain;
+
+    if (p && p - internal < array_count(wallet->internalChain)*sizeof(UInt160)) {
+        *chain = SEQUENCE_INTERNAL_CHAIN;
+        return (p - internal)/sizeof(UInt160);
+    }
+
+    if (p && p - external < array_count(wallet->externalChain)*sizeof(UInt160)) {
+        *chain = SEQUENCE_EXTERNAL_CHAIN;
+        return (p - external)/sizeof(UInt160);
+    }
+
+    return (size_t) -1;
 }
 
 // non-threadsafe version of BRWalletContainsTransaction()
@@ -161,116 +441,671 @@ static int _BRWalletContainsTx(BRWallet *wallet, const BRTransaction *tx)
     return r;
 }
 
-static void _BRWalletUpdateBalance(BRWallet *wallet)
+// adds the given output to the UTXO set as the newest UTXO
+static void _BRWalletAddUTXO(BRWallet *wallet, UInt256 txHash, uint32_t n, uint64_t amount)
+{
+    BRWalletUTXO *utxo = calloc(1, sizeof(*utxo));
+
+    assert(utxo != NULL);
+    utxo->o = (BRUTXO) { txHash, n };
+    utxo->amount = amount;
+    utxo->prev = wallet->newestUTXO;
+
+    if (wallet->newestUTXO) wallet->newestUTXO->next = utxo;
+    else wallet->oldestUTXO = utxo;
+
+    wallet->newestUTXO = utxo;
+    BRSetAdd(wallet->utxos, utxo);
+    array_clear(wallet->utxosByAmount);
+}
+
+// removes the UTXO for outpoint, a BRUTXO or BRTxInput, from the UTXO set and returns its amount, or 0 if it wasn't
+// an unspent wallet output
+static uint64_t _BRWalletSpendUTXO(BRWallet *wallet, const void *outpoint)
+{
+    BRWalletUTXO *utxo = BRSetRemove(wallet->utxos, outpoint);
+    uint64_t amount;
+
+    if (! utxo) return 0;
+    if (utxo->prev) utxo->prev->next = utxo->next;
+    else wallet->oldestUTXO = utxo->next;
+    if (utxo->next) utxo->next->prev = utxo->prev;
+    else wallet->newestUTXO = utxo->prev;
+    amount = utxo->amount;
+    free(utxo);
+    array_clear(wallet->utxosByAmount);
+    wallet->viewUTXOsClean = 0; // the next _BRWalletPublishView() copies all the UTXOs again
+    return amount;
+}
+
+static void _BRWalletClearUTXOs(BRWallet *wallet)
+{
+    BRWalletUTXO *utxo, *next;
+
+    for (utxo = wallet->oldestUTXO; utxo; utxo = next) {
+        next = utxo->next;
+        free(utxo);
+    }
+
+    BRSetClear(wallet->utxos);
+    wallet->oldestUTXO = wallet->newestUTXO = NULL;
+    array_clear(wallet->utxosByAmount);
+    wallet->viewUTXOsClean = 0;
+}
+
+// largest amount first, then oldest first
+static int _BRWalletUTXOAmountCompare(const void *a, const void *b)
+{
+    const BRWalletUTXO *u1 = *(BRWalletUTXO * const *)a, *u2 = *(BRWalletUTXO * const *)b;
+
+    if (u1->amount != u2->amount) return (u1->amount > u2->amount) ? -1 : 1;
+    return (u1->age < u2->age) ? -1 : (u1->age > u2->age);
+}
+
+// sorts wallet->utxosByAmount, if it's stale, and returns it
+static BRWalletUTXO **_BRWalletUTXOsByAmount(BRWallet *wallet)
+{
+    size_t i = 0;
+
+    if (array_count(wallet->utxosByAmount) != BRSetCount(wallet->utxos)) {
+        array_set_count(wallet->utxosByAmount, BRSetCount(wallet->utxos));
+
+        for (BRWalletUTXO *utxo = wallet->oldestUTXO; utxo; utxo = utxo->next, i++) {
+            utxo->age = i;
+            wallet->utxosByAmount[i] = utxo;
+        }
+
+        qsort(wallet->utxosByAmount, i, sizeof(*wallet->utxosByAmount), _BRWalletUTXOAmountCompare);
+    }
+
+    return wallet->utxosByAmount;
+}
+
+// updates the balance, UTXOs, spent outputs and invalid/pending sets for tx, which must be the last tx in
+// wallet->transactions with the wallet state already reflecting all the tx before it, in time proportional to the
+// number of tx inputs and outputs
+static void _BRWalletApplyTx(BRWallet *wallet, BRTransaction *tx, time_t now)
 {
     int isInvalid, isPending;
-    uint64_t balance = 0, prevBalance = 0;
-    time_t now = time(NULL);
-    size_t i, j;
-    BRTransaction *tx, *t;
+    uint64_t balance = wallet->balance, prevBalance = wallet->balance;
+    size_t j;
     const uint8_t *pkh;
-    
-    array_clear(wallet->utxos);
+
+    // check if any inputs are invalid or already spent
+    if (tx->blockHeight == TX_UNCONFIRMED) {
+        for (j = 0, isInvalid = 0; ! isInvalid && j < tx->inCount; j++) {
+            if (BRSetContains(wallet->spentOutputs, &tx->inputs[j]) ||
+                BRSetContains(wallet->invalidTx, &tx->inputs[j].txHash)) isInvalid = 1;
+        }
+
+        if (isInvalid) {
+            BRSetAdd(wallet->invalidTx, tx);
+            _BRWalletTxStateClear(BRSetGet(wallet->txStates, tx));
+            array_add(wallet->balanceHist, balance);
+            return;
+        }
+    }
+
+    // add inputs to spent output set
+    for (j = 0; j < tx->inCount; j++) {
+        BRSetAdd(wallet->spentOutputs, &tx->inputs[j]);
+    }
+
+    // check if tx is pending
+    if (tx->blockHeight == TX_UNCONFIRMED) {
+        isPending = (BRTransactionVSize(tx) > TX_MAX_SIZE) ? 1 : 0; // check tx size is under TX_MAX_SIZE
+
+        for (j = 0; ! isPending && j < tx->outCount; j++) {
+            if (tx->outputs[j].amount < TX_MIN_OUTPUT_AMOUNT) isPending = 1; // check that no outputs are dust
+        }
+
+        for (j = 0; ! isPending && j < tx->inCount; j++) {
+            if (tx->inputs[j].sequence < UINT32_MAX - 1) isPending = 1; // check for replace-by-fee
+            if (tx->inputs[j].sequence < UINT32_MAX && tx->lockTime < TX_MAX_LOCK_HEIGHT &&
+                tx->lockTime > wallet->blockHeight + 1) isPending = 1; // future lockTime
+            if (tx->inputs[j].sequence < UINT32_MAX && tx->lockTime > now) isPending = 1; // future lockTime
+            if (BRSetContains(wallet->pendingTx, &tx->inputs[j].txHash)) isPending = 1; // check for pending inputs
+            // TODO: XXX handle BIP68 check lock time verify rules
+        }
+
+        if (isPending) {
+            // outputs spent by pending tx leave the UTXO set along with the next tx that isn't pending or invalid
+            for (j = 0; j < tx->inCount; j++) {
+                array_add(wallet->pendingSpent, ((const BRUTXO) { tx->inputs[j].txHash, tx->inputs[j].index }));
+            }
+
+            BRSetAdd(wallet->pendingTx, tx);
+            array_add(wallet->balanceHist, balance);
+            return;
+        }
+    }
+
+    // remove outputs spent by this tx, or by pending tx since the last update, from the UTXO set
+    for (j = 0; j < tx->inCount; j++) {
+        balance -= _BRWalletSpendUTXO(wallet, &tx->inputs[j]);
+    }
+
+    for (j = 0; j < array_count(wallet->pendingSpent); j++) {
+        balance -= _BRWalletSpendUTXO(wallet, &wallet->pendingSpent[j]);
+    }
+
+    array_clear(wallet->pendingSpent);
+
+    // add outputs to UTXO set, unless a tx before this one already spent them
+    // TODO: don't add outputs below TX_MIN_OUTPUT_AMOUNT
+    // TODO: don't add coin generation outputs < 100 blocks deep
+    // NOTE: balance/UTXOs will then need to be recalculated when last block changes
+    for (j = 0; j < tx->outCount; j++) {
+        pkh = BRScriptPKH(tx->outputs[j].script, tx->outputs[j].scriptLen);
+
+        if (pkh && BRSetContains(wallet->allPKH, pkh)) {
+            BRSetAdd(wallet->usedPKH, (void *)pkh);
+            if (BRSetContains(wallet->spentOutputs, &((const BRUTXO) { tx->txHash, (uint32_t)j }))) continue;
+            _BRWalletAddUTXO(wallet, tx->txHash, (uint32_t)j, tx->outputs[j].amount);
+            balance += tx->outputs[j].amount;
+        }
+        else if (pkh) BRSetAdd(wallet->otherPKH, (void *)pkh); // see BRWalletUnusedAddrs()
+    }
+
+    if (prevBalance < balance) wallet->totalReceived += balance - prevBalance;
+    if (balance < prevBalance) wallet->totalSent += prevBalance - balance;
+    array_add(wallet->balanceHist, balance);
+    wallet->balance = balance;
+}
+
+// reverses _BRWalletApplyTx() for tx, the last tx in wallet->transactions, if it was invalid or pending, otherwise
+// returns false and leaves the wallet state unchanged
+static int _BRWalletUnapplyTx(BRWallet *wallet, BRTransaction *tx)
+{
+    if (BRSetContains(wallet->invalidTx, tx)) {
+        BRSetRemove(wallet->invalidTx, tx);
+        _BRWalletTxStateClear(BRSetGet(wallet->txStates, tx));
+    }
+    else if (BRSetContains(wallet->pendingTx, tx)) {
+        // pending tx inputs weren't already spent, or tx would have been invalid
+        for (size_t j = 0; j < tx->inCount; j++) {
+            BRSetRemove(wallet->spentOutputs, &tx->inputs[j]);
+        }
+
+        assert(array_count(wallet->pendingSpent) >= tx->inCount);
+        array_set_count(wallet->pendingSpent, array_count(wallet->pendingSpent) - tx->inCount);
+        BRSetRemove(wallet->pendingTx, tx);
+    }
+    else return 0;
+
+    array_rm_last(wallet->balanceHist);
+    return 1;
+}
+
+// recalculates the balance, UTXOs, spent outputs and invalid/pending sets from scratch
+static void _BRWalletUpdateBalance(BRWallet *wallet)
+{
+    time_t now = time(NULL);
+
+    _BRWalletClearUTXOs(wallet);
+    array_clear(wallet->pendingSpent);
     array_clear(wallet->balanceHist);
     BRSetClear(wallet->spentOutputs);
+    BRSetApply(wallet->invalidTx, wallet, _setApplyClearTxState); // tx that were invalid may no longer be
     BRSetClear(wallet->invalidTx);
     BRSetClear(wallet->pendingTx);
     BRSetClear(wallet->usedPKH);
+    BRSetClear(wallet->otherPKH);
+    wallet->balance = 0;
     wallet->totalSent = 0;
     wallet->totalReceived = 0;
 
-    for (i = 0; i < array_count(wallet->transactions); i++) {
-        tx = wallet->transactions[i];
+    for (size_t i = 0; i < array_count(wallet->transactions); i++) {
+        _BRWalletApplyTx(wallet, wallet->transactions[i], now);
+    }
 
-        // check if any inputs are invalid or already spent
-        if (tx->blockHeight == TX_UNCONFIRMED) {
-            for (j = 0, isInvalid = 0; ! isInvalid && j < tx->inCount; j++) {
-                if (BRSetContains(wallet->spentOutputs, &tx->inputs[j]) ||
-                    BRSetContains(wallet->invalidTx, &tx->inputs[j].txHash)) isInvalid = 1;
-            }
-        
-            if (isInvalid) {
-                BRSetAdd(wallet->invalidTx, tx);
-                array_add(wallet->balanceHist, balance);
-                continue;
-            }
+    assert(array_count(wallet->balanceHist) == array_count(wallet->transactions));
+}
+
+#if defined(BITCOIN_DEBUG)
+// checks an incrementally updated wallet state against a full _BRWalletUpdateBalance()
+static void _BRWalletCheckBalance(BRWallet *wallet)
+{
+    uint64_t balance = wallet->balance, totalSent = wallet->totalSent, totalReceived = wallet->totalReceived;
+    size_t utxoCount = BRSetCount(wallet->utxos), histCount = array_count(wallet->balanceHist),
+           spentCount = BRSetCount(wallet->spentOutputs), usedCount = BRSetCount(wallet->usedPKH),
+           otherCount = BRSetCount(wallet->otherPKH);
+    BRUTXO *utxos = malloc(utxoCount*sizeof(*utxos));
+    uint64_t *balanceHist = malloc(histCount*sizeof(*balanceHist));
+    BRSet *invalidTx = BRSetNew(BRTransactionHash, BRTransactionEq, 10),
+          *pendingTx = BRSetNew(BRTransactionHash, BRTransactionEq, 10);
+    BRWalletUTXO *utxo;
+    size_t i = 0;
+
+    assert((utxos != NULL || utxoCount == 0) && (balanceHist != NULL || histCount == 0));
+    for (utxo = wallet->oldestUTXO; utxo; utxo = utxo->next) utxos[i++] = utxo->o;
+    assert(i == utxoCount);
+    if (histCount > 0) memcpy(balanceHist, wallet->balanceHist, histCount*sizeof(*balanceHist));
+    BRSetUnion(invalidTx, wallet->invalidTx);
+    BRSetUnion(pendingTx, wallet->pendingTx);
+    _BRWalletUpdateBalance(wallet);
+
+    assert(balance == wallet->balance && totalSent == wallet->totalSent && totalReceived == wallet->totalReceived);
+    assert(utxoCount == BRSetCount(wallet->utxos) && histCount == array_count(wallet->balanceHist));
+    assert(spentCount == BRSetCount(wallet->spentOutputs) && usedCount == BRSetCount(wallet->usedPKH));
+    assert(otherCount == BRSetCount(wallet->otherPKH));
+    assert(BRSetCount(invalidTx) == BRSetCount(wallet->invalidTx));
+    assert(BRSetCount(pendingTx) == BRSetCount(wallet->pendingTx));
+    BRSetMinus(invalidTx, wallet->invalidTx);
+    BRSetMinus(pendingTx, wallet->pendingTx);
+    assert(BRSetCount(invalidTx) == 0 && BRSetCount(pendingTx) == 0);
+    for (i = 0, utxo = wallet->oldestUTXO; i < utxoCount; i++, utxo = utxo->next) assert(BRUTXOEq(&utxos[i], utxo));
+    for (i = 0; i < histCount; i++) assert(balanceHist[i] == wallet->balanceHist[i]);
+    BRSetFree(pendingTx);
+    BRSetFree(invalidTx);
+    free(balanceHist);
+    free(utxos);
+}
+#else
+#define _BRWalletCheckBalance(wallet) ((void)(wallet))
+#endif
+
+#if defined(BITCOIN_DEBUG)
+// checks a view published by _BRWalletPublishView(), with only what changed copied, against the wallet it's a view of
+static void _BRWalletCheckView(BRWallet *wallet, const BRWalletView *view)
+{
+    BRWalletUTXO *utxo = wallet->oldestUTXO;
+
+    assert(view->txCount == array_count(wallet->transactions) && view->utxoCount == BRSetCount(wallet->utxos));
+    assert(view->internalCount == array_count(wallet->internalChain));
+    assert(view->externalCount == array_count(wallet->externalChain));
+    assert(memcmp(view->transactions, wallet->transactions, view->txCount*sizeof(BRTransaction *)) == 0);
+    assert(memcmp(view->internalChain, wallet->internalChain, view->internalCount*sizeof(UInt160)) == 0);
+    assert(memcmp(view->externalChain, wallet->externalChain, view->externalCount*sizeof(UInt160)) == 0);
+    for (size_t i = 0; i < view->utxoCount; i++, utxo = utxo->next) assert(BRUTXOEq(&view->utxos[i], utxo));
+}
+#else
+#define _BRWalletCheckView(wallet, view) ((void)(wallet))
+#endif
+
+static void _BRWalletViewItemsRelease(BRWalletViewItems *items)
+{
+    if (items && atomic_fetch_sub(&items->refCount, 1) == 1) free(items);
+}
+
+// makes *items hold count items of itemSize, the first clean of which are unchanged since the last published view, by
+// appending to *items if none of the others are in a published view, or else by copying the unchanged ones to new
+// items, and returns the index of the first item to write
+static size_t _BRWalletViewItemsPrepare(BRWalletViewItems **items, size_t itemSize, size_t count, size_t clean)
+{
+    BRWalletViewItems *prev = *items;
+    size_t capacity = count*2 + 16;
+
+    if (clean > count) clean = count;
+
+    if (! prev || count > prev->capacity || (clean < count && clean < prev->written)) {
+        *items = malloc(sizeof(**items) + capacity*itemSize);
+        assert(*items != NULL);
+        atomic_init(&(*items)->refCount, 1); // the reference held by the wallet
+        (*items)->capacity = capacity;
+        (*items)->written = 0;
+        if (prev) memcpy(_viewItems(*items), _viewItems(prev), clean*itemSize);
+        else clean = 0;
+        _BRWalletViewItemsRelease(prev);
+    }
+
+    if ((*items)->written < count) (*items)->written = count;
+    return clean;
+}
+
+// replaces wallet->view with a view of the current balance, UTXOs, transactions and address chains, called with
+// wallet->lock held after any of them change; only what changed since the last view is copied, the rest is shared with
+// it, and readers of older views are never waited on
+static void _BRWalletPublishView(BRWallet *wallet)
+{
+    size_t txCount = array_count(wallet->transactions), utxoCount = BRSetCount(wallet->utxos),
+           internalCount = array_count(wallet->internalChain), externalCount = array_count(wallet->externalChain), i;
+    BRWalletView *view = malloc(sizeof(*view)), *prev;
+    BRWalletUTXO *utxo = wallet->newestUTXO;
+
+    assert(view != NULL);
+    atomic_init(&view->refCount, 1); // the reference held by wallet->view
+    view->balance = wallet->balance;
+    view->totalSent = wallet->totalSent;
+    view->totalReceived = wallet->totalReceived;
+    view->addrParams = wallet->addrParams;
+
+    i = _BRWalletViewItemsPrepare(&wallet->viewTxs, sizeof(BRTransaction *), txCount, wallet->viewTxsClean);
+    view->transactions = _viewItems(wallet->viewTxs);
+    memcpy(&view->transactions[i], &wallet->transactions[i], (txCount - i)*sizeof(BRTransaction *));
+
+    // UTXOs are only added as the newest, so any that changed are the newest ones
+    i = _BRWalletViewItemsPrepare(&wallet->viewUTXOs, sizeof(BRUTXO), utxoCount, wallet->viewUTXOsClean);
+    view->utxos = _viewItems(wallet->viewUTXOs);
+    for (size_t j = utxoCount; j > i; j--, utxo = utxo->prev) view->utxos[j - 1] = utxo->o;
+
+    // address chains only grow
+    i = _BRWalletViewItemsPrepare(&wallet->viewInternal, sizeof(UInt160), internalCount,
+                                  (wallet->viewInternal) ? wallet->viewInternal->written : 0);
+    view->internalChain = _viewItems(wallet->viewInternal);
+    memcpy(&view->internalChain[i], &wallet->internalChain[i], (internalCount - i)*sizeof(UInt160));
+    i = _BRWalletViewItemsPrepare(&wallet->viewExternal, sizeof(UInt160), externalCount,
+                                  (wallet->viewExternal) ? wallet->viewExternal->written : 0);
+    view->externalChain = _viewItems(wallet->viewExternal);
+    memcpy(&view->externalChain[i], &wallet->externalChain[i], (externalCount - i)*sizeof(UInt160));
+
+    view->txItems = wallet->viewTxs;
+    view->utxoItems = wallet->viewUTXOs;
+    view->internalItems = wallet->viewInternal;
+    view->externalItems = wallet->viewExternal;
+    atomic_fetch_add(&view->txItems->refCount, 1);
+    atomic_fetch_add(&view->utxoItems->refCount, 1);
+    atomic_fetch_add(&view->internalItems->refCount, 1);
+    atomic_fetch_add(&view->externalItems->refCount, 1);
+    view->txCount = txCount;
+    view->utxoCount = utxoCount;
+    view->internalCount = internalCount;
+    view->externalCount = externalCount;
+    wallet->viewTxsClean = txCount;
+    wallet->viewUTXOsClean = utxoCount;
+    _BRWalletCheckView(wallet, view);
+
+    // readers only hold viewLock to retain wallet->view, so swapping it never waits on them, and a reader still using
+    // prev keeps it until it releases it
+    pthread_mutex_lock(&wallet->viewLock);
+    prev = wallet->view;
+    wallet->view = view;
+    pthread_mutex_unlock(&wallet->viewLock);
+    if (prev) BRWalletViewRelease(prev);
+}
+
+// the digest identifying a master public key in a wallet snapshot or address chains
+static UInt160 _BRWalletMPKDigest(BRMasterPubKey mpk)
+{
+    uint8_t data[sizeof(uint32_t) + sizeof(UInt256) + sizeof(mpk.pubKey)];
+    UInt160 md;
+
+    UInt32SetLE(data, mpk.fingerPrint);
+    UInt256Set(&data[sizeof(uint32_t)], mpk.chainCode);
+    memcpy(&data[sizeof(uint32_t) + sizeof(UInt256)], mpk.pubKey, sizeof(mpk.pubKey));
+    BRHash160(&md, data, sizeof(data));
+    return md;
+}
+
+// checks the version, master public key digest and trailing checksum of a snapshot or address chains
+// returns the offset past the digest, or 0 if not valid for mpk
+static size_t _BRWalletCheckHeader(const uint8_t *buf, size_t bufLen, uint8_t version, BRMasterPubKey mpk)
+{
+    UInt256 md;
+
+    if (! buf || bufLen < 1 + sizeof(UInt160) + sizeof(UInt256)) return 0;
+    BRSHA256(&md, buf, bufLen - sizeof(UInt256));
+    if (! UInt256Eq(md, UInt256Get(&buf[bufLen - sizeof(UInt256)])) || buf[0] != version) return 0;
+    if (! UInt160Eq(_BRWalletMPKDigest(mpk), UInt160Get(&buf[1]))) return 0;
+    return 1 + sizeof(UInt160);
+}
+
+// writes the wallet's address chains - the hash160 of every address generated by BRWalletUnusedAddrs() - to buf, for
+// BRWalletNewWithSnapshot(), to restore the chains without deriving the addresses again
+// returns number of bytes written to buf, or total bufLen needed if buf is NULL or bufLen is too small
+size_t BRWalletAddressChains(BRWallet *wallet, uint8_t *buf, size_t bufLen)
+{
+    size_t i, off = 0, len;
+
+    assert(wallet != NULL);
+    pthread_mutex_lock(&wallet->lock);
+    len = 1 + sizeof(UInt160) + sizeof(uint32_t) + array_count(wallet->internalChain)*sizeof(UInt160) +
+          sizeof(uint32_t) + array_count(wallet->externalChain)*sizeof(UInt160) + sizeof(UInt256);
+
+    if (buf && len <= bufLen) {
+        buf[off] = WALLET_CHAINS_VERSION;
+        off += 1;
+        UInt160Set(&buf[off], _BRWalletMPKDigest(wallet->masterPubKey));
+        off += sizeof(UInt160);
+        UInt32SetLE(&buf[off], (uint32_t)array_count(wallet->internalChain));
+        off += sizeof(uint32_t);
+
+        for (i = 0; i < array_count(wallet->internalChain); i++) {
+            UInt160Set(&buf[off], wallet->internalChain[i]);
+            off += sizeof(UInt160);
         }
 
-        // add inputs to spent output set
-        for (j = 0; j < tx->inCount; j++) {
-            BRSetAdd(wallet->spentOutputs, &tx->inputs[j]);
+        UInt32SetLE(&buf[off], (uint32_t)array_count(wallet->externalChain));
+        off += sizeof(uint32_t);
+
+        for (i = 0; i < array_count(wallet->externalChain); i++) {
+            UInt160Set(&buf[off], wallet->externalChain[i]);
+            off += sizeof(UInt160);
         }
 
-        // check if tx is pending
-        if (tx->blockHeight == TX_UNCONFIRMED) {
-            isPending = (BRTransactionVSize(tx) > TX_MAX_SIZE) ? 1 : 0; // check tx size is under TX_MAX_SIZE
-            
-            for (j = 0; ! isPending && j < tx->outCount; j++) {
-                if (tx->outputs[j].amount < TX_MIN_OUTPUT_AMOUNT) isPending = 1; // check that no outputs are dust
-            }
+        BRSHA256(&buf[off], buf, off); // checksum
+        off += sizeof(UInt256);
+        assert(off == len);
+    }
 
-            for (j = 0; ! isPending && j < tx->inCount; j++) {
-                if (tx->inputs[j].sequence < UINT32_MAX - 1) isPending = 1; // check for replace-by-fee
-                if (tx->inputs[j].sequence < UINT32_MAX && tx->lockTime < TX_MAX_LOCK_HEIGHT &&
-                    tx->lockTime > wallet->blockHeight + 1) isPending = 1; // future lockTime
-                if (tx->inputs[j].sequence < UINT32_MAX && tx->lockTime > now) isPending = 1; // future lockTime
-                if (BRSetContains(wallet->pendingTx, &tx->inputs[j].txHash)) isPending = 1; // check for pending inputs
-                // TODO: XXX handle BIP68 check lock time verify rules
-            }
-            
-            if (isPending) {
-                BRSetAdd(wallet->pendingTx, tx);
-                array_add(wallet->balanceHist, balance);
-                continue;
-            }
+    pthread_mutex_unlock(&wallet->lock);
+    return len;
+}
+
+// restores the address chains written by BRWalletAddressChains() into wallet, returns true on success
+static int _BRWalletRestoreChains(BRWallet *wallet, const uint8_t *chains, size_t chainsLen)
+{
+    size_t off = _BRWalletCheckHeader(chains, chainsLen, WALLET_CHAINS_VERSION, wallet->masterPubKey),
+           end = chainsLen - sizeof(UInt256), internalCount, externalCount;
+
+    if (off == 0 || off + sizeof(uint32_t) > end) return 0;
+    internalCount = UInt32GetLE(&chains[off]);
+    if (internalCount > (end - off - sizeof(uint32_t))/sizeof(UInt160)) return 0;
+    off += sizeof(uint32_t) + internalCount*sizeof(UInt160);
+    if (off + sizeof(uint32_t) > end) return 0;
+    externalCount = UInt32GetLE(&chains[off]);
+    if (externalCount != (end - off - sizeof(uint32_t))/sizeof(UInt160) ||
+        (end - off - sizeof(uint32_t)) % sizeof(UInt160) != 0) return 0;
+    off = 1 + sizeof(UInt160) + sizeof(uint32_t);
+
+    for (size_t i = 0; i < internalCount; i++, off += sizeof(UInt160)) {
+        array_add(wallet->internalChain, UInt160Get(&chains[off]));
+    }
+
+    off += sizeof(uint32_t);
+
+    for (size_t i = 0; i < externalCount; i++, off += sizeof(UInt160)) {
+        array_add(wallet->externalChain, UInt160Get(&chains[off]));
+    }
+
+    return 1;
+}
+
+// writes a snapshot of the wallet state derived from its transactions - transaction order, balances and UTXOs - to
+// buf, for BRWalletNewWithSnapshot()
+// returns number of bytes written to buf, or total bufLen needed if buf is NULL or bufLen is too small
+size_t BRWalletSnapshot(BRWallet *wallet, uint8_t *buf, size_t bufLen)
+{
+    size_t i, off = 0, len;
+
+    assert(wallet != NULL);
+    pthread_mutex_lock(&wallet->lock);
+    len = WALLET_SNAPSHOT_HEADER_SIZE + array_count(wallet->transactions)*WALLET_SNAPSHOT_TX_SIZE +
+          sizeof(uint32_t) + BRSetCount(wallet->utxos)*WALLET_SNAPSHOT_UTXO_SIZE + sizeof(UInt256);
+
+    if (buf && len <= bufLen) {
+        buf[off] = WALLET_SNAPSHOT_VERSION;
+        off += 1;
+        UInt160Set(&buf[off], _BRWalletMPKDigest(wallet->masterPubKey));
+        off += sizeof(UInt160);
+        UInt32SetLE(&buf[off], (uint32_t)array_count(wallet->internalChain)); // the chains the balances are for
+        off += sizeof(uint32_t);
+        UInt32SetLE(&buf[off], (uint32_t)array_count(wallet->externalChain));
+        off += sizeof(uint32_t);
+        UInt64SetLE(&buf[off], wallet->balance);
+        off += sizeof(uint64_t);
+        UInt64SetLE(&buf[off], wallet->totalSent);
+        off += sizeof(uint64_t);
+        UInt64SetLE(&buf[off], wallet->totalReceived);
+        off += sizeof(uint64_t);
+        UInt32SetLE(&buf[off], (uint32_t)array_count(wallet->transactions));
+        off += sizeof(uint32_t);
+        assert(off == WALLET_SNAPSHOT_HEADER_SIZE);
+
+        for (i = 0; i < array_count(wallet->transactions); i++) {
+            UInt256Set(&buf[off], wallet->transactions[i]->txHash);
+            UInt32SetLE(&buf[off + sizeof(UInt256)], wallet->transactions[i]->blockHeight);
+            UInt64SetLE(&buf[off + sizeof(UInt256) + sizeof(uint32_t)], wallet->balanceHist[i]);
+            off += WALLET_SNAPSHOT_TX_SIZE;
         }
 
-        // add outputs to UTXO set
-        // TODO: don't add outputs below TX_MIN_OUTPUT_AMOUNT
-        // TODO: don't add coin generation outputs < 100 blocks deep
-        // NOTE: balance/UTXOs will then need to be recalculated when last block changes
-        for (j = 0; j < tx->outCount; j++) {
-            pkh = BRScriptPKH(tx->outputs[j].script, tx->outputs[j].scriptLen);
+        UInt32SetLE(&buf[off], (uint32_t)BRSetCount(wallet->utxos));
+        off += sizeof(uint32_t);
 
-            if (pkh && BRSetContains(wallet->allPKH, pkh)) {
-                BRSetAdd(wallet->usedPKH, (void *)pkh);
-                array_add(wallet->utxos, ((const BRUTXO) { tx->txHash, (uint32_t)j }));
-                balance += tx->outputs[j].amount;
-            }
+        for (BRWalletUTXO *utxo = wallet->oldestUTXO; utxo; utxo = utxo->next) {
+            UInt256Set(&buf[off], utxo->o.hash);
+            UInt32SetLE(&buf[off + sizeof(UInt256)], utxo->o.n);
+            off += WALLET_SNAPSHOT_UTXO_SIZE;
         }
 
-        // transaction ordering is not guaranteed, so check the entire UTXO set against the entire spent output set
-        for (j = array_count(wallet->utxos); j > 0; j--) {
-            if (! BRSetContains(wallet->spentOutputs, &wallet->utxos[j - 1])) continue;
-            t = BRSetGet(wallet->allTx, &wallet->utxos[j - 1].hash);
-            balance -= t->outputs[wallet->utxos[j - 1].n].amount;
-            array_rm(wallet->utxos, j - 1);
+        BRSHA256(&buf[off], buf, off); // checksum
+        off += sizeof(UInt256);
+        assert(off == len);
+    }
+
+    pthread_mutex_unlock(&wallet->lock);
+    return len;
+}
+
+// checks that a snapshot is valid for mpk and that its transactions are exactly those in wallet->allTx
+// returns true if so
+static int _BRWalletCheckSnapshot(BRWallet *wallet, const uint8_t *snapshot, size_t snapshotLen)
+{
+    size_t i, off, count;
+    BRSet *seen;
+    BRTransaction *tx;
+    UInt256 txHash;
+
+    if (_BRWalletCheckHeader(snapshot, snapshotLen, WALLET_SNAPSHOT_VERSION, wallet->masterPubKey) == 0) return 0;
+    if (snapshotLen < WALLET_SNAPSHOT_HEADER_SIZE + sizeof(uint32_t) + sizeof(UInt256)) return 0;
+    count = UInt32GetLE(&snapshot[WALLET_SNAPSHOT_HEADER_SIZE - sizeof(uint32_t)]);
+    off = WALLET_SNAPSHOT_HEADER_SIZE;
+
+    if (count != BRSetCount(wallet->allTx) ||
+        count > (snapshotLen - off - sizeof(uint32_t) - sizeof(UInt256))/WALLET_SNAPSHOT_TX_SIZE) return 0;
+    seen = BRSetNew(BRTransactionHash, BRTransactionEq, count);
+
+    for (i = 0; i < count; i++, off += WALLET_SNAPSHOT_TX_SIZE) {
+        txHash = UInt256Get(&snapshot[off]);
+        tx = BRSetGet(wallet->allTx, &txHash);
+        if (! tx || tx->blockHeight != UInt32GetLE(&snapshot[off + sizeof(UInt256)]) || BRSetContains(seen, tx)) break;
+        BRSetAdd(seen, tx);
+    }
+
+    BRSetFree(seen);
+    return (i == count);
+}
+
+// sorts the transactions of a snapshot checked by _BRWalletCheckSnapshot(), adding them in snapshot order
+// returns true if they sort in snapshot order, as they do unless the snapshot was written by an older sort
+static int _BRWalletRestoreTxOrder(BRWallet *wallet, const uint8_t *snapshot)
+{
+    size_t i, count = UInt32GetLE(&snapshot[WALLET_SNAPSHOT_HEADER_SIZE - sizeof(uint32_t)]),
+           off = WALLET_SNAPSHOT_HEADER_SIZE;
+    UInt256 txHash;
+
+    for (i = 0; i < count; i++, off += WALLET_SNAPSHOT_TX_SIZE) {
+        txHash = UInt256Get(&snapshot[off]);
+        _BRWalletInsertTx(wallet, BRSetGet(wallet->allTx, &txHash));
+    }
+
+    for (i = 0, off = WALLET_SNAPSHOT_HEADER_SIZE; i < count; i++, off += WALLET_SNAPSHOT_TX_SIZE) {
+        if (! UInt256Eq(wallet->transactions[i]->txHash, UInt256Get(&snapshot[off]))) break;
+    }
+
+    return (i == count);
+}
+
+// restores the balances and UTXOs of a snapshot checked by _BRWalletCheckSnapshot(), if its transaction order was
+// returns true on success
+static int _BRWalletRestoreBalances(BRWallet *wallet, const uint8_t *snapshot, size_t snapshotLen)
+{
+    size_t i, j, count, utxoCount, off = 1 + sizeof(UInt160), end = snapshotLen - sizeof(UInt256);
+    BRTransaction *tx;
+    const uint8_t *pkh;
+    BRUTXO utxo;
+
+    // the balances are for the address chains of the snapshot
+    if (UInt32GetLE(&snapshot[off]) != array_count(wallet->internalChain) ||
+        UInt32GetLE(&snapshot[off + sizeof(uint32_t)]) != array_count(wallet->externalChain)) return 0;
+
+    // whether an unconfirmed tx is pending depends on the current time and block height
+    for (i = 0; i < array_count(wallet->transactions); i++) {
+        if (wallet->transactions[i]->blockHeight == TX_UNCONFIRMED) return 0;
+    }
+
+    off += 2*sizeof(uint32_t);
+    wallet->balance = UInt64GetLE(&snapshot[off]);
+    wallet->totalSent = UInt64GetLE(&snapshot[off + sizeof(uint64_t)]);
+    wallet->totalReceived = UInt64GetLE(&snapshot[off + 2*sizeof(uint64_t)]);
+    count = UInt32GetLE(&snapshot[WALLET_SNAPSHOT_HEADER_SIZE - sizeof(uint32_t)]);
+    off = WALLET_SNAPSHOT_HEADER_SIZE;
+
+    for (i = 0; i < count; i++, off += WALLET_SNAPSHOT_TX_SIZE) {
+        array_add(wallet->balanceHist, UInt64GetLE(&snapshot[off + sizeof(UInt256) + sizeof(uint32_t)]));
+    }
+
+    utxoCount = UInt32GetLE(&snapshot[off]);
+    off += sizeof(uint32_t);
+    if (utxoCount != (end - off)/WALLET_SNAPSHOT_UTXO_SIZE || (end - off) % WALLET_SNAPSHOT_UTXO_SIZE != 0) return 0;
+
+    for (i = 0; i < utxoCount; i++, off += WALLET_SNAPSHOT_UTXO_SIZE) {
+        utxo = (BRUTXO) { UInt256Get(&snapshot[off]), UInt32GetLE(&snapshot[off + sizeof(UInt256)]) };
+        tx = BRSetGet(wallet->allTx, &utxo.hash);
+        if (! tx || utxo.n >= tx->outCount || BRSetContains(wallet->utxos, &utxo)) return 0;
+        _BRWalletAddUTXO(wallet, utxo.hash, utxo.n, tx->outputs[utxo.n].amount);
+    }
+
+    // with every transaction confirmed, none are invalid or pending
+    for (i = 0; i < count; i++) {
+        tx = wallet->transactions[i];
+
+        for (j = 0; j < tx->inCount; j++) {
+            BRSetAdd(wallet->spentOutputs, &tx->inputs[j]);
+        }
+
+        for (j = 0; j < tx->outCount; j++) {
+            pkh = BRScriptPKH(tx->outputs[j].script, tx->outputs[j].scriptLen);
+            if (pkh && BRSetContains(wallet->allPKH, pkh)) BRSetAdd(wallet->usedPKH, (void *)pkh);
+            else if (pkh) BRSetAdd(wallet->otherPKH, (void *)pkh);
         }
-        
-        if (prevBalance < balance) wallet->totalReceived += balance - prevBalance;
-        if (balance < prevBalance) wallet->totalSent += prevBalance - balance;
-        array_add(wallet->balanceHist, balance);
-        prevBalance = balance;
     }
 
-    assert(array_count(wallet->balanceHist) == array_count(wallet->transactions));
-    wallet->balance = balance;
+    return 1;
 }
 
 // allocates and populates a BRWallet struct which must be freed by calling BRWalletFree()
 BRWallet *BRWalletNew(BRAddressParams addrParams, BRTransaction *transactions[], size_t txCount, BRMasterPubKey mpk)
+{
+    return BRWalletNewWithSnapshot(addrParams, transactions, txCount, mpk, NULL, 0, NULL, 0);
+}
+
+// allocates and populates a BRWallet struct, as BRWalletNew() does, restoring its address chains from chains, written
+// by BRWalletAddressChains(), and its derived state from snapshot, written by BRWalletSnapshot(), which avoids
+// re-deriving addresses and recomputing balances; chains or a snapshot that are invalid for mpk, and a snapshot of
+// other transactions, are ignored
+BRWallet *BRWalletNewWithSnapshot(BRAddressParams addrParams, BRTransaction *transactions[], size_t txCount,
+                                  BRMasterPubKey mpk, const uint8_t *chains, size_t chainsLen,
+                                  const uint8_t *snapshot, size_t snapshotLen)
 {
     BRWallet *wallet = NULL;
     BRTransaction *tx;
     const uint8_t *pkh;
+    int hasSnapshot;
 
     assert(transactions != NULL || txCount == 0);
     wallet = calloc(1, sizeof(*wallet));
     assert(wallet != NULL);
-    array_new(wallet->utxos, 100);
+    wallet->utxos = BRSetNew(BRUTXOHash, BRUTXOEq, txCount + 100);
+    array_new(wallet->utxosByAmount, 0);
+    array_new(wallet->pendingSpent, 10);
     array_new(wallet->transactions, txCount + 100);
+    wallet->txKeys = BRSetNew(BRTransactionHash, BRTransactionEq, txCount + 100);
+    wallet->txStates = BRSetNew(BRTransactionHash, BRTransactionEq, txCount + 100);
     wallet->feePerKb = DEFAULT_FEE_PER_KB;
     wallet->masterPubKey = mpk;
+    wallet->chainPubKeys[SEQUENCE_EXTERNAL_CHAIN] = BRBIP32ChainPubKey(mpk, SEQUENCE_EXTERNAL_CHAIN);
+    wallet->chainPubKeys[SEQUENCE_INTERNAL_CHAIN] = BRBIP32ChainPubKey(mpk, SEQUENCE_INTERNAL_CHAIN);
     wallet->addrParams = addrParams;
     array_new(wallet->internalChain, 100);
     array_new(wallet->externalChain, 100);
@@ -281,24 +1116,49 @@ BRWallet *BRWalletNew(BRAddressParams addrParams, BRTransaction *transactions[],
     wallet->spentOutputs = BRSetNew(BRUTXOHash, BRUTXOEq, txCount + 100);
     wallet->usedPKH = BRSetNew(_pkhHash, _pkhEq, txCount + 100);
     wallet->allPKH = BRSetNew(_pkhHash, _pkhEq, txCount + 100);
+    wallet->otherPKH = BRSetNew(_pkhHash, _pkhEq, txCount + 100);
     pthread_mutex_init(&wallet->lock, NULL);
+    pthread_mutex_init(&wallet->viewLock, NULL);
 
     for (size_t i = 0; transactions && i < txCount; i++) {
         tx = transactions[i];
         if (! BRTransactionIsSigned(tx) || BRSetContains(wallet->allTx, tx)) continue;
         BRSetAdd(wallet->allTx, tx);
-        _BRWalletInsertTx(wallet, tx);
+        _BRWalletTxStateAdd(wallet, tx);
 
         for (size_t j = 0; j < tx->outCount; j++) {
             pkh = BRScriptPKH(tx->outputs[j].script, tx->outputs[j].scriptLen);
             if (pkh) BRSetAdd(wallet->usedPKH, (void *)pkh);
         }
     }
-    
+
+    hasSnapshot = _BRWalletCheckSnapshot(wallet, snapshot, snapshotLen);
+
+    if (hasSnapshot) hasSnapshot = _BRWalletRestoreTxOrder(wallet, snapshot);
+    else { // sort the transactions before generating any addresses, as BRWalletNew() always has
+        for (size_t i = 0; transactions && i < txCount; i++) {
+            tx = transactions[i];
+            if (BRSetGet(wallet->allTx, tx) == tx) _BRWalletInsertTx(wallet, tx);
+        }
+    }
+
+    if (_BRWalletRestoreChains(wallet, chains, chainsLen)) {
+        for (size_t i = 0; i < array_count(wallet->internalChain); i++) {
+            BRSetAdd(wallet->allPKH, &wallet->internalChain[i]);
+        }
+
+        for (size_t i = 0; i < array_count(wallet->externalChain); i++) {
+            BRSetAdd(wallet->allPKH, &wallet->externalChain[i]);
+        }
+    }
+
+    // only addresses past the end of restored chains are derived
     BRWalletUnusedAddrs(wallet, NULL, SEQUENCE_GAP_LIMIT_EXTERNAL_EXTENDED, SEQUENCE_EXTERNAL_CHAIN);
     BRWalletUnusedAddrs(wallet, NULL, SEQUENCE_GAP_LIMIT_INTERNAL_EXTENDED, SEQUENCE_INTERNAL_CHAIN);
 
-    _BRWalletUpdateBalance(wallet);
+    BRSetClear(wallet->usedPKH);
+    if (! hasSnapshot || ! _BRWalletRestoreBalances(wallet, snapshot, snapshotLen)) _BRWalletUpdateBalance(wallet);
+    _BRWalletPublishView(wallet);
 
     if (txCount > 0 && ! _BRWalletContainsTx(wallet, transactions[0])) { // verify transactions match master pubKey
         BRWalletFree(wallet);
@@ -341,6 +1201,7 @@ size_t BRWalletUnusedAddrs(BRWallet *wallet, BRAddress addrs[], uint32_t gapLimi
 {
     UInt160 *chain = NULL, *origChain;
     size_t i, j = 0, count, startCount;
+    int needsUpdate = 0;
 
     assert(wallet != NULL);
     assert(gapLimit > 0);
@@ -354,15 +1215,23 @@ size_t BRWalletUnusedAddrs(BRWallet *wallet, BRAddress addrs[], uint32_t gapLimi
     // keep only the trailing contiguous block of addresses with no transactions
     while (i > 0 && ! BRSetContains(wallet->usedPKH, &chain[i - 1])) i--;
     
-    while (i + gapLimit > count) { // generate new addresses up to gapLimit
+    while (i + gapLimit > count) { // generate new addresses up to gapLimit, deriving each batch in parallel
         BRKey key;
-        uint8_t pubKey[BRBIP32PubKey(NULL, 0, wallet->masterPubKey, internal, count)];
-        size_t len = BRBIP32PubKey(pubKey, sizeof(pubKey), wallet->masterPubKey, internal, (uint32_t)count);
-        
-        if (! BRKeySetPubKey(&key, pubKey, len)) break;
-        array_add(chain, BRKeyHash160(&key));
-        count++;
-        if (BRSetContains(wallet->usedPKH, &chain[array_count(chain) - 1])) i = count;
+        size_t k, n = i + gapLimit - count;
+        BRECPoint pubKeys[n];
+
+        BRBIP32ChainPubKeyList(pubKeys, n, wallet->chainPubKeys[internal], (uint32_t)count, WALLET_ADDRESS_THREADS);
+
+        for (k = 0; k < n && BRKeySetPubKey(&key, pubKeys[k].p, sizeof(pubKeys[k])); k++) {
+            array_add(chain, BRKeyHash160(&key));
+            count++;
+            if (BRSetContains(wallet->usedPKH, &chain[array_count(chain) - 1])) i = count;
+
+            // an existing tx paying to the new address changes the balance, which was applied without it
+            if (BRSetContains(wallet->otherPKH, &chain[array_count(chain) - 1])) i = count, needsUpdate = 1;
+        }
+
+        if (k < n) break;
     }
 
     if (addrs && i + gapLimit <= count) {
@@ -392,6 +1261,8 @@ size_t BRWalletUnusedAddrs(BRWallet *wallet, BRAddress addrs[], uint32_t gapLimi
         }
     }
 
+    if (needsUpdate) _BRWalletUpdateBalance(wallet);
+    if (count > startCount) _BRWalletPublishView(wallet);
     pthread_mutex_unlock(&wallet->lock);
     return j;
 }
@@ -399,24 +1270,38 @@ size_t BRWalletUnusedAddrs(BRWallet *wallet, BRAddress addrs[], uint32_t gapLimi
 // current wallet balance, not including transactions known to be invalid
 uint64_t BRWalletBalance(BRWallet *wallet)
 {
+    BRWalletView *view;
     uint64_t balance;
 
     assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
-    balance = wallet->balance;
-    pthread_mutex_unlock(&wallet->lock);
+    view = BRWalletCurrentView(wallet);
+    balance = view->balance;
+    BRWalletViewRelease(view);
     return balance;
 }
 
 // writes unspent outputs to utxos and returns the number of outputs written, or total number available if utxos is NULL
 size_t BRWalletUTXOs(BRWallet *wallet, BRUTXO *utxos, size_t utxosCount)
+{
+    BRWalletView *view;
+
+    assert(wallet != NULL);
+    view = BRWalletCurrentView(wallet);
+    utxosCount = BRWalletViewUTXOs(view, utxos, utxosCount);
+    BRWalletViewRelease(view);
+    return utxosCount;
+}
+
+// writes unspent outputs to utxos, largest amount first, and returns the number of outputs written, or total number
+// available if utxos is NULL
+size_t BRWalletUTXOsByAmount(BRWallet *wallet, BRUTXO *utxos, size_t utxosCount)
 {
     assert(wallet != NULL);
     pthread_mutex_lock(&wallet->lock);
-    if (! utxos || array_count(wallet->utxos) < utxosCount) utxosCount = array_count(wallet->utxos);
+    if (! utxos || BRSetCount(wallet->utxos) < utxosCount) utxosCount = BRSetCount(wallet->utxos);
 
     for (size_t i = 0; utxos && i < utxosCount; i++) {
-        utxos[i] = wallet->utxos[i];
+        utxos[i] = _BRWalletUTXOsByAmount(wallet)[i]->o;
     }
 
     pthread_mutex_unlock(&wallet->lock);
@@ -427,80 +1312,187 @@ size_t BRWalletUTXOs(BRWallet *wallet, BRUTXO *utxos, size_t utxosCount)
 // returns the number of transactions written, or total number available if transactions is NULL
 size_t BRWalletTransactions(BRWallet *wallet, BRTransaction *transactions[], size_t txCount)
 {
+    BRWalletView *view;
+
+    assert(wallet != NULL);
+    view = BRWalletCurrentView(wallet);
+    txCount = BRWalletViewTransactions(view, transactions, txCount);
+    BRWalletViewRelease(view);
+    return txCount;
+}
+
+// writes transactions registered in the wallet, and that were unconfirmed before blockHeight, to the transactions array
+// returns the number of transactions written, or total number available if transactions is NULL
+size_t BRWalletTxUnconfirmedBefore(BRWallet *wallet, BRTransaction *transactions[], size_t txCount,
+                                   uint32_t blockHeight)
+{
+    size_t total, n = 0;
+
     assert(wallet != NULL);
     pthread_mutex_lock(&wallet->lock);
-    if (! transactions || array_count(wallet->transactions) < txCount) txCount = array_count(wallet->transactions);
+    total = array_count(wallet->transactions);
+    while (n < total && wallet->transactions[(total - n) - 1]->blockHeight >= blockHeight) n++;
+    if (! transactions || n < txCount) txCount = n;
 
     for (size_t i = 0; transactions && i < txCount; i++) {
-        transactions[i] = wallet->transactions[i];
+        transactions[i] = wallet->transactions[(total - n) + i];
     }
-    
+
     pthread_mutex_unlock(&wallet->lock);
     return txCount;
 }
 
-// writes transactions registered in the wallet, and that were unconfirmed before blockHeight, to the transactions array
+// total amount spent from the wallet (exluding change)
+uint64_t BRWalletTotalSent(BRWallet *wallet)
+{
+    BRWalletView *view;
+    uint64_t totalSent;
+    
+    assert(wallet != NULL);
+    view = BRWalletCurrentView(wallet);
+    totalSent = view->totalSent;
+    BRWalletViewRelease(view);
+    return totalSent;
+}
+
+// total amount received by the wallet (exluding change)
+uint64_t BRWalletTotalReceived(BRWallet *wallet)
+{
+    BRWalletView *view;
+    uint64_t totalReceived;
+    
+    assert(wallet != NULL);
+    view = BRWalletCurrentView(wallet);
+    totalReceived = view->totalReceived;
+    BRWalletViewRelease(view);
+    return totalReceived;
+}
+
+// returns the most recently published view of the wallet, without taking the wallet lock
+BRWalletView *BRWalletCurrentView(BRWallet *wallet)
+{
+    BRWalletView *view;
+
+    assert(wallet != NULL);
+    pthread_mutex_lock(&wallet->viewLock);
+    view = wallet->view;
+    atomic_fetch_add(&view->refCount, 1);
+    pthread_mutex_unlock(&wallet->viewLock);
+    return view;
+}
+
+// releases a view returned by BRWalletCurrentView()
+void BRWalletViewRelease(BRWalletView *view)
+{
+    assert(view != NULL);
+    if (atomic_fetch_sub(&view->refCount, 1) > 1) return;
+    _BRWalletViewItemsRelease(view->txItems);
+    _BRWalletViewItemsRelease(view->utxoItems);
+    _BRWalletViewItemsRelease(view->internalItems);
+    _BRWalletViewItemsRelease(view->externalItems);
+    free(view);
+}
+
+// wallet balance as of view
+uint64_t BRWalletViewBalance(const BRWalletView *view)
+{
+    assert(view != NULL);
+    return view->balance;
+}
+
+// total amount spent from the wallet as of view (exluding change)
+uint64_t BRWalletViewTotalSent(const BRWalletView *view)
+{
+    assert(view != NULL);
+    return view->totalSent;
+}
+
+// total amount received by the wallet as of view (exluding change)
+uint64_t BRWalletViewTotalReceived(const BRWalletView *view)
+{
+    assert(view != NULL);
+    return view->totalReceived;
+}
+
+// writes unspent outputs as of view to utxos and returns the number of outputs written, or total number available if
+// utxos is NULL
+size_t BRWalletViewUTXOs(const BRWalletView *view, BRUTXO utxos[], size_t utxosCount)
+{
+    assert(view != NULL);
+    if (! utxos || view->utxoCount < utxosCount) utxosCount = view->utxoCount;
+    if (utxos) memcpy(utxos, view->utxos, utxosCount*sizeof(*utxos));
+    return utxosCount;
+}
+
+// writes transactions as of view, sorted by date, oldest first, to the given transactions array
 // returns the number of transactions written, or total number available if transactions is NULL
-size_t BRWalletTxUnconfirmedBefore(BRWallet *wallet, BRTransaction *transactions[], size_t txCount,
-                                   uint32_t blockHeight)
+size_t BRWalletViewTransactions(const BRWalletView *view, BRTransaction *transactions[], size_t txCount)
 {
-    size_t total, n = 0;
+    assert(view != NULL);
+    if (! transactions || view->txCount < txCount) txCount = view->txCount;
+    if (transactions) memcpy(transactions, view->transactions, txCount*sizeof(*transactions));
+    return txCount;
+}
 
-    assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
-    total = array_count(wallet->transactions);
-    while (n < total && wallet->transactions[(total - n) - 1]->blockHeight >= blockHeight) n++;
-    if (! transactions || n < txCount) txCount = n;
+// writes all addresses generated as of view to addrs
+// returns the number addresses written, or total number available if addrs is NULL
+size_t BRWalletViewAllAddrs(const BRWalletView *view, BRAddress addrs[], size_t addrsCount)
+{
+    size_t i, internalCount = 0, externalCount = 0;
 
-    for (size_t i = 0; transactions && i < txCount; i++) {
-        transactions[i] = wallet->transactions[(total - n) + i];
+    assert(view != NULL);
+    internalCount = (! addrs || view->internalCount < addrsCount) ? view->internalCount : addrsCount;
+
+    for (i = 0; addrs && i < internalCount; i++) {
+        BRAddressFromHash160(addrs[i].s, sizeof(*addrs), view->addrParams, &view->internalChain[i]);
     }
 
-    pthread_mutex_unlock(&wallet->lock);
-    return txCount;
+    externalCount = (! addrs || view->externalCount < addrsCount - internalCount) ?
+                    view->externalCount : addrsCount - internalCount;
+
+    for (i = 0; addrs && i < externalCount; i++) {
+        BRAddressFromHash160(addrs[internalCount + i].s, sizeof(*addrs), view->addrParams, &view->externalChain[i]);
+    }
+
+    return internalCount + externalCount;
 }
 
-// total amount spent from the wallet (exluding change)
-uint64_t BRWalletTotalSent(BRWallet *wallet)
+// fee-per-kb of transaction size to use when creating a transaction
+uint64_t BRWalletFeePerKb(BRWallet *wallet)
 {
-    uint64_t totalSent;
+    uint64_t feePerKb;
     
     assert(wallet != NULL);
     pthread_mutex_lock(&wallet->lock);
-    totalSent = wallet->totalSent;
+    feePerKb = wallet->feePerKb;
     pthread_mutex_unlock(&wallet->lock);
-    return totalSent;
+    return feePerKb;
 }
 
-// total amount received by the wallet (exluding change)
-uint64_t BRWalletTotalReceived(BRWallet *wallet)
+void BRWalletSetFeePerKb(BRWallet *wallet, uint64_t feePerKb)
 {
-    uint64_t totalReceived;
-    
     assert(wallet != NULL);
     pthread_mutex_lock(&wallet->lock);
-    totalReceived = wallet->totalReceived;
+    wallet->feePerKb = feePerKb;
     pthread_mutex_unlock(&wallet->lock);
-    return totalReceived;
 }
 
-// fee-per-kb of transaction size to use when creating a transaction
-uint64_t BRWalletFeePerKb(BRWallet *wallet)
+BRWalletCoinSelection BRWalletGetCoinSelection(BRWallet *wallet)
 {
-    uint64_t feePerKb;
-    
+    BRWalletCoinSelection coinSelection;
+
     assert(wallet != NULL);
     pthread_mutex_lock(&wallet->lock);
-    feePerKb = wallet->feePerKb;
+    coinSelection = wallet->coinSelection;
     pthread_mutex_unlock(&wallet->lock);
-    return feePerKb;
+    return coinSelection;
 }
 
-void BRWalletSetFeePerKb(BRWallet *wallet, uint64_t feePerKb)
+void BRWalletSetCoinSelection(BRWallet *wallet, BRWalletCoinSelection coinSelection)
 {
     assert(wallet != NULL);
     pthread_mutex_lock(&wallet->lock);
-    wallet->feePerKb = feePerKb;
+    wallet->coinSelection = coinSelection;
     pthread_mutex_unlock(&wallet->lock);
 }
 
@@ -548,26 +1540,13 @@ BRAddress BRWalletAddressToLegacy (BRWallet *wallet, BRAddress *addrPtr) {
 // returns the number addresses written, or total number available if addrs is NULL
 size_t BRWalletAllAddrs(BRWallet *wallet, BRAddress addrs[], size_t addrsCount)
 {
-    size_t i, internalCount = 0, externalCount = 0;
-    
-    assert(wallet != NULL);
-    pthread_mutex_lock(&wallet->lock);
-    internalCount = (! addrs || array_count(wallet->internalChain) < addrsCount) ?
-                    array_count(wallet->internalChain) : addrsCount;
-
-    for (i = 0; addrs && i < internalCount; i++) {
-        BRAddressFromHash160(addrs[i].s, sizeof(*addrs), wallet->addrParams, &wallet->internalChain[i]);
-    }
-
-    externalCount = (! addrs || array_count(wallet->externalChain) < addrsCount - internalCount) ?
-                    array_count(wallet->externalChain) : addrsCount - internalCount;
-
-    for (i = 0; addrs && i < externalCount; i++) {
-        BRAddressFromHash160(addrs[internalCount + i].s, sizeof(*addrs), wallet->addrParams, &wallet->externalChain[i]);
-    }
+    BRWalletView *view;
 
-    pthread_mutex_unlock(&wallet->lock);
-    return internalCount + externalCount;
+    assert(wallet != NULL);
+    view = BRWalletCurrentView(wallet);
+    addrsCount = BRWalletViewAllAddrs(view, addrs, addrsCount);
+    BRWalletViewRelease(view);
+    return addrsCount;
 }
 
 // true if the address was previously generated by BRWalletUnusedAddrs() (even if it's now used)
@@ -629,6 +1608,164 @@ BRTransaction *BRWalletCreateTxForOutputs(BRWallet *wallet, const BRTxOutput out
     return BRWalletCreateTxForOutputsWithFeePerKb(wallet, UINT64_MAX, outputs, outCount);
 }
 
+// returns the unspent outputs worth more than the fee to spend them at feePerKb, largest first
+// result must be freed using array_free()
+static BRWalletCoin *_BRWalletCoins(BRWallet *wallet, uint64_t feePerKb)
+{
+    BRWalletUTXO **utxos = _BRWalletUTXOsByAmount(wallet);
+    BRWalletCoin *coins, coin;
+    BRTxOutput *o;
+
+    array_new(coins, array_count(utxos));
+
+    for (size_t i = 0; i < array_count(utxos); i++) {
+        coin = (BRWalletCoin) { utxos[i], BRSetGet(wallet->allTx, &utxos[i]->o), 0, 0 };
+        if (! coin.tx || coin.utxo->o.n >= coin.tx->outCount) continue;
+        o = &coin.tx->outputs[coin.utxo->o.n];
+        _txAddInputSize(&coin.size, &coin.witSize, o->script, o->scriptLen);
+        if (coin.utxo->amount > _txFee(feePerKb, (coin.size*4 + coin.witSize + 3)/4)) array_add(coins, coin);
+    }
+
+    return coins;
+}
+
+// depth-first branch-and-bound search of coins, largest first, for a set that pays amount plus the fee of a
+// transaction with no change output, overpaying the fee by no more than minAmount, where size is the size of the
+// transaction outputs; sets selected and fee for the lowest fee found, and returns the number of coins selected, or 0
+// if there's no such set or the search gave up
+static size_t _BRWalletSelectChangeless(const BRWalletCoin coins[], size_t count, uint64_t amount, size_t size,
+                                        size_t outCount, uint64_t feePerKb, uint64_t minAmount, uint8_t selected[],
+                                        uint64_t *fee)
+{
+    uint8_t *included = calloc(count + 1, sizeof(*included));
+    size_t depth = 0, n = 0, witSize = 0, vsize, bestCount = 0;
+    uint64_t total = 0, available = 0, need, bestFee = UINT64_MAX;
+    int backtrack;
+
+    assert(included != NULL);
+    for (size_t i = 0; i < count; i++) available += coins[i].utxo->amount;
+
+    for (size_t tries = 0; tries < COIN_SELECTION_MAX_TRIES; tries++) {
+        vsize = _txVSize(size, witSize, n, outCount);
+        need = amount + _txFee(feePerKb, vsize);
+
+        // including more coins only raises the fee
+        backtrack = (total + available < need || need - amount >= bestFee || depth == count || vsize > TX_MAX_SIZE);
+
+        if (total >= need) {
+            if (total - need <= minAmount && total - amount < bestFee && vsize <= TX_MAX_SIZE) {
+                *fee = bestFee = total - amount;
+                bestCount = n;
+                memcpy(selected, included, depth);
+                memset(&selected[depth], 0, count - depth);
+            }
+
+            backtrack = 1;
+        }
+
+        if (backtrack) { // exclude the last coin included, and search on without it
+            while (depth > 0 && ! included[depth - 1]) available += coins[--depth].utxo->amount;
+            if (depth == 0) break;
+            included[depth - 1] = 0;
+            total -= coins[depth - 1].utxo->amount;
+            size -= coins[depth - 1].size;
+            witSize -= coins[depth - 1].witSize;
+            n--;
+        }
+        else if (depth > 0 && ! included[depth - 1] && coins[depth].utxo->amount == coins[depth - 1].utxo->amount &&
+                 coins[depth].size == coins[depth - 1].size && coins[depth].witSize == coins[depth - 1].witSize) {
+            // including a coin just like the one excluded before it would repeat the search already done with that one
+            available -= coins[depth].utxo->amount;
+            included[depth++] = 0;
+        }
+        else {
+            available -= coins[depth].utxo->amount;
+            total += coins[depth].utxo->amount;
+            size += coins[depth].size;
+            witSize += coins[depth].witSize;
+            n++;
+            included[depth++] = 1;
+        }
+    }
+
+    free(included);
+    return bestCount;
+}
+
+// knapsack search of coins, largest first, for the smallest total that pays amount plus the fee of a transaction with
+// a change output, and either leaves at least minAmount for the change or pays exactly, where size is the size of the
+// other transaction outputs; compares the smallest coin that pays alone against random sets of the smaller coins,
+// sets selected and fee for the smallest total found, and returns the number of coins selected, or 0 if none pay
+static size_t _BRWalletSelectKnapsack(const BRWalletCoin coins[], size_t count, uint64_t amount, size_t size,
+                                      size_t outCount, uint64_t feePerKb, uint64_t minAmount, uint8_t selected[],
+                                      uint64_t *fee)
+{
+    uint8_t *included = calloc(count + 1, sizeof(*included));
+    size_t i, start, n, txSize, witSize, vsize, bestCount = 0;
+    uint64_t total, need, best = UINT64_MAX;
+    uint32_t bits = 0;
+    int exact = 0, reached;
+
+    assert(included != NULL);
+    size += TX_OUTPUT_SIZE; // change output, as estimated for oldest first selection
+    memset(selected, 0, count);
+
+    for (start = count; start > 0; start--) { // smallest coin first
+        vsize = _txVSize(size + coins[start - 1].size, coins[start - 1].witSize, 1, outCount);
+        need = amount + _txFee(feePerKb, vsize);
+        total = coins[start - 1].utxo->amount;
+        if (vsize > TX_MAX_SIZE || (total != need && total < need + minAmount)) continue;
+        best = total;
+        exact = (total == need);
+        *fee = need - amount;
+        bestCount = 1;
+        selected[start - 1] = 1;
+        break;
+    }
+
+    for (size_t pass = 0; pass < COIN_SELECTION_PASSES && pass*(count - start) < COIN_SELECTION_MAX_STEPS &&
+         ! exact && start < count; pass++) {
+        memset(included, 0, count);
+        total = n = witSize = 0;
+        txSize = size;
+        reached = 0;
+
+        for (int round = 0; round < 2 && ! reached; round++) { // random coins, then all the coins left out
+            for (i = start; i < count; i++) {
+                if (round == 0 && (i - start) % 31 == 0) bits = BRRand(0); // 31 random bits at a time
+                if ((round == 0) ? ((bits >> ((i - start) % 31)) & 1) == 0 : included[i]) continue;
+                included[i] = 1;
+                total += coins[i].utxo->amount;
+                txSize += coins[i].size;
+                witSize += coins[i].witSize;
+                n++;
+                vsize = _txVSize(txSize, witSize, n, outCount);
+                need = amount + _txFee(feePerKb, vsize);
+                if (vsize > TX_MAX_SIZE || (total != need && total < need + minAmount)) continue;
+                reached = 1;
+
+                if (total < best) {
+                    best = total;
+                    exact = (total == need);
+                    *fee = need - amount;
+                    bestCount = n;
+                    memcpy(selected, included, count);
+                }
+
+                // search on without this coin for a smaller total
+                included[i] = 0;
+                total -= coins[i].utxo->amount;
+                txSize -= coins[i].size;
+                witSize -= coins[i].witSize;
+                n--;
+            }
+        }
+    }
+
+    free(included);
+    return bestCount;
+}
+
 // returns an unsigned transaction that satisifes the given transaction outputs
 // result must be freed using BRTransactionFree()
 // use feePerKb UINT64_MAX to indicate that the wallet feePerKb should be used
@@ -636,7 +1773,9 @@ BRTransaction *BRWalletCreateTxForOutputsWithFeePerKb(BRWallet *wallet, uint64_t
 {
     BRTransaction *tx, *transaction = BRTransactionNew();
     uint64_t feeAmount, amount = 0, balance = 0, minAmount;
-    size_t i, j, cpfpSize = 0;
+    size_t i, j, size = 0, witSize = 0, cpfpSize = 0;
+    BRWalletCoin *coins;
+    uint8_t *selected;
     BRUTXO *o;
     BRAddress addr = BR_ADDRESS_NONE;
     
@@ -647,30 +1786,58 @@ BRTransaction *BRWalletCreateTxForOutputsWithFeePerKb(BRWallet *wallet, uint64_t
         assert(outputs[i].script != NULL && outputs[i].scriptLen > 0);
         BRTransactionAddOutput(transaction, outputs[i].amount, outputs[i].script, outputs[i].scriptLen);
         amount += outputs[i].amount;
+        size += sizeof(uint64_t) + BRVarIntSize(outputs[i].scriptLen) + outputs[i].scriptLen;
     }
     
     minAmount = BRWalletMinOutputAmountWithFeePerKb(wallet, feePerKb);
     pthread_mutex_lock(&wallet->lock);
     feePerKb = UINT64_MAX == feePerKb ? wallet->feePerKb : feePerKb;
-    feeAmount = _txFee(feePerKb, BRTransactionVSize(transaction) + TX_OUTPUT_SIZE);
-    
+    feeAmount = _txFee(feePerKb, _txVSize(size, witSize, 0, outCount) + TX_OUTPUT_SIZE);
+
+    if (wallet->coinSelection == BRWalletCoinSelectionBranchAndBound) {
+        coins = _BRWalletCoins(wallet, feePerKb);
+        selected = calloc(array_count(coins) + 1, sizeof(*selected));
+        assert(selected != NULL);
+
+        if (_BRWalletSelectChangeless(coins, array_count(coins), amount, size, outCount, feePerKb, minAmount, selected,
+                                      &feeAmount) > 0 ||
+            _BRWalletSelectKnapsack(coins, array_count(coins), amount, size, outCount, feePerKb, minAmount, selected,
+                                    &feeAmount) > 0) {
+            for (i = 0; i < array_count(coins); i++) {
+                if (! selected[i]) continue;
+                tx = coins[i].tx;
+                o = &coins[i].utxo->o;
+                BRTransactionAddInput(transaction, tx->txHash, o->n, tx->outputs[o->n].amount,
+                                      tx->outputs[o->n].script, tx->outputs[o->n].scriptLen, NULL, 0, NULL, 0,
+                                      TXIN_SEQUENCE);
+                balance += tx->outputs[o->n].amount;
+            }
+        }
+
+        free(selected);
+        array_free(coins);
+    }
+
     // TODO: use up all UTXOs for all used addresses to avoid leaving funds in addresses whose public key is revealed
     // TODO: avoid combining addresses in a single transaction when possible to reduce information leakage
     // TODO: use up UTXOs received from any of the output scripts that this transaction sends funds to, to mitigate an
     //       attacker double spending and requesting a refund
-    for (i = 0; i < array_count(wallet->utxos); i++) {
-        o = &wallet->utxos[i];
+    // oldest first, unless coins were already selected
+    for (BRWalletUTXO *utxo = (transaction->inCount == 0) ? wallet->oldestUTXO : NULL; utxo; utxo = utxo->next) {
+        o = &utxo->o;
         tx = BRSetGet(wallet->allTx, o);
         if (! tx || o->n >= tx->outCount) continue;
         BRTransactionAddInput(transaction, tx->txHash, o->n, tx->outputs[o->n].amount,
                               tx->outputs[o->n].script, tx->outputs[o->n].scriptLen, NULL, 0, NULL, 0, TXIN_SEQUENCE);
-        
-        if (BRTransactionVSize(transaction) + TX_OUTPUT_SIZE > TX_MAX_SIZE) { // transaction size-in-bytes too large
+        _txAddInputSize(&size, &witSize, tx->outputs[o->n].script, tx->outputs[o->n].scriptLen);
+
+        // transaction size-in-bytes too large
+        if (_txVSize(size, witSize, transaction->inCount, outCount) + TX_OUTPUT_SIZE > TX_MAX_SIZE) {
             BRTransactionFree(transaction);
             transaction = NULL;
         
             // check for sufficient total funds before building a smaller transaction
-            if (wallet->balance < amount + _txFee(feePerKb, 10 + array_count(wallet->utxos)*TX_INPUT_SIZE +
+            if (wallet->balance < amount + _txFee(feePerKb, 10 + BRSetCount(wallet->utxos)*TX_INPUT_SIZE +
                                                   (outCount + 1)*TX_OUTPUT_SIZE + cpfpSize)) break;
             pthread_mutex_unlock(&wallet->lock);
 
@@ -699,7 +1866,8 @@ BRTransaction *BRWalletCreateTxForOutputsWithFeePerKb(BRWallet *wallet, uint64_t
 //            ! _BRWalletTxIsSend(wallet, tx)) cpfpSize += BRTransactionVSize(tx);
 
         // fee amount after adding a change output
-        feeAmount = _txFee(feePerKb, BRTransactionVSize(transaction) + TX_OUTPUT_SIZE + cpfpSize);
+        feeAmount = _txFee(feePerKb, _txVSize(size, witSize, transaction->inCount, outCount) + TX_OUTPUT_SIZE +
+                           cpfpSize);
 
         // increase fee to round off remaining wallet balance to nearest 100 satoshi
         if (wallet->balance > amount + feeAmount) feeAmount += (wallet->balance - (amount + feeAmount)) % 100;
@@ -731,8 +1899,8 @@ BRTransaction *BRWalletCreateTxForOutputsWithFeePerKb(BRWallet *wallet, uint64_t
 // returns true if all inputs were signed, or false if there was an error or not all inputs were able to be signed
 int BRWalletSignTransaction(BRWallet *wallet, BRTransaction *tx, uint8_t forkId, const void *seed, size_t seedLen)
 {
-    uint32_t j, internalIdx[tx->inCount], externalIdx[tx->inCount];
-    size_t i, internalCount = 0, externalCount = 0;
+    uint32_t chain, internalIdx[tx->inCount], externalIdx[tx->inCount];
+    size_t i, j, internalCount = 0, externalCount = 0;
     int r = 0;
     
     assert(wallet != NULL);
@@ -741,14 +1909,10 @@ int BRWalletSignTransaction(BRWallet *wallet, BRTransaction *tx, uint8_t forkId,
     
     for (i = 0; tx && i < tx->inCount; i++) {
         const uint8_t *pkh = BRScriptPKH(tx->inputs[i].script, tx->inputs[i].scriptLen);
-        
-        for (j = (uint32_t)array_count(wallet->internalChain); pkh && j > 0; j--) {
-            if (UInt160Eq(UInt160Get(pkh), wallet->internalChain[j - 1])) internalIdx[internalCount++] = j - 1;
-        }
 
-        for (j = (uint32_t)array_count(wallet->externalChain); pkh && j > 0; j--) {
-            if (UInt160Eq(UInt160Get(pkh), wallet->externalChain[j - 1])) externalIdx[externalCount++] = j - 1;
-        }
+        j = (pkh) ? _BRWalletPKHIndex(wallet, pkh, &chain) : (size_t) -1;
+        if (j != (size_t) -1 && chain == SEQUENCE_INTERNAL_CHAIN) internalIdx[internalCount++] = (uint32_t)j;
+        if (j != (size_t) -1 && chain == SEQUENCE_EXTERNAL_CHAIN) externalIdx[externalCount++] = (uint32_t)j;
     }
 
     pthread_mutex_unlock(&wallet->lock);
@@ -781,6 +1945,26 @@ int BRWalletContainsTransaction(BRWallet *wallet, const BRTransaction *tx)
     return r;
 }
 
+// adds tx, which must be associated with the wallet, to wallet->transactions and applies it to the balance, unless
+// needsUpdate is already set, returns true if the balance needs a full _BRWalletUpdateBalance()
+static int _BRWalletAddTx(BRWallet *wallet, BRTransaction *tx, int needsUpdate)
+{
+    BRSetAdd(wallet->allTx, tx);
+    _BRWalletTxStateAdd(wallet, tx);
+    if (_BRWalletInsertTx(wallet, tx) > 0) needsUpdate = 1; // keep balanceHist in transaction order
+
+    // a tx sorted last can be applied on top of the current balance, as long as no pending tx needs its lockTime
+    // rechecked against the current time and block height
+    if (! needsUpdate && wallet->transactions[array_count(wallet->transactions) - 1] == tx &&
+        BRSetCount(wallet->pendingTx) == 0) {
+        _BRWalletApplyTx(wallet, tx, time(NULL));
+        _BRWalletCheckBalance(wallet);
+        return 0;
+    }
+
+    return 1;
+}
+
 // adds a transaction to the wallet, or returns false if it isn't associated with the wallet
 int BRWalletRegisterTransaction(BRWallet *wallet, BRTransaction *tx)
 {
@@ -797,14 +1981,16 @@ int BRWalletRegisterTransaction(BRWallet *wallet, BRTransaction *tx)
                 // TODO: verify signatures when possible
                 // TODO: handle tx replacement with input sequence numbers
                 //       (for now, replacements appear invalid until confirmation)
-                BRSetAdd(wallet->allTx, tx);
-                _BRWalletInsertTx(wallet, tx);
-                _BRWalletUpdateBalance(wallet);
+                if (_BRWalletAddTx(wallet, tx, 0)) _BRWalletUpdateBalance(wallet);
+                _BRWalletPublishView(wallet);
                 wasAdded = 1;
             }
             else { // keep track of unconfirmed non-wallet tx for invalid tx checks and child-pays-for-parent fees
                    // BUG: limit total non-wallet unconfirmed tx to avoid memory exhaustion attack
-                if (tx->blockHeight == TX_UNCONFIRMED) BRSetAdd(wallet->allTx, tx);
+                if (tx->blockHeight == TX_UNCONFIRMED) {
+                    BRSetAdd(wallet->allTx, tx);
+                    _BRWalletTxStateAdd(wallet, tx);
+                }
                 r = 0;
                 // BUG: XXX memory leak if tx is not added to wallet->allTx, and we can't just free it
             }
@@ -825,6 +2011,85 @@ int BRWalletRegisterTransaction(BRWallet *wallet, BRTransaction *tx)
     return r;
 }
 
+// adds transactions to the wallet like BRWalletRegisterTransaction(), but calls balanceChanged once for the whole batch,
+// tx that are only associated with the wallet through addresses generated to replace ones the others used are also
+// added, returns the number of transactions added
+// the balance is recalculated when the batch can't be applied on top of it, at most once for the batch and once before
+// each round of generating replacement addresses
+size_t BRWalletRegisterTransactions(BRWallet *wallet, BRTransaction *transactions[], size_t txCount)
+{
+    BRTransaction *tx, **added = NULL, **others = NULL;
+    size_t i, count;
+    int needsUpdate = 0;
+
+    assert(wallet != NULL);
+    assert(transactions != NULL || txCount == 0);
+    array_new(added, txCount);
+    array_new(others, 0);
+    pthread_mutex_lock(&wallet->lock);
+
+    for (i = 0; transactions && i < txCount; i++) {
+        tx = transactions[i];
+        assert(tx != NULL && BRTransactionIsSigned(tx));
+        if (! tx || ! BRTransactionIsSigned(tx) || BRSetContains(wallet->allTx, tx)) continue;
+
+        if (_BRWalletContainsTx(wallet, tx)) {
+            // TODO: verify signatures when possible
+            needsUpdate = _BRWalletAddTx(wallet, tx, needsUpdate);
+            array_add(added, tx);
+        }
+        else array_add(others, tx);
+    }
+
+    // tx that weren't associated with the wallet may be once addresses are generated to replace the ones used
+    for (count = 0; array_count(added) > count && array_count(others) > 0;) {
+        count = array_count(added);
+        if (needsUpdate) _BRWalletUpdateBalance(wallet); // so usedPKH includes the outputs of tx added so far
+        needsUpdate = 0;
+        pthread_mutex_unlock(&wallet->lock);
+        BRWalletUnusedAddrs(wallet, NULL, SEQUENCE_GAP_LIMIT_EXTERNAL, SEQUENCE_EXTERNAL_CHAIN);
+        BRWalletUnusedAddrs(wallet, NULL, SEQUENCE_GAP_LIMIT_INTERNAL, SEQUENCE_INTERNAL_CHAIN);
+        pthread_mutex_lock(&wallet->lock);
+
+        for (i = array_count(others); i > 0; i--) {
+            tx = others[i - 1];
+
+            if (BRSetContains(wallet->allTx, tx)) array_rm(others, i - 1);
+            else if (_BRWalletContainsTx(wallet, tx)) {
+                needsUpdate = _BRWalletAddTx(wallet, tx, needsUpdate);
+                array_add(added, tx);
+                array_rm(others, i - 1);
+            }
+        }
+    }
+
+    // keep track of unconfirmed non-wallet tx for invalid tx checks and child-pays-for-parent fees
+    for (i = 0; i < array_count(others); i++) {
+        if (others[i]->blockHeight != TX_UNCONFIRMED) continue;
+        BRSetAdd(wallet->allTx, others[i]);
+        _BRWalletTxStateAdd(wallet, others[i]);
+    }
+
+    if (needsUpdate) _BRWalletUpdateBalance(wallet);
+    if (array_count(added) > 0) _BRWalletPublishView(wallet);
+    pthread_mutex_unlock(&wallet->lock);
+    count = array_count(added);
+
+    if (count > 0) {
+        BRWalletUnusedAddrs(wallet, NULL, SEQUENCE_GAP_LIMIT_EXTERNAL, SEQUENCE_EXTERNAL_CHAIN);
+        BRWalletUnusedAddrs(wallet, NULL, SEQUENCE_GAP_LIMIT_INTERNAL, SEQUENCE_INTERNAL_CHAIN);
+        if (wallet->balanceChanged) wallet->balanceChanged(wallet->callbackInfo, wallet->balance);
+
+        for (i = 0; wallet->txAdded && i < count; i++) {
+            wallet->txAdded(wallet->callbackInfo, added[i]);
+        }
+    }
+
+    array_free(others);
+    array_free(added);
+    return count;
+}
+
 // removes a tx from the wallet, along with any tx that depend on its outputs
 void BRWalletRemoveTransaction(BRWallet *wallet, UInt256 txHash)
 {
@@ -862,13 +2127,24 @@ void BRWalletRemoveTransaction(BRWallet *wallet, UInt256 txHash)
             BRWalletRemoveTransaction(wallet, txHash);
         }
         else {
-            for (size_t i = array_count(wallet->transactions); i > 0; i--) {
-                if (! BRTransactionEq(wallet->transactions[i - 1], tx)) continue;
-                array_rm(wallet->transactions, i - 1);
-                break;
+            int needsUpdate = 1;
+            size_t i = _BRWalletTxIndex(wallet, tx);
+
+            if (i != (size_t) -1) {
+                // the last tx can be backed out of the balance directly if it was invalid or pending, and no other
+                // pending tx needs its lockTime rechecked
+                if (i + 1 == array_count(wallet->transactions) &&
+                    BRSetCount(wallet->pendingTx) == (BRSetContains(wallet->pendingTx, tx) ? 1 : 0) &&
+                    _BRWalletUnapplyTx(wallet, tx)) needsUpdate = 0;
+
+                array_rm(wallet->transactions, i);
+                _BRWalletTxsChanged(wallet, i);
+                free(BRSetRemove(wallet->txKeys, tx));
             }
             
-            _BRWalletUpdateBalance(wallet);
+            if (needsUpdate) _BRWalletUpdateBalance(wallet);
+            else _BRWalletCheckBalance(wallet);
+            _BRWalletPublishView(wallet);
             pthread_mutex_unlock(&wallet->lock);
             
             // if this is for a transaction we sent, and it wasn't already known to be invalid, notify user
@@ -918,21 +2194,19 @@ BRTransaction *BRWalletTransactionCopyForHash(BRWallet *wallet, UInt256 txHash)
     return tx;
 }
 
-// true if no previous wallet transaction spends any of the given transaction's inputs, and no inputs are invalid
-int BRWalletTransactionIsValid(BRWallet *wallet, const BRTransaction *tx)
+// returns the memoized BRWalletTransactionIsValid() with wallet->lock held
+static int _BRWalletTxIsValid(BRWallet *wallet, const BRTransaction *tx)
 {
+    BRWalletTxState *state = _BRWalletTxState(wallet, tx);
     BRTransaction *t;
     int r = 1;
 
-    assert(wallet != NULL);
-    assert(tx != NULL && BRTransactionIsSigned(tx));
-    
+    if (state && (state->flags & TX_STATE_VALID_KNOWN)) return (state->flags & TX_STATE_VALID) ? 1 : 0;
+
     // TODO: XXX attempted double spends should cause conflicted tx to remain unverified until they're confirmed
     // TODO: XXX conflicted tx with the same wallet outputs should be presented as the same tx to the user
 
-    if (tx && tx->blockHeight == TX_UNCONFIRMED) { // only unconfirmed transactions can be invalid
-        pthread_mutex_lock(&wallet->lock);
-
+    if (tx->blockHeight == TX_UNCONFIRMED) { // only unconfirmed transactions can be invalid
         if (! BRSetContains(wallet->allTx, tx)) {
             for (size_t i = 0; r && i < tx->inCount; i++) {
                 if (BRSetContains(wallet->spentOutputs, &tx->inputs[i])) r = 0;
@@ -940,73 +2214,127 @@ int BRWalletTransactionIsValid(BRWallet *wallet, const BRTransaction *tx)
         }
         else if (BRSetContains(wallet->invalidTx, tx)) r = 0;
 
-        pthread_mutex_unlock(&wallet->lock);
-
         for (size_t i = 0; r && i < tx->inCount; i++) {
-            t = BRWalletTransactionForHash(wallet, tx->inputs[i].txHash);
-            if (t && ! BRWalletTransactionIsValid(wallet, t)) r = 0;
+            t = BRSetGet(wallet->allTx, &tx->inputs[i].txHash);
+            if (t && ! _BRWalletTxIsValid(wallet, t)) r = 0;
         }
     }
-    
+
+    if (state) state->flags |= TX_STATE_VALID_KNOWN | (r ? TX_STATE_VALID : 0);
     return r;
 }
 
-// true if tx cannot be immediately spent (i.e. if it or an input tx can be replaced-by-fee)
-int BRWalletTransactionIsPending(BRWallet *wallet, const BRTransaction *tx)
+// returns the memoized BRWalletTransactionIsPending() with wallet->lock held, clearing *isFinal if tx is only pending
+// until a lockTime is reached, which isn't memoized since no tx has to change for that
+static int _BRWalletTxIsPending(BRWallet *wallet, const BRTransaction *tx, time_t now, int *isFinal)
 {
+    BRWalletTxState *state = _BRWalletTxState(wallet, tx);
     BRTransaction *t;
-    time_t now = time(NULL);
-    uint32_t blockHeight;
-    int r = 0;
-    
-    assert(wallet != NULL);
-    assert(tx != NULL && BRTransactionIsSigned(tx));
-    pthread_mutex_lock(&wallet->lock);
-    blockHeight = wallet->blockHeight;
-    pthread_mutex_unlock(&wallet->lock);
+    int r = 0, final = 1;
 
-    if (tx && tx->blockHeight == TX_UNCONFIRMED) { // only unconfirmed transactions can be postdated
+    if (state && (state->flags & TX_STATE_PENDING_KNOWN)) return (state->flags & TX_STATE_PENDING) ? 1 : 0;
+
+    if (tx->blockHeight == TX_UNCONFIRMED) { // only unconfirmed transactions can be postdated
         if (BRTransactionVSize(tx) > TX_MAX_SIZE) r = 1; // check transaction size is under TX_MAX_SIZE
-        
+
         for (size_t i = 0; ! r && i < tx->inCount; i++) {
             if (tx->inputs[i].sequence < UINT32_MAX - 1) r = 1; // check for replace-by-fee
-            if (tx->inputs[i].sequence < UINT32_MAX && tx->lockTime < TX_MAX_LOCK_HEIGHT &&
-                tx->lockTime > blockHeight + 1) r = 1; // future lockTime
-            if (tx->inputs[i].sequence < UINT32_MAX && tx->lockTime > now) r = 1; // future lockTime
+            else if (tx->inputs[i].sequence < UINT32_MAX &&
+                     ((tx->lockTime < TX_MAX_LOCK_HEIGHT && tx->lockTime > wallet->blockHeight + 1) ||
+                      tx->lockTime > now)) { // future lockTime
+                r = 1;
+                final = 0;
+            }
         }
-        
+
         for (size_t i = 0; ! r && i < tx->outCount; i++) { // check that no outputs are dust
             if (tx->outputs[i].amount < TX_MIN_OUTPUT_AMOUNT) r = 1;
         }
-        
+
         for (size_t i = 0; ! r && i < tx->inCount; i++) { // check if any inputs are known to be pending
-            t = BRWalletTransactionForHash(wallet, tx->inputs[i].txHash);
-            if (t && BRWalletTransactionIsPending(wallet, t)) r = 1;
+            t = BRSetGet(wallet->allTx, &tx->inputs[i].txHash);
+            if (t && _BRWalletTxIsPending(wallet, t, now, &final)) r = 1;
         }
     }
-    
+
+    if (state && final) state->flags |= TX_STATE_PENDING_KNOWN | (r ? TX_STATE_PENDING : 0);
+    if (! final) *isFinal = 0;
     return r;
 }
 
-// true if tx is considered 0-conf safe (valid and not pending, timestamp is greater than 0, and no unverified inputs)
-int BRWalletTransactionIsVerified(BRWallet *wallet, const BRTransaction *tx)
+// returns the memoized BRWalletTransactionIsVerified() with wallet->lock held, clearing *isFinal as
+// _BRWalletTxIsPending() does
+static int _BRWalletTxIsVerified(BRWallet *wallet, const BRTransaction *tx, time_t now, int *isFinal)
 {
+    BRWalletTxState *state = _BRWalletTxState(wallet, tx);
     BRTransaction *t;
+    int r = 1, final = 1;
+
+    if (state && (state->flags & TX_STATE_VERIFIED_KNOWN)) return (state->flags & TX_STATE_VERIFIED) ? 1 : 0;
+
+    if (tx->blockHeight == TX_UNCONFIRMED) { // only unconfirmed transactions can be unverified
+        if (tx->timestamp == 0 || ! _BRWalletTxIsValid(wallet, tx) ||
+            _BRWalletTxIsPending(wallet, tx, now, &final)) r = 0;
+
+        for (size_t i = 0; r && i < tx->inCount; i++) { // check if any inputs are known to be unverified
+            t = BRSetGet(wallet->allTx, &tx->inputs[i].txHash);
+            if (t && ! _BRWalletTxIsVerified(wallet, t, now, &final)) r = 0;
+        }
+    }
+
+    if (state && final) state->flags |= TX_STATE_VERIFIED_KNOWN | (r ? TX_STATE_VERIFIED : 0);
+    if (! final) *isFinal = 0;
+    return r;
+}
+
+// true if no previous wallet transaction spends any of the given transaction's inputs, and no inputs are invalid
+int BRWalletTransactionIsValid(BRWallet *wallet, const BRTransaction *tx)
+{
     int r = 1;
 
     assert(wallet != NULL);
     assert(tx != NULL && BRTransactionIsSigned(tx));
 
-    if (tx && tx->blockHeight == TX_UNCONFIRMED) { // only unconfirmed transactions can be unverified
-        if (tx->timestamp == 0 || ! BRWalletTransactionIsValid(wallet, tx) ||
-            BRWalletTransactionIsPending(wallet, tx)) r = 0;
-            
-        for (size_t i = 0; r && i < tx->inCount; i++) { // check if any inputs are known to be unverified
-            t = BRWalletTransactionForHash(wallet, tx->inputs[i].txHash);
-            if (t && ! BRWalletTransactionIsVerified(wallet, t)) r = 0;
-        }
+    if (tx) {
+        pthread_mutex_lock(&wallet->lock);
+        r = _BRWalletTxIsValid(wallet, tx);
+        pthread_mutex_unlock(&wallet->lock);
     }
-    
+
+    return r;
+}
+
+// true if tx cannot be immediately spent (i.e. if it or an input tx can be replaced-by-fee)
+int BRWalletTransactionIsPending(BRWallet *wallet, const BRTransaction *tx)
+{
+    int r = 0, isFinal = 1;
+
+    assert(wallet != NULL);
+    assert(tx != NULL && BRTransactionIsSigned(tx));
+
+    if (tx) {
+        pthread_mutex_lock(&wallet->lock);
+        r = _BRWalletTxIsPending(wallet, tx, time(NULL), &isFinal);
+        pthread_mutex_unlock(&wallet->lock);
+    }
+
+    return r;
+}
+
+// true if tx is considered 0-conf safe (valid and not pending, timestamp is greater than 0, and no unverified inputs)
+int BRWalletTransactionIsVerified(BRWallet *wallet, const BRTransaction *tx)
+{
+    int r = 1, isFinal = 1;
+
+    assert(wallet != NULL);
+    assert(tx != NULL && BRTransactionIsSigned(tx));
+
+    if (tx) {
+        pthread_mutex_lock(&wallet->lock);
+        r = _BRWalletTxIsVerified(wallet, tx, time(NULL), &isFinal);
+        pthread_mutex_unlock(&wallet->lock);
+    }
+
     return r;
 }
 
@@ -1075,25 +2403,31 @@ void BRWalletUpdateTransactions(BRWallet *wallet, const UInt256 txHashes[], size
         if (! tx || (tx->blockHeight == blockHeight && tx->timestamp == timestamp)) continue;
         tx->timestamp = timestamp;
         tx->blockHeight = blockHeight;
+        _BRWalletTxStateClear(BRSetGet(wallet->txStates, tx));
         
         if (_BRWalletContainsTx(wallet, tx)) {
-            for (k = array_count(wallet->transactions); k > 0; k--) { // remove and re-insert tx to keep wallet sorted
-                if (! BRTransactionEq(wallet->transactions[k - 1], tx)) continue;
-                array_rm(wallet->transactions, k - 1);
-                _BRWalletInsertTx(wallet, tx);
-                break;
+            k = _BRWalletTxIndex(wallet, tx);
+
+            if (k != (size_t) -1) { // remove and re-insert tx to keep wallet sorted
+                array_rm(wallet->transactions, k);
+                _BRWalletTxsChanged(wallet, k);
+                if (_BRWalletInsertTx(wallet, tx) > 0 || wallet->transactions[k] != tx) {
+                    needsUpdate = 1; // keep balanceHist in transaction order
+                }
             }
             
             hashes[j++] = txHashes[i];
             if (BRSetContains(wallet->pendingTx, tx) || BRSetContains(wallet->invalidTx, tx)) needsUpdate = 1;
         }
         else if (blockHeight != TX_UNCONFIRMED) { // remove and free confirmed non-wallet tx
+            _BRWalletTxStateRemove(wallet, tx);
             BRSetRemove(wallet->allTx, tx);
             BRTransactionFree(tx);
         }
     }
     
     if (needsUpdate) _BRWalletUpdateBalance(wallet);
+    if (j > 0) _BRWalletPublishView(wallet);
     pthread_mutex_unlock(&wallet->lock);
     if (j > 0 && wallet->txUpdated) wallet->txUpdated(wallet->callbackInfo, hashes, j, blockHeight, timestamp);
     if (hashes != hashesBuf) free (hashes);
@@ -1106,6 +2440,8 @@ void BRWalletSetTxUnconfirmedAfter(BRWallet *wallet, uint32_t blockHeight)
     
     assert(wallet != NULL);
     pthread_mutex_lock(&wallet->lock);
+    // lockTimes that were already reached may no longer be at a lower block height
+    if (blockHeight < wallet->blockHeight) BRSetApply(wallet->txStates, NULL, _setApplyResetTxState);
     wallet->blockHeight = blockHeight;
     count = i = array_count(wallet->transactions);
     while (i > 0 && wallet->transactions[i - 1]->blockHeight > blockHeight) i--;
@@ -1114,15 +2450,32 @@ void BRWalletSetTxUnconfirmedAfter(BRWallet *wallet, uint32_t blockHeight)
     UInt256 hashesBuf[4096];
     UInt256 *hashes = (count <= 4096 ? hashesBuf : calloc (count, sizeof (UInt256)));
 
+    BRTransaction *txBuf[4096];
+    BRTransaction **txs = (count <= 4096 ? txBuf : calloc (count, sizeof (BRTransaction *)));
+
     for (j = 0; j < count; j++) {
-        wallet->transactions[i + j]->blockHeight = TX_UNCONFIRMED;
-        hashes[j] = wallet->transactions[i + j]->txHash;
+        txs[j] = wallet->transactions[i + j];
+        txs[j]->blockHeight = TX_UNCONFIRMED;
+        _BRWalletTxStateClear(BRSetGet(wallet->txStates, txs[j]));
+        hashes[j] = txs[j]->txHash;
     }
-    
-    if (count > 0) _BRWalletUpdateBalance(wallet);
+
+    array_set_count(wallet->transactions, i);
+    _BRWalletTxsChanged(wallet, i);
+
+    for (j = 0; j < count; j++) { // re-insert the transactions, now all at the same height, to keep wallet sorted
+        _BRWalletInsertTx(wallet, txs[j]);
+    }
+
+    if (count > 0) {
+        _BRWalletUpdateBalance(wallet);
+        _BRWalletPublishView(wallet);
+    }
+
     pthread_mutex_unlock(&wallet->lock);
     if (count > 0 && wallet->txUpdated) wallet->txUpdated(wallet->callbackInfo, hashes, count, TX_UNCONFIRMED, 0);
     if (hashes != hashesBuf) free (hashes);
+    if (txs != txBuf) free (txs);
 }
 
 // returns the amount received by the wallet from the transaction (total outputs to change and/or receive addresses)
@@ -1201,18 +2554,14 @@ uint64_t BRWalletFeeForTx(BRWallet *wallet, const BRTransaction *tx)
 uint64_t BRWalletBalanceAfterTx(BRWallet *wallet, const BRTransaction *tx)
 {
     uint64_t balance;
+    size_t i;
     
     assert(wallet != NULL);
     assert(tx != NULL && BRTransactionIsSigned(tx));
     pthread_mutex_lock(&wallet->lock);
     balance = wallet->balance;
-    
-    for (size_t i = array_count(wallet->transactions); tx && i > 0; i--) {
-        if (! BRTransactionEq(tx, wallet->transactions[i - 1])) continue;
-        balance = wallet->balanceHist[i - 1];
-        break;
-    }
-
+    i = (tx) ? _BRWalletTxIndex(wallet, tx) : (size_t) -1;
+    if (i != (size_t) -1) balance = wallet->balanceHist[i];
     pthread_mutex_unlock(&wallet->lock);
     return balance;
 }
@@ -1295,14 +2644,14 @@ uint64_t BRWalletMaxOutputAmountWithFeePerKb(BRWallet *wallet, uint64_t feePerKb
     BRTransaction *tx;
     BRUTXO *o;
     uint64_t fee, amount = 0;
-    size_t i, txSize, cpfpSize = 0, inCount = 0;
+    size_t txSize, cpfpSize = 0, inCount = 0;
 
     assert(wallet != NULL);
     pthread_mutex_lock(&wallet->lock);
     feePerKb = UINT64_MAX == feePerKb ? wallet->feePerKb : feePerKb;
 
-    for (i = array_count(wallet->utxos); i > 0; i--) {
-        o = &wallet->utxos[i - 1];
+    for (BRWalletUTXO *utxo = wallet->newestUTXO; utxo; utxo = utxo->prev) {
+        o = &utxo->o;
         tx = BRSetGet(wallet->allTx, &o->hash);
         if (! tx || o->n >= tx->outCount) continue;
         inCount++;
@@ -1326,12 +2675,23 @@ static void _setApplyFreeTx(void *info, void *tx)
     BRTransactionFree(tx);
 }
 
+static void _setApplyFreeTxKey(void *info, void *key)
+{
+    free(key);
+}
+
+static void _setApplyFreeTxState(void *info, void *state)
+{
+    _BRWalletTxStateFree(state);
+}
+
 // frees memory allocated for wallet, and calls BRTransactionFree() for all registered transactions
 void BRWalletFree(BRWallet *wallet)
 {
     assert(wallet != NULL);
     pthread_mutex_lock(&wallet->lock);
     BRSetFree(wallet->allPKH);
+    BRSetFree(wallet->otherPKH);
     BRSetFree(wallet->usedPKH);
     BRSetFree(wallet->invalidTx);
     BRSetFree(wallet->pendingTx);
@@ -1342,8 +2702,21 @@ void BRWalletFree(BRWallet *wallet)
     array_free(wallet->externalChain);
     array_free(wallet->balanceHist);
     array_free(wallet->transactions);
-    array_free(wallet->utxos);
+    BRSetApply(wallet->txKeys, NULL, _setApplyFreeTxKey);
+    BRSetFree(wallet->txKeys);
+    BRSetApply(wallet->txStates, NULL, _setApplyFreeTxState);
+    BRSetFree(wallet->txStates);
+    array_free(wallet->pendingSpent);
+    _BRWalletClearUTXOs(wallet);
+    BRSetFree(wallet->utxos);
+    array_free(wallet->utxosByAmount);
+    BRWalletViewRelease(wallet->view);
+    _BRWalletViewItemsRelease(wallet->viewTxs);
+    _BRWalletViewItemsRelease(wallet->viewUTXOs);
+    _BRWalletViewItemsRelease(wallet->viewInternal);
+    _BRWalletViewItemsRelease(wallet->viewExternal);
     pthread_mutex_unlock(&wallet->lock);
+    pthread_mutex_destroy(&wallet->viewLock);
     pthread_mutex_destroy(&wallet->lock);
     free(wallet);
 }
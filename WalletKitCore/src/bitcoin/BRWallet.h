@@ -61,6 +61,24 @@ typedef struct BRWalletStruct BRWallet;
 // allocates and populates a BRWallet struct that must be freed by calling BRWalletFree()
 BRWallet *BRWalletNew(BRAddressParams addrParams, BRTransaction *transactions[], size_t txCount, BRMasterPubKey mpk);
 
+// allocates and populates a BRWallet struct, as BRWalletNew() does, restoring its address chains from chains, written
+// by BRWalletAddressChains(), and its derived state from snapshot, written by BRWalletSnapshot(), which avoids
+// re-deriving addresses and re-sorting transactions; chains or a snapshot that are invalid for mpk, and a snapshot of
+// other transactions, are ignored
+BRWallet *BRWalletNewWithSnapshot(BRAddressParams addrParams, BRTransaction *transactions[], size_t txCount,
+                                  BRMasterPubKey mpk, const uint8_t *chains, size_t chainsLen,
+                                  const uint8_t *snapshot, size_t snapshotLen);
+
+// writes the wallet's address chains - the hash160 of every address generated by BRWalletUnusedAddrs() - to buf, for
+// BRWalletNewWithSnapshot(), to restore the chains without deriving the addresses again
+// returns number of bytes written to buf, or total bufLen needed if buf is NULL or bufLen is too small
+size_t BRWalletAddressChains(BRWallet *wallet, uint8_t *buf, size_t bufLen);
+
+// writes a snapshot of the wallet state derived from its transactions - transaction order, balances and UTXOs - to
+// buf, for BRWalletNewWithSnapshot()
+// returns number of bytes written to buf, or total bufLen needed if buf is NULL or bufLen is too small
+size_t BRWalletSnapshot(BRWallet *wallet, uint8_t *buf, size_t bufLen);
+
 // not thread-safe, set callbacks once after BRWalletNew(), before calling other BRWallet functions
 // info is a void pointer that will be passed along with each callback call
 // void balanceChanged(void *, uint64_t) - called when the wallet balance changes
@@ -124,6 +142,38 @@ uint64_t BRWalletTotalReceived(BRWallet *wallet);
 
 // writes unspent outputs to utxos and returns the number of outputs written, or number available if utxos is NULL
 size_t BRWalletUTXOs(BRWallet *wallet, BRUTXO utxos[], size_t utxosCount);
+
+// writes unspent outputs to utxos, largest amount first, and returns the number of outputs written, or number
+// available if utxos is NULL
+size_t BRWalletUTXOsByAmount(BRWallet *wallet, BRUTXO utxos[], size_t utxosCount);
+
+// an immutable view of the wallet balance, unspent outputs, transactions and addresses, published each time any of them
+// changes, sharing what didn't change with the previous view, that can be read without waiting on the wallet lock
+typedef struct BRWalletViewStruct BRWalletView;
+
+// returns the most recently published view of the wallet, without taking the wallet lock
+// result must be released using BRWalletViewRelease(), its transactions remain valid until the wallet is freed
+BRWalletView *BRWalletCurrentView(BRWallet *wallet);
+
+// releases a view returned by BRWalletCurrentView()
+void BRWalletViewRelease(BRWalletView *view);
+
+// wallet balance, and total amounts spent and received, as of view
+uint64_t BRWalletViewBalance(const BRWalletView *view);
+uint64_t BRWalletViewTotalSent(const BRWalletView *view);
+uint64_t BRWalletViewTotalReceived(const BRWalletView *view);
+
+// writes unspent outputs as of view to utxos, as BRWalletUTXOs() does
+// returns the number of outputs written, or number available if utxos is NULL
+size_t BRWalletViewUTXOs(const BRWalletView *view, BRUTXO utxos[], size_t utxosCount);
+
+// writes transactions as of view, sorted by date, oldest first, to the given transactions array
+// returns the number of transactions written, or total number available if transactions is NULL
+size_t BRWalletViewTransactions(const BRWalletView *view, BRTransaction *transactions[], size_t txCount);
+
+// writes all addresses generated as of view to addrs, as BRWalletAllAddrs() does
+// returns the number addresses written, or total number available if addrs is NULL
+size_t BRWalletViewAllAddrs(const BRWalletView *view, BRAddress addrs[], size_t addrsCount);
     
 // fee-per-kb of transaction size to use when creating a transaction
 // the wallet maintains a fee per kb that is associated with it
@@ -135,6 +185,18 @@ size_t BRWalletUTXOs(BRWallet *wallet, BRUTXO utxos[], size_t utxosCount);
 uint64_t BRWalletFeePerKb(BRWallet *wallet);
 void BRWalletSetFeePerKb(BRWallet *wallet, uint64_t feePerKb);
 
+// how BRWalletCreateTxForOutputs() and the functions built on it choose which unspent outputs to spend
+typedef enum {
+    BRWalletCoinSelectionOldestFirst = 0, // oldest outputs first, adding change unless the amount is matched exactly
+    BRWalletCoinSelectionBranchAndBound   // a set of outputs that needs no change output if a branch-and-bound search
+                                          // finds one, otherwise the smallest set a knapsack search finds, falling back
+                                          // to oldest first if neither does
+} BRWalletCoinSelection;
+
+// coin selection to use when creating a transaction, BRWalletCoinSelectionOldestFirst unless set
+BRWalletCoinSelection BRWalletGetCoinSelection(BRWallet *wallet);
+void BRWalletSetCoinSelection(BRWallet *wallet, BRWalletCoinSelection coinSelection);
+
 // returns an unsigned transaction that sends the specified amount from the wallet to the given address
 // result must be freed using BRTransactionFree()
 BRTransaction *BRWalletCreateTransaction(BRWallet *wallet, uint64_t amount, const char *addr);
@@ -165,6 +227,13 @@ int BRWalletContainsTransaction(BRWallet *wallet, const BRTransaction *tx);
 // adds a transaction to the wallet, or returns false if it isn't associated with the wallet
 int BRWalletRegisterTransaction(BRWallet *wallet, BRTransaction *tx);
 
+// adds transactions to the wallet like BRWalletRegisterTransaction(), but calls balanceChanged once for the whole batch,
+// tx that are only associated with the wallet through addresses generated to replace ones the others used are also
+// added, returns the number of transactions added
+// the balance is recalculated when the batch can't be applied on top of it, at most once for the batch and once before
+// each round of generating replacement addresses
+size_t BRWalletRegisterTransactions(BRWallet *wallet, BRTransaction *transactions[], size_t txCount);
+
 // removes a tx from the wallet, along with any tx that depend on its outputs
 void BRWalletRemoveTransaction(BRWallet *wallet, UInt256 txHash);
 
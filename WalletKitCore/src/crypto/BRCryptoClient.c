@@ -608,8 +608,7 @@ cryptoClientHandleTransactions (OwnershipKept BRCryptoWalletManager manager,
                 size_t bundlesCount = array_count(bundles);
 
                 // Save the transaction bundles immediately
-                for (size_t index = 0; index < bundlesCount; index++)
-                    cryptoWalletManagerSaveTransactionBundle(manager, bundles[index]);
+                cryptoWalletManagerSaveTransactionBundles (manager, bundles);
 
                 // Sort bundles to have the lowest blocknumber first.  Use of `mergesort` is
                 // appropriate given that the bundles are likely already ordered.  This minimizes
@@ -620,9 +619,8 @@ cryptoClientHandleTransactions (OwnershipKept BRCryptoWalletManager manager,
                 mergesort_brd (bundles, bundlesCount, sizeof (BRCryptoClientTransactionBundle),
                                cryptoClientTransactionBundleCompareForSort);
 
-                // Recover transfers from each bundle
-                for (size_t index = 0; index < bundlesCount; index++)
-                   cryptoWalletManagerRecoverTransfersFromTransactionBundle (manager, bundles[index]);
+                // Recover transfers from the bundles, as a batch
+                cryptoWalletManagerRecoverTransfersFromTransactionBundles (manager, bundles);
 
                 // The following assumes `bundles` has produced transfers which may have
                 // impacted the wallet's addresses.  Thus the recovery must be *serial w.r.t. the
@@ -745,8 +743,7 @@ cryptoClientHandleTransfers (OwnershipKept BRCryptoWalletManager manager,
             case CRYPTO_TRUE: {
                 size_t bundlesCount = array_count(bundles);
 
-                for (size_t index = 0; index < bundlesCount; index++)
-                    cryptoWalletManagerSaveTransferBundle(manager, bundles[index]);
+                cryptoWalletManagerSaveTransferBundles (manager, bundles);
 
                 // Sort bundles to have the lowest blocknumber first.  Use of `mergesort` is
                 // appropriate given that the bundles are likely already ordered.  This minimizes
@@ -74,6 +74,14 @@ cryptoFileServiceTypeTransferV1Writer (BRFileServiceContext context,
     return data.bytes;
 }
 
+private_extern int64_t
+cryptoFileServiceTypeTransferSortKey (BRFileServiceContext context,
+                                      BRFileService fs,
+                                      const void *entity) {
+    BRCryptoClientTransferBundle bundle = (BRCryptoClientTransferBundle) entity;
+    return cryptoFileServiceSortKeyForBlockNumber (bundle->blockNumber);
+}
+
 // MARK: - Client Transaction Bundle
 
 private_extern UInt256
@@ -129,6 +137,14 @@ cryptoFileServiceTypeTransactionV1Writer (BRFileServiceContext context,
     return data.bytes;
 }
 
+private_extern int64_t
+cryptoFileServiceTypeTransactionSortKey (BRFileServiceContext context,
+                                         BRFileService fs,
+                                         const void *entity) {
+    BRCryptoClientTransactionBundle bundle = (BRCryptoClientTransactionBundle) entity;
+    return cryptoFileServiceSortKeyForBlockNumber (bundle->blockHeight);
+}
+
 BRFileServiceTypeSpecification cryptoFileServiceSpecifications[] = {
     {
         CRYPTO_FILE_SERVICE_TYPE_TRANSFER,
@@ -141,7 +157,8 @@ BRFileServiceTypeSpecification cryptoFileServiceSpecifications[] = {
                 cryptoFileServiceTypeTransferV1Reader,
                 cryptoFileServiceTypeTransferV1Writer
             },
-        }
+        },
+        cryptoFileServiceTypeTransferSortKey
     },
 
     {
@@ -155,7 +172,8 @@ BRFileServiceTypeSpecification cryptoFileServiceSpecifications[] = {
                 cryptoFileServiceTypeTransactionV1Reader,
                 cryptoFileServiceTypeTransactionV1Writer
             },
-        }
+        },
+        cryptoFileServiceTypeTransactionSortKey
     }
 };
 size_t cryptoFileServiceSpecificationsCount = (sizeof (cryptoFileServiceSpecifications) / sizeof (BRFileServiceTypeSpecification));
@@ -19,6 +19,13 @@
 extern "C" {
 #endif
 
+/// A sort key for a block number; unbound block numbers (as for pending transfers and
+/// transactions), which don't fit into an int64_t, sort last.
+static inline int64_t
+cryptoFileServiceSortKeyForBlockNumber (uint64_t blockNumber) {
+    return (blockNumber > INT64_MAX ? INT64_MAX : (int64_t) blockNumber);
+}
+
 #define CRYPTO_FILE_SERVICE_TYPE_TRANSFER      "crypto_transfers"
 
 typedef enum {
@@ -42,6 +49,10 @@ cryptoFileServiceTypeTransferV1Writer (BRFileServiceContext context,
                                  const void* entity,
                                  uint32_t *bytesCount);
 
+private_extern int64_t
+cryptoFileServiceTypeTransferSortKey (BRFileServiceContext context,
+                                      BRFileService fs,
+                                      const void *entity);
 
 #define CRYPTO_FILE_SERVICE_TYPE_TRANSACTION      "crypto_transactions"
 
@@ -66,6 +77,11 @@ cryptoFileServiceTypeTransactionV1Writer (BRFileServiceContext context,
                                     const void* entity,
                                     uint32_t *bytesCount);
 
+private_extern int64_t
+cryptoFileServiceTypeTransactionSortKey (BRFileServiceContext context,
+                                         BRFileService fs,
+                                         const void *entity);
+
 extern BRFileServiceTypeSpecification cryptoFileServiceSpecifications[];
 extern size_t cryptoFileServiceSpecificationsCount;
 
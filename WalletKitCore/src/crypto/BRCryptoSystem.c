@@ -16,8 +16,10 @@
 #include "crypto/BRCryptoNetworkP.h"
 #include "crypto/BRCryptoClientP.h"
 #include "crypto/BRCryptoListenerP.h"
+#include "crypto/BRCryptoWalletManagerP.h"
 
 #include <stdio.h>                  // sprintf
+#include <assert.h>
 
 // MARK: - All Systems
 
@@ -212,6 +214,27 @@ static BRFileServiceTypeSpecification systemFileServiceSpecifications[] = {
 
 static size_t systemFileServiceSpecificationsCount = (sizeof (systemFileServiceSpecifications) / sizeof (BRFileServiceTypeSpecification));
 
+// MARK: - Persistence Profile
+
+static BRFileServiceDurability
+cryptoPersistenceProfileGetDurability (BRCryptoPersistenceProfile profile) {
+    switch (profile) {
+        case CRYPTO_PERSISTENCE_PROFILE_DURABLE:  return FILE_SERVICE_DURABILITY_DEFAULT;
+        case CRYPTO_PERSISTENCE_PROFILE_BALANCED: return FILE_SERVICE_DURABILITY_WAL;
+        case CRYPTO_PERSISTENCE_PROFILE_SHARED:   return FILE_SERVICE_DURABILITY_WAL;
+    }
+    assert (false);
+    return FILE_SERVICE_DURABILITY_DEFAULT;
+}
+
+private_extern void
+cryptoSystemApplyPersistenceProfile (BRCryptoSystem system,
+                                     BRFileService fileService) {
+    if (NULL != fileService)
+        fileServiceSetDurability (fileService,
+                                  cryptoPersistenceProfileGetDurability (system->persistenceProfile));
+}
+
 // MARK: - System
 
 IMPLEMENT_CRYPTO_GIVE_TAKE (BRCryptoSystem, cryptoSystem)
@@ -221,7 +244,8 @@ cryptoSystemCreate (BRCryptoClient client,
                     BRCryptoListener listener,
                     BRCryptoAccount account,
                     const char *basePath,
-                    BRCryptoBoolean onMainnet) {
+                    BRCryptoBoolean onMainnet,
+                    BRCryptoPersistenceProfile persistenceProfile) {
     BRCryptoSystem system = calloc (1, sizeof (struct BRCryptoSystemRecord));
 
     system->state       = CRYPTO_SYSTEM_STATE_CREATED;
@@ -230,6 +254,7 @@ cryptoSystemCreate (BRCryptoClient client,
     system->client      = client;
     system->listener    = cryptoListenerTake (listener);
     system->account     = cryptoAccountTake  (account);
+    system->persistenceProfile = persistenceProfile;
 
     // Build a `path` specific to `account`
     char *accountFileSystemIdentifier = cryptoAccountGetFileSystemIdentifier(account);
@@ -237,12 +262,25 @@ cryptoSystemCreate (BRCryptoClient client,
     sprintf (system->path, "%s/%s", basePath, accountFileSystemIdentifier);
     free (accountFileSystemIdentifier);
 
+    // Create the store shared by every file service, if the profile shares one.  If the store
+    // can't be created, each file service has its own DB.
+    system->fileServiceStore = (CRYPTO_PERSISTENCE_PROFILE_SHARED == persistenceProfile
+                                ? fileServiceStoreCreate (system->path)
+                                : NULL);
+
     // Create the system-state file service
-    system->fileService = fileServiceCreateFromTypeSpecifications (system->path, "system", "state",
-                                                                   system,
-                                                                   cryptoSystemFileServiceErrorHandler,
-                                                                   systemFileServiceSpecificationsCount,
-                                                                   systemFileServiceSpecifications);
+    system->fileService = (NULL != system->fileServiceStore
+                           ? fileServiceCreateFromTypeSpecificationsInStore (system->fileServiceStore, "system", "state",
+                                                                             system,
+                                                                             cryptoSystemFileServiceErrorHandler,
+                                                                             systemFileServiceSpecificationsCount,
+                                                                             systemFileServiceSpecifications)
+                           : fileServiceCreateFromTypeSpecifications (system->path, "system", "state",
+                                                                      system,
+                                                                      cryptoSystemFileServiceErrorHandler,
+                                                                      systemFileServiceSpecificationsCount,
+                                                                      systemFileServiceSpecifications));
+    cryptoSystemApplyPersistenceProfile (system, system->fileService);
 
     // Fill in the builtin networks
     size_t networksCount = 0;
@@ -311,6 +349,11 @@ cryptoSystemRelease (BRCryptoSystem system) {
     cryptoListenerGive (system->listener);
     free (system->path);
 
+    // The store stays open until the file services in it, such as those of managers still
+    // referenced, are released.
+    if (NULL != system->fileServiceStore)
+        fileServiceStoreRelease (system->fileServiceStore);
+
     pthread_mutex_unlock  (&system->lock);
     pthread_mutex_destroy (&system->lock);
 
@@ -347,6 +390,11 @@ cryptoSystemGetResolvedPath (BRCryptoSystem system) {
     return system->path;
 }
 
+private_extern BRFileServiceStore
+cryptoSystemGetFileServiceStore (BRCryptoSystem system) {
+    return system->fileServiceStore;
+}
+
 extern BRCryptoSystemState
 cryptoSystemGetState (BRCryptoSystem system) {
     return system->state;
@@ -38,6 +38,8 @@ struct BRCryptoSystemRecord {
     BRCryptoAccount account;
     char *path;
 
+    BRCryptoPersistenceProfile persistenceProfile;
+    BRFileServiceStore fileServiceStore;    // NULL unless CRYPTO_PERSISTENCE_PROFILE_SHARED
     BRFileService fileService;
     
     BRArrayOf (BRCryptoNetwork) networks;
@@ -69,6 +71,15 @@ private_extern void
 cryptoSystemRemWalletManager (BRCryptoSystem system,
                               BRCryptoWalletManager manager);
 
+private_extern BRFileServiceStore
+cryptoSystemGetFileServiceStore (BRCryptoSystem system);
+
+/// Apply the system's persistence profile durability to `fileService`, if not NULL.  Apply before
+/// the file service is first used.
+private_extern void
+cryptoSystemApplyPersistenceProfile (BRCryptoSystem system,
+                                     BRFileService fileService);
+
 private_extern void
 cryptoSystemHandleCurrencyBundles (BRCryptoSystem system,
                                    OwnershipKept BRArrayOf (BRCryptoClientCurrencyBundle) bundles);
@@ -28,6 +28,7 @@
 
 #include "BRCryptoWalletManager.h"
 #include "BRCryptoWalletManagerP.h"
+#include "BRCryptoSystemP.h"
 
 #include "BRCryptoHandlersP.h"
 
@@ -56,6 +57,10 @@
 #define CWM_MAXIMUM_SAMPLING_PERIOD_IN_MILLISECONDS   (1 * 60 * 1000)    //  1 minute
 #define CWM_MINIMUM_SAMPLING_PERIOD_IN_MILLISECONDS   (    10 * 1000)    // 10 seconds
 
+// The threads decoding persisted transactions, transfers and blocks on a load.  A few threads
+// speed up the decoding of a large history without overwhelming a phone's cores.
+#define CWM_FILE_SERVICE_LOAD_THREADS   (4)
+
 static unsigned int
 cryptoWalletManagerBoundSamplingPeriod (unsigned int milliseconds) {
     return (milliseconds > CWM_MAXIMUM_SAMPLING_PERIOD_IN_MILLISECONDS
@@ -147,36 +152,44 @@ cryptoClientTransferBundleCompareByBlockheight (const void *tb1, const void *tb2
                :  0));
 }
 
+static int
+cryptoWalletManagerInitialTransferBundleLoaded (BRFileServiceContext context,
+                                                BRFileService fs,
+                                                void *entity) {
+    BRCryptoWalletManager manager = context;
+    array_add (manager->bundleTransfers, (BRCryptoClientTransferBundle) entity);
+    return 1;
+}
+
 static void // not locked; called during manager init
 cryptoWalletManagerInitialTransferBundlesLoad (BRCryptoWalletManager manager) {
     assert (NULL == manager->bundleTransfers);
 
-    BRSetOf(BRCryptoClientTransferBundle) bundles = cryptoClientTransferBundleSetCreate (25);
+    if (!fileServiceHasType (manager->fileService, CRYPTO_FILE_SERVICE_TYPE_TRANSFER))
+        return;
+
+    // Stream the bundles, ordered by block number, directly into `bundleTransfers`
+    array_new (manager->bundleTransfers, 25);
 
-    if (fileServiceHasType (manager->fileService, CRYPTO_FILE_SERVICE_TYPE_TRANSFER) &&
-        1 != fileServiceLoad (manager->fileService, bundles, CRYPTO_FILE_SERVICE_TYPE_TRANSFER, 1)) {
-        cryptoClientTransferBundleSetRelease (bundles);
+    if (1 != fileServiceLoadIterate (manager->fileService, CRYPTO_FILE_SERVICE_TYPE_TRANSFER, 1,
+                                     cryptoClientTransferBundleCompareByBlockheight,
+                                     manager,
+                                     cryptoWalletManagerInitialTransferBundleLoaded)) {
+        array_free_all (manager->bundleTransfers, cryptoClientTransferBundleRelease);
+        manager->bundleTransfers = NULL;
         printf ("CRY: %4s: failed to load transfer bundles",
                 cryptoBlockChainTypeGetCurrencyCode (manager->type));
-        cryptoClientTransferBundleSetRelease(bundles);
         return;
     }
-    size_t sortedBundlesCount = BRSetCount(bundles);
 
     printf ("CRY: %4s: loaded %4zu transfer bundles\n",
             cryptoBlockChainTypeGetCurrencyCode (manager->type),
-            sortedBundlesCount);
-
-    if (0 != sortedBundlesCount) {
-        array_new (manager->bundleTransfers, sortedBundlesCount);
-        BRSetAll (bundles, (void**) manager->bundleTransfers, sortedBundlesCount);
-        array_set_count (manager->bundleTransfers, sortedBundlesCount);
+            array_count (manager->bundleTransfers));
 
-        qsort (manager->bundleTransfers, sortedBundlesCount, sizeof (BRCryptoClientTransferBundle), cryptoClientTransferBundleCompareByBlockheight);
+    if (0 == array_count (manager->bundleTransfers)) {
+        array_free (manager->bundleTransfers);
+        manager->bundleTransfers = NULL;
     }
-
-    // Don't release the set's bundles
-    BRSetFree(bundles);
 }
 
 static void // called wtih manager->lock
@@ -202,51 +215,109 @@ cryptoClientTransactionBundleCompareByBlockheight (const void *tb1, const void *
                :  0));
 }
 
+static int
+cryptoWalletManagerInitialTransactionBundleLoaded (BRFileServiceContext context,
+                                                   BRFileService fs,
+                                                   void *entity) {
+    BRCryptoWalletManager manager = context;
+    array_add (manager->bundleTransactions, (BRCryptoClientTransactionBundle) entity);
+    return 1;
+}
+
 static void // not locked; called during manager init
 cryptoWalletManagerInitialTransactionBundlesLoad (BRCryptoWalletManager manager) {
     assert (NULL == manager->bundleTransactions);
 
-    BRSetOf(BRCryptoClientTransactionBundle) bundles = cryptoClientTransactionBundleSetCreate (25);
-    if (fileServiceHasType (manager->fileService, CRYPTO_FILE_SERVICE_TYPE_TRANSACTION) &&
-        1 != fileServiceLoad (manager->fileService, bundles, CRYPTO_FILE_SERVICE_TYPE_TRANSACTION, 1)) {
-        cryptoClientTransactionBundleSetRelease (bundles);
+    if (!fileServiceHasType (manager->fileService, CRYPTO_FILE_SERVICE_TYPE_TRANSACTION))
+        return;
+
+    // Stream the bundles, ordered by block height, directly into `bundleTransactions`
+    array_new (manager->bundleTransactions, 25);
+
+    if (1 != fileServiceLoadIterate (manager->fileService, CRYPTO_FILE_SERVICE_TYPE_TRANSACTION, 1,
+                                     cryptoClientTransactionBundleCompareByBlockheight,
+                                     manager,
+                                     cryptoWalletManagerInitialTransactionBundleLoaded)) {
+        array_free_all (manager->bundleTransactions, cryptoClientTransactionBundleRelease);
+        manager->bundleTransactions = NULL;
         printf ("CRY: %4s: failed to load transaction bundles",
                 cryptoBlockChainTypeGetCurrencyCode (manager->type));
         return;
     }
-    size_t sortedBundlesCount = BRSetCount(bundles);
 
     printf ("CRY: %4s: loaded %4zu transaction bundles\n",
             cryptoBlockChainTypeGetCurrencyCode (manager->type),
-            sortedBundlesCount);
-
-    if (0 != sortedBundlesCount) {
-        BRArrayOf(BRCryptoClientTransactionBundle) sortedBundles;
-        array_new (sortedBundles, sortedBundlesCount);
-        BRSetAll (bundles, (void**) sortedBundles, sortedBundlesCount);
-        array_set_count(sortedBundles, sortedBundlesCount);
-
-        qsort (sortedBundles, sortedBundlesCount, sizeof (BRCryptoClientTransactionBundle), cryptoClientTransactionBundleCompareByBlockheight);
+            array_count (manager->bundleTransactions));
 
-        manager->bundleTransactions = sortedBundles;
+    if (0 == array_count (manager->bundleTransactions)) {
+        array_free (manager->bundleTransactions);
+        manager->bundleTransactions = NULL;
     }
-
-    // Don't release the set's bundles
-    BRSetFree(bundles);
 }
 
 static void // called wtih manager->lock
 cryptoWalletManagerInitialTransactionBundlesRecover (BRCryptoWalletManager manager) {
     if (NULL != manager->bundleTransactions) {
-        for (size_t index = 0; index < array_count(manager->bundleTransactions); index++) {
-            cryptoWalletManagerRecoverTransfersFromTransactionBundle (manager, manager->bundleTransactions[index]);
-        }
+        cryptoWalletManagerRecoverTransfersFromTransactionBundles (manager, manager->bundleTransactions);
 
         array_free_all (manager->bundleTransactions, cryptoClientTransactionBundleRelease);
         manager->bundleTransactions = NULL;
     }
 }
 
+static BRFileServiceStore
+cryptoWalletManagerGetFileServiceStore (BRCryptoWalletManager manager) {
+    return (NULL == manager->listener.system
+            ? NULL
+            : cryptoSystemGetFileServiceStore (manager->listener.system));
+}
+
+private_extern BRFileService
+cryptoWalletManagerCreateFileService (BRCryptoWalletManager manager,
+                                      const char *basePath,
+                                      const char *currency,
+                                      const char *network,
+                                      BRFileServiceContext context,
+                                      BRFileServiceErrorHandler handler,
+                                      size_t specificationsCount,
+                                      BRFileServiceTypeSpecification *specifications) {
+    BRFileServiceStore store = cryptoWalletManagerGetFileServiceStore (manager);
+
+    BRFileService fileService = (NULL != store
+                                 ? fileServiceCreateFromTypeSpecificationsInStore (store, currency, network,
+                                                                                   context, handler,
+                                                                                   specificationsCount,
+                                                                                   specifications)
+                                 : fileServiceCreateFromTypeSpecifications (basePath, currency, network,
+                                                                            context, handler,
+                                                                            specificationsCount,
+                                                                            specifications));
+
+    // Apply the system's durability before any load or save, including those made as the manager
+    // and its wallets are created.
+    if (NULL != manager->listener.system)
+        cryptoSystemApplyPersistenceProfile (manager->listener.system, fileService);
+
+    // The bundles, many and alike, are compressed; see `cryptoWalletManagerTrainFileServiceCompression()`
+    const char *compressedTypes[] = { CRYPTO_FILE_SERVICE_TYPE_TRANSFER, CRYPTO_FILE_SERVICE_TYPE_TRANSACTION };
+    for (size_t index = 0; NULL != fileService && index < sizeof (compressedTypes) / sizeof (compressedTypes[0]); index++)
+        if (fileServiceHasType (fileService, compressedTypes[index]))
+            fileServiceDefineCompression (fileService, compressedTypes[index]);
+
+    return fileService;
+}
+
+static void // not locked; called during manager init
+cryptoWalletManagerTrainFileServiceCompression (BRCryptoWalletManager manager) {
+    // Train once, when enough bundles are stored; until then bundles are compressed without a
+    // dictionary.
+    const char *compressedTypes[] = { CRYPTO_FILE_SERVICE_TYPE_TRANSFER, CRYPTO_FILE_SERVICE_TYPE_TRANSACTION };
+    for (size_t index = 0; index < sizeof (compressedTypes) / sizeof (compressedTypes[0]); index++)
+        if (fileServiceHasType (manager->fileService, compressedTypes[index]) &&
+            !fileServiceHasCompressionDictionary (manager->fileService, compressedTypes[index]))
+            fileServiceTrainCompression (manager->fileService, compressedTypes[index]);
+}
+
 extern BRCryptoWalletManager
 cryptoWalletManagerAllocAndInit (size_t sizeInBytes,
                                  BRCryptoBlockChainType type,
@@ -300,6 +371,16 @@ cryptoWalletManagerAllocAndInit (size_t sizeInBytes,
                                                                  manager,
                                                                  cryptoWalletManagerFileServiceErrorHandler);
 
+    // Persist off of the event handler and P2P threads; disk latency must not stall a sync.  A
+    // shared store already writes on its own thread.
+    if (NULL != manager->fileService) {
+        if (NULL == cryptoWalletManagerGetFileServiceStore (manager))
+            fileServiceSetWriteBehind (manager->fileService, 1);
+
+        // Decode a large history in parallel; every currency's readers are reentrant.
+        fileServiceSetLoadThreads (manager->fileService, CWM_FILE_SERVICE_LOAD_THREADS);
+    }
+
     // TODO: This causes an Android (only - Core Demo App) crash.  Understand, then restore
     // fileServicePurge (manager->fileService);
 
@@ -350,6 +431,7 @@ cryptoWalletManagerAllocAndInit (size_t sizeInBytes,
 
     cryptoWalletManagerInitialTransferBundlesLoad (manager);
     cryptoWalletManagerInitialTransactionBundlesLoad (manager);
+    cryptoWalletManagerTrainFileServiceCompression (manager);
 
     // Create the primary wallet
     manager->wallet = cryptoWalletManagerCreateWalletInitialized (manager,
@@ -651,6 +733,77 @@ cryptoWalletManagerGetWallets (BRCryptoWalletManager cwm, size_t *count) {
 }
 
 
+#if CRYPTO_STORAGE_LATENCY_BUCKETS_COUNT != FILE_SERVICE_LATENCY_BUCKETS_COUNT
+#error "BRCryptoStorageLatency and BRFileServiceLatency must have the same buckets"
+#endif
+
+static BRCryptoStorageLatency
+cryptoStorageLatencyCreate (BRFileServiceLatency latency) {
+    BRCryptoStorageLatency result = { latency.count, latency.microseconds };
+    memcpy (result.buckets, latency.buckets, sizeof (result.buckets));
+    return result;
+}
+
+static void
+cryptoStorageLatencyAdd (BRCryptoStorageLatency *sum,
+                         const BRCryptoStorageLatency *latency) {
+    sum->count        += latency->count;
+    sum->microseconds += latency->microseconds;
+    for (size_t index = 0; index < CRYPTO_STORAGE_LATENCY_BUCKETS_COUNT; index++)
+        sum->buckets[index] += latency->buckets[index];
+}
+
+extern BRCryptoStorageStats *
+cryptoWalletManagerGetStorageStats (BRCryptoWalletManager cwm,
+                                    size_t *count) {
+    *count = 0;
+    if (NULL == cwm->fileService) return NULL;
+
+    size_t typesCount = fileServiceGetStats (cwm->fileService, NULL, 0);
+    if (0 == typesCount) return NULL;
+
+    BRFileServiceTypeStats fsStats[typesCount];
+    typesCount = fileServiceGetStats (cwm->fileService, fsStats, typesCount);
+
+    BRCryptoStorageStats *stats = calloc (typesCount, sizeof (BRCryptoStorageStats));
+    for (size_t index = 0; index < typesCount; index++)
+        stats[index] = (BRCryptoStorageStats) {
+            fsStats[index].type,
+            fsStats[index].entitiesCount,
+            fsStats[index].bytesCount,
+            fsStats[index].entitiesSaved,
+            fsStats[index].entitiesLoaded,
+            cryptoStorageLatencyCreate (fsStats[index].saves),
+            cryptoStorageLatencyCreate (fsStats[index].loads),
+            cryptoStorageLatencyCreate (fsStats[index].removes)
+        };
+
+    *count = typesCount;
+    return stats;
+}
+
+extern BRCryptoStorageStats
+cryptoWalletManagerGetStorageStatsTotal (BRCryptoWalletManager cwm) {
+    BRCryptoStorageStats total;
+    memset (&total, 0, sizeof (total));
+
+    size_t count;
+    BRCryptoStorageStats *stats = cryptoWalletManagerGetStorageStats (cwm, &count);
+
+    for (size_t index = 0; index < count; index++) {
+        total.entitiesCount  += stats[index].entitiesCount;
+        total.bytesCount     += stats[index].bytesCount;
+        total.entitiesSaved  += stats[index].entitiesSaved;
+        total.entitiesLoaded += stats[index].entitiesLoaded;
+        cryptoStorageLatencyAdd (&total.saves,   &stats[index].saves);
+        cryptoStorageLatencyAdd (&total.loads,   &stats[index].loads);
+        cryptoStorageLatencyAdd (&total.removes, &stats[index].removes);
+    }
+
+    if (NULL != stats) free (stats);
+    return total;
+}
+
 extern BRCryptoWallet
 cryptoWalletManagerGetWalletForCurrency (BRCryptoWalletManager cwm,
                                          BRCryptoCurrency currency) {
@@ -737,6 +890,9 @@ cryptoWalletManagerStop (BRCryptoWalletManager cwm) {
     // Stop the CWM 'Event Handler'
     eventHandlerStop (cwm->handler);
 
+    // Complete all pending file service writes
+    if (NULL != cwm->fileService) fileServiceFlush (cwm->fileService);
+
     // {P2P,QRY} Manager - on disconnect
 }
 
@@ -1204,12 +1360,50 @@ cryptoWalletManagerSaveTransferBundle (BRCryptoWalletManager manager,
         fileServiceSave (manager->fileService, CRYPTO_FILE_SERVICE_TYPE_TRANSFER, bundle);
 }
 
+// Save all bundles within a single file service batch; a sync can produce thousands of bundles
+// and a DB commit per bundle would dominate the sync time.
+
+private_extern void
+cryptoWalletManagerSaveTransactionBundles (BRCryptoWalletManager manager,
+                                           OwnershipKept BRArrayOf(BRCryptoClientTransactionBundle) bundles) {
+    bool batched = (NULL != manager->fileService && fileServiceBeginBatch (manager->fileService));
+
+    for (size_t index = 0; index < array_count (bundles); index++)
+        cryptoWalletManagerSaveTransactionBundle (manager, bundles[index]);
+
+    if (batched) fileServiceCommitBatch (manager->fileService);
+}
+
+private_extern void
+cryptoWalletManagerSaveTransferBundles (BRCryptoWalletManager manager,
+                                        OwnershipKept BRArrayOf(BRCryptoClientTransferBundle) bundles) {
+    bool batched = (NULL != manager->fileService && fileServiceBeginBatch (manager->fileService));
+
+    for (size_t index = 0; index < array_count (bundles); index++)
+        cryptoWalletManagerSaveTransferBundle (manager, bundles[index]);
+
+    if (batched) fileServiceCommitBatch (manager->fileService);
+}
+
 private_extern void
 cryptoWalletManagerRecoverTransfersFromTransactionBundle (BRCryptoWalletManager cwm,
                                                           OwnershipKept BRCryptoClientTransactionBundle bundle) {
     cwm->handlers->recoverTransfersFromTransactionBundle (cwm, bundle);
 }
 
+// Recover all bundles at once if the handler supports it; a wallet can then update its balance
+// once for the batch rather than once per bundle.
+
+private_extern void
+cryptoWalletManagerRecoverTransfersFromTransactionBundles (BRCryptoWalletManager cwm,
+                                                           OwnershipKept BRArrayOf(BRCryptoClientTransactionBundle) bundles) {
+    if (NULL != cwm->handlers->recoverTransfersFromTransactionBundles)
+        cwm->handlers->recoverTransfersFromTransactionBundles (cwm, bundles);
+    else
+        for (size_t index = 0; index < array_count (bundles); index++)
+            cryptoWalletManagerRecoverTransfersFromTransactionBundle (cwm, bundles[index]);
+}
+
 private_extern void
 cryptoWalletManagerRecoverTransferFromTransferBundle (BRCryptoWalletManager cwm,
                                                       OwnershipKept BRCryptoClientTransferBundle bundle) {
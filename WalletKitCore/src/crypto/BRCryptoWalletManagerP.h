@@ -111,6 +111,11 @@ typedef void
 (*BRCryptoWalletManagerRecoverTransfersFromTransactionBundleHandler) (BRCryptoWalletManager cwm,
                                                                       OwnershipKept BRCryptoClientTransactionBundle bundle);
 
+// Optional; when NULL the bundles are recovered one by one with `recoverTransfersFromTransactionBundle`
+typedef void
+(*BRCryptoWalletManagerRecoverTransfersFromTransactionBundlesHandler) (BRCryptoWalletManager cwm,
+                                                                       OwnershipKept BRArrayOf(BRCryptoClientTransactionBundle) bundles);
+
 typedef void
 (*BRCryptoWalletManagerRecoverTransferFromTransferBundleHandler) (BRCryptoWalletManager cwm,
                                                                   OwnershipKept BRCryptoClientTransferBundle bundle);
@@ -148,6 +153,7 @@ typedef struct {
     BRCryptoWalletManagerSaveTransactionBundleHandler saveTransactionBundle;
     BRCryptoWalletManagerSaveTransferBundleHandler    saveTransferBundle;
     BRCryptoWalletManagerRecoverTransfersFromTransactionBundleHandler recoverTransfersFromTransactionBundle;
+    BRCryptoWalletManagerRecoverTransfersFromTransactionBundlesHandler recoverTransfersFromTransactionBundles;
     BRCryptoWalletManagerRecoverTransferFromTransferBundleHandler     recoverTransferFromTransferBundle;
     BRCryptoWalletManagerRecoverFeeBasisFromFeeEstimateHandler        recoverFeeBasisFromFeeEstimate;
     BRCryptoWalletManagerWalletSweeperValidateSupportedHandler validateSweeperSupported;
@@ -228,6 +234,18 @@ cryptoWalletManagerAllocAndInit (size_t sizeInBytes,
 private_extern BRCryptoBlockChainType
 cryptoWalletManagerGetType (BRCryptoWalletManager manager);
 
+/// Create a file service, for a `createFileService` handler, in the system's shared store if
+/// there is one and otherwise in `basePath`.
+private_extern BRFileService
+cryptoWalletManagerCreateFileService (BRCryptoWalletManager manager,
+                                      const char *basePath,
+                                      const char *currency,
+                                      const char *network,
+                                      BRFileServiceContext context,
+                                      BRFileServiceErrorHandler handler,
+                                      size_t specificationsCount,
+                                      BRFileServiceTypeSpecification *specifications);
+
 private_extern void
 cryptoWalletManagerSetState (BRCryptoWalletManager cwm,
                              BRCryptoWalletManagerState state);
@@ -251,6 +269,14 @@ private_extern void
 cryptoWalletManagerSaveTransferBundle (BRCryptoWalletManager manager,
                                        OwnershipKept BRCryptoClientTransferBundle bundle);
 
+private_extern void
+cryptoWalletManagerSaveTransactionBundles (BRCryptoWalletManager manager,
+                                           OwnershipKept BRArrayOf(BRCryptoClientTransactionBundle) bundles);
+
+private_extern void
+cryptoWalletManagerSaveTransferBundles (BRCryptoWalletManager manager,
+                                        OwnershipKept BRArrayOf(BRCryptoClientTransferBundle) bundles);
+
 private_extern BRCryptoWallet
 cryptoWalletManagerCreateWalletInitialized (BRCryptoWalletManager cwm,
                                             BRCryptoCurrency currency,
@@ -261,6 +287,10 @@ private_extern void
 cryptoWalletManagerRecoverTransfersFromTransactionBundle (BRCryptoWalletManager cwm,
                                                           OwnershipKept BRCryptoClientTransactionBundle bundle);
 
+private_extern void
+cryptoWalletManagerRecoverTransfersFromTransactionBundles (BRCryptoWalletManager cwm,
+                                                           OwnershipKept BRArrayOf(BRCryptoClientTransactionBundle) bundles);
+
 // Is it possible that the transfers do not have the 'submitted' state?  In some race between
 // the submit call and the included call?  Highly, highly unlikely but possible?
 private_extern void
@@ -167,11 +167,18 @@ cryptoWalletRemResolvedAsBTC (BRCryptoWallet wallet,
 
 typedef struct BRCryptoWalletManagerBTCRecord {
     struct BRCryptoWalletManagerRecord base;
+
+    // The size of the address chains last saved, or loaded; the chains only grow.
+    size_t addressChainsSize;
 } *BRCryptoWalletManagerBTC;
 
 extern BRCryptoWalletManagerBTC
 cryptoWalletManagerCoerceBTC (BRCryptoWalletManager manager, BRCryptoBlockChainType type);
 
+private_extern void
+cryptoWalletManagerSaveAddressChainsBTC (BRCryptoWalletManagerBTC manager,
+                                         BRWallet *btcWallet);
+
 extern BRCryptoWalletManagerHandlers cryptoWalletManagerHandlersBTC;
 
 // MAKR: - Wallet Manger P2P
@@ -249,6 +256,8 @@ cryptoHashCreateAsBTC (UInt256 btc);
 extern const char *fileServiceTypeTransactionsBTC;
 extern const char *fileServiceTypeBlocksBTC;
 extern const char *fileServiceTypePeersBTC;
+extern const char *fileServiceTypeAddressChainsBTC;
+extern const char *fileServiceTypeWalletSnapshotBTC;
 
 extern size_t fileServiceSpecificationsCountBTC;
 extern BRFileServiceTypeSpecification *fileServiceSpecificationsBTC;
@@ -256,6 +265,11 @@ extern BRFileServiceTypeSpecification *fileServiceSpecificationsBTC;
 extern BRArrayOf(BRTransaction*) initialTransactionsLoadBTC (BRCryptoWalletManager manager);
 extern BRArrayOf(BRPeer)         initialPeersLoadBTC        (BRCryptoWalletManager manager);
 extern BRArrayOf(BRMerkleBlock*) initialBlocksLoadBTC       (BRCryptoWalletManager manager);
+extern BRArrayOf(uint8_t)        initialAddressChainsLoadBTC  (BRCryptoWalletManager manager);
+extern BRArrayOf(uint8_t)        initialWalletSnapshotLoadBTC (BRCryptoWalletManager manager);
+
+extern size_t walletAddressChainsSaveBTC (BRCryptoWalletManager manager, BRWallet *wallet);
+extern void   walletSnapshotSaveBTC      (BRCryptoWalletManager manager, BRWallet *wallet);
 
 #ifdef __cplusplus
 }
@@ -71,7 +71,21 @@ cryptoWalletManagerCreateBTC (BRCryptoWalletManagerListener listener,
 
 static void
 cryptoWalletManagerReleaseBTC (BRCryptoWalletManager manager) {
+    // Checkpoint the BRWallet's derived state, for the next BRWalletNewWithSnapshot()
+    if (NULL != manager->wallet && NULL != manager->fileService) {
+        BRWallet *btcWallet = cryptoWalletAsBTC (manager->wallet);
 
+        cryptoWalletManagerSaveAddressChainsBTC (cryptoWalletManagerCoerceBTC (manager, manager->type), btcWallet);
+        walletSnapshotSaveBTC (manager, btcWallet);
+    }
+}
+
+private_extern void
+cryptoWalletManagerSaveAddressChainsBTC (BRCryptoWalletManagerBTC manager,
+                                         BRWallet *btcWallet) {
+    // The chains only grow; a change in size is a change in the chains.
+    if (manager->addressChainsSize != BRWalletAddressChains (btcWallet, NULL, 0))
+        manager->addressChainsSize = walletAddressChainsSaveBTC (&manager->base, btcWallet);
 }
 
 static BRFileService
@@ -81,10 +95,10 @@ crytpWalletManagerCreateFileServiceBTC (BRCryptoWalletManager manager,
                                         const char *network,
                                         BRFileServiceContext context,
                                         BRFileServiceErrorHandler handler) {
-    return fileServiceCreateFromTypeSpecifications (basePath, currency, network,
-                                                    context, handler,
-                                                    fileServiceSpecificationsCountBTC,
-                                                    fileServiceSpecificationsBTC);
+    return cryptoWalletManagerCreateFileService (manager, basePath, currency, network,
+                                                 context, handler,
+                                                 fileServiceSpecificationsCountBTC,
+                                                 fileServiceSpecificationsBTC);
 }
 
 static const BREventType **
@@ -191,17 +205,34 @@ cryptoWalletManagerCreateWalletBTC (BRCryptoWalletManager manager,
     assert (NULL == initialTransferBundles     || 0 == array_count (initialTransferBundles));
 
     BRArrayOf(BRTransaction*) transactions = initialTransactionsLoadBTC(manager);
+    BRArrayOf(uint8_t)        chains       = initialAddressChainsLoadBTC(manager);
+    BRArrayOf(uint8_t)        snapshot     = initialWalletSnapshotLoadBTC(manager);
 
     // Create the BTC wallet
     //
     // Since the BRWallet callbacks are not set, none of these transactions generate callbacks.
     // And, in fact, looking at BRWalletNew(), there is not even an attempt to generate callbacks
     // even if they could have been specified.
-    BRWallet *btcWallet = BRWalletNew (btcChainParams->addrParams, transactions, array_count(transactions), btcMPK);
+    //
+    // The address chains, if any, restore the wallet's addresses without deriving them again.  The
+    // snapshot, if any and if still valid for `transactions`, restores the derived wallet state
+    // without sorting `transactions`.
+    BRWallet *btcWallet = BRWalletNewWithSnapshot (btcChainParams->addrParams,
+                                                   transactions, array_count(transactions),
+                                                   btcMPK,
+                                                   chains,   (NULL == chains   ? 0 : array_count (chains)),
+                                                   snapshot, (NULL == snapshot ? 0 : array_count (snapshot)));
     assert (NULL != btcWallet);
 
     // The btcWallet now should include *all* the transactions
     array_free (transactions);
+    if (NULL != snapshot) array_free (snapshot);
+
+    // Save the address chains if BRWalletNewWithSnapshot() derived any addresses
+    BRCryptoWalletManagerBTC managerBTC = cryptoWalletManagerCoerceBTC (manager, manager->type);
+    managerBTC->addressChainsSize = (NULL == chains ? 0 : array_count (chains));
+    cryptoWalletManagerSaveAddressChainsBTC (managerBTC, btcWallet);
+    if (NULL != chains) array_free (chains);
 
     // Set the callbacks
     BRWalletSetCallbacks (btcWallet,
@@ -266,48 +297,29 @@ cryptoWalletManagerSaveTransactionBundleBTC (BRCryptoWalletManager manager,
     }
 }
 
+// Handle `btcTransaction`, parsed from `bundle`, after it has been registered with the BRWallet:
+// remove or update it to match the bundle and free it unless the BRWallet has taken ownership.
 static void
-cryptoWalletManagerRecoverTransfersFromTransactionBundleBTC (BRCryptoWalletManager manager,
-                                                             OwnershipKept BRCryptoClientTransactionBundle bundle) {
-    BRTransaction *btcTransaction = BRTransactionParse (bundle->serialization, bundle->serializationCount);
-
+cryptoWalletManagerRecoverTransfersFromTransactionBTC (BRCryptoWalletManager manager,
+                                                       OwnershipKept  BRCryptoClientTransactionBundle bundle,
+                                                       OwnershipGiven BRTransaction *btcTransaction) {
     bool error = CRYPTO_TRANSFER_STATE_ERRORED == bundle->status;
-    bool needRegistration = (!error && NULL != btcTransaction && BRTransactionIsSigned (btcTransaction));
-    bool needFree = true;
 
     BRWallet *btcWallet = cryptoWalletAsBTC(manager->wallet);
 
+    // If our transaction made it into the wallet, do not deallocate it
+    bool needFree = (NULL == btcTransaction ||
+                     btcTransaction != BRWalletTransactionForHash (btcWallet, btcTransaction->txHash));
+
     // Convert from `uint64_t` to `uint32_t` with a bit of care regarding BLOCK_HEIGHT_UNBOUND
     // and TX_UNCONFIRMED - they are directly coercible but be explicit about it.
     uint32_t btcBlockHeight = (BLOCK_HEIGHT_UNBOUND == bundle->blockHeight ? TX_UNCONFIRMED : (uint32_t) bundle->blockHeight);
     uint32_t btcTimestamp   = (uint32_t) bundle->timestamp;
 
-
-    //     if (needRegistration) {
-    //         if (0 == pthread_mutex_lock (&manager->lock)) {
-    //             // confirm completion is for in-progress sync
-    //             needRegistration &= (rid == BRClientSyncManagerScanStateGetRequestId (&manager->scanState) && manager->isConnected);
-    //             pthread_mutex_unlock (&manager->lock);
-    //         } else {
-    //             assert (0);
-    //         }
-    //     }
-
-    if (needRegistration) {
-        if (NULL == BRWalletTransactionForHash (btcWallet, btcTransaction->txHash)) {
-            // BRWalletRegisterTransaction doesn't reliably report if the txn was added to the wallet.
-            BRWalletRegisterTransaction (btcWallet, btcTransaction);
-            if (btcTransaction == BRWalletTransactionForHash (btcWallet, btcTransaction->txHash)) {
-                // If our transaction made it into the wallet, do not deallocate it
-                needFree = false;
-            }
-        }
-    }
-
     // Check if the wallet knows about transaction.  This is an important check.  If the wallet
     // does not know about the tranaction then the subsequent BRWalletUpdateTransactions will
     // free the transaction (with BRTransactionFree()).
-    if (BRWalletContainsTransaction (btcWallet, btcTransaction)) {
+    if (NULL != btcTransaction && BRWalletContainsTransaction (btcWallet, btcTransaction)) {
         if (error) {
             // On an error, remove the transaction.  This will cascade through BRWallet callbacks
             // to produce `balanceUpdated` and `txDeleted`.  The later will be handled by removing
@@ -330,7 +342,7 @@ cryptoWalletManagerRecoverTransfersFromTransactionBundleBTC (BRCryptoWalletManag
 
     // Free if ownership hasn't been passed
     if (needFree) {
-        BRTransactionFree (btcTransaction);
+        if (NULL != btcTransaction) BRTransactionFree (btcTransaction);
     }
 
     // The transaction is in the wallet, this has generated more BRWallet EXTERNAL and INTERNAL
@@ -361,6 +373,73 @@ cryptoWalletManagerRecoverTransfersFromTransactionBundleBTC (BRCryptoWalletManag
     }
 }
 
+// Parse the bundles' transactions and register those new to the BRWallet as one batch, so that the
+// BRWallet balance is recalculated once rather than once per bundle.  Each transaction is given the
+// bundle's block height and timestamp up front; registering them as unconfirmed and then updating
+// them one by one would re-sort and recalculate the BRWallet for every confirmed transaction.
+static void
+cryptoWalletManagerRecoverTransfersBTC (BRCryptoWalletManager manager,
+                                        OwnershipKept BRCryptoClientTransactionBundle *bundles,
+                                        size_t bundlesCount) {
+    BRWallet *btcWallet = cryptoWalletAsBTC(manager->wallet);
+
+    BRTransaction **btcTransactions = calloc (bundlesCount > 0 ? bundlesCount : 1, sizeof (BRTransaction*));
+    BRArrayOf(BRTransaction*) btcRegistrations;
+    array_new (btcRegistrations, bundlesCount);
+
+    for (size_t index = 0; index < bundlesCount; index++) {
+        BRCryptoClientTransactionBundle bundle = bundles[index];
+        BRTransaction *btcTransaction = BRTransactionParse (bundle->serialization, bundle->serializationCount);
+
+        bool error = CRYPTO_TRANSFER_STATE_ERRORED == bundle->status;
+        bool needRegistration = (!error && NULL != btcTransaction && BRTransactionIsSigned (btcTransaction));
+
+        //     if (needRegistration) {
+        //         if (0 == pthread_mutex_lock (&manager->lock)) {
+        //             // confirm completion is for in-progress sync
+        //             needRegistration &= (rid == BRClientSyncManagerScanStateGetRequestId (&manager->scanState) && manager->isConnected);
+        //             pthread_mutex_unlock (&manager->lock);
+        //         } else {
+        //             assert (0);
+        //         }
+        //     }
+
+        if (needRegistration && NULL == BRWalletTransactionForHash (btcWallet, btcTransaction->txHash)) {
+            btcTransaction->blockHeight = (BLOCK_HEIGHT_UNBOUND == bundle->blockHeight ? TX_UNCONFIRMED : (uint32_t) bundle->blockHeight);
+            btcTransaction->timestamp   = (uint32_t) bundle->timestamp;
+            array_add (btcRegistrations, btcTransaction);
+        }
+
+        btcTransactions[index] = btcTransaction;
+    }
+
+    // The BRWallet callbacks save each added or updated transaction; commit those saves together.
+    bool batched = (NULL != manager->fileService && fileServiceBeginBatch (manager->fileService));
+
+    // BRWalletRegisterTransactions doesn't report which txns were added to the wallet; that is
+    // determined, per transaction, below.
+    BRWalletRegisterTransactions (btcWallet, btcRegistrations, array_count (btcRegistrations));
+    array_free (btcRegistrations);
+
+    for (size_t index = 0; index < bundlesCount; index++)
+        cryptoWalletManagerRecoverTransfersFromTransactionBTC (manager, bundles[index], btcTransactions[index]);
+
+    if (batched) fileServiceCommitBatch (manager->fileService);
+    free (btcTransactions);
+}
+
+static void
+cryptoWalletManagerRecoverTransfersFromTransactionBundleBTC (BRCryptoWalletManager manager,
+                                                             OwnershipKept BRCryptoClientTransactionBundle bundle) {
+    cryptoWalletManagerRecoverTransfersBTC (manager, &bundle, 1);
+}
+
+static void
+cryptoWalletManagerRecoverTransfersFromTransactionBundlesBTC (BRCryptoWalletManager manager,
+                                                              OwnershipKept BRArrayOf(BRCryptoClientTransactionBundle) bundles) {
+    cryptoWalletManagerRecoverTransfersBTC (manager, bundles, array_count (bundles));
+}
+
 static void
 cryptoWalletManagerRecoverTransferFromTransferBundleBTC (BRCryptoWalletManager cwm,
                                                          OwnershipKept BRCryptoClientTransferBundle bundle) {
@@ -457,6 +536,9 @@ static void cryptoWalletManagerBTCTxAdded   (void *info, BRTransaction *tid) {
     // Save `tid` to the fileService.
     fileServiceSave (manager->base.fileService, fileServiceTypeTransactionsBTC, tid);
 
+    // Registering `tid` may have extended the address chains; if so, save them.
+    cryptoWalletManagerSaveAddressChainsBTC (manager, wid);
+
     // If `tid` is not resolved in `wid`, then add it as unresolved to `wid` and skip out.
     if (!BRWalletTransactionIsResolved (wid, tid)) {
         printf ("BTC: TxAdded  : %s (Not Resolved)\n", u256hex(UInt256Reverse(tid->txHash)));
@@ -665,6 +747,7 @@ BRCryptoWalletManagerHandlers cryptoWalletManagerHandlersBTC = {
     cryptoWalletManagerSaveTransactionBundleBTC,
     NULL, // BRCryptoWalletManagerSaveTransactionBundleHandler
     cryptoWalletManagerRecoverTransfersFromTransactionBundleBTC,
+    cryptoWalletManagerRecoverTransfersFromTransactionBundlesBTC,
     cryptoWalletManagerRecoverTransferFromTransferBundleBTC,
     NULL,//BRCryptoWalletManagerRecoverFeeBasisFromFeeEstimateHandler not supported
     cryptoWalletManagerWalletSweeperValidateSupportedBTC,
@@ -685,6 +768,7 @@ BRCryptoWalletManagerHandlers cryptoWalletManagerHandlersBCH = {
     cryptoWalletManagerSaveTransactionBundleBTC,
     NULL, // BRCryptoWalletManagerSaveTransactionBundleHandler
     cryptoWalletManagerRecoverTransfersFromTransactionBundleBTC,
+    cryptoWalletManagerRecoverTransfersFromTransactionBundlesBTC,
     cryptoWalletManagerRecoverTransferFromTransferBundleBTC,
     NULL,//BRCryptoWalletManagerRecoverFeeBasisFromFeeEstimateHandler not supported
     cryptoWalletManagerWalletSweeperValidateSupportedBTC,
@@ -705,6 +789,7 @@ BRCryptoWalletManagerHandlers cryptoWalletManagerHandlersBSV = {
     cryptoWalletManagerSaveTransactionBundleBTC,
     NULL, // BRCryptoWalletManagerSaveTransactionBundleHandler
     cryptoWalletManagerRecoverTransfersFromTransactionBundleBTC,
+    cryptoWalletManagerRecoverTransfersFromTransactionBundlesBTC,
     cryptoWalletManagerRecoverTransferFromTransferBundleBTC,
     NULL,//BRCryptoWalletManagerRecoverFeeBasisFromFeeEstimateHandler not supported
     cryptoWalletManagerWalletSweeperValidateSupportedBTC,
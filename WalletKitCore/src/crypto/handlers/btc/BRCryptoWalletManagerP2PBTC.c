@@ -282,6 +282,17 @@ static void cryptoWalletManagerBTCSyncStopped (void *info, int reason) {
 
     pthread_mutex_unlock (&p2p->base.lock);
 
+    // Checkpoint the BRWallet's derived state upon a completed sync
+    if (needStop && syncCompleted && 0 == reason && NULL != manager->base.fileService) {
+        BRWallet *btcWallet = cryptoWalletAsBTC (manager->base.wallet);
+
+        pthread_mutex_lock (&manager->base.lock);
+        cryptoWalletManagerSaveAddressChainsBTC (manager, btcWallet);
+        pthread_mutex_unlock (&manager->base.lock);
+
+        walletSnapshotSaveBTC (&manager->base, btcWallet);
+    }
+
     if (needStop) {
         BRCryptoSyncStoppedReason stopReason = (reason
                                                 ? cryptoSyncStoppedReasonPosix(reason)
@@ -348,12 +359,12 @@ static void cryptoWalletManagerBTCTxStatusUpdate (void *info) {
 static void cryptoWalletManagerBTCSaveBlocks (void *info, int replace, BRMerkleBlock **blocks, size_t count) {
     BRCryptoWalletManagerBTC manager = info;
 
+    // A replace repeats, mostly unchanged, the blocks already saved; write only the changes.
     if (replace) {
-        fileServiceReplace (manager->base.fileService, fileServiceTypeBlocksBTC, (const void **) blocks, count);
+        fileServiceReplaceChanged (manager->base.fileService, fileServiceTypeBlocksBTC, (const void **) blocks, count);
     }
     else {
-        for (size_t index = 0; index < count; index++)
-            fileServiceSave (manager->base.fileService, fileServiceTypeBlocksBTC, blocks[index]);
+        fileServiceSaveMany (manager->base.fileService, fileServiceTypeBlocksBTC, (const void **) blocks, count);
     }
 }
 
@@ -362,27 +373,25 @@ static void cryptoWalletManagerBTCSavePeers  (void *info, int replace, const BRP
 
     // filesystem changes are NOT queued; they are acted upon immediately
 
-    if (!replace) {
-        // save each peer, one-by-one
-        for (size_t index = 0; index < count; index++)
-            fileServiceSave (manager->base.fileService, fileServiceTypePeersBTC, &peers[index]);
-    }
-
-    else if (0 == count) {
+    if (replace && 0 == count) {
         // no peers to set, just do a clear
         fileServiceClear (manager->base.fileService, fileServiceTypePeersBTC);
     }
 
-    else {
-        // fileServiceReplace expects an array of pointers to entities, instead of an array of
-        // structures so let's do the conversion here
+    else if (0 != count) {
+        // fileServiceReplaceChanged and fileServiceSaveMany expect an array of pointers to entities,
+        // instead of an array of structures so let's do the conversion here
         const BRPeer **peerRefs = calloc (count, sizeof(BRPeer *));
 
         for (size_t i = 0; i < count; i++) {
             peerRefs[i] = &peers[i];
         }
 
-        fileServiceReplace (manager->base.fileService, fileServiceTypePeersBTC, (const void **) peerRefs, count);
+        if (replace)
+            fileServiceReplaceChanged (manager->base.fileService, fileServiceTypePeersBTC, (const void **) peerRefs, count);
+        else
+            fileServiceSaveMany (manager->base.fileService, fileServiceTypePeersBTC, (const void **) peerRefs, count);
+
         free (peerRefs);
     }
 }
@@ -9,6 +9,7 @@
 //  See the CONTRIBUTORS file at the project root for a list of contributors.
 //
 #include "BRCryptoBTC.h"
+#include "crypto/BRCryptoAccountP.h"
 #include "crypto/BRCryptoFileService.h"
 
 
@@ -293,6 +294,226 @@ initialPeersLoadBTC (BRCryptoWalletManager manager) {
     return peers;
 }
 
+/// MARK: - Address Chains File Service
+
+#define FILE_SERVICE_TYPE_ADDRESS_CHAINS      "address_chains"
+
+enum {
+    FILE_SERVICE_TYPE_ADDRESS_CHAINS_VERSION_1
+};
+
+// The entity holds the bytes of BRWalletAddressChains() for the master public key with
+// `fingerPrint`, which identifies the entity.  The chains are saved whenever they grow, apart
+// from the wallet snapshot, so that a restart derives, at most, the addresses added since.
+typedef struct {
+    uint32_t fingerPrint;
+    BRArrayOf(uint8_t) chains;
+} BRWalletAddressChainsBTC;
+
+static UInt256
+fileServiceTypeAddressChainsIdentifier (uint32_t fingerPrint) {
+    uint8_t data[sizeof (FILE_SERVICE_TYPE_ADDRESS_CHAINS) - 1 + sizeof (uint32_t)];
+
+    memcpy (data, FILE_SERVICE_TYPE_ADDRESS_CHAINS, sizeof (FILE_SERVICE_TYPE_ADDRESS_CHAINS) - 1);
+    UInt32SetLE (&data[sizeof (FILE_SERVICE_TYPE_ADDRESS_CHAINS) - 1], fingerPrint);
+
+    UInt256 identifier;
+    BRSHA256 (&identifier, data, sizeof (data));
+    return identifier;
+}
+
+static UInt256
+fileServiceTypeAddressChainsV1Identifier (BRFileServiceContext context,
+                                          BRFileService fs,
+                                          const void *entity) {
+    const BRWalletAddressChainsBTC *addressChains = entity;
+    return fileServiceTypeAddressChainsIdentifier (addressChains->fingerPrint);
+}
+
+static uint8_t *
+fileServiceTypeAddressChainsV1Writer (BRFileServiceContext context,
+                                      BRFileService fs,
+                                      const void* entity,
+                                      uint32_t *bytesCount) {
+    const BRWalletAddressChainsBTC *addressChains = entity;
+    size_t chainsCount = array_count (addressChains->chains);
+
+    *bytesCount = (uint32_t) (sizeof (uint32_t) + chainsCount);
+
+    uint8_t *bytes = malloc (*bytesCount);
+    UInt32SetLE (bytes, addressChains->fingerPrint);
+    memcpy (&bytes[sizeof (uint32_t)], addressChains->chains, chainsCount);
+
+    return bytes;
+}
+
+static void *
+fileServiceTypeAddressChainsV1Reader (BRFileServiceContext context,
+                                      BRFileService fs,
+                                      uint8_t *bytes,
+                                      uint32_t bytesCount) {
+    if (bytesCount < sizeof (uint32_t)) return NULL;
+
+    BRWalletAddressChainsBTC *addressChains = malloc (sizeof (BRWalletAddressChainsBTC));
+    addressChains->fingerPrint = UInt32GetLE (bytes);
+
+    array_new (addressChains->chains, bytesCount - sizeof (uint32_t));
+    array_add_array (addressChains->chains, &bytes[sizeof (uint32_t)], bytesCount - sizeof (uint32_t));
+
+    return addressChains;
+}
+
+static int
+fileServiceTypeAddressChainsLoadHandler (BRFileServiceContext context,
+                                         BRFileService fs,
+                                         void *entity) {
+    BRWalletAddressChainsBTC *found = context;
+    BRWalletAddressChainsBTC *addressChains = entity;
+
+    // Keep the chains for the master public key's fingerprint, if any.
+    if (addressChains->fingerPrint == found->fingerPrint && NULL == found->chains)
+        found->chains = addressChains->chains;
+    else
+        array_free (addressChains->chains);
+
+    free (addressChains);
+    return 1;
+}
+
+extern BRArrayOf(uint8_t)
+initialAddressChainsLoadBTC (BRCryptoWalletManager manager) {
+    BRWalletAddressChainsBTC found = { cryptoAccountAsBTC (manager->account).fingerPrint, NULL };
+
+    if (1 != fileServiceLoadIterate (manager->fileService, fileServiceTypeAddressChainsBTC, 1, NULL,
+                                     &found, fileServiceTypeAddressChainsLoadHandler)) {
+        if (NULL != found.chains) array_free (found.chains);
+        _peer_log ("BWM: %4s: failed to load address chains",
+                   cryptoBlockChainTypeGetCurrencyCode (manager->type));
+        return NULL;
+    }
+
+    _peer_log ("BWM: %4s: loaded %4zu bytes of address chains\n",
+               cryptoBlockChainTypeGetCurrencyCode (manager->type),
+               (NULL == found.chains ? 0 : array_count (found.chains)));
+    return found.chains;
+}
+
+extern size_t
+walletAddressChainsSaveBTC (BRCryptoWalletManager manager,
+                            BRWallet *wallet) {
+    BRWalletAddressChainsBTC addressChains = { cryptoAccountAsBTC (manager->account).fingerPrint, NULL };
+    size_t chainsCount = BRWalletAddressChains (wallet, NULL, 0);
+
+    array_new (addressChains.chains, chainsCount);
+    array_set_count (addressChains.chains, chainsCount);
+
+    // The chains may grow between the two calls; if so, try again with the larger size.
+    while (array_count (addressChains.chains) < (chainsCount = BRWalletAddressChains (wallet, addressChains.chains, array_count (addressChains.chains))))
+        array_set_count (addressChains.chains, chainsCount);
+    array_set_count (addressChains.chains, chainsCount);
+
+    fileServiceSave (manager->fileService, fileServiceTypeAddressChainsBTC, &addressChains);
+    array_free (addressChains.chains);
+
+    return chainsCount;
+}
+
+/// MARK: - Wallet Snapshot File Service
+
+#define FILE_SERVICE_TYPE_WALLET_SNAPSHOT     "wallet_snapshot"
+
+enum {
+    FILE_SERVICE_TYPE_WALLET_SNAPSHOT_VERSION_1
+};
+
+// The entity is a BRArrayOf(uint8_t) holding the bytes of BRWalletSnapshot().  A file service
+// holds one snapshot, for its one BRWallet; the snapshot itself identifies the wallet's master
+// public key and is checksummed, see BRWalletNewWithSnapshot().  Snapshots are saved only at
+// checkpoints.
+
+static UInt256
+fileServiceTypeWalletSnapshotV1Identifier (BRFileServiceContext context,
+                                           BRFileService fs,
+                                           const void *entity) {
+    UInt256 identifier;
+    BRSHA256 (&identifier, FILE_SERVICE_TYPE_WALLET_SNAPSHOT, strlen (FILE_SERVICE_TYPE_WALLET_SNAPSHOT));
+    return identifier;
+}
+
+static uint8_t *
+fileServiceTypeWalletSnapshotV1Writer (BRFileServiceContext context,
+                                       BRFileService fs,
+                                       const void* entity,
+                                       uint32_t *bytesCount) {
+    BRArrayOf(uint8_t) snapshot = (BRArrayOf(uint8_t)) entity;
+
+    *bytesCount = (uint32_t) array_count (snapshot);
+
+    uint8_t *bytes = malloc (*bytesCount);
+    memcpy (bytes, snapshot, *bytesCount);
+
+    return bytes;
+}
+
+static void *
+fileServiceTypeWalletSnapshotV1Reader (BRFileServiceContext context,
+                                       BRFileService fs,
+                                       uint8_t *bytes,
+                                       uint32_t bytesCount) {
+    BRArrayOf(uint8_t) snapshot;
+    array_new (snapshot, bytesCount);
+    array_add_array (snapshot, bytes, bytesCount);
+
+    return snapshot;
+}
+
+static int
+fileServiceTypeWalletSnapshotLoadHandler (BRFileServiceContext context,
+                                          BRFileService fs,
+                                          void *entity) {
+    BRArrayOf(uint8_t) *snapshot = context;
+
+    if (NULL != *snapshot) array_free (*snapshot);
+    *snapshot = entity;
+
+    return 1;
+}
+
+extern BRArrayOf(uint8_t)
+initialWalletSnapshotLoadBTC (BRCryptoWalletManager manager) {
+    BRArrayOf(uint8_t) snapshot = NULL;
+    if (1 != fileServiceLoadIterate (manager->fileService, fileServiceTypeWalletSnapshotBTC, 1, NULL,
+                                     &snapshot, fileServiceTypeWalletSnapshotLoadHandler)) {
+        if (NULL != snapshot) array_free (snapshot);
+        _peer_log ("BWM: %4s: failed to load wallet snapshot",
+                   cryptoBlockChainTypeGetCurrencyCode (manager->type));
+        return NULL;
+    }
+
+    _peer_log ("BWM: %4s: loaded %4zu bytes of wallet snapshot\n",
+               cryptoBlockChainTypeGetCurrencyCode (manager->type),
+               (NULL == snapshot ? 0 : array_count (snapshot)));
+    return snapshot;
+}
+
+extern void
+walletSnapshotSaveBTC (BRCryptoWalletManager manager,
+                       BRWallet *wallet) {
+    BRArrayOf(uint8_t) snapshot;
+    size_t snapshotCount = BRWalletSnapshot (wallet, NULL, 0);
+
+    array_new (snapshot, snapshotCount);
+    array_set_count (snapshot, snapshotCount);
+
+    // The wallet may change between the two calls; if so, try again with the larger size.
+    while (array_count (snapshot) < (snapshotCount = BRWalletSnapshot (wallet, snapshot, array_count (snapshot))))
+        array_set_count (snapshot, snapshotCount);
+    array_set_count (snapshot, snapshotCount);
+
+    fileServiceSave (manager->fileService, fileServiceTypeWalletSnapshotBTC, snapshot);
+    array_free (snapshot);
+}
+
 ///
 /// For BTC, the FileService DOES NOT save BRCryptoClientTransactionBundles; instead BTC saves
 /// BRTransaction.  This allows the P2P mode to work seamlessly as P2P mode has zero knowledge of
@@ -342,12 +563,42 @@ static BRFileServiceTypeSpecification fileServiceSpecificationsArrayBTC[] = {
                 fileServiceTypePeerV1Writer
             }
         }
+    },
+
+    {
+        FILE_SERVICE_TYPE_ADDRESS_CHAINS,
+        FILE_SERVICE_TYPE_ADDRESS_CHAINS_VERSION_1,
+        1,
+        {
+            {
+                FILE_SERVICE_TYPE_ADDRESS_CHAINS_VERSION_1,
+                fileServiceTypeAddressChainsV1Identifier,
+                fileServiceTypeAddressChainsV1Reader,
+                fileServiceTypeAddressChainsV1Writer
+            }
+        }
+    },
+
+    {
+        FILE_SERVICE_TYPE_WALLET_SNAPSHOT,
+        FILE_SERVICE_TYPE_WALLET_SNAPSHOT_VERSION_1,
+        1,
+        {
+            {
+                FILE_SERVICE_TYPE_WALLET_SNAPSHOT_VERSION_1,
+                fileServiceTypeWalletSnapshotV1Identifier,
+                fileServiceTypeWalletSnapshotV1Reader,
+                fileServiceTypeWalletSnapshotV1Writer
+            }
+        }
     }
 };
 
 const char *fileServiceTypeTransactionsBTC = FILE_SERVICE_TYPE_TRANSACTION;
 const char *fileServiceTypeBlocksBTC       = FILE_SERVICE_TYPE_BLOCK;
 const char *fileServiceTypePeersBTC        = FILE_SERVICE_TYPE_PEER;
+const char *fileServiceTypeAddressChainsBTC  = FILE_SERVICE_TYPE_ADDRESS_CHAINS;
+const char *fileServiceTypeWalletSnapshotBTC = FILE_SERVICE_TYPE_WALLET_SNAPSHOT;
 
 size_t fileServiceSpecificationsCountBTC = sizeof(fileServiceSpecificationsArrayBTC)/sizeof(BRFileServiceTypeSpecification);
 BRFileServiceTypeSpecification *fileServiceSpecificationsBTC = fileServiceSpecificationsArrayBTC;
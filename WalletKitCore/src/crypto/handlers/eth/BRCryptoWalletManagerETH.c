@@ -143,10 +143,10 @@ cryptoWalletManagerCreateFileServiceETH (BRCryptoWalletManager manager,
                                          const char *network,
                                          BRFileServiceContext context,
                                          BRFileServiceErrorHandler handler) {
-    return fileServiceCreateFromTypeSpecifications (basePath, currency, network,
-                                                    context, handler,
-                                                    cryptoFileServiceSpecificationsCount,
-                                                    cryptoFileServiceSpecifications);
+    return cryptoWalletManagerCreateFileService (manager, basePath, currency, network,
+                                                 context, handler,
+                                                 cryptoFileServiceSpecificationsCount,
+                                                 cryptoFileServiceSpecifications);
 }
 
 static const BREventType **
@@ -1005,6 +1005,7 @@ BRCryptoWalletManagerHandlers cryptoWalletManagerHandlersETH = {
     NULL, // BRCryptoWalletManagerSaveTransactionBundleHandler
     NULL, // BRCryptoWalletManagerSaveTransactionBundleHandler
     cryptoWalletManagerRecoverTransfersFromTransactionBundleETH,
+    NULL, // BRCryptoWalletManagerRecoverTransfersFromTransactionBundlesHandler
     cryptoWalletManagerRecoverTransferFromTransferBundleETH,
     cryptoWalletManagerRecoverFeeBasisFromFeeEstimateETH,
     NULL,//BRCryptoWalletManagerWalletSweeperValidateSupportedHandler not supported
@@ -66,10 +66,10 @@ crytpWalletManagerCreateFileServiceHBAR (BRCryptoWalletManager manager,
                                          const char *network,
                                          BRFileServiceContext context,
                                          BRFileServiceErrorHandler handler) {
-    return fileServiceCreateFromTypeSpecifications (basePath, currency, network,
-                                                    context, handler,
-                                                    cryptoFileServiceSpecificationsCount,
-                                                    cryptoFileServiceSpecifications);
+    return cryptoWalletManagerCreateFileService (manager, basePath, currency, network,
+                                                 context, handler,
+                                                 cryptoFileServiceSpecificationsCount,
+                                                 cryptoFileServiceSpecifications);
 }
 
 static const BREventType **
@@ -303,6 +303,7 @@ BRCryptoWalletManagerHandlers cryptoWalletManagerHandlersHBAR = {
     NULL, // BRCryptoWalletManagerSaveTransactionBundleHandler
     NULL, // BRCryptoWalletManagerSaveTransactionBundleHandler
     cryptoWalletManagerRecoverTransfersFromTransactionBundleHBAR,
+    NULL, // BRCryptoWalletManagerRecoverTransfersFromTransactionBundlesHandler
     cryptoWalletManagerRecoverTransferFromTransferBundleHBAR,
     NULL,//BRCryptoWalletManagerRecoverFeeBasisFromFeeEstimateHandler not supported
     cryptoWalletManagerWalletSweeperValidateSupportedHBAR,
@@ -26,12 +26,15 @@
 #include "BRCrypto.h"
 #include "BRBase58.h"
 #include <string.h>
+#include <pthread.h>
 #include <assert.h>
 
 #define BIP32_SEED_KEY "Bitcoin seed"
 #define BIP32_XPRV     "\x04\x88\xAD\xE4"
 #define BIP32_XPUB     "\x04\x88\xB2\x1E"
 
+#define BIP32_THREAD_MIN_KEYS 32 // fewest keys BRBIP32ChainPubKeyList() derives on a thread of its own
+
 // BIP32 is a scheme for deriving chains of addresses from a seed value
 // https://github.com/bitcoin/bips/blob/master/bip-0032.mediawiki
 
@@ -154,6 +157,78 @@ size_t BRBIP32PubKey(uint8_t *pubKey, size_t pubKeyLen, BRMasterPubKey mpk, uint
     return (! pubKey || sizeof(BRECPoint) <= pubKeyLen) ? sizeof(BRECPoint) : 0;
 }
 
+// returns the extended public key for path N(m/0H/chain), for deriving the keys in chain with BRBIP32ChainPubKeyList()
+BRChainPubKey BRBIP32ChainPubKey(BRMasterPubKey mpk, uint32_t chain)
+{
+    BRChainPubKey cpk = { mpk.chainCode, { 0 } };
+
+    assert(memcmp(&mpk, &BR_MASTER_PUBKEY_NONE, sizeof(mpk)) != 0);
+    assert(sizeof(cpk.pubKey) == sizeof(BRECPoint));
+    memcpy(cpk.pubKey, mpk.pubKey, sizeof(cpk.pubKey));
+    _CKDpub((BRECPoint *)cpk.pubKey, &cpk.chainCode, chain); // path N(m/0H/chain)
+    return cpk;
+}
+
+typedef struct {
+    BRECPoint *pubKeys;
+    size_t count;
+    const BRChainPubKey *cpk;
+    uint32_t index;
+    pthread_t thread;
+    int started;
+} _BRChainPubKeyListPart;
+
+static void *_BRChainPubKeyListDerive(void *arg)
+{
+    _BRChainPubKeyListPart *part = arg;
+    UInt256 c;
+
+    for (size_t i = 0; i < part->count; i++) {
+        part->pubKeys[i] = *(const BRECPoint *)part->cpk->pubKey;
+        c = part->cpk->chainCode;
+        _CKDpub(&part->pubKeys[i], &c, part->index + (uint32_t)i); // index'th key in chain
+    }
+
+    var_clean(&c);
+    return NULL;
+}
+
+// writes the public keys for paths N(m/0H/chain/index) through N(m/0H/chain/index + count - 1), where cpk is the
+// extended public key for N(m/0H/chain), to pubKeys, spreading large lists over up to threadCount threads
+void BRBIP32ChainPubKeyList(BRECPoint pubKeys[], size_t count, BRChainPubKey cpk, uint32_t index, size_t threadCount)
+{
+    size_t partCount = count/BIP32_THREAD_MIN_KEYS;
+    
+    assert(pubKeys != NULL || count == 0);
+    if (partCount > threadCount) partCount = threadCount;
+    if (partCount < 1) partCount = 1;
+    
+    _BRChainPubKeyListPart parts[partCount];
+    pthread_attr_t attr;
+
+    for (size_t i = 0; i < partCount; i++) {
+        parts[i] = (_BRChainPubKeyListPart) { &pubKeys[i*count/partCount], (i + 1)*count/partCount - i*count/partCount,
+                                              &cpk, index + (uint32_t)(i*count/partCount) };
+    }
+
+    // the calling thread derives the first part, and any part that didn't get a thread of its own
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+    for (size_t i = 1; i < partCount; i++) {
+        parts[i].started = (pthread_create(&parts[i].thread, &attr, _BRChainPubKeyListDerive, &parts[i]) == 0);
+    }
+
+    pthread_attr_destroy(&attr);
+
+    for (size_t i = 0; i < partCount; i++) {
+        if (parts[i].started) pthread_join(parts[i].thread, NULL);
+        else _BRChainPubKeyListDerive(&parts[i]);
+    }
+
+    var_clean(&cpk.chainCode);
+}
+
 // sets the private key for path m/0H/chain/index to key
 void BRBIP32PrivKey(BRKey *key, const void *seed, size_t seedLen, uint32_t chain, uint32_t index)
 {
@@ -72,6 +72,12 @@ typedef struct {
     uint8_t pubKey[33];
 } BRMasterPubKey;
 
+// the extended public key N(m/0H/chain) that the keys in a chain are derived from
+typedef struct {
+    UInt256 chainCode;
+    uint8_t pubKey[33];
+} BRChainPubKey;
+
 #define BR_MASTER_PUBKEY_NONE ((const BRMasterPubKey) { 0, UINT256_ZERO, \
     { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 } })
 
@@ -82,6 +88,13 @@ BRMasterPubKey BRBIP32MasterPubKey(const void *seed, size_t seedLen);
 // returns number of bytes written, or pubKeyLen needed if pubKey is NULL
 size_t BRBIP32PubKey(uint8_t *pubKey, size_t pubKeyLen, BRMasterPubKey mpk, uint32_t chain, uint32_t index);
 
+// returns the extended public key for path N(m/0H/chain), for deriving the keys in chain with BRBIP32ChainPubKeyList()
+BRChainPubKey BRBIP32ChainPubKey(BRMasterPubKey mpk, uint32_t chain);
+
+// writes the public keys for paths N(m/0H/chain/index) through N(m/0H/chain/index + count - 1), where cpk is the
+// extended public key for N(m/0H/chain), to pubKeys, spreading large lists over up to threadCount threads
+void BRBIP32ChainPubKeyList(BRECPoint pubKeys[], size_t count, BRChainPubKey cpk, uint32_t index, size_t threadCount);
+
 // sets the private key for path m/0H/chain/index to key
 void BRBIP32PrivKey(BRKey *key, const void *seed, size_t seedLen, uint32_t chain, uint32_t index);
 
@@ -0,0 +1,326 @@
+//
+//  BRCompress.c
+//  Core
+//
+//  Copyright © 2019 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "BRCompress.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define MIN_MATCH       4
+#define MAX_OFFSET      0xffff
+#define HASH_BITS       12
+#define HASH_COUNT      (1 << HASH_BITS)
+
+// training: sequences of KMER_LEN bytes are counted by the number of samples holding them and
+// the dictionary is built from the SEGMENT_LEN byte segments holding the most counted sequences
+#define KMER_LEN        8
+#define SEGMENT_LEN     64
+#define KMER_HASH_BITS  16
+
+struct BRCompressDictionaryStruct {
+    uint8_t *bytes;
+    size_t count;
+    uint32_t table[HASH_COUNT]; // the last dictionary position, plus 1, for each hash; 0 if none
+};
+
+static uint32_t _read32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t _hash4(const uint8_t *p)
+{
+    return (_read32(p)*2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint32_t _hashKmer(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t)((v*0x9e3779b97f4a7c15ull) >> (64 - KMER_HASH_BITS));
+}
+
+// returns a newly allocated dictionary, with a copy of `bytes`, that must be freed by calling
+// BRCompressDictionaryFree()
+BRCompressDictionary BRCompressDictionaryNew(const uint8_t *bytes, size_t bytesCount)
+{
+    BRCompressDictionary dictionary = calloc(1, sizeof(*dictionary));
+
+    assert(dictionary != NULL);
+    assert(bytes != NULL || bytesCount == 0);
+
+    // matches must be reachable from the start of the compressed bytes; keep the end
+    if (bytesCount > BR_COMPRESS_DICTIONARY_MAX_COUNT) {
+        bytes += bytesCount - BR_COMPRESS_DICTIONARY_MAX_COUNT;
+        bytesCount = BR_COMPRESS_DICTIONARY_MAX_COUNT;
+    }
+
+    dictionary->bytes = malloc(bytesCount + 1);
+    memcpy(dictionary->bytes, bytes, bytesCount);
+    dictionary->count = bytesCount;
+
+    for (size_t i = 0; i + MIN_MATCH <= bytesCount; i++) {
+        dictionary->table[_hash4(&bytes[i])] = (uint32_t)(i + 1);
+    }
+
+    return dictionary;
+}
+
+// frees the memory allocated for dictionary
+void BRCompressDictionaryFree(BRCompressDictionary dictionary)
+{
+    assert(dictionary != NULL);
+    free(dictionary->bytes);
+    free(dictionary);
+}
+
+// the most bytes that compressing srcCount bytes can produce
+size_t BRCompressBound(size_t srcCount)
+{
+    return 1 + srcCount + srcCount/255 + 1;
+}
+
+// appends the sequence {literals, match} to dst at *op, returns false if it doesn't fit
+static int _BRCompressEmit(uint8_t *dst, size_t dstCapacity, size_t *op, const uint8_t *literals,
+                           size_t literalsCount, size_t offset, size_t matchCount)
+{
+    size_t o = *op, n, matchCode = (matchCount == 0) ? 0 : matchCount - MIN_MATCH;
+    size_t need = 1 + literalsCount/255 + 1 + literalsCount + ((matchCount == 0) ? 0 : 2 + matchCode/255 + 1);
+    uint8_t *token;
+
+    if (o + need > dstCapacity) return 0;
+
+    token = &dst[o++];
+    *token = (uint8_t)(((literalsCount >= 15) ? 15 : literalsCount) << 4);
+
+    if (literalsCount >= 15) {
+        for (n = literalsCount - 15; n >= 255; n -= 255) dst[o++] = 255;
+        dst[o++] = (uint8_t)n;
+    }
+
+    memcpy(&dst[o], literals, literalsCount);
+    o += literalsCount;
+
+    if (matchCount != 0) {
+        dst[o++] = (uint8_t)(offset & 0xff);
+        dst[o++] = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)((matchCode >= 15) ? 15 : matchCode);
+
+        if (matchCode >= 15) {
+            for (n = matchCode - 15; n >= 255; n -= 255) dst[o++] = 255;
+            dst[o++] = (uint8_t)n;
+        }
+    }
+
+    *op = o;
+    return 1;
+}
+
+// compresses src into dst, with dictionary if not NULL, and returns the number of bytes written
+// to dst or 0 if dstCapacity is too small
+size_t BRCompress(uint8_t *dst, size_t dstCapacity, const uint8_t *src, size_t srcCount,
+                  BRCompressDictionary dictionary)
+{
+    uint32_t table[HASH_COUNT]; // the last src position, plus 1, for each hash; 0 if none
+    const uint8_t *dict = (dictionary) ? dictionary->bytes : NULL;
+    size_t dictCount = (dictionary) ? dictionary->count : 0, i = 0, anchor = 0, op = 0;
+
+    assert(dst != NULL);
+    assert(src != NULL || srcCount == 0);
+    memset(table, 0, sizeof(table));
+
+    while (i + MIN_MATCH <= srcCount) {
+        uint32_t h = _hash4(&src[i]), candidate = table[h];
+        size_t c, matchCount = 0, offset = 0;
+
+        table[h] = (uint32_t)(i + 1);
+
+        if (candidate != 0 && i - (candidate - 1) <= MAX_OFFSET &&
+            _read32(&src[candidate - 1]) == _read32(&src[i])) { // a match within src
+            c = candidate - 1;
+            matchCount = MIN_MATCH;
+            while (i + matchCount < srcCount && src[c + matchCount] == src[i + matchCount]) matchCount++;
+            offset = i - c;
+        }
+        else if (dictionary && dictionary->table[h] != 0) { // otherwise, a match within the dictionary
+            c = dictionary->table[h] - 1;
+
+            if (i + dictCount - c <= MAX_OFFSET && _read32(&dict[c]) == _read32(&src[i])) {
+                matchCount = MIN_MATCH;
+                while (i + matchCount < srcCount && c + matchCount < dictCount &&
+                       dict[c + matchCount] == src[i + matchCount]) matchCount++;
+                offset = i + dictCount - c;
+            }
+        }
+
+        if (matchCount == 0) {
+            i++;
+            continue;
+        }
+
+        if (! _BRCompressEmit(dst, dstCapacity, &op, &src[anchor], i - anchor, offset, matchCount)) return 0;
+        i += matchCount;
+        anchor = i;
+
+        // index a position near the end of the match, for the matches that follow it
+        if (i + MIN_MATCH <= srcCount) table[_hash4(&src[i - 2])] = (uint32_t)(i - 2 + 1);
+    }
+
+    // the last sequence has only literals
+    if (! _BRCompressEmit(dst, dstCapacity, &op, &src[anchor], srcCount - anchor, 0, 0)) return 0;
+    return op;
+}
+
+// reads an extended count, of bytes of 255 until a smaller byte, into *count
+static int _BRDecompressCount(const uint8_t *src, size_t srcCount, size_t *ip, size_t *count)
+{
+    uint8_t b;
+
+    do {
+        if (*ip >= srcCount) return 0;
+        b = src[(*ip)++];
+        *count += b;
+    } while (b == 255);
+
+    return 1;
+}
+
+// decompresses src, compressed with dictionary, into exactly dstCount bytes of dst and returns
+// dstCount or 0 if src is malformed or does not decompress to dstCount bytes
+size_t BRDecompress(uint8_t *dst, size_t dstCount, const uint8_t *src, size_t srcCount,
+                    BRCompressDictionary dictionary)
+{
+    const uint8_t *dict = (dictionary) ? dictionary->bytes : NULL;
+    size_t dictCount = (dictionary) ? dictionary->count : 0, ip = 0, op = 0;
+
+    assert(dst != NULL || dstCount == 0);
+    assert(src != NULL || srcCount == 0);
+
+    while (1) {
+        if (ip >= srcCount) return 0; // the last sequence is missing
+        uint8_t token = src[ip++];
+        size_t literalsCount = token >> 4, matchCount = token & 0x0f, offset;
+
+        if (literalsCount == 15 && ! _BRDecompressCount(src, srcCount, &ip, &literalsCount)) return 0;
+        if (literalsCount > srcCount - ip || literalsCount > dstCount - op) return 0;
+        memcpy(&dst[op], &src[ip], literalsCount);
+        ip += literalsCount;
+        op += literalsCount;
+
+        if (ip == srcCount) return (op == dstCount) ? op : 0; // the last sequence has only literals
+        if (srcCount - ip < 2) return 0;
+        offset = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+
+        if (matchCount == 15 && ! _BRDecompressCount(src, srcCount, &ip, &matchCount)) return 0;
+        matchCount += MIN_MATCH;
+        if (offset == 0 || offset > op + dictCount || matchCount > dstCount - op) return 0;
+
+        // byte by byte; a match can overlap the bytes it produces and can start in the dictionary
+        for (size_t end = op + matchCount; op < end; op++) {
+            dst[op] = (op >= offset) ? dst[op - offset] : dict[dictCount - (offset - op)];
+        }
+    }
+}
+
+// trains a dictionary, of up to dictCapacity bytes, from the byte sequences that recur in
+// samples and returns the dictionary's length or 0 if nothing recurs
+size_t BRCompressTrain(uint8_t *dict, size_t dictCapacity, const uint8_t **samples,
+                       const size_t *samplesCounts, size_t samplesCount)
+{
+    size_t total = 0, dictCount = 0, i, j, epochs, epochSize;
+    uint32_t *counts, *lastSample;
+    uint16_t *hashes;
+    uint8_t *all;
+
+    assert(dict != NULL || dictCapacity == 0);
+    assert(samples != NULL || samplesCount == 0);
+
+    for (i = 0; i < samplesCount; i++) total += samplesCounts[i];
+    if (dictCapacity > BR_COMPRESS_DICTIONARY_MAX_COUNT) dictCapacity = BR_COMPRESS_DICTIONARY_MAX_COUNT;
+    if (total < SEGMENT_LEN || dictCapacity < SEGMENT_LEN) return 0;
+
+    all = malloc(total);
+    hashes = calloc(total, sizeof(*hashes));
+    counts = calloc(1 << KMER_HASH_BITS, sizeof(*counts));
+    lastSample = calloc(1 << KMER_HASH_BITS, sizeof(*lastSample));
+    assert(all != NULL && hashes != NULL && counts != NULL && lastSample != NULL);
+
+    // count each sequence once per sample that holds it; a sequence repeated within one sample is
+    // already compressed without a dictionary
+    for (i = 0, total = 0; i < samplesCount; i++) {
+        memcpy(&all[total], samples[i], samplesCounts[i]);
+
+        for (j = 0; j + KMER_LEN <= samplesCounts[i]; j++) {
+            uint32_t h = _hashKmer(&all[total + j]);
+
+            hashes[total + j] = (uint16_t)h;
+            if (lastSample[h] != i + 1) counts[h]++, lastSample[h] = (uint32_t)(i + 1);
+        }
+
+        total += samplesCounts[i];
+    }
+
+    // pick the best segment of each epoch; the epochs spread the dictionary across the samples
+    epochs = dictCapacity/SEGMENT_LEN;
+    if (epochs > total/SEGMENT_LEN) epochs = total/SEGMENT_LEN;
+    epochSize = total/epochs;
+
+    for (size_t epoch = 0; epoch < epochs; epoch++) {
+        size_t start = epoch*epochSize, end = start + epochSize, best = start;
+        uint64_t score = 0, bestScore = 0;
+
+        if (end > total) end = total;
+        if (end - start < SEGMENT_LEN) continue;
+
+        // slide a segment across the epoch, scoring it by the counts of the sequences it holds
+        for (j = start; j + KMER_LEN <= start + SEGMENT_LEN; j++) score += counts[hashes[j]];
+        bestScore = score;
+
+        for (i = start + 1; i + SEGMENT_LEN <= end; i++) {
+            score -= counts[hashes[i - 1]];
+            score += counts[hashes[i + SEGMENT_LEN - KMER_LEN]];
+            if (score > bestScore) bestScore = score, best = i;
+        }
+
+        // skip a segment whose sequences are, on average, in fewer than two samples
+        if (bestScore < 2*(SEGMENT_LEN - KMER_LEN + 1)) continue;
+
+        memcpy(&dict[dictCount], &all[best], SEGMENT_LEN);
+        dictCount += SEGMENT_LEN;
+
+        // the sequences of a picked segment add nothing to later segments
+        for (j = best; j + KMER_LEN <= best + SEGMENT_LEN; j++) counts[hashes[j]] = 0;
+    }
+
+    free(lastSample);
+    free(counts);
+    free(hashes);
+    free(all);
+    return dictCount;
+}
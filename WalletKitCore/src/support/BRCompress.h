@@ -0,0 +1,79 @@
+//
+//  BRCompress.h
+//  Core
+//
+//  Copyright © 2019 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef BRCompress_h
+#define BRCompress_h
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// An LZ77 codec for small buffers, such as serialized entities, with an optional preset
+// dictionary.  Many small buffers of one kind share little within each buffer but much across
+// buffers - the same addresses, hashes and strings - which a dictionary trained on samples of
+// the buffers captures.
+//
+// The compressed bytes are a sequence of {Token:1, LiteralsCount+, Literals, Offset:2,
+// MatchCount+} where Token holds 4 bits each of the literals and match counts, extended by
+// bytes of 255 until a smaller byte.  The last sequence has only literals.  An offset reaches
+// back into the decompressed bytes and, before them, into the end of the dictionary.
+
+/// The largest dictionary; longer dictionaries are truncated, keeping the end.
+#define BR_COMPRESS_DICTIONARY_MAX_COUNT        (32 * 1024)
+
+typedef struct BRCompressDictionaryStruct *BRCompressDictionary;
+
+// returns a newly allocated dictionary, with a copy of `bytes`, that must be freed by calling
+// BRCompressDictionaryFree()
+BRCompressDictionary BRCompressDictionaryNew(const uint8_t *bytes, size_t bytesCount);
+
+// frees the memory allocated for dictionary
+void BRCompressDictionaryFree(BRCompressDictionary dictionary);
+
+// the most bytes that compressing srcCount bytes can produce
+size_t BRCompressBound(size_t srcCount);
+
+// compresses src into dst, with dictionary if not NULL, and returns the number of bytes written
+// to dst or 0 if dstCapacity is too small
+size_t BRCompress(uint8_t *dst, size_t dstCapacity, const uint8_t *src, size_t srcCount,
+                  BRCompressDictionary dictionary);
+
+// decompresses src, compressed with dictionary, into exactly dstCount bytes of dst and returns
+// dstCount or 0 if src is malformed or does not decompress to dstCount bytes
+size_t BRDecompress(uint8_t *dst, size_t dstCount, const uint8_t *src, size_t srcCount,
+                    BRCompressDictionary dictionary);
+
+// trains a dictionary, of up to dictCapacity bytes, from the byte sequences that recur in
+// samples and returns the dictionary's length or 0 if nothing recurs
+size_t BRCompressTrain(uint8_t *dict, size_t dictCapacity, const uint8_t **samples,
+                       const size_t *samplesCounts, size_t samplesCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BRCompress_h
@@ -32,84 +32,52 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <sys/time.h>
 #include "support/BROSCompat.h"
+#include "support/BRSet.h"
+#include "support/BRCrypto.h"
+#include "support/BRCompress.h"
 
-#include "../vendor/sqlite3/sqlite3.h"
-typedef int sqlite3_status_code;
+#include "BRFileServiceBackend.h"
 
 #define FILE_SERVICE_INITIAL_TYPE_COUNT    (5)
 #define FILE_SERVICE_INITIAL_HANDLER_COUNT    (2)
 
-#define FILE_SERVICE_SDB_FILENAME      "entities.db"
+#define FILE_SERVICE_WRITE_BEHIND_THREAD_NAME   "Core File Service Writer"
+#define FILE_SERVICE_WRITE_BEHIND_INITIAL_COUNT (50)
 
-#define FILE_SERVICE_SDB_ENTITY_TABLE     \
-"CREATE TABLE IF NOT EXISTS Entity(     \n\
-  Type      CHAR(64)    NOT NULL,       \n\
-  Hash      CHAR(64)    NOT NULL,       \n\
-  Data      TEXT        NOT NULL,       \n\
-  PRIMARY KEY (Type, Hash));"
+#define FILE_SERVICE_LOAD_THREAD_NAME           "Core File Service Loader"
 
-typedef char FileServiceSQL[1024];
+// The fewest entities decoded by each load thread; smaller loads use fewer threads.
+#define FILE_SERVICE_LOAD_THREAD_MIN_COUNT      (64)
 
-#define FILE_SERVICE_SDB_INSERT_ENTITY    \
-"INSERT OR REPLACE INTO Entity (Type, Hash, Data) VALUES (?, ?, ?);"
-
-#define FILE_SERVICE_SDB_QUERY_ENTITY     \
-"SELECT Data FROM Entity WHERE Type = ? AND Hash = ?;"
-
-#define FILE_SERVICE_SDB_QUERY_ALL_ENTITY     \
-"SELECT Hash, Data FROM Entity WHERE Type = ?;"
-
-#define FILE_SERVICE_SDB_UPDATE_ENTITY     \
-"UPDATE Entity SET Data = ? WHERE Type = ? AND Hash = ?;"
-
-#define FILE_SERVICE_SDB_DELETE_ENTITY     \
-"DELETE FROM Entity WHERE Type = ? AND Hash = ?;"
-
-#define FILE_SERVICE_SDB_DELETE_ALL_TYPE_ENTITY     \
-"DELETE FROM Entity WHERE Type = ?;"
-
-#define FILE_SERVICE_SDB_DELETE_ALL_ENTITY     \
-"DELETE FROM Entity;"
-
-#if defined(DEBUG)
-static int needSQLiteCompileOptions = 1;
-#endif
-// HEX Encode/Decode - Cribbed from ethereum/util/BRUtilHex.c
-
-// Convert a char into uint8_t (decode)
-#define decodeChar(c)           ((uint8_t) _hexu(c))
-
-// Convert a uint8_t into a char (encode)
-#define encodeChar(u)           ((char)    _hexc(u))
-
-static void
-hexDecode (uint8_t *target, size_t targetLen, const char *source, size_t sourceLen) {
-    //
-    assert (0 == sourceLen % 2);
-    assert (2 * targetLen == sourceLen);
-
-    for (int i = 0; i < targetLen; i++) {
-        target[i] = (uint8_t) ((decodeChar(source[2*i]) << 4) | decodeChar(source[(2*i)+1]));
-    }
-}
-
-static void
-hexEncode (char *target, size_t targetLen, const uint8_t *source, size_t sourceLen) {
-    assert (targetLen == 2 * sourceLen  + 1);
-
-    for (int i = 0; i < sourceLen; i++) {
-        target[2*i + 0] = encodeChar (source[i] >> 4);
-        target[2*i + 1] = encodeChar (source[i]);
-    }
-    target[2*sourceLen] = '\0';
-}
+// Compression; see `fileServiceTrainCompression()`.  A dictionary is trained from up to
+// SAMPLES_MAX_COUNT stored entities, but not from fewer than SAMPLES_MIN_COUNT.
+#define FILE_SERVICE_DICTIONARY_TYPE_SUFFIX         ".dictionary"
+#define FILE_SERVICE_DICTIONARY_BYTES_COUNT         (16 * 1024)
+#define FILE_SERVICE_DICTIONARY_SAMPLES_MIN_COUNT   (16)
+#define FILE_SERVICE_DICTIONARY_SAMPLES_MAX_COUNT   (1024)
 
 /** Forward Declarations */
 static int
-fileServiceFailedSDB (BRFileService fs,
-                      int releaseLock,
-                      sqlite3_status_code code);
+fileServiceFailedBackend (BRFileService fs,
+                          int releaseLock,
+                          BRFileServiceBackendStatus status);
+
+#if !defined(NEUTER_FILE_SERVICE)
+static BRFileServiceBackendStatus
+fileServiceSaveBytes (BRFileService fs,
+                      const char *type,
+                      UInt256 identifier,
+                      int64_t sortKey,
+                      const uint8_t *bytes,
+                      size_t bytesCount);
+
+static BRFileServiceBackendStatus
+fileServiceRemoveBytes (BRFileService fs,
+                        const char *type,
+                        UInt256 identifier);
+#endif
 
 /// Return 0 on success, -1 otherwise
 static int directoryMake (const char *path) {
@@ -121,11 +89,30 @@ static int directoryMake (const char *path) {
 }
 
 // This must be coercible to/from a uint8_t forever.
+//
+// The formats share a header: {HeaderFormatVersion, Current(Type)Version, EntityBytesCount}
+// followed by the EntityBytes.  They differ in how `Entity.Data` is stored:
+//   HEADER_FORMAT_1: the header+entity bytes are hex-encoded and stored as TEXT
+//   HEADER_FORMAT_2: the header+entity bytes are stored, unencoded, as a BLOB
+//   HEADER_FORMAT_3: as HEADER_FORMAT_2 but the header adds {DictionaryId} and the entity bytes
+//                    are compressed, with the type's dictionary `DictionaryId` (0 for none), into
+//                    the remaining bytes.  See BRCompress.h
+//
+// Entities in HEADER_FORMAT_1 are migrated to HEADER_FORMAT_2 when loaded with `updateVersion`.
+// Entities of a type with compression are saved in HEADER_FORMAT_3 when that saves bytes.
 typedef enum {
-    HEADER_FORMAT_1
+    HEADER_FORMAT_1,
+    HEADER_FORMAT_2,
+    HEADER_FORMAT_3
 } BRFileServiceHeaderFormatVersion;
 
-static BRFileServiceHeaderFormatVersion currentHeaderFormatVersion = HEADER_FORMAT_1;
+static BRFileServiceHeaderFormatVersion currentHeaderFormatVersion = HEADER_FORMAT_2;
+
+// The sort key of an entity whose type has no `BRFileServiceSortKey`; stored without a sort key.
+#define FILE_SERVICE_SORT_KEY_NONE            (FILE_SERVICE_BACKEND_SORT_KEY_NONE)
+
+#define FILE_SERVICE_HEADER_BYTES_COUNT       (1 + 1 + sizeof (uint32_t))
+#define FILE_SERVICE_HEADER_3_BYTES_COUNT     (FILE_SERVICE_HEADER_BYTES_COUNT + sizeof (uint32_t))
 
 ///
 /// The handlers for a particular entity's version
@@ -138,6 +125,14 @@ typedef struct {
     BRFileServiceWriter writer;
 } BRFileServiceEntityHandler;
 
+///
+/// A compression dictionary for an entity type, identified by `id`, as stored in HEADER_FORMAT_3.
+///
+typedef struct {
+    uint32_t id;
+    BRCompressDictionary dictionary;
+} BRFileServiceDictionary;
+
 ///
 /// The set of handlers, by version, for a particular entity.
 ///
@@ -145,6 +140,19 @@ typedef struct {
     char *type;
     BRFileServiceVersion currentVersion;
     BRArrayOf(BRFileServiceEntityHandler) handlers;
+    BRFileServiceContext sortKeyContext;
+    BRFileServiceSortKey sortKey;       // Nullable
+
+    // The operation counts and latencies; protected by `statsLock`.  The stored entities and
+    // bytes are filled in by `fileServiceGetStats()`.
+    BRFileServiceTypeStats stats;
+
+    // Compression; see `fileServiceDefineCompression()`.  The dictionaries are stored as the
+    // `dictionaryType` entities.  The `dictionaries` array, with the current one last, is
+    // protected by `codecLock`; a dictionary itself is immutable and lives until the release.
+    bool compressed;
+    char *dictionaryType;
+    BRArrayOf(BRFileServiceDictionary) dictionaries;
 } BRFileServiceEntityType;
 
 static void
@@ -152,6 +160,15 @@ fileServiceEntityTypeRelease (const BRFileServiceEntityType *entityType) {
     free (entityType->type);
     if (NULL != entityType->handlers)
         array_free(entityType->handlers);
+
+    if (NULL != entityType->dictionaryType)
+        free (entityType->dictionaryType);
+
+    if (NULL != entityType->dictionaries) {
+        for (size_t index = 0; index < array_count (entityType->dictionaries); index++)
+            BRCompressDictionaryFree (entityType->dictionaries[index].dictionary);
+        array_free (entityType->dictionaries);
+    }
 }
 
 static BRFileServiceEntityHandler *
@@ -176,24 +193,72 @@ fileServiceEntityTypeAddHandler (BRFileServiceEntityType *entityType,
         *existingHandler = *handler;
 }
 
+#if !defined(NEUTER_FILE_SERVICE)
+///
+/// A save or a remove waiting on the write-behind thread.  A save holds `bytes` as encoded by
+/// `fileServiceEntityEncode()`; a remove holds NULL `bytes`.  Queued writes are unique by {type,
+/// identifier} - a later write replaces an earlier one.
+///
+typedef struct {
+    const char *type;   // The entity type's `type`; stable for the life of the file service
+    UInt256 identifier;
+    int64_t sortKey;
+    uint8_t *bytes;
+    size_t bytesCount;
+} BRFileServiceQueuedWrite;
+
+static size_t
+fileServiceQueuedWriteHash (const void *item) {
+    const BRFileServiceQueuedWrite *write = item;
+    return (size_t) write->identifier.u32[0] ^ (size_t) write->type;
+}
+
+static int
+fileServiceQueuedWriteEq (const void *item1, const void *item2) {
+    const BRFileServiceQueuedWrite *write1 = item1;
+    const BRFileServiceQueuedWrite *write2 = item2;
+    return (write1->type == write2->type &&
+            UInt256Eq (write1->identifier, write2->identifier));
+}
+
+static void
+fileServiceQueuedWriteRelease (void *item) {
+    BRFileServiceQueuedWrite *write = item;
+    if (NULL != write->bytes) free (write->bytes);
+    free (write);
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
 ///
 ///
 ///
 struct BRFileServiceRecord {
     char *currency;
     char *network;
-    char *sdbPath;
 
 #if !defined(NEUTER_FILE_SERVICE)
-    sqlite3 *sdb;
-    sqlite3_stmt *sdbInsertStmt;
-    sqlite3_stmt *sdbSelectStmt;
-    sqlite3_stmt *sdbSelectAllStmt;
-    sqlite3_stmt *sdbUpdateStmt;
-    sqlite3_stmt *sdbDeleteStmt;
-    sqlite3_stmt *sdbDeleteAllTypeStmt;
-    sqlite3_stmt *sdbDeleteAllStmt;
-    bool  sdbClosed;
+    // The storage engine; see BRFileServiceBackend.h
+    const BRFileServiceBackendHandlers *backendHandlers;
+    BRFileServiceBackend backend;
+    bool  closed;
+
+    // The depth of nested `fileServiceBeginBatch()` calls.  `batchCond` is signalled, with `lock`,
+    // when the outermost batch completes.
+    size_t batchDepth;
+    pthread_cond_t batchCond;
+
+    // The threads that decode loaded entities; see `fileServiceSetLoadThreads()`.
+    size_t loadThreadsCount;
+
+    // Write-behind; see `fileServiceSetWriteBehind()`.  These are protected by `wbLock`.  Lock
+    // order is `wbLock` then `lock` - but never hold `wbLock` while writing to the DB.
+    bool wbEnabled;
+    bool wbQuit;
+    bool wbWriting;
+    pthread_t wbThread;
+    pthread_mutex_t wbLock;
+    pthread_cond_t  wbCond;
+    BRSetOf(BRFileServiceQueuedWrite*) wbWrites;
 #endif
 
     BRArrayOf(BRFileServiceEntityType) entityTypes;
@@ -201,61 +266,89 @@ struct BRFileServiceRecord {
     BRFileServiceErrorHandler handler;
 
     pthread_mutex_t lock;
-};
 
-static BRFileService
-fileServiceCreateReturnError (BRFileService fs,
-                              int releaseLock,
-                              BRFileServiceError error) {
-    // Nothing with 'error' at this point; a placeholder for now.
-    if (releaseLock) pthread_mutex_unlock (&fs->lock);
-    fileServiceRelease (fs);
-    return NULL;
-}
+    // Protects each entity type's `stats`; never held while acquiring another lock.
+    pthread_mutex_t statsLock;
+
+    // Protects each entity type's `dictionaries`; never held while acquiring another lock.
+    pthread_mutex_t codecLock;
+};
 
-static char *
+extern char *
 fileServiceCreateFilePath (const char *basePath,
                            const char *currency,
                            const char *network,
                            const char *filename) {
-    size_t sdbPathLength = strlen (basePath) + 1 + strlen(currency) + 1 + strlen(network) + 1 + strlen (filename) + 1;
-    char   *sdbPath      = malloc (sdbPathLength);
-    sprintf (sdbPath, "%s/%s-%s-%s", basePath, currency, network, filename);
-    return sdbPath;
+    size_t filePathLength = strlen (basePath) + 1 + strlen(currency) + 1 + strlen(network) + 1 + strlen (filename) + 1;
+    char   *filePath      = malloc (filePathLength);
+    sprintf (filePath, "%s/%s-%s-%s", basePath, currency, network, filename);
+    return filePath;
 }
 
+#if !defined(NEUTER_FILE_SERVICE)
+static const BRFileServiceBackendHandlers *
+fileServiceBackendHandlersForType (BRFileServiceBackendType backendType) {
+    switch (backendType) {
+        case FILE_SERVICE_BACKEND_SQLITE: return &fileServiceBackendHandlersSQLite;
+        case FILE_SERVICE_BACKEND_LOG:    return &fileServiceBackendHandlersLog;
+    }
+    return NULL;
+}
+#endif
+
 extern BRFileService
 fileServiceCreate (const char *basePath,
                    const char *currency,
                    const char *network,
                    BRFileServiceContext context,
                    BRFileServiceErrorHandler handler) {
-    if (NULL == basePath || 0 == strlen(basePath)) return NULL;
-    if (NULL == currency || 0 == strlen(currency)) return NULL;
-    if (NULL == network  || 0 == strlen(network))  return NULL;
-
-    // Reasonable limits on `network` and `currency` (ensure subsequent stack allocation works).
-    if (strlen(network) > FILENAME_MAX || strlen(currency) > FILENAME_MAX)
-        return NULL;
-
-#if !defined(NEUTER_FILE_SERVICE)
-    // Make directory if needed.
-    if (-1 == directoryMake(basePath)) return NULL;
+    return fileServiceCreateWithBackend (basePath, currency, network,
+                                         FILE_SERVICE_BACKEND_SQLITE,
+                                         context,
+                                         handler);
+}
 
-    // Require `basePath` to be an existing directory.
-    DIR *dir = opendir(basePath);
-    if (NULL == dir) return NULL;
-    closedir(dir);
+///
+/// Check the limits on `currency` and `network`; see `fileServiceCreate()`
+///
+static bool
+fileServiceCheckNames (const char *currency,
+                       const char *network) {
+    if (NULL == currency || 0 == strlen(currency)) return false;
+    if (NULL == network  || 0 == strlen(network))  return false;
 
-    // Require SQLite to support 'MULTI_THREADED' or 'SERIALIZED'.  We'll lock our connection.
-    // and thus 'MULTI_THREADED' is appropriate.
-    if (0 == sqlite3_threadsafe()) return NULL;
-#endif
+    // Reasonable limits on `network` and `currency` (ensure subsequent stack allocation works).
+    return strlen(network) <= FILENAME_MAX && strlen(currency) <= FILENAME_MAX;
+}
 
+///
+/// Allocate a file service, without a backend, for {currency, network}
+///
+static BRFileService
+fileServiceAlloc (const char *currency,
+                  const char *network,
+                  BRFileServiceContext context,
+                  BRFileServiceErrorHandler handler) {
     // Create the file service itself
     BRFileService fs = calloc (1, sizeof (struct BRFileServiceRecord));
 
     pthread_mutex_init_brd (&fs->lock, PTHREAD_MUTEX_NORMAL);
+    pthread_mutex_init_brd (&fs->statsLock, PTHREAD_MUTEX_NORMAL);
+    pthread_mutex_init_brd (&fs->codecLock, PTHREAD_MUTEX_NORMAL);
+
+#if !defined(NEUTER_FILE_SERVICE)
+    pthread_cond_init (&fs->batchCond, NULL);
+
+    // Write-behind is disabled until `fileServiceSetWriteBehind()`
+    pthread_mutex_init_brd (&fs->wbLock, PTHREAD_MUTEX_NORMAL);
+    pthread_cond_init (&fs->wbCond, NULL);
+    fs->wbWrites = BRSetNew (fileServiceQueuedWriteHash,
+                             fileServiceQueuedWriteEq,
+                             FILE_SERVICE_WRITE_BEHIND_INITIAL_COUNT);
+
+    // Closed until the backend is opened
+    fs->closed = true;
+#endif
 
     // Set the error handler - early
     fileServiceSetErrorHandler (fs, context, handler);
@@ -264,132 +357,100 @@ fileServiceCreate (const char *basePath,
     fs->currency = strdup (currency);
     fs->network  = strdup (network);
 
-    // Locate the SQLITE Database
-     fs->sdbPath = fileServiceCreateFilePath (basePath, currency, network, FILE_SERVICE_SDB_FILENAME);
+    // Allocate the `entityTypes` array
+    array_new (fs->entityTypes, FILE_SERVICE_INITIAL_TYPE_COUNT);
+
+    return fs;
+}
+
+extern BRFileService
+fileServiceCreateWithBackend (const char *basePath,
+                              const char *currency,
+                              const char *network,
+                              BRFileServiceBackendType backendType,
+                              BRFileServiceContext context,
+                              BRFileServiceErrorHandler handler) {
+    if (NULL == basePath || 0 == strlen(basePath)) return NULL;
+    if (!fileServiceCheckNames (currency, network)) return NULL;
 
 #if !defined(NEUTER_FILE_SERVICE)
-    fs->sdb = NULL;
-    fs->sdbClosed = false;
+    const BRFileServiceBackendHandlers *backendHandlers = fileServiceBackendHandlersForType (backendType);
+    if (NULL == backendHandlers) return NULL;
 
-    // Create/Open the SQLITE Database
-    sqlite3_status_code status = sqlite3_open(fs->sdbPath, &fs->sdb);
-    if (SQLITE_OK != status) {
+    // Make directory if needed.
+    if (-1 == directoryMake(basePath)) return NULL;
+
+    // Require `basePath` to be an existing directory.
+    DIR *dir = opendir(basePath);
+    if (NULL == dir) return NULL;
+    closedir(dir);
+#endif
+
+    BRFileService fs = fileServiceAlloc (currency, network, context, handler);
+
+#if !defined(NEUTER_FILE_SERVICE)
+    // Create/Open the backend's store
+    BRFileServiceBackendStatus status;
+    fs->backendHandlers = backendHandlers;
+    fs->backend = backendHandlers->open (basePath, currency, network, &status);
+    fs->closed  = (NULL == fs->backend);
+    if (NULL == fs->backend) {
         fileServiceRelease (fs);
         return NULL;
     }
-
-    // Create the SQLite 'Entity' Table
-    sqlite3_stmt *sdbCreateTableStmt;
-    status = sqlite3_prepare_v2 (fs->sdb, FILE_SERVICE_SDB_ENTITY_TABLE, -1, &sdbCreateTableStmt, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceCreateReturnError (fs, 1, (BRFileServiceError) {
-            FILE_SERVICE_SDB,
-            { .sdb = { status }}
-        });
-
-    if (SQLITE_DONE != sqlite3_step(sdbCreateTableStmt))
-        return fileServiceCreateReturnError (fs, 1, (BRFileServiceError) {
-            FILE_SERVICE_SDB,
-            { .sdb = { status }}
-        });
-    sqlite3_finalize(sdbCreateTableStmt);
-
-    // Create the SQLITE 'Insert into Entity' Statement
-    status = sqlite3_prepare_v2 (fs->sdb, FILE_SERVICE_SDB_INSERT_ENTITY, -1, &fs->sdbInsertStmt, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceCreateReturnError (fs, 1, (BRFileServiceError) {
-            FILE_SERVICE_SDB,
-            { .sdb = { status }}
-        });
-
-    // Create the SQLITE "Select Entity By Hash' Statement
-    status = sqlite3_prepare_v2 (fs->sdb, FILE_SERVICE_SDB_QUERY_ENTITY, -1, &fs->sdbSelectStmt, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceCreateReturnError (fs, 1, (BRFileServiceError) {
-            FILE_SERVICE_SDB,
-            { .sdb = { status }}
-        });
-
-    // Create the SQLITE "Select Entity ' Statement
-    status = sqlite3_prepare_v2 (fs->sdb, FILE_SERVICE_SDB_QUERY_ALL_ENTITY, -1, &fs->sdbSelectAllStmt, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceCreateReturnError (fs, 1, (BRFileServiceError) {
-            FILE_SERVICE_SDB,
-            { .sdb = { status }}
-        });
-
-    status = sqlite3_prepare_v2 (fs->sdb, FILE_SERVICE_SDB_UPDATE_ENTITY, -1, &fs->sdbUpdateStmt, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceCreateReturnError (fs, 1, (BRFileServiceError) {
-            FILE_SERVICE_SDB,
-            { .sdb = { status }}
-        });
-
-    status = sqlite3_prepare_v2 (fs->sdb, FILE_SERVICE_SDB_DELETE_ENTITY, -1, &fs->sdbDeleteStmt, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceCreateReturnError (fs, 1, (BRFileServiceError) {
-            FILE_SERVICE_SDB,
-            { .sdb = { status }}
-        });
-
-    status = sqlite3_prepare_v2 (fs->sdb, FILE_SERVICE_SDB_DELETE_ALL_TYPE_ENTITY, -1, &fs->sdbDeleteAllTypeStmt, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceCreateReturnError (fs, 1, (BRFileServiceError) {
-            FILE_SERVICE_SDB,
-            { .sdb = { status }}
-        });
-
-#  if defined(DEBUG)
-    if (needSQLiteCompileOptions) {
-        needSQLiteCompileOptions = 0;
-        printf ("SQLITE ThreadSafe Mutex: %d\n", sqlite3_threadsafe());
-        printf ("SQLITE Compile Options:\n");
-        const char *option = NULL;
-        for (int index = 0;
-             NULL != (option = sqlite3_compileoption_get(index));
-             index++) {
-            printf ("-DSQLITE_%s\n", option);
-        }
-    }
-#  endif
 #endif // !define(NEUTER_FILE_SERVICE)
 
-    // Allocate the `entityTypes` array
-    array_new (fs->entityTypes, FILE_SERVICE_INITIAL_TYPE_COUNT);
-
     return fs;
 }
 
-static void
-_fileServiceFinalizeStmt (BRFileService fs, sqlite3_stmt **stmt) {
-    if (NULL != stmt && NULL != *stmt) {
-        sqlite3_finalize (*stmt);
-        *stmt = NULL;
+extern BRFileService
+fileServiceCreateInStore (BRFileServiceStore store,
+                          const char *currency,
+                          const char *network,
+                          BRFileServiceContext context,
+                          BRFileServiceErrorHandler handler) {
+    if (NULL == store) return NULL;
+    if (!fileServiceCheckNames (currency, network)) return NULL;
+
+    BRFileService fs = fileServiceAlloc (currency, network, context, handler);
+
+#if !defined(NEUTER_FILE_SERVICE)
+    // Open the {currency, network} namespace of `store`
+    BRFileServiceBackendStatus status;
+    fs->backendHandlers = &fileServiceBackendHandlersStore;
+    fs->backend = fileServiceStoreOpenNamespace (store, currency, network, &status);
+    fs->closed  = (NULL == fs->backend);
+    if (NULL == fs->backend) {
+        fileServiceRelease (fs);
+        return NULL;
     }
+#endif // !define(NEUTER_FILE_SERVICE)
+
+    return fs;
 }
 
 static void
 _fileServiceCloseInternal (BRFileService fs) {
 #if !defined(NEUTER_FILE_SERVICE)
-    if (fs->sdbClosed) return;
-
-    fs->sdbClosed = true;
-    _fileServiceFinalizeStmt (fs, &fs->sdbInsertStmt);
-    _fileServiceFinalizeStmt (fs, &fs->sdbSelectStmt);
-    _fileServiceFinalizeStmt (fs, &fs->sdbSelectAllStmt);
-    _fileServiceFinalizeStmt (fs, &fs->sdbUpdateStmt);
-    _fileServiceFinalizeStmt (fs, &fs->sdbDeleteStmt);
-    _fileServiceFinalizeStmt (fs, &fs->sdbDeleteAllTypeStmt);
-    _fileServiceFinalizeStmt (fs, &fs->sdbDeleteAllStmt);
-
-    if (NULL != fs->sdb) sqlite3_close (fs->sdb);
-    fs->sdb = NULL;
+    if (fs->closed) return;
+
+    // Any batch left open is committed by the backend; saves made within a batch are not
+    // discarded by a close.
+    fs->batchDepth = 0;
+    pthread_cond_broadcast (&fs->batchCond);
+
+    fs->closed = true;
+    fs->backendHandlers->close (fs->backend);
+    fs->backend = NULL;
 #endif
 }
 
 extern void
 fileServiceClose (BRFileService fs) {
 #if !defined(NEUTER_FILE_SERVICE)
+    // Complete all queued writes; subsequent writes will fail as 'closed'.
+    fileServiceFlush (fs);
+
     pthread_mutex_lock (&fs->lock);
     _fileServiceCloseInternal(fs);
     pthread_mutex_unlock (&fs->lock);
@@ -400,6 +461,11 @@ fileServiceClose (BRFileService fs) {
 // careful with fields that might not yet exist.
 extern void
 fileServiceRelease (BRFileService fs) {
+#if !defined(NEUTER_FILE_SERVICE)
+    // Stop the write-behind thread, if running, after it completes all queued writes.
+    fileServiceSetWriteBehind (fs, 0);
+#endif
+
     pthread_mutex_lock (&fs->lock);
 
 #if !defined(NEUTER_FILE_SERVICE)
@@ -415,10 +481,18 @@ fileServiceRelease (BRFileService fs) {
 
     if (NULL != fs->network)  free (fs->network);
     if (NULL != fs->currency) free (fs->currency);
-    if (NULL != fs->sdbPath)  free (fs->sdbPath);
+
+#if !defined(NEUTER_FILE_SERVICE)
+    if (NULL != fs->wbWrites) BRSetFreeAll (fs->wbWrites, fileServiceQueuedWriteRelease);
+    pthread_cond_destroy  (&fs->wbCond);
+    pthread_mutex_destroy (&fs->wbLock);
+    pthread_cond_destroy  (&fs->batchCond);
+#endif
 
     pthread_mutex_unlock (&fs->lock);
     pthread_mutex_destroy(&fs->lock);
+    pthread_mutex_destroy(&fs->statsLock);
+    pthread_mutex_destroy(&fs->codecLock);
 
     free (fs);
 }
@@ -448,6 +522,12 @@ fileServiceAddType (const BRFileService fs,
     BRFileServiceEntityType entityType = {
         strdup (type),
         version,
+        NULL,
+        NULL,
+        NULL,
+        { NULL },
+        false,
+        NULL,
         NULL
     };
     array_new (entityType.handlers, FILE_SERVICE_INITIAL_HANDLER_COUNT);
@@ -516,22 +596,23 @@ fileServiceFailedUnix(BRFileService fs,
 #pragma GCC diagnostic pop
 
 static int
-fileServiceFailedSDBWithBufferFree (BRFileService fs,
-                                    int releaseLock,
-                                    void *bufferToFree,
-                                    sqlite3_status_code code) {
-    return fileServiceFailedInternal (fs, releaseLock, bufferToFree, NULL,
-                                      (BRFileServiceError) {
-        FILE_SERVICE_SDB,
-        { .sdb = { code, sqlite3_errstr(code) }}
-    });
+fileServiceFailedBackendWithBufferFree (BRFileService fs,
+                                        int releaseLock,
+                                        void *bufferToFree,
+                                        BRFileServiceBackendStatus status) {
+#if !defined(NEUTER_FILE_SERVICE)
+    BRFileServiceError error = fs->backendHandlers->error (status);
+#else
+    BRFileServiceError error = { FILE_SERVICE_IMPL, { .impl = { "neutered" }}};
+#endif
+    return fileServiceFailedInternal (fs, releaseLock, bufferToFree, NULL, error);
 }
 
 static int
-fileServiceFailedSDB (BRFileService fs,
-                      int releaseLock,
-                      sqlite3_status_code code) {
-    return fileServiceFailedSDBWithBufferFree (fs, releaseLock, NULL, code);
+fileServiceFailedBackend (BRFileService fs,
+                          int releaseLock,
+                          BRFileServiceBackendStatus status) {
+    return fileServiceFailedBackendWithBufferFree (fs, releaseLock, NULL, status);
 }
 
 static int
@@ -548,241 +629,1230 @@ fileServiceFailedEntity(BRFileService fs,
                                       });
 }
 
-/// MARK: - Save
+/// MARK: - Stats
 
-static int
-_fileServiceSave (BRFileService fs,
-                  const char *type,  /* block, peers, transactions, logs, ... */
-                  const void *entity,
-                  int needLock) {     /* BRMerkleBlock*, BRTransaction, BREthereumTransaction, ... */
+typedef enum {
+    FILE_SERVICE_STATS_SAVE,
+    FILE_SERVICE_STATS_LOAD,
+    FILE_SERVICE_STATS_REMOVE
+} BRFileServiceStatsOperation;
+
+///
+/// Record an `operation` on `entitiesCount` entities of `type` that began at `start`.
+///
+static void
+fileServiceStatsRecord (BRFileService fs,
+                        const char *type,
+                        BRFileServiceStatsOperation operation,
+                        struct timeval start,
+                        size_t entitiesCount) {
+    struct timeval end;
+    gettimeofday (&end, NULL);
+
+    int64_t microseconds = (1000000 * (int64_t) (end.tv_sec - start.tv_sec) +
+                            (int64_t) (end.tv_usec - start.tv_usec));
+    if (microseconds < 0) microseconds = 0;
+
+    size_t bucket = 0;
+    for (int64_t limit = 10;
+         bucket < FILE_SERVICE_LATENCY_BUCKETS_COUNT - 1 && microseconds >= limit;
+         limit *= 10)
+        bucket++;
 
     BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
-    if (NULL == entityType) { fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type"); return 0; };
+    if (NULL == entityType) return;
+
+    pthread_mutex_lock (&fs->statsLock);
+    BRFileServiceTypeStats *stats = &entityType->stats;
+
+    BRFileServiceLatency *latency = NULL;
+    switch (operation) {
+        case FILE_SERVICE_STATS_SAVE:
+            latency = &stats->saves;
+            stats->entitiesSaved += entitiesCount;
+            break;
+        case FILE_SERVICE_STATS_LOAD:
+            latency = &stats->loads;
+            stats->entitiesLoaded += entitiesCount;
+            break;
+        case FILE_SERVICE_STATS_REMOVE:
+            latency = &stats->removes;
+            break;
+    }
 
-    BRFileServiceEntityHandler *handler = fileServiceEntityTypeLookupHandler(entityType, entityType->currentVersion);
-    if (NULL == handler) { fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type handler"); return 0; };
+    latency->count        += 1;
+    latency->microseconds += (uint64_t) microseconds;
+    latency->buckets[bucket] += 1;
+    pthread_mutex_unlock (&fs->statsLock);
+}
+
+extern size_t
+fileServiceGetStats (BRFileService fs,
+                     BRFileServiceTypeStats *stats,
+                     size_t statsCount) {
+    size_t typesCount = array_count (fs->entityTypes);
 
 #if !defined(NEUTER_FILE_SERVICE)
-    // Get then hex-encode the identifer
-    UInt256 identifier = handler->identifier (handler->context, fs, entity);
-    const char *hash = u256hex(identifier);
+    // Complete queued writes so that the stored entities include them.
+    fileServiceFlush (fs);
+#endif
 
-    // Get the entity bytes
-    uint32_t entityBytesCount;
-    uint8_t *entityBytes = handler->writer (handler->context, fs, entity, &entityBytesCount);
+    for (size_t index = 0; index < typesCount && index < statsCount; index++) {
+        BRFileServiceEntityType *entityType = &fs->entityTypes[index];
 
-    // Always, always write the header for the currentHeaderFormatVersion
+        pthread_mutex_lock (&fs->statsLock);
+        stats[index] = entityType->stats;
+        pthread_mutex_unlock (&fs->statsLock);
 
-    // Extend the entity bytes with the current header format, which is:
-    //   {HeaderFormatVersion, Current(Type)Version, EntityBytesCount, EntityBytes}
-    size_t  offset = 0;
-    size_t  bytesCount = 1 + 1 + sizeof(uint32_t) + entityBytesCount;
-    uint8_t *bytes = malloc (bytesCount);
+        stats[index].type = entityType->type;
+        stats[index].entitiesCount = 0;
+        stats[index].bytesCount    = 0;
 
-    bytes[offset] = (uint8_t) currentHeaderFormatVersion;
-    offset += 1;
+#if !defined(NEUTER_FILE_SERVICE)
+        pthread_mutex_lock (&fs->lock);
+        if (!fs->closed)
+            fs->backendHandlers->stats (fs->backend, entityType->type,
+                                        &stats[index].entitiesCount,
+                                        &stats[index].bytesCount);
+        pthread_mutex_unlock (&fs->lock);
+#endif
+    }
 
-    bytes[offset] = (uint8_t) entityType->currentVersion;
-    offset += 1;
+    return typesCount;
+}
 
-    UInt32SetBE (&bytes[offset], entityBytesCount);
-    offset += sizeof (uint32_t);
+/// MARK: - DB Transactions
 
-    memcpy (&bytes[offset], entityBytes, entityBytesCount);
-    free (entityBytes);
+#if !defined(NEUTER_FILE_SERVICE)
+//
+// Backend transactions nest.  Outside of a batch (see `fileServiceBeginBatch()`) a transaction
+// commits on its own; inside of a batch its commit is deferred until the batch commits.  Thus a
+// replace (or a load's version update) works the same whether or not it is part of a batch.
+//
+// These must be called with `fs->lock` held.
+//
+static BRFileServiceBackendStatus
+fileServiceTransactionBegin (BRFileService fs) {
+    return fs->backendHandlers->begin (fs->backend);
+}
 
-    // Nex encode bytes
-    size_t dataCount = 2 * bytesCount + 1;
-    char *data = malloc (dataCount);
-    hexEncode (data, dataCount, bytes, bytesCount);
-    free (bytes);
+static BRFileServiceBackendStatus
+fileServiceTransactionCommit (BRFileService fs) {
+    return fs->backendHandlers->commit (fs->backend);
+}
 
-    // Fill out the SQL statement
-    sqlite3_status_code status;
+static void
+fileServiceTransactionRollback (BRFileService fs) {
+    fs->backendHandlers->rollback (fs->backend);
+}
 
-    if (needLock)
-        pthread_mutex_lock (&fs->lock);
+static void
+fileServiceWriteBehindDrain (BRFileService fs);
+#endif // !defined(NEUTER_FILE_SERVICE)
 
-    if (fs->sdbClosed)
-        return fileServiceFailedImpl (fs, needLock, NULL, NULL, "closed");
+extern int
+fileServiceBeginBatch (BRFileService fs) {
+#if !defined(NEUTER_FILE_SERVICE)
+    // Complete the queued writes.  Holding `wbLock` until `lock` is held ensures that no write is
+    // queued before the batch begins; within the batch writes are not queued at all - see
+    // `fileServiceWriteBehindActive()` - and so are grouped into, and committed with, the batch.
+    pthread_mutex_lock (&fs->wbLock);
+    fileServiceWriteBehindDrain (fs);
+    pthread_mutex_lock (&fs->lock);
+    pthread_mutex_unlock (&fs->wbLock);
+
+    if (fs->closed)
+        return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
 
-    sqlite3_reset (fs->sdbInsertStmt);
-    sqlite3_clear_bindings(fs->sdbInsertStmt);
+    BRFileServiceBackendStatus status = fileServiceTransactionBegin (fs);
+    if (FILE_SERVICE_BACKEND_OK != status)
+        return fileServiceFailedBackend (fs, 1, status);
 
-    status = sqlite3_bind_text (fs->sdbInsertStmt, 1, type, -1, SQLITE_STATIC);
-    if (SQLITE_OK != status) {
-        free (data);
-        return fileServiceFailedSDB (fs, needLock, status);
-    }
+    fs->batchDepth += 1;
+    pthread_mutex_unlock (&fs->lock);
+#endif // !defined(NEUTER_FILE_SERVICE)
 
-    status = sqlite3_bind_text (fs->sdbInsertStmt, 2, hash, -1, SQLITE_STATIC);
-    if (SQLITE_OK != status) {
-        free (data);
-        return fileServiceFailedSDB (fs, needLock, status);
-    }
+    return 1;
+}
 
-    status = sqlite3_bind_text (fs->sdbInsertStmt, 3, data, -1, SQLITE_STATIC);
-    if (SQLITE_OK != status) {
-        free (data);
-        return fileServiceFailedSDB (fs, needLock, status);
-    }
+extern int
+fileServiceCommitBatch (BRFileService fs) {
+#if !defined(NEUTER_FILE_SERVICE)
+    pthread_mutex_lock (&fs->lock);
+    if (fs->closed)
+        return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
 
-    status = sqlite3_step (fs->sdbInsertStmt);
-    if (SQLITE_DONE != status) {
-        free (data);
-        return fileServiceFailedSDB (fs, needLock, status);
-    }
+    if (0 == fs->batchDepth)
+        return fileServiceFailedImpl (fs, 1, NULL, NULL, "missed batch begin");
 
-    // Ensure the 'implicit DB transaction' is committed.
-    sqlite3_reset (fs->sdbInsertStmt);
+    fs->batchDepth -= 1;
+    if (0 == fs->batchDepth) pthread_cond_broadcast (&fs->batchCond);
 
-    if (needLock)
-        pthread_mutex_unlock (&fs->lock);
+    BRFileServiceBackendStatus status = fileServiceTransactionCommit (fs);
+    if (FILE_SERVICE_BACKEND_OK != status) {
+        fileServiceTransactionRollback (fs);
+        return fileServiceFailedBackend (fs, 1, status);
+    }
 
-    free (data);
+    pthread_mutex_unlock (&fs->lock);
 #endif // !defined(NEUTER_FILE_SERVICE)
 
     return 1;
 }
 
-extern int
-fileServiceSave (BRFileService fs,
-                 const char *type,  /* block, peers, transactions, logs, ... */
-                 const void *entity) {     /* BRMerkleBlock*, BRTransaction, BREthereumTransaction, ... */
-    return _fileServiceSave (fs, type, entity, 1);
+static int
+fileServiceBatchFailed (BRFileService fs, int needUnlock) {
+#if !defined(NEUTER_FILE_SERVICE)
+    fileServiceTransactionRollback (fs);
+#endif
+    if (needUnlock) pthread_mutex_unlock (&fs->lock);
+    return 0;
 }
 
-/// MARK: - Load
-
-extern int
-fileServiceLoad (BRFileService fs,
-                 BRSet *results,
-                 const char *type,
-                 int updateVersion) {
-    BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
-    if (NULL == entityType) return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type");
-
-    BRFileServiceEntityHandler *entityHandlerCurrent = fileServiceEntityTypeLookupHandler(entityType, entityType->currentVersion);
-    if (NULL == entityHandlerCurrent) return fileServiceFailedImpl (fs,  0, NULL, NULL, "missed type handler");
+/// MARK: - Write Behind
 
 #if !defined(NEUTER_FILE_SERVICE)
-    sqlite3_status_code status;
+///
+/// Check if writes are to be queued: write-behind is enabled and no batch is open.  A write made
+/// while a batch is open belongs to the batch and is thus written synchronously.  Must be called
+/// with `fs->wbLock` held.
+///
+static bool
+fileServiceWriteBehindActive (BRFileService fs) {
+    if (!fs->wbEnabled) return false;
 
     pthread_mutex_lock (&fs->lock);
-    if (fs->sdbClosed)
-        return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
+    bool inBatch = (0 != fs->batchDepth);
+    pthread_mutex_unlock (&fs->lock);
 
-    sqlite3_reset (fs->sdbSelectAllStmt);
-    sqlite3_clear_bindings (fs->sdbSelectAllStmt);
-
-    status = sqlite3_bind_text (fs->sdbSelectAllStmt, 1, type, -1, SQLITE_STATIC);
-    if (SQLITE_OK != status)
-        return fileServiceFailedSDB (fs, 1, status);
-
-    uint8_t  dataBytesBuffer[8196];
-    uint8_t *dataBytes = dataBytesBuffer;
-    size_t   dataBytesCount = 8196;
-
-    // Zero out the dataByte memory to avoid subsequent Clang Static Analysis errors releted
-    // to dereferencing uninitialized memory.  We accept this minimal, extraneous function call.
-    memset(dataBytes, 0, dataBytesCount);
-
-    while (SQLITE_ROW == sqlite3_step(fs->sdbSelectAllStmt)) {
-        const char *hash = (const char *) sqlite3_column_text (fs->sdbSelectAllStmt, 0);
-        const char *data = (const char *) sqlite3_column_text (fs->sdbSelectAllStmt, 1);
-
-        if (NULL == hash || NULL == data)
-            return fileServiceFailedImpl (fs, 1, (dataBytes == dataBytesBuffer ? NULL : dataBytes), NULL,
-                                          "missed query `hash` or `data`");
-
-        assert (64 == strlen (hash));
-        
-        // Ensure `dataBytes` is large enough for hex-decoded `data`
-        size_t dataCount = strlen (data);
-        assert (0 == dataCount % 2);  // Surely 'even'
-        if ((dataCount/2) > dataBytesCount) {
-            if (dataBytes != dataBytesBuffer) free (dataBytes);
-            dataBytesCount = dataCount/2;
-            dataBytes = malloc (dataBytesCount);
-        }
+    return !inBatch;
+}
+
+///
+/// Queue a save (`bytes` non-NULL) or a remove (`bytes` NULL) for the write-behind thread.  If
+/// writes are not queued - see `fileServiceWriteBehindActive()` - nothing is queued and false is
+/// returned; the caller still owns `bytes`.  Otherwise the queued write owns `bytes`.
+///
+static bool
+fileServiceWriteBehindEnqueue (BRFileService fs,
+                               const char *type,
+                               UInt256 identifier,
+                               int64_t sortKey,
+                               uint8_t *bytes,
+                               size_t bytesCount) {
+    pthread_mutex_lock (&fs->wbLock);
+    if (!fileServiceWriteBehindActive (fs)) {
+        pthread_mutex_unlock (&fs->wbLock);
+        return false;
+    }
 
-        // Actually decode `data` into `dataBytes`
-        hexDecode (dataBytes, dataCount/2, data, dataCount);
+    BRFileServiceQueuedWrite *write = malloc (sizeof (BRFileServiceQueuedWrite));
+    *write = (BRFileServiceQueuedWrite) { type, identifier, sortKey, bytes, bytesCount };
 
-        size_t offset = 0;
-        BRFileServiceVersion version;
-        uint32_t  entityBytesCount;
-        uint8_t  *entityBytes;
+    // Coalesce with any write, for the same entity, that has not been taken by the writer.
+    BRFileServiceQueuedWrite *replaced = BRSetAdd (fs->wbWrites, write);
+    if (NULL != replaced) fileServiceQueuedWriteRelease (replaced);
 
-        BRFileServiceHeaderFormatVersion headerVersion = dataBytes[offset];
-        offset += 1;
+    pthread_cond_broadcast (&fs->wbCond);
+    pthread_mutex_unlock (&fs->wbLock);
+    return true;
+}
 
-        switch (headerVersion) {
-            case HEADER_FORMAT_1:
-                version = dataBytes[offset];
-                offset += 1;
+///
+/// Write `writes` in a single DB transaction.  On an error, none are written and the error
+/// is reported.
+///
+/// The transaction is never nested in a batch; were it, its commit would merge into the batch
+/// and a failed batch would discard writes already taken as committed.  A batch begins only once
+/// the queued writes are complete, so this waits only if a batch is begun other than that way.
+///
+static void
+fileServiceWriteBehindCommit (BRFileService fs,
+                              BRSetOf(BRFileServiceQueuedWrite*) writes) {
+    BRFileServiceBackendStatus status;
 
-                entityBytesCount = UInt32GetBE (&dataBytes[offset]);
-                offset += sizeof (uint32_t);
+    pthread_mutex_lock (&fs->lock);
+    while (!fs->closed && 0 != fs->batchDepth)
+        pthread_cond_wait (&fs->batchCond, &fs->lock);
 
-                break;
-        }
+    if (fs->closed) {
+        fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
+        return;
+    }
 
-        // Assert entityBytesCount remain in dataBytes
-        if (offset + entityBytesCount > dataBytesCount) {
-            assert (0); // In DEBUG builds.
-            return fileServiceFailedImpl (fs, 1, (dataBytes == dataBytesBuffer ? NULL : dataBytes), NULL,
-                                          "missed bytes count");
-        }
+    status = fileServiceTransactionBegin (fs);
+    if (FILE_SERVICE_BACKEND_OK != status) {
+        fileServiceFailedBackend (fs, 1, status);
+        return;
+    }
 
-        entityBytes = &dataBytes[offset];
+    BRFileServiceQueuedWrite *write = NULL;
+    while (FILE_SERVICE_BACKEND_OK == status && NULL != (write = BRSetIterate (writes, write)))
+        status = (NULL != write->bytes
+                  ? fileServiceSaveBytes   (fs, write->type, write->identifier, write->sortKey, write->bytes, write->bytesCount)
+                  : fileServiceRemoveBytes (fs, write->type, write->identifier));
 
-        switch (headerVersion) {
-            case HEADER_FORMAT_1:
-                // compute then compare checksum
-                break;
-        }
+    if (FILE_SERVICE_BACKEND_OK == status)
+        status = fileServiceTransactionCommit (fs);
 
-        // Look up the entity handler
-        BRFileServiceEntityHandler *handler = fileServiceEntityTypeLookupHandler(entityType, version);
-        if (NULL == handler)
-            return fileServiceFailedImpl (fs, 1, (dataBytes == dataBytesBuffer ? NULL : dataBytes), NULL,
-                                          "missed type handler");
-
-        // Read the entity from buffer and add to results.
-        void *entity = handler->reader (handler->context, fs, entityBytes, entityBytesCount);
-        if (NULL == entity)
-            return fileServiceFailedEntity (fs, 1, (dataBytes == dataBytesBuffer ? NULL : dataBytes), NULL,
-                                            type, "reader");
-
-        // Update restuls with the newly restored entity
-        void *oldEntity = BRSetAdd (results, entity);
-        //assert (NULL == oldEntity);  // DEBUG builds
-        if (NULL != oldEntity)
-            return fileServiceFailedEntity (fs, 1, (dataBytes == dataBytesBuffer ? NULL : dataBytes), NULL,
-                                            type, "duplicate set entry");
-
-        // If the read version is not the current version, update
-        if (updateVersion &&
-            (version != entityType->currentVersion ||
-             headerVersion != currentHeaderFormatVersion))
-            // This could signal an error.  Perhaps we should test the return result and
-            // if `0` skip out here?  We won't - we couldn't save the entity in the new format
-            // but we'll continue and will try next time we load it.
-            _fileServiceSave (fs, type, entity, 0);
+    if (FILE_SERVICE_BACKEND_OK != status) {
+        fileServiceTransactionRollback (fs);
+        fileServiceFailedBackend (fs, 1, status);
+        return;
     }
 
-    // Ensure the 'implicit DB transaction' is committed.
-    sqlite3_reset (fs->sdbSelectAllStmt);
-
     pthread_mutex_unlock (&fs->lock);
+}
 
-    if (dataBytes != dataBytesBuffer) free (dataBytes);
+typedef void* (*ThreadRoutine) (void*);
+
+static void *
+fileServiceWriteBehindThread (BRFileService fs) {
+    pthread_setname_brd (pthread_self(), FILE_SERVICE_WRITE_BEHIND_THREAD_NAME);
+
+    pthread_mutex_lock (&fs->wbLock);
+    while (1) {
+        while (!fs->wbQuit && 0 == BRSetCount (fs->wbWrites))
+            pthread_cond_wait (&fs->wbCond, &fs->wbLock);
+
+        // Only quit once every queued write is complete.
+        if (0 == BRSetCount (fs->wbWrites)) break;
+
+        // Take all the queued writes as one group; writes queued while this group is being
+        // committed will form the next group.
+        BRSetOf(BRFileServiceQueuedWrite*) writes = fs->wbWrites;
+        fs->wbWrites = BRSetNew (fileServiceQueuedWriteHash,
+                                 fileServiceQueuedWriteEq,
+                                 FILE_SERVICE_WRITE_BEHIND_INITIAL_COUNT);
+        fs->wbWriting = true;
+        pthread_mutex_unlock (&fs->wbLock);
+
+        fileServiceWriteBehindCommit (fs, writes);
+        BRSetFreeAll (writes, fileServiceQueuedWriteRelease);
+
+        pthread_mutex_lock (&fs->wbLock);
+        fs->wbWriting = false;
+        pthread_cond_broadcast (&fs->wbCond);
+    }
+    pthread_mutex_unlock (&fs->wbLock);
+
+    return NULL;
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+extern void
+fileServiceSetWriteBehind (BRFileService fs,
+                           int writeBehind) {
+#if !defined(NEUTER_FILE_SERVICE)
+    pthread_mutex_lock (&fs->wbLock);
+    if (writeBehind == fs->wbEnabled) {
+        pthread_mutex_unlock (&fs->wbLock);
+        return;
+    }
+
+    fs->wbEnabled = writeBehind;
+
+    if (writeBehind) {
+        fs->wbQuit = false;
+
+        pthread_attr_t attr;
+        pthread_attr_init (&attr);
+        pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_JOINABLE);
+        pthread_attr_setstacksize (&attr, 1024 * 1024);
+        if (0 != pthread_create (&fs->wbThread, &attr, (ThreadRoutine) fileServiceWriteBehindThread, fs))
+            fs->wbEnabled = false;
+        pthread_attr_destroy (&attr);
+
+        pthread_mutex_unlock (&fs->wbLock);
+    }
+    else {
+        // Nothing more will be queued; the writer completes the queued writes and then exits.
+        fs->wbQuit = true;
+        pthread_cond_broadcast (&fs->wbCond);
+        pthread_mutex_unlock (&fs->wbLock);
+
+        pthread_join (fs->wbThread, NULL);
+    }
+#endif // !defined(NEUTER_FILE_SERVICE)
+}
+
+#if !defined(NEUTER_FILE_SERVICE)
+///
+/// Wait until all queued writes are committed.  Must be called with `fs->wbLock` held.
+///
+static void
+fileServiceWriteBehindDrain (BRFileService fs) {
+    while (fs->wbWriting || 0 != BRSetCount (fs->wbWrites))
+        pthread_cond_wait (&fs->wbCond, &fs->wbLock);
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+extern void
+fileServiceFlush (BRFileService fs) {
+#if !defined(NEUTER_FILE_SERVICE)
+    pthread_mutex_lock (&fs->wbLock);
+    fileServiceWriteBehindDrain (fs);
+    pthread_mutex_unlock (&fs->wbLock);
+#endif // !defined(NEUTER_FILE_SERVICE)
+}
+
+/// MARK: - Durability
+
+extern int
+fileServiceSetDurability (BRFileService fs,
+                          BRFileServiceDurability durability) {
+#if !defined(NEUTER_FILE_SERVICE)
+    // A backend applies durability only outside of a transaction.
+    fileServiceFlush (fs);
+
+    pthread_mutex_lock (&fs->lock);
+    if (fs->closed)
+        return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
+
+    if (0 != fs->batchDepth)
+        return fileServiceFailedImpl (fs, 1, NULL, NULL, "in batch");
+
+    BRFileServiceBackendStatus status = fs->backendHandlers->setDurability (fs->backend, durability);
+    if (FILE_SERVICE_BACKEND_OK != status)
+        return fileServiceFailedBackend (fs, 1, status);
+
+    pthread_mutex_unlock (&fs->lock);
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+    return 1;
+}
+
+/// MARK: - Save
+
+///
+/// Lookup the dictionary `id` of `entityType`; if `id` is 0, the current dictionary.
+///
+/// @return the dictionary or NULL if none.
+///
+static BRCompressDictionary
+fileServiceEntityTypeLookupDictionary (BRFileService fs,
+                                       BRFileServiceEntityType *entityType,
+                                       uint32_t *id) {
+    BRCompressDictionary dictionary = NULL;
+
+    pthread_mutex_lock (&fs->codecLock);
+    size_t dictionariesCount = (NULL == entityType->dictionaries ? 0 : array_count (entityType->dictionaries));
+    if (0 == *id && 0 != dictionariesCount) {
+        *id        = entityType->dictionaries[dictionariesCount - 1].id;
+        dictionary = entityType->dictionaries[dictionariesCount - 1].dictionary;
+    }
+    else
+        for (size_t index = 0; index < dictionariesCount; index++)
+            if (*id == entityType->dictionaries[index].id) {
+                dictionary = entityType->dictionaries[index].dictionary;
+                break;
+            }
+    pthread_mutex_unlock (&fs->codecLock);
+
+    return dictionary;
+}
+
+///
+/// Produce the stored bytes for `entityBytes` in `version`.  If `entityType` has compression and
+/// compressing, with the dictionary `dictionaryId` (0 for the current one), saves bytes then the
+/// header format is HEADER_FORMAT_3; otherwise it is `currentHeaderFormatVersion`.  You own the
+/// returned bytes.
+///
+static uint8_t *
+fileServiceEntityBytesEncode (BRFileService fs,
+                              BRFileServiceEntityType *entityType,
+                              BRFileServiceVersion version,
+                              uint32_t dictionaryId,
+                              const uint8_t *entityBytes,
+                              uint32_t entityBytesCount,
+                              size_t *bytesCount) {
+    size_t  offset = 0;
+    uint8_t *bytes;
+
+    // Compress into bytes that are, with the larger header, fewer than the uncompressed bytes.
+    if (entityType->compressed &&
+        entityBytesCount > FILE_SERVICE_HEADER_3_BYTES_COUNT - FILE_SERVICE_HEADER_BYTES_COUNT + 1) {
+        BRCompressDictionary dictionary = fileServiceEntityTypeLookupDictionary (fs, entityType, &dictionaryId);
+        if (NULL == dictionary) dictionaryId = 0;
+
+        size_t compressedCapacity = entityBytesCount - (FILE_SERVICE_HEADER_3_BYTES_COUNT - FILE_SERVICE_HEADER_BYTES_COUNT) - 1;
+        bytes = malloc (FILE_SERVICE_HEADER_3_BYTES_COUNT + compressedCapacity);
+
+        size_t compressedCount = BRCompress (&bytes[FILE_SERVICE_HEADER_3_BYTES_COUNT], compressedCapacity,
+                                             entityBytes, entityBytesCount,
+                                             dictionary);
+        if (0 != compressedCount) {
+            // {HeaderFormatVersion, Current(Type)Version, EntityBytesCount, DictionaryId, CompressedBytes}
+            bytes[offset] = (uint8_t) HEADER_FORMAT_3;
+            offset += 1;
+
+            bytes[offset] = (uint8_t) version;
+            offset += 1;
+
+            UInt32SetBE (&bytes[offset], entityBytesCount);
+            offset += sizeof (uint32_t);
+
+            UInt32SetBE (&bytes[offset], dictionaryId);
+            offset += sizeof (uint32_t);
+
+            *bytesCount = FILE_SERVICE_HEADER_3_BYTES_COUNT + compressedCount;
+            return bytes;
+        }
+
+        free (bytes);
+    }
+
+    // Extend the entity bytes with the current header format, which is:
+    //   {HeaderFormatVersion, Current(Type)Version, EntityBytesCount, EntityBytes}
+    *bytesCount = FILE_SERVICE_HEADER_BYTES_COUNT + entityBytesCount;
+    bytes = malloc (*bytesCount);
+
+    bytes[offset] = (uint8_t) currentHeaderFormatVersion;
+    offset += 1;
+
+    bytes[offset] = (uint8_t) version;
+    offset += 1;
+
+    UInt32SetBE (&bytes[offset], entityBytesCount);
+    offset += sizeof (uint32_t);
+
+    memcpy (&bytes[offset], entityBytes, entityBytesCount);
+
+    return bytes;
+}
+
+///
+/// Extract the entity bytes, and their version, from the stored `dataBytes`.  If the entity bytes
+/// are compressed, they are decompressed into `ownedBytes`, which you must free; otherwise
+/// `ownedBytes` is NULL and `entityBytes` points into `dataBytes`.  May be called concurrently.
+///
+/// @return NULL on success, otherwise the failure reason.
+///
+static const char *
+fileServiceEntityBytesDecode (BRFileService fs,
+                              BRFileServiceEntityType *entityType,
+                              const uint8_t *dataBytes,
+                              size_t dataBytesCount,
+                              BRFileServiceHeaderFormatVersion *headerVersion,
+                              BRFileServiceVersion *version,
+                              const uint8_t **entityBytes,
+                              uint32_t *entityBytesCount,
+                              uint8_t **ownedBytes) {
+    size_t offset = 0;
+    uint32_t dictionaryId = 0;
+
+    *ownedBytes = NULL;
+
+    if (NULL == dataBytes || dataBytesCount < FILE_SERVICE_HEADER_BYTES_COUNT)
+        return "missed header bytes";
+
+    *headerVersion = dataBytes[offset];
+    offset += 1;
+
+    switch (*headerVersion) {
+        case HEADER_FORMAT_1:
+        case HEADER_FORMAT_2:
+            *version = dataBytes[offset];
+            offset += 1;
+
+            *entityBytesCount = UInt32GetBE (&dataBytes[offset]);
+            offset += sizeof (uint32_t);
+
+            break;
+
+        case HEADER_FORMAT_3:
+            if (dataBytesCount < FILE_SERVICE_HEADER_3_BYTES_COUNT)
+                return "missed header bytes";
+
+            *version = dataBytes[offset];
+            offset += 1;
+
+            *entityBytesCount = UInt32GetBE (&dataBytes[offset]);
+            offset += sizeof (uint32_t);
+
+            dictionaryId = UInt32GetBE (&dataBytes[offset]);
+            offset += sizeof (uint32_t);
+
+            break;
+
+        default:
+            return "missed header format";
+    }
+
+    switch (*headerVersion) {
+        case HEADER_FORMAT_1:
+        case HEADER_FORMAT_2:
+            // Assert entityBytesCount remain in dataBytes
+            if (offset + *entityBytesCount > dataBytesCount) {
+                assert (0); // In DEBUG builds.
+                return "missed bytes count";
+            }
+
+            *entityBytes = &dataBytes[offset];
+            // compute then compare checksum
+            break;
+
+        case HEADER_FORMAT_3: {
+            BRCompressDictionary dictionary = NULL;
+
+            if (0 != dictionaryId) {
+                dictionary = fileServiceEntityTypeLookupDictionary (fs, entityType, &dictionaryId);
+                if (NULL == dictionary) return "missed dictionary";
+            }
+
+            *ownedBytes = malloc (*entityBytesCount + 1);
+            if (NULL == *ownedBytes) return "missed bytes count";
+
+            if (*entityBytesCount != BRDecompress (*ownedBytes, *entityBytesCount,
+                                                   &dataBytes[offset], dataBytesCount - offset,
+                                                   dictionary)) {
+                free (*ownedBytes);
+                *ownedBytes = NULL;
+                return "missed compressed bytes";
+            }
+
+            *entityBytes = *ownedBytes;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+///
+/// Produce the bytes, in the `currentHeaderFormatVersion` or, with compression, in
+/// HEADER_FORMAT_3, for `entity` of `entityType` using `handler`.  The entity's identifier and
+/// sort key are filled into `identifier` and `sortKey`.  You own the returned bytes.
+///
+static uint8_t *
+fileServiceEntityEncode (BRFileService fs,
+                         BRFileServiceEntityType *entityType,
+                         BRFileServiceEntityHandler *handler,
+                         const void *entity,
+                         UInt256 *identifier,
+                         int64_t *sortKey,
+                         size_t *bytesCount) {
+    // Get the identifier
+    *identifier = handler->identifier (handler->context, fs, entity);
+
+    // Get the sort key
+    *sortKey = (NULL == entityType->sortKey
+                ? FILE_SERVICE_SORT_KEY_NONE
+                : entityType->sortKey (entityType->sortKeyContext, fs, entity));
+
+    // Get the entity bytes
+    uint32_t entityBytesCount;
+    uint8_t *entityBytes = handler->writer (handler->context, fs, entity, &entityBytesCount);
+
+    // Always, always write the header for the currentHeaderFormatVersion (or HEADER_FORMAT_3)
+    uint8_t *bytes = fileServiceEntityBytesEncode (fs, entityType, entityType->currentVersion, 0,
+                                                   entityBytes, entityBytesCount,
+                                                   bytesCount);
+    free (entityBytes);
+
+    return bytes;
+}
+
+#if !defined(NEUTER_FILE_SERVICE)
+///
+/// Insert (or replace) `bytes`, with `sortKey`, for {type, identifier}.  Must be called with
+/// `fs->lock` held; the lock is never released.
+///
+/// @return FILE_SERVICE_BACKEND_OK on success, otherwise the failing backend status.
+///
+static BRFileServiceBackendStatus
+fileServiceSaveBytes (BRFileService fs,
+                      const char *type,
+                      UInt256 identifier,
+                      int64_t sortKey,
+                      const uint8_t *bytes,
+                      size_t bytesCount) {
+    return fs->backendHandlers->save (fs->backend, type, identifier, sortKey, bytes, bytesCount);
+}
+
+///
+/// Delete the {type, identifier} entity.  Must be called with `fs->lock` held; the lock is never
+/// released.
+///
+/// @return FILE_SERVICE_BACKEND_OK on success, otherwise the failing backend status.
+///
+static BRFileServiceBackendStatus
+fileServiceRemoveBytes (BRFileService fs,
+                        const char *type,
+                        UInt256 identifier) {
+    return fs->backendHandlers->remove (fs->backend, type, identifier);
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+static int
+_fileServiceSave (BRFileService fs,
+                  const char *type,  /* block, peers, transactions, logs, ... */
+                  const void *entity,
+                  int needLock) {     /* BRMerkleBlock*, BRTransaction, BREthereumTransaction, ... */
+
+    BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
+    if (NULL == entityType) { fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type"); return 0; };
+
+    BRFileServiceEntityHandler *handler = fileServiceEntityTypeLookupHandler(entityType, entityType->currentVersion);
+    if (NULL == handler) { fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type handler"); return 0; };
+
+#if !defined(NEUTER_FILE_SERVICE)
+    UInt256 identifier;
+    int64_t sortKey;
+    size_t  bytesCount;
+    uint8_t *bytes = fileServiceEntityEncode (fs, entityType, handler, entity, &identifier, &sortKey, &bytesCount);
+
+    // If not already within a DB transaction, try to hand `bytes` off to the write-behind thread.
+    if (needLock && fileServiceWriteBehindEnqueue (fs, entityType->type, identifier, sortKey, bytes, bytesCount))
+        return 1;
+
+    if (needLock)
+        pthread_mutex_lock (&fs->lock);
+
+    if (fs->closed)
+        return fileServiceFailedImpl (fs, needLock, bytes, NULL, "closed");
+
+    BRFileServiceBackendStatus status = fileServiceSaveBytes (fs, type, identifier, sortKey, bytes, bytesCount);
+    if (FILE_SERVICE_BACKEND_OK != status)
+        return fileServiceFailedBackendWithBufferFree (fs, needLock, bytes, status);
+
+    if (needLock)
+        pthread_mutex_unlock (&fs->lock);
+
+    free (bytes);
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+    return 1;
+}
+
+extern int
+fileServiceSave (BRFileService fs,
+                 const char *type,  /* block, peers, transactions, logs, ... */
+                 const void *entity) {     /* BRMerkleBlock*, BRTransaction, BREthereumTransaction, ... */
+    struct timeval start;
+    gettimeofday (&start, NULL);
+
+    int success = _fileServiceSave (fs, type, entity, 1);
+
+    fileServiceStatsRecord (fs, type, FILE_SERVICE_STATS_SAVE, start, 1);
+    return success;
+}
+
+/// MARK: - Load
+
+///
+/// An entity, already encoded in the current header format, that needs to be written.  Used to
+/// defer the update of old entity versions until after a load completes.
+///
+typedef struct {
+    UInt256 identifier;
+    int64_t sortKey;
+    uint8_t *bytes;
+    size_t bytesCount;
+} BRFileServicePendingWrite;
+
+static void
+fileServicePendingWritesRelease (BRArrayOf(BRFileServicePendingWrite) writes) {
+    for (size_t index = 0; index < array_count(writes); index++)
+        free (writes[index].bytes);
+    array_free (writes);
+}
+
+#if !defined(NEUTER_FILE_SERVICE)
+///
+/// Pass the `ordered` entities, if any, to `handler`.  Called w/o the lock.
+///
+/// @return true (1) if `handler` accepted every entity, false (0) otherwise.
+///
+static int
+fileServiceLoadDeliverOrdered (BRFileService fs,
+                               BRArrayOf(void*) ordered,
+                               BRFileServiceEntityComparator compare,
+                               BRFileServiceContext context,
+                               BRFileServiceLoadHandler handler) {
+    if (NULL == ordered) return 1;
+
+    qsort (ordered, array_count (ordered), sizeof (void*), compare);
+
+    // Every entity is passed to `handler`, even after a failure; `handler` owns the entities.
+    int success = 1;
+    for (size_t index = 0; index < array_count (ordered); index++)
+        success &= handler (context, fs, ordered[index]);
+
+    array_free (ordered);
+    return success;
+}
+
+///
+/// A stored entity, as passed by the backend, held to be decoded by a load thread.  Once
+/// decoded, either `entity` is filled in or `failed` and `error` are set.
+///
+typedef struct {
+    int64_t sortKey;
+    uint8_t *bytes;
+    size_t bytesCount;
+
+    void *entity;
+    BRFileServicePendingWrite update;   // update.bytes is NULL if no update is needed
+
+    bool failed;
+    BRFileServiceError error;
+} BRFileServiceLoadRow;
+
+///
+/// The state of a load, shared with `fileServiceLoadEntity()` as the backend passes each stored
+/// entity.  On a failure, `failed` and `error` are set and the load stops.
+///
+typedef struct {
+    BRFileService fs;
+    BRFileServiceEntityType *entityType;
+    BRFileServiceEntityHandler *entityHandlerCurrent;
+    int updateVersion;
+
+    // Entities read in an old version, re-encoded in the current version.  We can't write them
+    // while the backend is passing entities - the write could then be revisited.
+    BRArrayOf(BRFileServicePendingWrite) updates;
+
+    // If `compare` is provided, the entities are held and then ordered once all have been read.
+    BRArrayOf(void*) ordered;
+
+    // If load threads are used, the stored entities are held and then decoded in parallel.
+    BRArrayOf(BRFileServiceLoadRow) rows;
+
+    BRFileServiceContext context;
+    BRFileServiceLoadHandler handler;
+
+    // The entities passed, or held to be passed, to `handler`.
+    size_t entitiesCount;
+
+    bool failed;
+    BRFileServiceError error;
+} BRFileServiceLoadState;
+
+#define FILE_SERVICE_LOAD_ERROR_IMPL(reason)                               \
+    ((BRFileServiceError) { FILE_SERVICE_IMPL, { .impl = { (reason) }}})
+
+#define FILE_SERVICE_LOAD_ERROR_ENTITY(reason)                             \
+    ((BRFileServiceError) { FILE_SERVICE_ENTITY, { .entity = { state->entityType->type, (reason) }}})
+
+///
+/// Decode one stored entity.  If the entity needs to be rewritten, in the current version or
+/// with a sort key, fills `update`; otherwise `update->bytes` is NULL.  Only reads `state`; may
+/// be called concurrently, from load threads, if the entity type's handlers are reentrant.
+///
+/// @return the entity or, on a failure, NULL with `error` filled.
+///
+static void *
+fileServiceLoadDecode (const BRFileServiceLoadState *state,
+                       int64_t sortKey,
+                       const uint8_t *dataBytes,
+                       size_t dataBytesCount,
+                       BRFileServicePendingWrite *update,
+                       BRFileServiceError *error) {
+    BRFileServiceEntityType *entityType = state->entityType;
+    BRFileService fs = state->fs;
+
+    update->bytes = NULL;
+
+    BRFileServiceHeaderFormatVersion headerVersion;
+    BRFileServiceVersion version;
+    const uint8_t *entityBytes;
+    uint32_t entityBytesCount;
+    uint8_t *ownedBytes;
+
+    const char *reason = fileServiceEntityBytesDecode (fs, entityType, dataBytes, dataBytesCount,
+                                                       &headerVersion, &version,
+                                                       &entityBytes, &entityBytesCount, &ownedBytes);
+    if (NULL != reason) {
+        *error = FILE_SERVICE_LOAD_ERROR_IMPL (reason);
+        return NULL;
+    }
+
+    // Look up the entity handler
+    BRFileServiceEntityHandler *entityHandler = fileServiceEntityTypeLookupHandler(entityType, version);
+    if (NULL == entityHandler) {
+        if (NULL != ownedBytes) free (ownedBytes);
+        *error = FILE_SERVICE_LOAD_ERROR_IMPL ("missed type handler");
+        return NULL;
+    }
+
+    // Read the entity from buffer.
+    void *entity = entityHandler->reader (entityHandler->context, fs, (uint8_t *) entityBytes, entityBytesCount);
+    if (NULL != ownedBytes) free (ownedBytes);
+    if (NULL == entity) {
+        *error = FILE_SERVICE_LOAD_ERROR_ENTITY ("reader");
+        return NULL;
+    }
+
+    // If the read version is not the current version, or if the sort key is missing,
+    // re-encode for an update
+    if (state->updateVersion &&
+        (version != entityType->currentVersion ||
+         headerVersion < currentHeaderFormatVersion ||
+         (NULL != entityType->sortKey && FILE_SERVICE_SORT_KEY_NONE == sortKey)))
+        update->bytes = fileServiceEntityEncode (fs, entityType, state->entityHandlerCurrent, entity,
+                                                 &update->identifier,
+                                                 &update->sortKey,
+                                                 &update->bytesCount);
+
+    return entity;
+}
+
+///
+/// Hold `entity` for ordering or pass it directly to the load's handler.
+///
+/// @return true (1) if held or if the handler accepted `entity`; false (0) otherwise.
+///
+static int
+fileServiceLoadDeliver (BRFileServiceLoadState *state,
+                        void *entity) {
+    state->entitiesCount += 1;
+
+    if (NULL != state->ordered) {
+        array_add (state->ordered, entity);
+        return 1;
+    }
+    return state->handler (state->context, state->fs, entity);
+}
+
+///
+/// Read one stored entity and pass it to the load's handler.  Called by the backend with
+/// `fs->lock` held.
+///
+/// @return true (1) to continue the load, false (0) on a failure.
+///
+static int
+fileServiceLoadEntity (void *context,
+                       UInt256 identifier,
+                       int64_t sortKey,
+                       const uint8_t *dataBytes,
+                       size_t dataBytesCount) {
+    BRFileServiceLoadState *state = context;
+
+    BRFileServicePendingWrite update;
+    void *entity = fileServiceLoadDecode (state, sortKey, dataBytes, dataBytesCount, &update, &state->error);
+    if (NULL == entity) {
+        state->failed = true;
+        return 0;
+    }
+
+    if (NULL != update.bytes)
+        array_add (state->updates, update);
+
+    if (!fileServiceLoadDeliver (state, entity)) {
+        state->failed = true;
+        state->error  = FILE_SERVICE_LOAD_ERROR_ENTITY ("handler");
+        return 0;
+    }
+
+    return 1;
+}
+
+///
+/// Hold one stored entity, to be decoded by the load threads.  Called by the backend with
+/// `fs->lock` held.
+///
+static int
+fileServiceLoadEntityHold (void *context,
+                           UInt256 identifier,
+                           int64_t sortKey,
+                           const uint8_t *dataBytes,
+                           size_t dataBytesCount) {
+    BRFileServiceLoadState *state = context;
+
+    BRFileServiceLoadRow row = { sortKey, NULL, dataBytesCount };
+    if (NULL != dataBytes) {
+        row.bytes = malloc (dataBytesCount);
+        memcpy (row.bytes, dataBytes, dataBytesCount);
+    }
+
+    array_add (state->rows, row);
+    return 1;
+}
+
+///
+/// The rows, [rowsIndex, rowsIndex + rowsCount), decoded by one load thread.
+///
+typedef struct {
+    const BRFileServiceLoadState *state;
+    size_t rowsIndex;
+    size_t rowsCount;
+    pthread_t thread;
+    bool started;
+} BRFileServiceLoadWorker;
+
+static void *
+fileServiceLoadThread (BRFileServiceLoadWorker *worker) {
+    pthread_setname_brd (pthread_self(), FILE_SERVICE_LOAD_THREAD_NAME);
+
+    BRFileServiceLoadRow *rows = worker->state->rows;
+
+    for (size_t index = worker->rowsIndex; index < worker->rowsIndex + worker->rowsCount; index++) {
+        BRFileServiceLoadRow *row = &rows[index];
+
+        row->entity = fileServiceLoadDecode (worker->state, row->sortKey, row->bytes, row->bytesCount,
+                                             &row->update, &row->error);
+        row->failed = (NULL == row->entity);
+
+        free (row->bytes);
+        row->bytes = NULL;
+    }
+
+    return NULL;
+}
+
+///
+/// Decode the held rows, using up to `fs->loadThreadsCount` threads, and then pass the entities
+/// to the load's handler in row order.  As with an ordered load, every decoded entity is passed
+/// to the handler, even after a failure; the first failure, by row, is recorded in `state`.
+///
+static void
+fileServiceLoadDecodeRows (BRFileServiceLoadState *state) {
+    size_t rowsCount = array_count (state->rows);
+
+    size_t workersCount = rowsCount / FILE_SERVICE_LOAD_THREAD_MIN_COUNT;
+    if (workersCount > state->fs->loadThreadsCount) workersCount = state->fs->loadThreadsCount;
+    if (workersCount < 1) workersCount = 1;
+
+    BRFileServiceLoadWorker workers[workersCount];
+
+    for (size_t index = 0; index < workersCount; index++) {
+        workers[index] = (BRFileServiceLoadWorker) {
+            state,
+            index * rowsCount / workersCount,
+            (index + 1) * rowsCount / workersCount - index * rowsCount / workersCount
+        };
+    }
+
+    // This thread decodes the first worker's rows; others get their own thread.  A worker
+    // without a thread has its rows decoded here.
+    pthread_attr_t attr;
+    pthread_attr_init (&attr);
+    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setstacksize (&attr, 1024 * 1024);
+
+    for (size_t index = 1; index < workersCount; index++)
+        workers[index].started = (0 == pthread_create (&workers[index].thread, &attr,
+                                                       (ThreadRoutine) fileServiceLoadThread,
+                                                       &workers[index]));
+    pthread_attr_destroy (&attr);
+
+    for (size_t index = 0; index < workersCount; index++) {
+        if (workers[index].started) pthread_join (workers[index].thread, NULL);
+        else fileServiceLoadThread (&workers[index]);
+    }
+
+    // Merge, in row order.
+    for (size_t index = 0; index < rowsCount; index++) {
+        BRFileServiceLoadRow *row = &state->rows[index];
+
+        if (row->failed) {
+            if (!state->failed) { state->failed = true; state->error = row->error; }
+            continue;
+        }
+
+        if (NULL != row->update.bytes)
+            array_add (state->updates, row->update);
+
+        if (!fileServiceLoadDeliver (state, row->entity) && !state->failed) {
+            state->failed = true;
+            state->error  = FILE_SERVICE_LOAD_ERROR_ENTITY ("handler");
+        }
+    }
+
+    array_free (state->rows);
+    state->rows = NULL;
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+///
+/// Load entities of `type` passing each to `handler`.  If `range` is not NULL, then only
+/// entities with a sort key in [range[0], range[1]] or without a sort key are loaded, ordered by
+/// sort key.  Otherwise, if `compare` is not NULL, entities are ordered by their sort key, if
+/// every one has a sort key, or by `compare`.  Fills `entitiesCount` with the number of
+/// entities passed to `handler`.
+///
+static int
+_fileServiceLoad (BRFileService fs,
+                  const char *type,
+                  int updateVersion,
+                  BRFileServiceEntityComparator compare,
+                  const int64_t *range,
+                  BRFileServiceContext context,
+                  BRFileServiceLoadHandler handler,
+                  size_t *entitiesCount) {
+    *entitiesCount = 0;
+
+    BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
+    if (NULL == entityType) return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type");
+
+    BRFileServiceEntityHandler *entityHandlerCurrent = fileServiceEntityTypeLookupHandler(entityType, entityType->currentVersion);
+    if (NULL == entityHandlerCurrent) return fileServiceFailedImpl (fs,  0, NULL, NULL, "missed type handler");
+
+#if !defined(NEUTER_FILE_SERVICE)
+    BRFileServiceBackendStatus status;
+
+    // Complete queued writes so that the load includes them.
+    fileServiceFlush (fs);
+
+    pthread_mutex_lock (&fs->lock);
+    if (fs->closed)
+        return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
+
+    // When every entity has a sort key, the backend orders the entities and `compare` is not
+    // needed.
+    bool ordered = false;
+    if (NULL == range &&
+        NULL != compare &&
+        NULL != entityType->sortKey &&
+        !fs->backendHandlers->hasUnkeyed (fs->backend, type)) {
+        ordered = true;
+        compare = NULL;
+    }
+
+    BRFileServiceLoadState state = {
+        fs,
+        entityType,
+        entityHandlerCurrent,
+        updateVersion,
+        NULL,
+        NULL,
+        NULL,
+        context,
+        handler,
+        0,
+        false
+    };
+
+    array_new (state.updates, 0);
+    if (NULL != compare) array_new (state.ordered, 25);
+
+    // With load threads, hold every stored entity and decode them once all have been read;
+    // otherwise decode each as it is read.  Entities are held and decoded with `fs->lock` held
+    // so that an update can't overwrite a concurrent save.
+    if (fs->loadThreadsCount > 1) {
+        array_new (state.rows, 100);
+        status = fs->backendHandlers->load (fs->backend, type, ordered, range, &state, fileServiceLoadEntityHold);
+        if (FILE_SERVICE_BACKEND_OK == status)
+            fileServiceLoadDecodeRows (&state);
+        else {
+            for (size_t index = 0; index < array_count (state.rows); index++)
+                free (state.rows[index].bytes);
+            array_free (state.rows);
+        }
+    }
+    else
+        status = fs->backendHandlers->load (fs->backend, type, ordered, range, &state, fileServiceLoadEntity);
+
+    *entitiesCount = state.entitiesCount;
+
+    if (FILE_SERVICE_BACKEND_OK != status || state.failed) {
+        fileServicePendingWritesRelease (state.updates);
+
+        if (state.failed) fileServiceFailedInternal (fs, 1, NULL, NULL, state.error);
+        else              fileServiceFailedBackend  (fs, 1, status);
+
+        // The entities already read are owned by `handler`
+        fileServiceLoadDeliverOrdered (fs, state.ordered, compare, context, handler);
+        return 0;
+    }
+
+    // Write the updated entities, all in one DB transaction.  A failure could signal an error.
+    // Perhaps we should report it?  We won't - we couldn't save the entities in the new format
+    // but we'll continue and will try next time we load them.
+    BRArrayOf(BRFileServicePendingWrite) updates = state.updates;
+    if (0 != array_count (updates) &&
+        FILE_SERVICE_BACKEND_OK == fileServiceTransactionBegin (fs)) {
+        status = FILE_SERVICE_BACKEND_OK;
+        for (size_t index = 0; FILE_SERVICE_BACKEND_OK == status && index < array_count (updates); index++)
+            status = fileServiceSaveBytes (fs, type,
+                                           updates[index].identifier,
+                                           updates[index].sortKey,
+                                           updates[index].bytes,
+                                           updates[index].bytesCount);
+
+        if (FILE_SERVICE_BACKEND_OK != status || FILE_SERVICE_BACKEND_OK != fileServiceTransactionCommit (fs))
+            fileServiceTransactionRollback (fs);
+    }
+
+    pthread_mutex_unlock (&fs->lock);
+
+    fileServicePendingWritesRelease (updates);
+
+    if (!fileServiceLoadDeliverOrdered (fs, state.ordered, compare, context, handler))
+        return fileServiceFailedEntity (fs, 0, NULL, NULL, type, "handler");
 #endif // !defined(NEUTER_FILE_SERVICE)
 
     return 1;
 }
 
+extern void
+fileServiceSetLoadThreads (BRFileService fs,
+                           size_t threadsCount) {
+#if !defined(NEUTER_FILE_SERVICE)
+    pthread_mutex_lock (&fs->lock);
+    fs->loadThreadsCount = threadsCount;
+    pthread_mutex_unlock (&fs->lock);
+#endif // !defined(NEUTER_FILE_SERVICE)
+}
+
+extern int
+fileServiceLoadIterate (BRFileService fs,
+                        const char *type,
+                        int updateVersion,
+                        BRFileServiceEntityComparator compare,
+                        BRFileServiceContext context,
+                        BRFileServiceLoadHandler handler) {
+    struct timeval start;
+    gettimeofday (&start, NULL);
+
+    size_t entitiesCount;
+    int success = _fileServiceLoad (fs, type, updateVersion, compare, NULL, context, handler, &entitiesCount);
+
+    fileServiceStatsRecord (fs, type, FILE_SERVICE_STATS_LOAD, start, entitiesCount);
+    return success;
+}
+
+extern int
+fileServiceLoadRange (BRFileService fs,
+                      const char *type,
+                      int updateVersion,
+                      int64_t sortKeyLower,
+                      int64_t sortKeyUpper,
+                      BRFileServiceContext context,
+                      BRFileServiceLoadHandler handler) {
+    int64_t range[2] = { sortKeyLower, sortKeyUpper };
+
+    struct timeval start;
+    gettimeofday (&start, NULL);
+
+    size_t entitiesCount;
+    int success = _fileServiceLoad (fs, type, updateVersion, NULL, range, context, handler, &entitiesCount);
+
+    fileServiceStatsRecord (fs, type, FILE_SERVICE_STATS_LOAD, start, entitiesCount);
+    return success;
+}
+
+static int
+fileServiceLoadHandlerSet (BRFileServiceContext context,
+                           BRFileService fs,
+                           void *entity) {
+    BRSet *results = context;
+
+    // Update results with the newly restored entity
+    void *oldEntity = BRSetAdd (results, entity);
+    //assert (NULL == oldEntity);  // DEBUG builds
+    return NULL == oldEntity;
+}
+
+extern int
+fileServiceLoad (BRFileService fs,
+                 BRSet *results,
+                 const char *type,
+                 int updateVersion) {
+    return fileServiceLoadIterate (fs, type, updateVersion, NULL, results, fileServiceLoadHandlerSet);
+}
+
 /// MARK: - Remove, Clear
 
 extern int
@@ -793,42 +1863,26 @@ fileServiceRemove (BRFileService fs,
 
     return !UInt256Eq (identiifer, UINT256_ZERO) && fileServiceRemoveByIdentifier (fs, type, identiifer);
 }
-
-extern int
-fileServiceRemoveByIdentifier (BRFileService fs,
-                               const char *type,
-                               UInt256 identifier) {
+
+static int
+_fileServiceRemoveByIdentifier (BRFileService fs,
+                                const char *type,
+                                UInt256 identifier) {
     BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
     if (NULL == entityType)
         return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type");
 
 #if !defined(NEUTER_FILE_SERVICE)
-    // Hex-Encode identifier
-    const char *hash = u256hex(identifier);
-
-    sqlite3_status_code status;
+    if (fileServiceWriteBehindEnqueue (fs, entityType->type, identifier, FILE_SERVICE_SORT_KEY_NONE, NULL, 0))
+        return 1;
 
     pthread_mutex_lock (&fs->lock);
-    if (fs->sdbClosed)
+    if (fs->closed)
         return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
 
-    sqlite3_reset (fs->sdbDeleteStmt);
-    sqlite3_clear_bindings (fs->sdbDeleteStmt);
-
-    status = sqlite3_bind_text (fs->sdbDeleteStmt, 1, type, -1, SQLITE_STATIC);
-    if (SQLITE_OK != status)
-        return fileServiceFailedSDB (fs, 1, status);
-
-    status = sqlite3_bind_text (fs->sdbDeleteStmt, 2, hash, -1, SQLITE_STATIC);
-    if (SQLITE_OK != status)
-        return fileServiceFailedSDB (fs, 1, status);
-
-    status = sqlite3_step (fs->sdbDeleteStmt);
-    if (SQLITE_DONE != status)
-        return fileServiceFailedSDB (fs, 1, status);
-
-    // Ensure the 'implicit DB transaction' is committed.
-    sqlite3_reset (fs->sdbDeleteStmt);
+    BRFileServiceBackendStatus status = fileServiceRemoveBytes (fs, type, identifier);
+    if (FILE_SERVICE_BACKEND_OK != status)
+        return fileServiceFailedBackend (fs, 1, status);
 
     pthread_mutex_unlock (&fs->lock);
 #endif // !defined(NEUTER_FILE_SERVICE)
@@ -836,6 +1890,19 @@ fileServiceRemoveByIdentifier (BRFileService fs,
     return 1;
 }
 
+extern int
+fileServiceRemoveByIdentifier (BRFileService fs,
+                               const char *type,
+                               UInt256 identifier) {
+    struct timeval start;
+    gettimeofday (&start, NULL);
+
+    int success = _fileServiceRemoveByIdentifier (fs, type, identifier);
+
+    fileServiceStatsRecord (fs, type, FILE_SERVICE_STATS_REMOVE, start, 1);
+    return success;
+}
+
 static int
 fileServiceClearForType (BRFileService fs,
                          BRFileServiceEntityType *entityType,
@@ -843,25 +1910,18 @@ fileServiceClearForType (BRFileService fs,
 #if !defined(NEUTER_FILE_SERVICE)
     const char *type = entityType->type;
 
-    sqlite3_status_code status;
+    BRFileServiceBackendStatus status;
+
+    // Complete queued writes so that none are applied after the clear.
+    if (needLock) fileServiceFlush (fs);
 
     if (needLock) pthread_mutex_lock (&fs->lock);
-    if (fs->sdbClosed)
+    if (fs->closed)
         return fileServiceFailedImpl (fs, needLock, NULL, NULL, "closed");
 
-    sqlite3_reset (fs->sdbDeleteAllTypeStmt);
-    sqlite3_clear_bindings (fs->sdbDeleteAllTypeStmt);
-
-    status = sqlite3_bind_text (fs->sdbDeleteAllTypeStmt, 1, type, -1, SQLITE_STATIC);
-    if (SQLITE_OK != status)
-        return fileServiceFailedSDB (fs, needLock, status);
-
-    status = sqlite3_step (fs->sdbDeleteAllTypeStmt);
-    if (SQLITE_DONE != status)
-        return fileServiceFailedSDB (fs, needLock, status);
-
-    // Ensure the 'implicit DB transaction' is committed.
-    sqlite3_reset (fs->sdbDeleteAllTypeStmt);
+    status = fs->backendHandlers->clear (fs->backend, type);
+    if (FILE_SERVICE_BACKEND_OK != status)
+        return fileServiceFailedBackend (fs, needLock, status);
 
     if (needLock) pthread_mutex_unlock (&fs->lock);
 #endif // !defined(NEUTER_FILE_SERVICE)
@@ -876,7 +1936,13 @@ fileServiceClear (BRFileService fs,
     if (NULL == entityType)
         return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type");
 
-    return fileServiceClearForType(fs, entityType, 1);
+    struct timeval start;
+    gettimeofday (&start, NULL);
+
+    int success = fileServiceClearForType(fs, entityType, 1);
+
+    fileServiceStatsRecord (fs, type, FILE_SERVICE_STATS_REMOVE, start, 0);
+    return success;
 }
 
 extern int
@@ -884,46 +1950,52 @@ fileServiceClearAll (BRFileService fs) {
     int success = 1;
     size_t typeCount = array_count(fs->entityTypes);
     for (size_t index = 0; index < typeCount; index++)
-        success &= fileServiceClearForType (fs, &fs->entityTypes[index], 1);
+        success &= fileServiceClear (fs, fs->entityTypes[index].type);
     return success;
 }
 
 static int
-fileServiceReplaceFailed (BRFileService fs, int needUnlock) {
-    if (needUnlock) pthread_mutex_unlock (&fs->lock);
-    return 0;
-}
-
-extern int
-fileServiceReplace (BRFileService fs,
-                    const char *type,
-                    const void **entities,
-                    size_t entitiesCount) {
+_fileServiceSaveMany (BRFileService fs,
+                      const char *type,
+                      const void **entities,
+                      size_t entitiesCount) {
     BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
     if (NULL == entityType)
         return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type");
 
 #if !defined(NEUTER_FILE_SERVICE)
-    sqlite3_status_code status;
+    BRFileServiceBackendStatus status;
+
+    // With write-behind, and outside of a batch, each entity is queued; the writer commits them
+    // in groups.
+    pthread_mutex_lock (&fs->wbLock);
+    bool writeBehind = fileServiceWriteBehindActive (fs);
+    pthread_mutex_unlock (&fs->wbLock);
+
+    if (writeBehind) {
+        int success = 1;
+        for (size_t index = 0; index < entitiesCount; index++)
+            success &= _fileServiceSave (fs, type, entities[index], 1);
+        return success;
+    }
 
     pthread_mutex_lock (&fs->lock);
-    if (fs->sdbClosed)
+    if (fs->closed)
         return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
 
-    status = sqlite3_exec (fs->sdb, "BEGIN", NULL, NULL, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceFailedSDB (fs, 1, status);
-
-    if (0 == fileServiceClearForType (fs, entityType, 0))
-        return fileServiceReplaceFailed (fs, 1);
+    status = fileServiceTransactionBegin (fs);
+    if (FILE_SERVICE_BACKEND_OK != status)
+        return fileServiceFailedBackend (fs, 1, status);
 
     for (size_t index = 0; index < entitiesCount; index++)
         if (0 == _fileServiceSave (fs, type, entities[index], 0))
-            return fileServiceReplaceFailed (fs, 1);
+            return fileServiceBatchFailed (fs, 1);
 
-    status = sqlite3_exec (fs->sdb, "COMMIT", NULL, NULL, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceFailedSDB (fs, 1, status);
+    status = fileServiceTransactionCommit (fs);
+    if (FILE_SERVICE_BACKEND_OK != status) {
+        fileServiceTransactionRollback (fs);
+        return fileServiceFailedBackend (fs, 1, status);
+    }
 
     pthread_mutex_unlock (&fs->lock);
 #endif // !defined(NEUTER_FILE_SERVICE)
@@ -931,45 +2003,230 @@ fileServiceReplace (BRFileService fs,
     return 1;
 }
 
-static char * // called while locked
-fileServicePurgeCreateSQL (BRFileService fs) {
-    size_t typeCount = array_count(fs->entityTypes);
+extern int
+fileServiceSaveMany (BRFileService fs,
+                     const char *type,
+                     const void **entities,
+                     size_t entitiesCount) {
+    struct timeval start;
+    gettimeofday (&start, NULL);
 
-    static char *sqlFormatter = "DELETE FROM Entity WHERE Type NOT IN (%s);";
+    int success = _fileServiceSaveMany (fs, type, entities, entitiesCount);
 
-    char *sqlArgs;
-    size_t sqlArgsLength = 1;
+    fileServiceStatsRecord (fs, type, FILE_SERVICE_STATS_SAVE, start, entitiesCount);
+    return success;
+}
 
-    char *sqlArgPrefix = "\"";
+#if !defined(NEUTER_FILE_SERVICE)
+///
+/// An entity, as stored in the DB, considered by a delta replace.  The `bytes` are a copy of the
+/// stored header and entity bytes, as the backend loads them, for every header format.  The first
+/// header byte is the header format version; thus the bytes of a HEADER_FORMAT_1 entity never match
+/// those of the current encoding and the entity is always rewritten in the current header format.
+///
+typedef struct {
+    UInt256 identifier;
+    int64_t sortKey;
+    uint8_t *bytes;
+    size_t bytesCount;
+    bool retained;      // true if the replacing entities include `identifier`
+} BRFileServiceStoredEntity;
+
+static size_t
+fileServiceStoredEntityHash (const void *item) {
+    return (size_t) ((const BRFileServiceStoredEntity *) item)->identifier.u32[0];
+}
 
-    // Find the args length
-    for (size_t index = 0; index < typeCount; index++) {
-        sqlArgsLength += strlen (sqlArgPrefix);
-        sqlArgsLength += strlen (fs->entityTypes[index].type) + 2; // quotes
-        sqlArgPrefix = "\",\"";
+static int
+fileServiceStoredEntityEq (const void *item1, const void *item2) {
+    return UInt256Eq (((const BRFileServiceStoredEntity *) item1)->identifier,
+                      ((const BRFileServiceStoredEntity *) item2)->identifier);
+}
+
+static void
+fileServiceStoredEntityRelease (void *item) {
+    BRFileServiceStoredEntity *stored = item;
+    if (NULL != stored->bytes) free (stored->bytes);
+    free (stored);
+}
+
+static int
+fileServiceReadStoredEntity (void *context,
+                             UInt256 identifier,
+                             int64_t sortKey,
+                             const uint8_t *bytes,
+                             size_t bytesCount) {
+    BRSet *stored = context;
+
+    BRFileServiceStoredEntity *entity = calloc (1, sizeof (BRFileServiceStoredEntity));
+    entity->identifier = identifier;
+    entity->sortKey    = sortKey;
+    entity->bytesCount = bytesCount;
+    entity->bytes      = malloc (bytesCount);
+    memcpy (entity->bytes, bytes, bytesCount);
+
+    BRFileServiceStoredEntity *replaced = BRSetAdd (stored, entity);
+    if (NULL != replaced) fileServiceStoredEntityRelease (replaced);
+    return 1;
+}
+
+///
+/// Read every stored entity of `type` into `stored`.  Must be called with `fs->lock` held; the
+/// lock is never released.
+///
+/// @return FILE_SERVICE_BACKEND_OK on success, otherwise the failing backend status.
+///
+static BRFileServiceBackendStatus
+fileServiceReadStored (BRFileService fs,
+                       const char *type,
+                       BRSet *stored) {
+    return fs->backendHandlers->load (fs->backend, type, false, NULL, stored, fileServiceReadStoredEntity);
+}
+
+///
+/// Replace the entities of `type` with `entities` by writing only the differences: entities that
+/// are new or whose encoded bytes changed are saved, stored entities that are missing from
+/// `entities` are removed and all others are untouched.  Must be called with `fs->lock` held,
+/// within a DB transaction; the lock is never released.
+///
+/// @return FILE_SERVICE_BACKEND_OK on success, otherwise the failing backend status.
+///
+static BRFileServiceBackendStatus
+fileServiceReplaceDelta (BRFileService fs,
+                         BRFileServiceEntityType *entityType,
+                         BRFileServiceEntityHandler *handler,
+                         const void **entities,
+                         size_t entitiesCount) {
+    const char *type = entityType->type;
+
+    BRSet *stored = BRSetNew (fileServiceStoredEntityHash,
+                              fileServiceStoredEntityEq,
+                              entitiesCount);
+
+    BRFileServiceBackendStatus status = fileServiceReadStored (fs, type, stored);
+
+    for (size_t index = 0; FILE_SERVICE_BACKEND_OK == status && index < entitiesCount; index++) {
+        BRFileServiceStoredEntity entity;
+        uint8_t *bytes = fileServiceEntityEncode (fs, entityType, handler, entities[index],
+                                                  &entity.identifier,
+                                                  &entity.sortKey,
+                                                  &entity.bytesCount);
+
+        BRFileServiceStoredEntity *existing = BRSetGet (stored, &entity);
+        if (NULL != existing) existing->retained = true;
+
+        if (NULL == existing ||
+            existing->sortKey    != entity.sortKey    ||
+            existing->bytesCount != entity.bytesCount ||
+            0 != memcmp (existing->bytes, bytes, entity.bytesCount))
+            status = fileServiceSaveBytes (fs, type, entity.identifier, entity.sortKey, bytes, entity.bytesCount);
+
+        free (bytes);
     }
-    sqlArgsLength += strlen ("\"");
 
-    sqlArgPrefix = "\"";
+    for (BRFileServiceStoredEntity *existing = BRSetIterate (stored, NULL);
+         FILE_SERVICE_BACKEND_OK == status && NULL != existing;
+         existing = BRSetIterate (stored, existing))
+        if (!existing->retained)
+            status = fileServiceRemoveBytes (fs, type, existing->identifier);
 
-    sqlArgs = malloc (sqlArgsLength);
-    for (size_t index = 0; index < typeCount; index++) {
-        strcat (sqlArgs, sqlArgPrefix);
-        strcat (sqlArgs, fs->entityTypes[index].type);
-        sqlArgPrefix = "\",\"";
+    BRSetFreeAll (stored, fileServiceStoredEntityRelease);
+    return status;
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+static int
+_fileServiceReplace (BRFileService fs,
+                     const char *type,
+                     const void **entities,
+                     size_t entitiesCount,
+                     bool delta) {
+    BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
+    if (NULL == entityType)
+        return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type");
+
+    BRFileServiceEntityHandler *handler = fileServiceEntityTypeLookupHandler(entityType, entityType->currentVersion);
+    if (NULL == handler)
+        return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type handler");
+
+#if !defined(NEUTER_FILE_SERVICE)
+    BRFileServiceBackendStatus status;
+
+    // Complete queued writes so that none are applied after the replace.
+    fileServiceFlush (fs);
+
+    pthread_mutex_lock (&fs->lock);
+    if (fs->closed)
+        return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
+
+    status = fileServiceTransactionBegin (fs);
+    if (FILE_SERVICE_BACKEND_OK != status)
+        return fileServiceFailedBackend (fs, 1, status);
+
+    if (delta) {
+        status = fileServiceReplaceDelta (fs, entityType, handler, entities, entitiesCount);
+        if (FILE_SERVICE_BACKEND_OK != status) {
+            fileServiceTransactionRollback (fs);
+            return fileServiceFailedBackend (fs, 1, status);
+        }
+    }
+    else {
+        if (0 == fileServiceClearForType (fs, entityType, 0))
+            return fileServiceBatchFailed (fs, 1);
+
+        for (size_t index = 0; index < entitiesCount; index++)
+            if (0 == _fileServiceSave (fs, type, entities[index], 0))
+                return fileServiceBatchFailed (fs, 1);
+    }
+
+    status = fileServiceTransactionCommit (fs);
+    if (FILE_SERVICE_BACKEND_OK != status) {
+        fileServiceTransactionRollback (fs);
+        return fileServiceFailedBackend (fs, 1, status);
     }
-    strcat (sqlArgs, "\"");
 
-    char *sql = NULL;
-    asprintf (&sql, sqlFormatter, sqlArgs);
+    pthread_mutex_unlock (&fs->lock);
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+    return 1;
+}
+
+extern int
+fileServiceReplace (BRFileService fs,
+                    const char *type,
+                    const void **entities,
+                    size_t entitiesCount) {
+    struct timeval start;
+    gettimeofday (&start, NULL);
+
+    int success = _fileServiceReplace (fs, type, entities, entitiesCount, false);
+
+    fileServiceStatsRecord (fs, type, FILE_SERVICE_STATS_SAVE, start, entitiesCount);
+    return success;
+}
+
+extern int
+fileServiceReplaceChanged (BRFileService fs,
+                           const char *type,
+                           const void **entities,
+                           size_t entitiesCount) {
+    struct timeval start;
+    gettimeofday (&start, NULL);
+
+    int success = _fileServiceReplace (fs, type, entities, entitiesCount, true);
 
-    return sql;
+    fileServiceStatsRecord (fs, type, FILE_SERVICE_STATS_SAVE, start, entitiesCount);
+    return success;
 }
 
 extern int
 fileServicePurge (BRFileService fs) {
     if (NULL == fs) return 0;
 
+#if !defined(NEUTER_FILE_SERVICE)
+    fileServiceFlush (fs);
+#endif
+
     pthread_mutex_lock (&fs->lock);
 
     size_t typeCount = array_count(fs->entityTypes);
@@ -978,31 +2235,41 @@ fileServicePurge (BRFileService fs) {
         return 0;
     }
 
-    char *sql = fileServicePurgeCreateSQL (fs);
-    printf ("DBG: FileServicePurge: SQL: %s\n", sql);
+    // The types to keep, including the dictionaries of types with compression
+    const char **types = calloc (2 * typeCount, sizeof (char *));
+    size_t keepCount = 0;
+    for (size_t index = 0; index < typeCount; index++) {
+        types[keepCount++] = fs->entityTypes[index].type;
+        if (NULL != fs->entityTypes[index].dictionaryType)
+            types[keepCount++] = fs->entityTypes[index].dictionaryType;
+    }
 
 #if !defined(NEUTER_FILE_SERVICE)
-    sqlite3_status_code status;
+    BRFileServiceBackendStatus status;
 
-    if (fs->sdbClosed)
-        return fileServiceFailedImpl (fs, 1, sql, NULL, "closed");
+    if (fs->closed)
+        return fileServiceFailedImpl (fs, 1, types, NULL, "closed");
 
-    status = sqlite3_exec (fs->sdb, "BEGIN", NULL, NULL, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceFailedSDBWithBufferFree (fs, 1, sql, status);
+    status = fileServiceTransactionBegin (fs);
+    if (FILE_SERVICE_BACKEND_OK != status)
+        return fileServiceFailedBackendWithBufferFree (fs, 1, types, status);
 
-    status = sqlite3_exec(fs->sdb, sql, NULL, NULL, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceFailedSDBWithBufferFree (fs, 1, sql, status);
+    status = fs->backendHandlers->purge (fs->backend, types, keepCount);
+    if (FILE_SERVICE_BACKEND_OK != status) {
+        fileServiceTransactionRollback (fs);
+        return fileServiceFailedBackendWithBufferFree (fs, 1, types, status);
+    }
 
-    status = sqlite3_exec (fs->sdb, "COMMIT", NULL, NULL, NULL);
-    if (SQLITE_OK != status)
-        return fileServiceFailedSDBWithBufferFree (fs, 1, sql, status);
+    status = fileServiceTransactionCommit (fs);
+    if (FILE_SERVICE_BACKEND_OK != status) {
+        fileServiceTransactionRollback (fs);
+        return fileServiceFailedBackendWithBufferFree (fs, 1, types, status);
+    }
 
 #endif // !defined(NEUTER_FILE_SERVICE)
     pthread_mutex_unlock (&fs->lock);
 
-    free (sql);
+    free (types);
     return 1;
 }
 
@@ -1012,14 +2279,14 @@ fileServiceWipe (const char *basePath,
                  const char *network) {
     int result = 0; // 0 on success, errno on failure
 
-#if !defined(NEUTER_FILE_SERVICE)
-    // Locate the SQLITE Database
-    char *sdbPath = fileServiceCreateFilePath (basePath, currency, network, FILE_SERVICE_SDB_FILENAME);
+    // Wipe every backend; a store could have been created by any of them.
+    result = fileServiceBackendHandlersSQLite.wipe (basePath, currency, network);
 
-    // Remove it.
-    result  = (0 == remove (sdbPath) ? 0 : errno);
-    free (sdbPath);
-#endif
+    int resultLog = fileServiceBackendHandlersLog.wipe (basePath, currency, network);
+    if (0 != resultLog) result = resultLog;
+
+    int resultStore = fileServiceBackendHandlersStore.wipe (basePath, currency, network);
+    if (0 != resultStore) result = resultStore;
 
     return result;
 }
@@ -1101,21 +2368,286 @@ fileServiceDefineCurrentVersion (BRFileService fs,
     return 1;
 }
 
-extern BRFileService
-fileServiceCreateFromTypeSpecifications(const char *basePath,
-                                        const char *currency,
-                                        const char *network,
-                                        BRFileServiceContext context,
-                                        BRFileServiceErrorHandler handler,
-                                        size_t specificationsCount,
-                                        BRFileServiceTypeSpecification *specfications) {
+extern int
+fileServiceDefineSortKey (BRFileService fs,
+                          const char *type,
+                          BRFileServiceContext context,
+                          BRFileServiceSortKey sortKey) {
+    BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
+    if (NULL == entityType) return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type");
+
+    entityType->sortKeyContext = context;
+    entityType->sortKey        = sortKey;
+
+    return 1;
+}
+
+#if !defined(NEUTER_FILE_SERVICE)
+///
+/// Add the dictionary `bytes`, as `id`, to the dictionaries of `entityType`; if `current`, as the
+/// current one.  An existing `id` is not replaced - the dictionary itself may be in use.
+///
+static void
+fileServiceEntityTypeAddDictionary (BRFileService fs,
+                                    BRFileServiceEntityType *entityType,
+                                    uint32_t id,
+                                    const uint8_t *bytes,
+                                    size_t bytesCount,
+                                    bool current) {
+    BRFileServiceDictionary dictionary = { id, NULL };
+
+    pthread_mutex_lock (&fs->codecLock);
+
+    for (size_t index = 0; index < array_count (entityType->dictionaries); index++)
+        if (id == entityType->dictionaries[index].id) {
+            dictionary = entityType->dictionaries[index];
+            array_rm (entityType->dictionaries, index);
+            break;
+        }
+
+    if (NULL == dictionary.dictionary)
+        dictionary.dictionary = BRCompressDictionaryNew (bytes, bytesCount);
+
+    if (current) array_add (entityType->dictionaries, dictionary);
+    else array_insert (entityType->dictionaries, 0, dictionary);
+
+    pthread_mutex_unlock (&fs->codecLock);
+}
+
+static uint32_t
+fileServiceDictionaryId (UInt256 identifier) {
+    uint32_t id = UInt32GetLE (identifier.u8);
+    return (0 == id ? 1 : id);  // 0 is 'no dictionary'
+}
+
+static int
+fileServiceLoadDictionary (void *context,
+                           UInt256 identifier,
+                           int64_t sortKey,
+                           const uint8_t *bytes,
+                           size_t bytesCount) {
+    void **args = context;
+    fileServiceEntityTypeAddDictionary (args[0], args[1], fileServiceDictionaryId (identifier), bytes, bytesCount, true);
+    return 1;
+}
+
+///
+/// A stored entity, with its entity bytes decoded, read to train and then to be recompressed.
+///
+typedef struct {
+    UInt256 identifier;
+    int64_t sortKey;
+    BRFileServiceVersion version;
+    uint8_t *entityBytes;
+    uint32_t entityBytesCount;
+} BRFileServiceTrainEntity;
+
+typedef struct {
+    BRFileService fs;
+    BRFileServiceEntityType *entityType;
+    BRArrayOf(BRFileServiceTrainEntity) entities;
+} BRFileServiceTrainState;
+
+static int
+fileServiceTrainReadEntity (void *context,
+                            UInt256 identifier,
+                            int64_t sortKey,
+                            const uint8_t *dataBytes,
+                            size_t dataBytesCount) {
+    BRFileServiceTrainState *state = context;
+
+    BRFileServiceHeaderFormatVersion headerVersion;
+    BRFileServiceTrainEntity entity = { identifier, sortKey };
+    const uint8_t *entityBytes;
+    uint8_t *ownedBytes;
+
+    // An entity that can't be decoded is skipped; its load will report it.
+    if (NULL != fileServiceEntityBytesDecode (state->fs, state->entityType, dataBytes, dataBytesCount,
+                                              &headerVersion, &entity.version,
+                                              &entityBytes, &entity.entityBytesCount, &ownedBytes))
+        return 1;
+
+    if (NULL != ownedBytes) entity.entityBytes = ownedBytes;
+    else {
+        entity.entityBytes = malloc (entity.entityBytesCount + 1);
+        memcpy (entity.entityBytes, entityBytes, entity.entityBytesCount);
+    }
+
+    array_add (state->entities, entity);
+    return 1;
+}
+
+static void
+fileServiceTrainStateRelease (BRFileServiceTrainState *state) {
+    for (size_t index = 0; index < array_count (state->entities); index++)
+        free (state->entities[index].entityBytes);
+    array_free (state->entities);
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+extern int
+fileServiceDefineCompression (BRFileService fs,
+                              const char *type) {
+    BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
+    if (NULL == entityType) return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type");
+
+    if (entityType->compressed) return 1;
+
+    entityType->dictionaryType = malloc (strlen (type) + strlen (FILE_SERVICE_DICTIONARY_TYPE_SUFFIX) + 1);
+    sprintf (entityType->dictionaryType, "%s%s", type, FILE_SERVICE_DICTIONARY_TYPE_SUFFIX);
+    array_new (entityType->dictionaries, 1);
+
+#if !defined(NEUTER_FILE_SERVICE)
+    // Load the trained dictionaries, oldest first, so that the last trained is current.
+    pthread_mutex_lock (&fs->lock);
+    if (fs->closed)
+        return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
+
+    void *args[2] = { fs, entityType };
+    BRFileServiceBackendStatus status = fs->backendHandlers->load (fs->backend, entityType->dictionaryType,
+                                                                   true, NULL,
+                                                                   args, fileServiceLoadDictionary);
+    if (FILE_SERVICE_BACKEND_OK != status)
+        return fileServiceFailedBackend (fs, 1, status);
+
+    pthread_mutex_unlock (&fs->lock);
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+    entityType->compressed = true;
+    return 1;
+}
+
+extern int
+fileServiceTrainCompression (BRFileService fs,
+                             const char *type) {
+    BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
+    if (NULL == entityType) return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed type");
+    if (!entityType->compressed) return fileServiceFailedImpl (fs, 0, NULL, NULL, "missed compression");
+
+#if !defined(NEUTER_FILE_SERVICE)
+    BRFileServiceBackendStatus status;
+
+    // Complete queued writes so that the training includes them.
+    fileServiceFlush (fs);
+
+    pthread_mutex_lock (&fs->lock);
+    if (fs->closed)
+        return fileServiceFailedImpl (fs, 1, NULL, NULL, "closed");
+
+    BRFileServiceTrainState state = { fs, entityType, NULL };
+    array_new (state.entities, 100);
+
+    status = fs->backendHandlers->load (fs->backend, type, false, NULL, &state, fileServiceTrainReadEntity);
+    if (FILE_SERVICE_BACKEND_OK != status) {
+        fileServiceTrainStateRelease (&state);
+        return fileServiceFailedBackend (fs, 1, status);
+    }
+
+    size_t entitiesCount = array_count (state.entities);
+    if (entitiesCount < FILE_SERVICE_DICTIONARY_SAMPLES_MIN_COUNT) {
+        pthread_mutex_unlock (&fs->lock);
+        fileServiceTrainStateRelease (&state);
+        return 0;
+    }
+
+    // Train from samples spread across the stored entities.
+    size_t samplesCount = (entitiesCount < FILE_SERVICE_DICTIONARY_SAMPLES_MAX_COUNT
+                           ? entitiesCount
+                           : FILE_SERVICE_DICTIONARY_SAMPLES_MAX_COUNT);
+    const uint8_t **samples = calloc (samplesCount, sizeof (uint8_t *));
+    size_t *samplesCounts   = calloc (samplesCount, sizeof (size_t));
+    for (size_t index = 0; index < samplesCount; index++) {
+        BRFileServiceTrainEntity *entity = &state.entities[index * entitiesCount / samplesCount];
+        samples[index]       = entity->entityBytes;
+        samplesCounts[index] = entity->entityBytesCount;
+    }
+
+    uint8_t *dictionaryBytes = malloc (FILE_SERVICE_DICTIONARY_BYTES_COUNT);
+    size_t dictionaryBytesCount = BRCompressTrain (dictionaryBytes, FILE_SERVICE_DICTIONARY_BYTES_COUNT,
+                                                   samples, samplesCounts, samplesCount);
+    free (samplesCounts);
+    free (samples);
+
+    if (0 == dictionaryBytesCount) {
+        pthread_mutex_unlock (&fs->lock);
+        fileServiceTrainStateRelease (&state);
+        free (dictionaryBytes);
+        return 0;
+    }
+
+    UInt256 identifier;
+    BRSHA256 (identifier.u8, dictionaryBytes, dictionaryBytesCount);
+
+    pthread_mutex_lock (&fs->codecLock);
+    int64_t sortKey = (int64_t) array_count (entityType->dictionaries);
+    pthread_mutex_unlock (&fs->codecLock);
+
+    // Save the dictionary and then recompress every stored entity with it; all in one DB
+    // transaction.  The dictionary becomes current once committed.
+    uint32_t dictionaryId = fileServiceDictionaryId (identifier);
+    fileServiceEntityTypeAddDictionary (fs, entityType, dictionaryId,
+                                        dictionaryBytes, dictionaryBytesCount, false);
+
+    status = fileServiceTransactionBegin (fs);
+    if (FILE_SERVICE_BACKEND_OK == status)
+        status = fileServiceSaveBytes (fs, entityType->dictionaryType, identifier, sortKey,
+                                       dictionaryBytes, dictionaryBytesCount);
+
+    if (FILE_SERVICE_BACKEND_OK == status) {
+        for (size_t index = 0; FILE_SERVICE_BACKEND_OK == status && index < entitiesCount; index++) {
+            BRFileServiceTrainEntity *entity = &state.entities[index];
+            size_t bytesCount;
+            uint8_t *bytes = fileServiceEntityBytesEncode (fs, entityType, entity->version, dictionaryId,
+                                                           entity->entityBytes, entity->entityBytesCount,
+                                                           &bytesCount);
+            status = fileServiceSaveBytes (fs, type, entity->identifier, entity->sortKey, bytes, bytesCount);
+            free (bytes);
+        }
+    }
+
+    if (FILE_SERVICE_BACKEND_OK == status)
+        status = fileServiceTransactionCommit (fs);
+
+    fileServiceTrainStateRelease (&state);
+
+    // On a failure the dictionary remains, but not as the current one, and is never used.
+    if (FILE_SERVICE_BACKEND_OK != status) {
+        fileServiceTransactionRollback (fs);
+        return fileServiceFailedBackendWithBufferFree (fs, 1, dictionaryBytes, status);
+    }
+
+    fileServiceEntityTypeAddDictionary (fs, entityType, dictionaryId,
+                                        dictionaryBytes, dictionaryBytesCount, true);
+    free (dictionaryBytes);
+
+    pthread_mutex_unlock (&fs->lock);
+    return 1;
+#else
+    return 0;
+#endif // !defined(NEUTER_FILE_SERVICE)
+}
+
+extern bool
+fileServiceHasCompressionDictionary (BRFileService fs,
+                                     const char *type) {
+    BRFileServiceEntityType *entityType = fileServiceLookupType (fs, type);
+    if (NULL == entityType || !entityType->compressed) return false;
+
+    uint32_t id = 0;
+    return NULL != fileServiceEntityTypeLookupDictionary (fs, entityType, &id);
+}
+
+///
+/// Define the types of `specifications` in `fileService`.  On failure, `fileService` is released
+/// and NULL is returned.
+///
+static BRFileService
+fileServiceDefineTypeSpecifications (BRFileService fileService,
+                                     BRFileServiceContext context,
+                                     size_t specificationsCount,
+                                     BRFileServiceTypeSpecification *specfications) {
     int success = 1;
 
-    BRFileService fileService = fileServiceCreate (basePath,
-                                                   currency,
-                                                   network,
-                                                   context,
-                                                   handler);
     if (NULL == fileService) return NULL;
 
     for (size_t index = 0; index < specificationsCount; index++) {
@@ -1135,8 +2667,51 @@ fileServiceCreateFromTypeSpecifications(const char *basePath,
                                                     specification->type,
                                                     specification->defaultVersion);
         if (!success) break;
+
+        if (NULL != specification->sortKey)
+            success &= fileServiceDefineSortKey (fileService,
+                                                 specification->type,
+                                                 context,
+                                                 specification->sortKey);
+        if (!success) break;
     }
 
     if (success) return fileService;
     else { fileServiceRelease (fileService); return NULL; }
 }
+
+extern BRFileService
+fileServiceCreateFromTypeSpecifications(const char *basePath,
+                                        const char *currency,
+                                        const char *network,
+                                        BRFileServiceContext context,
+                                        BRFileServiceErrorHandler handler,
+                                        size_t specificationsCount,
+                                        BRFileServiceTypeSpecification *specfications) {
+    return fileServiceDefineTypeSpecifications (fileServiceCreate (basePath,
+                                                                   currency,
+                                                                   network,
+                                                                   context,
+                                                                   handler),
+                                                context,
+                                                specificationsCount,
+                                                specfications);
+}
+
+extern BRFileService
+fileServiceCreateFromTypeSpecificationsInStore (BRFileServiceStore store,
+                                                const char *currency,
+                                                const char *network,
+                                                BRFileServiceContext context,
+                                                BRFileServiceErrorHandler handler,
+                                                size_t specificationsCount,
+                                                BRFileServiceTypeSpecification *specfications) {
+    return fileServiceDefineTypeSpecifications (fileServiceCreateInStore (store,
+                                                                          currency,
+                                                                          network,
+                                                                          context,
+                                                                          handler),
+                                                context,
+                                                specificationsCount,
+                                                specfications);
+}
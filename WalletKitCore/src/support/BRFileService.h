@@ -92,6 +92,109 @@ fileServiceCreate (const char *basePath,
                    BRFileServiceContext context,
                    BRFileServiceErrorHandler handler);
 
+///
+/// The storage engine of a file service.
+///
+///  - SQLITE: an sqlite3 DB with one 'Entity' table, the default.
+///  - LOG:    an append-only log of memory-mapped segments, with an in-memory index of the
+///            entities and background compaction of overwritten and removed entities.  Startup
+///            replays the log; writes never update in place.
+///
+/// The engines store the same entities but not in the same files; switching the engine of an
+/// existing {currency, network} starts with an empty store.
+///
+typedef enum {
+    FILE_SERVICE_BACKEND_SQLITE,
+    FILE_SERVICE_BACKEND_LOG
+} BRFileServiceBackendType;
+
+/// Create a file service, as `fileServiceCreate()`, using the `backendType` storage engine.
+extern BRFileService
+fileServiceCreateWithBackend (const char *basePath,
+                              const char *currency,
+                              const char *network,
+                              BRFileServiceBackendType backendType,
+                              BRFileServiceContext context,
+                              BRFileServiceErrorHandler handler);
+
+///
+/// A store shared by the file services of many {currency, network}s: one sqlite3 DB, in
+/// "`basePath`/entities.db", with each file service's entities namespaced by its currency and
+/// network.  Writes from every file service in the store are queued to a single writer thread
+/// which commits all that are queued as one DB transaction; each file service reads with its own
+/// DB connection, concurrently with the writer and with the other file services.
+///
+/// A write completes once queued; a read first waits for the queued writes to complete.  A
+/// failed write is reported by the next operation of its file service.  The DB always uses a
+/// write-ahead log; `fileServiceSetDurability()` on any file service applies to the whole DB.
+///
+typedef struct BRFileServiceStoreRecord *BRFileServiceStore;
+
+/// Create a store in `basePath`, creating `basePath` if needed.  Returns NULL on failure.
+extern BRFileServiceStore
+fileServiceStoreCreate (const char *basePath);
+
+/// Release `store`.  The store stays open until every file service created in it is released.
+extern void
+fileServiceStoreRelease (BRFileServiceStore store);
+
+/// Wait until every write queued to `store`, by any of its file services, is complete.
+extern void
+fileServiceStoreFlush (BRFileServiceStore store);
+
+/// Create a file service, as `fileServiceCreate()`, for {currency, network} in `store`.
+extern BRFileService
+fileServiceCreateInStore (BRFileServiceStore store,
+                          const char *currency,
+                          const char *network,
+                          BRFileServiceContext context,
+                          BRFileServiceErrorHandler handler);
+
+/// The sqlite3 `synchronous` setting; how often the DB waits for writes to reach the disk.
+typedef enum {
+    FILE_SERVICE_SYNCHRONOUS_OFF,
+    FILE_SERVICE_SYNCHRONOUS_NORMAL,
+    FILE_SERVICE_SYNCHRONOUS_FULL
+} BRFileServiceSynchronous;
+
+///
+/// The durability of file service writes, trading off against write latency.
+///
+///  - journalWAL:  if true, use a write-ahead log; otherwise use a rollback journal.  With a
+///                 write-ahead log, readers don't block the writer and a commit needs fewer syncs.
+///  - synchronous: with a write-ahead log, NORMAL is durable against an application crash but,
+///                 on an OS crash or power loss, might lose the latest commits.  FULL is always
+///                 durable.  OFF is fastest but, on power loss, might corrupt the DB.
+///  - mmapSize:    the bytes of the DB to memory map for reads; 0 disables memory mapping.
+///  - cacheSize:   the KiB of the DB page cache; 0 leaves the current cache size.
+///
+typedef struct {
+    bool journalWAL;
+    BRFileServiceSynchronous synchronous;
+    uint64_t mmapSize;
+    uint64_t cacheSize;
+} BRFileServiceDurability;
+
+/// The sqlite3 defaults: a rollback journal with every commit synced.
+#define FILE_SERVICE_DURABILITY_DEFAULT    ((BRFileServiceDurability) {                  \
+    false, FILE_SERVICE_SYNCHRONOUS_FULL, 0, 0                                               \
+})
+
+/// A write-ahead log with syncs only on checkpoints.
+#define FILE_SERVICE_DURABILITY_WAL        ((BRFileServiceDurability) {                  \
+    true, FILE_SERVICE_SYNCHRONOUS_NORMAL, 32 * 1024 * 1024, 8 * 1024                        \
+})
+
+/**
+ * Set the durability of `fs`.  This must not be called within a batch.  The journal mode is
+ * persistent - it applies to the DB when next opened until changed again.
+ *
+ * @return true (1) if success, false (0) otherwise;
+ */
+extern int  // 1 -> success, 0 -> failure
+fileServiceSetDurability (BRFileService fs,
+                          BRFileServiceDurability durability);
+
 /**
  * Release fs.  This will close `fs` if it hasn't been already and then free the memory and any
  * other resources associaed with the fs (such as locks).
@@ -129,11 +232,131 @@ fileServiceLoad (BRFileService fs,
                  const char *type,   /* blocks, peers, transactions, logs, ... */
                  int updateVersion);
 
+/**
+ * Handle one entity loaded by `fileServiceLoadIterate()`.  The handler owns `entity`.  The handler
+ * must not use the fileService.
+ *
+ * @return true (1) to accept `entity`, false (0) to fail the load.
+ */
+typedef int
+(*BRFileServiceLoadHandler) (BRFileServiceContext context,
+                             BRFileService fs,
+                             void *entity);
+
+/// Compare entities as for qsort() on an array of entities; the arguments are `void**`.
+typedef int
+(*BRFileServiceEntityComparator) (const void *entity1,
+                                  const void *entity2);
+
+/**
+ * Load all entities of `type` passing each to `handler`.  Unlike `fileServiceLoad()` the entities
+ * are never collected into a set.  If `compare` is NULL, entities are passed as they are read,
+ * in no particular order; otherwise entities are passed in order.  If `type` has a sort key, and
+ * every entity has one, the order is by sort key, as read, and `compare` must be consistent with
+ * it; otherwise entities are passed once all are read, ordered by `compare`.
+ *
+ * If there is an error then the fileService's error handler is invoked and 0 is returned.  Even
+ * then, every entity read is passed to `handler`.
+ *
+ * @return true (1) if success, false (0) otherwise;
+ */
+extern int
+fileServiceLoadIterate (BRFileService fs,
+                        const char *type,
+                        int updateVersion,
+                        BRFileServiceEntityComparator compare,
+                        BRFileServiceContext context,
+                        BRFileServiceLoadHandler handler);
+
+/**
+ * Load the entities of `type` with a sort key in [sortKeyLower, sortKeyUpper], ordered by sort
+ * key, passing each to `handler`.  See `fileServiceDefineSortKey()`.  Entities saved before
+ * `type` had a sort key, and not since re-saved or loaded with `updateVersion`, have no sort key;
+ * they are always loaded, before all others.
+ *
+ * @return true (1) if success, false (0) otherwise;
+ */
+extern int
+fileServiceLoadRange (BRFileService fs,
+                      const char *type,
+                      int updateVersion,
+                      int64_t sortKeyLower,
+                      int64_t sortKeyUpper,
+                      BRFileServiceContext context,
+                      BRFileServiceLoadHandler handler);
+
+/**
+ * Decode loaded entities on up to `threadsCount` threads; 0 or 1 decodes on the loading thread,
+ * the default.  With more than one thread, a load reads every stored entity of the type and then
+ * decodes them in parallel; entities are still passed to the load's handler, in order, from the
+ * loading thread.  Small loads use fewer threads.
+ *
+ * Every entity type's reader, writer, identifier and sort key functions must then be reentrant;
+ * they are called concurrently.
+ */
+extern void
+fileServiceSetLoadThreads (BRFileService fs,
+                           size_t threadsCount);
+
 extern int  // 1 -> success, 0 -> failure
 fileServiceSave (BRFileService fs,
                  const char *type,  /* block, peers, transactions, logs, ... */
                  const void *entity);     /* BRMerkleBlock*, BRTransaction, BREthereumTransaction, ... */
 
+/**
+ * Enable or disable write-behind.  With write-behind enabled, `fileServiceSave()`,
+ * `fileServiceSaveMany()` and `fileServiceRemove()` encode the entity on the caller's thread and
+ * then queue the write; a dedicated writer thread commits queued writes in groups, each group in
+ * a single DB transaction.  Queued writes for the same {type, identifier} are coalesced, keeping
+ * the latest.  Errors are reported, from the writer thread, through the error handler.
+ *
+ * Loads, clears, replaces and purges first wait for all queued writes to complete.  Disabling
+ * write-behind, `fileServiceClose()` and `fileServiceRelease()` complete all queued writes.
+ *
+ * Writes are not queued while a batch is open; see `fileServiceBeginBatch()`.
+ */
+extern void
+fileServiceSetWriteBehind (BRFileService fs,
+                           int writeBehind);
+
+/**
+ * Wait until all writes queued by write-behind are committed.  A no-op if write-behind is not
+ * enabled.
+ */
+extern void
+fileServiceFlush (BRFileService fs);
+
+/**
+ * Save `entitiesCount` entities of `type` in a single DB transaction.  Either all entities are
+ * saved or, on failure, none are.  Compared to repeated calls to `fileServiceSave()` this avoids
+ * a DB commit (and thus a disk sync) per entity.
+ *
+ * @return true (1) if success, false (0) otherwise;
+ */
+extern int  // 1 -> success, 0 -> failure
+fileServiceSaveMany (BRFileService fs,
+                     const char *type,
+                     const void **entities,
+                     size_t entitiesCount);
+
+/**
+ * Begin a batch.  Until the matching `fileServiceCommitBatch()` all saves, removes and replaces
+ * are grouped into a single DB transaction.  Batches nest; only the outermost commit writes to
+ * the DB.  The batch applies to the file service, not to a thread - changes made by other threads
+ * while a batch is open are committed with the batch.  A batch left open is committed on close.
+ *
+ * With write-behind enabled, beginning a batch first completes all queued writes; then, while the
+ * batch is open, saves and removes are written synchronously, as part of the batch, rather than
+ * queued.
+ *
+ * @return true (1) if success, false (0) otherwise;
+ */
+extern int  // 1 -> success, 0 -> failure
+fileServiceBeginBatch (BRFileService fs);
+
+extern int  // 1 -> success, 0 -> failure
+fileServiceCommitBatch (BRFileService fs);
+
 extern int  // 1 -> success, 0 -> failure
 fileServiceRemove (BRFileService fs,
                    const char *type,
@@ -150,6 +373,20 @@ fileServiceReplace (BRFileService fs,
                     const void **entities,
                     size_t entitiesCount);
 
+/**
+ * Replace all entities of `type` with `entities`, as `fileServiceReplace()` does, but write only
+ * the changes: entities that are new, or whose encoding differs from the stored bytes, are saved;
+ * stored entities not in `entities` are removed; unchanged entities are not written at all.
+ * Prefer this when successive replaces mostly repeat the same entities.
+ *
+ * @return true (1) if success, false (0) otherwise;
+ */
+extern int  // 1 -> success, 0 -> failure
+fileServiceReplaceChanged (BRFileService fs,
+                           const char *type,
+                           const void **entities,
+                           size_t entitiesCount);
+
 extern int
 fileServiceClear (BRFileService fs,
                   const char *type);
@@ -190,6 +427,16 @@ typedef uint8_t*
                         const void* entity,
                         uint32_t *bytesCount);
 
+/**
+ * A function type to produce a sort key from an entity.  Entities are stored with their sort key
+ * and can be loaded ordered by, and limited to a range of, sort keys.  For example, a sort key
+ * might be a block height.
+ */
+typedef int64_t
+(*BRFileServiceSortKey) (BRFileServiceContext context,
+                         BRFileService fs,
+                         const void* entity);
+
 /// TODO: There is a limitation on `type`.
 
 /**
@@ -220,6 +467,49 @@ fileServiceDefineCurrentVersion (BRFileService fs,
                                  const char *type,
                                  BRFileServiceVersion version);
 
+/**
+ * Define the sort key for `type`.  This applies to all versions.
+ *
+ * @return true (1) if success, false (0) otherwise
+ */
+extern int
+fileServiceDefineSortKey (BRFileService fs,
+                          const char *type,
+                          BRFileServiceContext context,
+                          BRFileServiceSortKey sortKey);
+
+/**
+ * Compress the stored entities of `type`.  Each entity is saved compressed when that saves
+ * bytes, using the current dictionary trained for `type`, if any, by
+ * `fileServiceTrainCompression()`.  Entities saved before, or without, compression are loaded
+ * as always; entities saved with compression can't be loaded without it.
+ *
+ * @return true (1) if success, false (0) otherwise
+ */
+extern int
+fileServiceDefineCompression (BRFileService fs,
+                              const char *type);
+
+/**
+ * Train a compression dictionary from the stored entities of `type`, which must have
+ * compression, make it the current dictionary and recompress the stored entities with it.  The
+ * dictionary is stored, along with any prior dictionaries, as `type` ".dictionary" entities.
+ * Entities are similar enough to benefit once a few dozen are stored; training is costly and is
+ * best done once, when a dictionary is missed.
+ *
+ * @return true (1) if trained, false (0) if too few entities are stored or on a failure.
+ */
+extern int
+fileServiceTrainCompression (BRFileService fs,
+                             const char *type);
+
+/**
+ * Check if `type` has a trained compression dictionary.
+ */
+extern bool
+fileServiceHasCompressionDictionary (BRFileService fs,
+                                     const char *type);
+
 // Version limit can increase with maximum number of version, historically.
 #define FILE_SERVICE_TYPE_SPECIFICATION_NUMBER_OF_VERSION_LIMIT   (5)
 
@@ -233,6 +523,7 @@ typedef struct {
         BRFileServiceReader reader;
         BRFileServiceWriter writer;
     } versions [FILE_SERVICE_TYPE_SPECIFICATION_NUMBER_OF_VERSION_LIMIT];
+    BRFileServiceSortKey sortKey;     // Nullable
 } BRFileServiceTypeSpecification;
 
 extern BRFileService
@@ -244,6 +535,16 @@ fileServiceCreateFromTypeSpecifications(const char *basePath,
                                         size_t specificationsCount,
                                         BRFileServiceTypeSpecification *specfications);
 
+/// Create a file service, as `fileServiceCreateFromTypeSpecifications()`, in `store`.
+extern BRFileService
+fileServiceCreateFromTypeSpecificationsInStore (BRFileServiceStore store,
+                                                const char *currency,
+                                                const char *network,
+                                                BRFileServiceContext context,
+                                                BRFileServiceErrorHandler handler,
+                                                size_t specificationsCount,
+                                                BRFileServiceTypeSpecification *specfications);
+
 ///
 /// Removes unused entities from the file system data
 ///
@@ -272,4 +573,52 @@ extern bool
 fileServiceHasType (BRFileService fs,
                     const char *type);
 
+/// MARK: - Stats
+
+/// The number of buckets in a `BRFileServiceLatency` histogram.
+#define FILE_SERVICE_LATENCY_BUCKETS_COUNT      (7)
+
+///
+/// The latency of an operation, as the caller sees it.  The histogram bucket `i` counts the
+/// operations that took less than 10^(i+1) microseconds (10us, 100us, ..., 1s); the last bucket
+/// counts the operations that took longer.
+///
+typedef struct {
+    uint64_t count;
+    uint64_t microseconds;      // The total
+    uint64_t buckets[FILE_SERVICE_LATENCY_BUCKETS_COUNT];
+} BRFileServiceLatency;
+
+///
+/// The stats for one entity type, since the file service was created.
+///
+///  - entitiesCount, bytesCount: the entities stored now and the bytes they use.
+///  - saves:   `fileServiceSave()`, `fileServiceSaveMany()` and the replaces.  With write-behind
+///             a save completes once it is queued.
+///  - loads:   `fileServiceLoad()`, `fileServiceLoadIterate()` and `fileServiceLoadRange()`.
+///  - removes: `fileServiceRemove()`, `fileServiceRemoveByIdentifier()` and `fileServiceClear()`.
+///  - entitiesSaved, entitiesLoaded: the entities passed by all saves and all loads.
+///
+typedef struct {
+    const char *type;           // Owned by the file service
+    size_t   entitiesCount;
+    uint64_t bytesCount;
+    uint64_t entitiesSaved;
+    uint64_t entitiesLoaded;
+    BRFileServiceLatency saves;
+    BRFileServiceLatency loads;
+    BRFileServiceLatency removes;
+} BRFileServiceTypeStats;
+
+///
+/// Fill `stats` with the stats of up to `statsCount` entity types, in the order the types were
+/// defined.
+///
+/// @return the number of entity types; if more than `statsCount` only `statsCount` are filled.
+///
+extern size_t
+fileServiceGetStats (BRFileService fs,
+                     BRFileServiceTypeStats *stats,
+                     size_t statsCount);
+
 #endif /* BRFileService_h */
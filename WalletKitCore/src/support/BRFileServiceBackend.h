@@ -0,0 +1,201 @@
+//
+//  BRFileServiceBackend.h
+//  Core
+//
+//  Copyright © 2019 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#ifndef BRFileServiceBackend_h
+#define BRFileServiceBackend_h
+
+#include "BRFileService.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A storage engine for BRFileService.  The file service owns the entity types, the entity
+// encoding, batches and write-behind; a backend stores the encoded entities, as bytes, keyed by
+// {type, identifier} with an optional sort key.  The file service serializes all calls into a
+// backend with its lock; a backend need not be thread-safe itself, other than with respect to
+// any threads of its own.
+//
+// Every backend implements transactions that nest - `begin` within an open transaction
+// defers the commit until the outermost `commit`.  Outside of a transaction each save, remove
+// and clear is committed on its own.
+
+/// A backend's state; opaque to the file service.
+typedef void *BRFileServiceBackend;
+
+/// The result of a backend operation; FILE_SERVICE_BACKEND_OK or a backend-specific error code.
+typedef int BRFileServiceBackendStatus;
+
+#define FILE_SERVICE_BACKEND_OK         (0)
+
+/// The sort key of an entity without one; the file service's FILE_SERVICE_SORT_KEY_NONE.
+#define FILE_SERVICE_BACKEND_SORT_KEY_NONE      (INT64_MIN)
+
+///
+/// Handle one stored entity during a load.  The `bytes` are only valid during the call.
+///
+/// @return true (1) to continue the load, false (0) to stop it.
+///
+typedef int
+(*BRFileServiceBackendLoadHandler) (void *context,
+                                    UInt256 identifier,
+                                    int64_t sortKey,
+                                    const uint8_t *bytes,
+                                    size_t bytesCount);
+
+/// Open, creating if needed, the store for {currency, network} in `basePath`.  On failure,
+/// returns NULL and fills `status`.
+typedef BRFileServiceBackend
+(*BRFileServiceBackendOpenHandler) (const char *basePath,
+                                    const char *currency,
+                                    const char *network,
+                                    BRFileServiceBackendStatus *status);
+
+/// Close the store and release `backend`.  Any open transaction is committed.
+typedef void
+(*BRFileServiceBackendCloseHandler) (BRFileServiceBackend backend);
+
+/// Describe `status` as a file service error.
+typedef BRFileServiceError
+(*BRFileServiceBackendErrorHandler) (BRFileServiceBackendStatus status);
+
+typedef BRFileServiceBackendStatus
+(*BRFileServiceBackendTransactionHandler) (BRFileServiceBackend backend);
+
+/// Discard the changes since the innermost `begin` and end that transaction.
+typedef void
+(*BRFileServiceBackendRollbackHandler) (BRFileServiceBackend backend);
+
+/// Insert or replace the {type, identifier} entity.  A `sortKey` of
+/// FILE_SERVICE_BACKEND_SORT_KEY_NONE means the entity has no sort key.
+typedef BRFileServiceBackendStatus
+(*BRFileServiceBackendSaveHandler) (BRFileServiceBackend backend,
+                                    const char *type,
+                                    UInt256 identifier,
+                                    int64_t sortKey,
+                                    const uint8_t *bytes,
+                                    size_t bytesCount);
+
+typedef BRFileServiceBackendStatus
+(*BRFileServiceBackendRemoveHandler) (BRFileServiceBackend backend,
+                                      const char *type,
+                                      UInt256 identifier);
+
+/// Remove every entity of `type`.
+typedef BRFileServiceBackendStatus
+(*BRFileServiceBackendClearHandler) (BRFileServiceBackend backend,
+                                     const char *type);
+
+/// Remove every entity whose type is not one of `types`.
+typedef BRFileServiceBackendStatus
+(*BRFileServiceBackendPurgeHandler) (BRFileServiceBackend backend,
+                                     const char **types,
+                                     size_t typesCount);
+
+/// Check if any entity of `type` lacks a sort key.  On any error, returns true.
+typedef bool
+(*BRFileServiceBackendHasUnkeyedHandler) (BRFileServiceBackend backend,
+                                          const char *type);
+
+///
+/// Pass each entity of `type` to `handler`.  If `range` is not NULL, only entities with a sort
+/// key in [range[0], range[1]], or without a sort key, are passed.  If `ordered` or `range`,
+/// entities are passed by increasing sort key, those without a sort key first.  Stopping the
+/// load from `handler` is not an error.
+///
+typedef BRFileServiceBackendStatus
+(*BRFileServiceBackendLoadEntitiesHandler) (BRFileServiceBackend backend,
+                                            const char *type,
+                                            bool ordered,
+                                            const int64_t *range,
+                                            void *context,
+                                            BRFileServiceBackendLoadHandler handler);
+
+/// Count the entities of `type` and the bytes they store.
+typedef BRFileServiceBackendStatus
+(*BRFileServiceBackendStatsHandler) (BRFileServiceBackend backend,
+                                     const char *type,
+                                     size_t *entitiesCount,
+                                     uint64_t *bytesCount);
+
+/// Apply `durability`, as best the backend can.  Never called within a transaction.
+typedef BRFileServiceBackendStatus
+(*BRFileServiceBackendSetDurabilityHandler) (BRFileServiceBackend backend,
+                                             BRFileServiceDurability durability);
+
+/// Remove the store for {currency, network} in `basePath`.  Returns 0 on success or an errno.
+typedef int
+(*BRFileServiceBackendWipeHandler) (const char *basePath,
+                                    const char *currency,
+                                    const char *network);
+
+typedef struct {
+    BRFileServiceBackendOpenHandler open;
+    BRFileServiceBackendCloseHandler close;
+    BRFileServiceBackendErrorHandler error;
+    BRFileServiceBackendTransactionHandler begin;
+    BRFileServiceBackendTransactionHandler commit;
+    BRFileServiceBackendRollbackHandler rollback;
+    BRFileServiceBackendSaveHandler save;
+    BRFileServiceBackendRemoveHandler remove;
+    BRFileServiceBackendClearHandler clear;
+    BRFileServiceBackendPurgeHandler purge;
+    BRFileServiceBackendHasUnkeyedHandler hasUnkeyed;
+    BRFileServiceBackendLoadEntitiesHandler load;
+    BRFileServiceBackendStatsHandler stats;
+    BRFileServiceBackendSetDurabilityHandler setDurability;
+    BRFileServiceBackendWipeHandler wipe;
+} BRFileServiceBackendHandlers;
+
+/// An sqlite3 DB with one 'Entity' table; see BRFileServiceSQLite.c
+extern const BRFileServiceBackendHandlers fileServiceBackendHandlersSQLite;
+
+/// An append-only log of memory-mapped segments; see BRFileServiceLog.c
+extern const BRFileServiceBackendHandlers fileServiceBackendHandlersLog;
+
+/// A {currency, network} namespace of a `BRFileServiceStore`; see BRFileServiceSQLite.c.  There
+/// is no `open` handler; a namespace is opened with `fileServiceStoreOpenNamespace()`.  The
+/// `wipe` handler removes the namespace from a store in `basePath`.
+extern const BRFileServiceBackendHandlers fileServiceBackendHandlersStore;
+
+/// Open, creating if needed, the {currency, network} namespace of `store`.  On failure, returns
+/// NULL and fills `status`.
+extern BRFileServiceBackend
+fileServiceStoreOpenNamespace (BRFileServiceStore store,
+                               const char *currency,
+                               const char *network,
+                               BRFileServiceBackendStatus *status);
+
+/// Create "`basePath`/`currency`-`network`-`filename`".  You own the returned path.
+extern char *
+fileServiceCreateFilePath (const char *basePath,
+                           const char *currency,
+                           const char *network,
+                           const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BRFileServiceBackend_h */
@@ -0,0 +1,1236 @@
+//
+//  BRFileServiceLog.c
+//  Core
+//
+//  Copyright © 2019 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "BRFileServiceBackend.h"
+#include "BRArray.h"
+#include "BRCrypto.h"
+#include "BROSCompat.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The log is a directory of segment files, numbered from 1, each a sequence of records.  Writes
+// only ever append to the last, 'active', segment.  The current state - which record holds each
+// {type, identifier} entity - is an in-memory index built by replaying every segment on open.
+//
+// A record is:
+//    {Checksum:4, Kind:1, Flags:1, TypeLength:2, BytesCount:4, Identifier:32, SortKey:8,
+//     Type:TypeLength, Bytes:BytesCount}
+// with integers little-endian and the checksum over everything following it.  A record with the
+// COMMIT flag ends a transaction; on replay the records of an uncommitted transaction, and any
+// partially written record, are discarded.
+//
+// As entities are overwritten or removed, the records holding them become garbage.  Once half of
+// the log is garbage a compaction thread copies the live records of the oldest segment to the
+// active segment and then deletes the oldest segment.  Only the oldest segment is compacted so
+// that a remove or a clear is never lost ahead of the records it replaces.
+
+#define FILE_SERVICE_LOG_DIRNAME                "entities.log"
+#define FILE_SERVICE_LOG_SEGMENT_FORMAT         "%08u.seg"
+
+#define FILE_SERVICE_LOG_SEGMENT_BYTES          (4 * 1024 * 1024)
+#define FILE_SERVICE_LOG_COMPACT_MIN_BYTES      (1 * 1024 * 1024)
+
+#define FILE_SERVICE_LOG_COMPACT_THREAD_NAME    "Core File Service Compactor"
+
+#define FILE_SERVICE_LOG_RECORD_HEADER_BYTES    (4 + 1 + 1 + 2 + 4 + 32 + 8)
+
+#define FILE_SERVICE_LOG_INITIAL_TYPE_COUNT     (5)
+#define FILE_SERVICE_LOG_INITIAL_ENTRY_COUNT    (100)
+
+#if !defined(NEUTER_FILE_SERVICE)
+
+typedef enum {
+    LOG_RECORD_SAVE = 1,
+    LOG_RECORD_REMOVE,
+    LOG_RECORD_CLEAR,
+    LOG_RECORD_COMMIT
+} BRFileServiceLogRecordKind;
+
+#define LOG_RECORD_FLAG_COMMIT      (0x01)
+
+///
+/// An entity in the index: the location of the record holding its bytes.
+///
+typedef struct {
+    UInt256 identifier;
+    int64_t sortKey;
+    uint32_t segment;       // The segment's number
+    size_t offset;          // The offset of the record within the segment
+    size_t bytesOffset;     // The offset of the entity's bytes within the segment
+    size_t bytesCount;
+    size_t recordCount;     // The bytes of the whole record
+} BRFileServiceLogEntry;
+
+static size_t
+fileServiceLogEntryHash (const void *item) {
+    return (size_t) ((const BRFileServiceLogEntry *) item)->identifier.u32[0];
+}
+
+static int
+fileServiceLogEntryEq (const void *item1, const void *item2) {
+    return UInt256Eq (((const BRFileServiceLogEntry *) item1)->identifier,
+                      ((const BRFileServiceLogEntry *) item2)->identifier);
+}
+
+static void
+fileServiceLogEntryRelease (void *item) {
+    free (item);
+}
+
+///
+/// The index of one type's entities
+///
+typedef struct {
+    char *type;
+    BRSetOf(BRFileServiceLogEntry*) entries;
+} BRFileServiceLogType;
+
+///
+/// A segment file, memory-mapped for reads.  The map covers `mapCount` bytes and is extended,
+/// as needed, to cover appended records.
+///
+typedef struct {
+    uint32_t number;
+    int fd;
+    uint8_t *map;
+    size_t mapCount;
+    size_t size;
+    size_t liveBytes;       // The bytes of records holding an entity in the index
+} BRFileServiceLogSegment;
+
+///
+/// An index change made in a transaction, to be undone on a rollback.  For a save or a remove
+/// `previous` is the replaced entry, if any; for a clear `previousEntries` are the cleared ones.
+///
+typedef struct {
+    size_t typeIndex;
+    UInt256 identifier;
+    BRFileServiceLogEntry *previous;
+    BRSetOf(BRFileServiceLogEntry*) previousEntries;
+} BRFileServiceLogUndo;
+
+///
+/// A (possibly nested) transaction's start: the active segment's size and the undo count.
+///
+typedef struct {
+    size_t size;
+    size_t undoCount;
+} BRFileServiceLogSavepoint;
+
+typedef struct {
+    char *path;
+    BRFileServiceDurability durability;
+
+    BRArrayOf(BRFileServiceLogType) types;
+    BRArrayOf(BRFileServiceLogSegment) segments;    // Ordered by number; the last is active
+
+    BRArrayOf(BRFileServiceLogSavepoint) savepoints;
+    BRArrayOf(BRFileServiceLogUndo) undos;
+
+    // Protects all of the above from the compaction thread.
+    pthread_mutex_t lock;
+
+    pthread_t compactThread;
+    pthread_cond_t compactCond;
+    bool compactQuit;
+} BRFileServiceLog;
+
+/// MARK: - Segments
+
+static char *
+fileServiceLogSegmentPath (BRFileServiceLog *log, uint32_t number) {
+    char *path = malloc (strlen (log->path) + 1 + 16 + 1);
+    sprintf (path, "%s/" FILE_SERVICE_LOG_SEGMENT_FORMAT, log->path, number);
+    return path;
+}
+
+static BRFileServiceLogSegment *
+fileServiceLogSegmentActive (BRFileServiceLog *log) {
+    return &log->segments[array_count (log->segments) - 1];
+}
+
+static BRFileServiceLogSegment *
+fileServiceLogSegmentLookup (BRFileServiceLog *log, uint32_t number) {
+    for (size_t index = 0; index < array_count (log->segments); index++)
+        if (number == log->segments[index].number)
+            return &log->segments[index];
+    return NULL;
+}
+
+static void
+fileServiceLogSegmentClose (BRFileServiceLogSegment *segment) {
+    if (NULL != segment->map) munmap (segment->map, segment->mapCount);
+    if (-1   != segment->fd)  close (segment->fd);
+    segment->map      = NULL;
+    segment->mapCount = 0;
+    segment->fd       = -1;
+}
+
+///
+/// Ensure the map of `segment` covers its first `count` bytes.
+///
+/// @return 0 on success, otherwise an errno
+///
+static int
+fileServiceLogSegmentMap (BRFileServiceLogSegment *segment, size_t count) {
+    if (count <= segment->mapCount) return 0;
+
+    // Map all of the segment, not just `count`, to limit remapping.
+    uint8_t *map = mmap (NULL, segment->size, PROT_READ, MAP_SHARED, segment->fd, 0);
+    if (MAP_FAILED == map) return errno;
+
+    if (NULL != segment->map) munmap (segment->map, segment->mapCount);
+    segment->map      = map;
+    segment->mapCount = segment->size;
+    return 0;
+}
+
+///
+/// Sync `fd` to storage, per `durability`.  With `always`, sync unless synchronous is OFF.
+///
+static int
+fileServiceLogSync (BRFileServiceLog *log, int fd, bool always) {
+    bool needSync = (FILE_SERVICE_SYNCHRONOUS_FULL == log->durability.synchronous ||
+                     (always && FILE_SERVICE_SYNCHRONOUS_OFF != log->durability.synchronous));
+    return (!needSync || 0 == fsync (fd) ? 0 : errno);
+}
+
+static int
+fileServiceLogSyncDirectory (BRFileServiceLog *log) {
+    if (FILE_SERVICE_SYNCHRONOUS_OFF == log->durability.synchronous) return 0;
+
+    int fd = open (log->path, O_RDONLY);
+    if (-1 == fd) return errno;
+
+    int status = (0 == fsync (fd) ? 0 : errno);
+    close (fd);
+    return status;
+}
+
+///
+/// Create a new, empty segment; it becomes the active segment.
+///
+static int
+fileServiceLogSegmentCreate (BRFileServiceLog *log) {
+    uint32_t number = (0 == array_count (log->segments)
+                       ? 1
+                       : fileServiceLogSegmentActive(log)->number + 1);
+
+    char *path = fileServiceLogSegmentPath (log, number);
+    int fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    free (path);
+    if (-1 == fd) return errno;
+
+    BRFileServiceLogSegment segment = { number, fd, NULL, 0, 0, 0 };
+    array_add (log->segments, segment);
+
+    return fileServiceLogSyncDirectory (log);
+}
+
+/// MARK: - Index
+
+static BRFileServiceLogType *
+fileServiceLogTypeLookup (BRFileServiceLog *log, const char *type, bool create) {
+    for (size_t index = 0; index < array_count (log->types); index++)
+        if (0 == strcmp (type, log->types[index].type))
+            return &log->types[index];
+
+    if (!create) return NULL;
+
+    BRFileServiceLogType logType = {
+        strdup (type),
+        BRSetNew (fileServiceLogEntryHash, fileServiceLogEntryEq, FILE_SERVICE_LOG_INITIAL_ENTRY_COUNT)
+    };
+    array_add (log->types, logType);
+    return &log->types[array_count (log->types) - 1];
+}
+
+static void
+fileServiceLogAccountLive (BRFileServiceLog *log,
+                           const BRFileServiceLogEntry *entry,
+                           bool live) {
+    BRFileServiceLogSegment *segment = fileServiceLogSegmentLookup (log, entry->segment);
+    if (NULL == segment) return;
+
+    if (live) segment->liveBytes += entry->recordCount;
+    else      segment->liveBytes -= entry->recordCount;
+}
+
+///
+/// Put `entry` in, or, if `entry` is NULL, remove `identifier` from, the `logType` index.
+///
+/// @return the replaced entry, if any; the caller owns it.
+///
+static BRFileServiceLogEntry *
+fileServiceLogIndexUpdate (BRFileServiceLog *log,
+                           BRFileServiceLogType *logType,
+                           UInt256 identifier,
+                           BRFileServiceLogEntry *entry) {
+    BRFileServiceLogEntry key = { identifier };
+    BRFileServiceLogEntry *previous = (NULL != entry
+                                       ? BRSetAdd    (logType->entries, entry)
+                                       : BRSetRemove (logType->entries, &key));
+
+    if (NULL != previous) fileServiceLogAccountLive (log, previous, false);
+    if (NULL != entry)    fileServiceLogAccountLive (log, entry,    true);
+
+    return previous;
+}
+
+static void
+fileServiceLogAccountLiveAll (BRFileServiceLog *log,
+                              BRSetOf(BRFileServiceLogEntry*) entries,
+                              bool live) {
+    for (BRFileServiceLogEntry *entry = BRSetIterate (entries, NULL);
+         NULL != entry;
+         entry = BRSetIterate (entries, entry))
+        fileServiceLogAccountLive (log, entry, live);
+}
+
+///
+/// Record an index change, made by a save, remove or clear, for undo within a transaction; or
+/// outside a transaction release the replaced entries.
+///
+static void
+fileServiceLogUndoAdd (BRFileServiceLog *log,
+                       BRFileServiceLogType *logType,
+                       UInt256 identifier,
+                       BRFileServiceLogEntry *previous,
+                       BRSetOf(BRFileServiceLogEntry*) previousEntries) {
+    if (0 == array_count (log->savepoints)) {
+        if (NULL != previous)        free (previous);
+        if (NULL != previousEntries) BRSetFreeAll (previousEntries, fileServiceLogEntryRelease);
+        return;
+    }
+
+    BRFileServiceLogUndo undo = {
+        (size_t) (logType - log->types),
+        identifier,
+        previous,
+        previousEntries
+    };
+    array_add (log->undos, undo);
+}
+
+///
+/// Undo, latest first, the index changes beyond the first `count`.
+///
+static void
+fileServiceLogUndoApply (BRFileServiceLog *log, size_t count) {
+    while (array_count (log->undos) > count) {
+        BRFileServiceLogUndo undo = log->undos[array_count (log->undos) - 1];
+        array_rm_last (log->undos);
+
+        BRFileServiceLogType *logType = &log->types[undo.typeIndex];
+
+        if (NULL != undo.previousEntries) {
+            // A clear; every entry added since was undone already.
+            fileServiceLogAccountLiveAll (log, logType->entries, false);
+            BRSetFreeAll (logType->entries, fileServiceLogEntryRelease);
+
+            logType->entries = undo.previousEntries;
+            fileServiceLogAccountLiveAll (log, logType->entries, true);
+        }
+        else {
+            // A save or a remove; restore the replaced entry, if any.
+            BRFileServiceLogEntry *current = fileServiceLogIndexUpdate (log, logType, undo.identifier, undo.previous);
+            if (NULL != current) free (current);
+        }
+    }
+}
+
+///
+/// Release, once the outermost transaction commits, the replaced entries kept for undo.
+///
+static void
+fileServiceLogUndoRelease (BRFileServiceLog *log) {
+    for (size_t index = 0; index < array_count (log->undos); index++) {
+        if (NULL != log->undos[index].previous)        free (log->undos[index].previous);
+        if (NULL != log->undos[index].previousEntries) BRSetFreeAll (log->undos[index].previousEntries,
+                                                                     fileServiceLogEntryRelease);
+    }
+    array_clear (log->undos);
+}
+
+/// MARK: - Records
+
+///
+/// Append a record to the active segment.  If `entry` is not NULL it is filled with the record's
+/// location.
+///
+/// @return 0 on success, otherwise an errno
+///
+static int
+fileServiceLogAppend (BRFileServiceLog *log,
+                      BRFileServiceLogRecordKind kind,
+                      uint8_t flags,
+                      const char *type,
+                      UInt256 identifier,
+                      int64_t sortKey,
+                      const uint8_t *bytes,
+                      size_t bytesCount,
+                      BRFileServiceLogEntry *entry) {
+    size_t typeLength  = (NULL == type ? 0 : strlen (type));
+    size_t recordCount = FILE_SERVICE_LOG_RECORD_HEADER_BYTES + typeLength + bytesCount;
+
+    if (typeLength > UINT16_MAX || bytesCount > UINT32_MAX) return EINVAL;
+
+    uint8_t *record = malloc (recordCount);
+    size_t offset = 4;
+
+    record[offset++] = (uint8_t) kind;
+    record[offset++] = flags;
+    UInt16SetLE (&record[offset], (uint16_t) typeLength);  offset += 2;
+    UInt32SetLE (&record[offset], (uint32_t) bytesCount);  offset += 4;
+    memcpy (&record[offset], identifier.u8, 32);           offset += 32;
+    UInt64SetLE (&record[offset], (uint64_t) sortKey);     offset += 8;
+    if (0 != typeLength) memcpy (&record[offset], type, typeLength);
+    offset += typeLength;
+    if (0 != bytesCount) memcpy (&record[offset], bytes, bytesCount);
+
+    UInt32SetLE (record, BRMurmur3_32 (&record[4], recordCount - 4, 0));
+
+    BRFileServiceLogSegment *segment = fileServiceLogSegmentActive (log);
+
+    ssize_t written = pwrite (segment->fd, record, recordCount, (off_t) segment->size);
+    int status = (written == (ssize_t) recordCount ? 0 : (-1 == written ? errno : EIO));
+    free (record);
+
+    if (0 != status) {
+        // Drop any partial record; if this fails, a replay will discard it.
+        if (0 != ftruncate (segment->fd, (off_t) segment->size)) { /* ignore */ }
+        return status;
+    }
+
+    if (NULL != entry)
+        *entry = (BRFileServiceLogEntry) {
+            identifier,
+            sortKey,
+            segment->number,
+            segment->size,
+            segment->size + FILE_SERVICE_LOG_RECORD_HEADER_BYTES + typeLength,
+            bytesCount,
+            recordCount
+        };
+
+    segment->size += recordCount;
+
+    return ((flags & LOG_RECORD_FLAG_COMMIT)
+            ? fileServiceLogSync (log, segment->fd, false)
+            : 0);
+}
+
+/// The flags for a record written outside of a transaction; it commits itself.
+static uint8_t
+fileServiceLogRecordFlags (BRFileServiceLog *log) {
+    return (0 == array_count (log->savepoints) ? LOG_RECORD_FLAG_COMMIT : 0);
+}
+
+/// MARK: - Replay
+
+///
+/// A record parsed during replay; `type` is not NUL-terminated.
+///
+typedef struct {
+    BRFileServiceLogRecordKind kind;
+    uint8_t flags;
+    const char *type;
+    size_t typeLength;
+    BRFileServiceLogEntry entry;
+} BRFileServiceLogRecord;
+
+///
+/// Parse the record at `offset` in `segment`.
+///
+/// @return true if the record is complete and valid; false otherwise.
+///
+static bool
+fileServiceLogRecordParse (BRFileServiceLogSegment *segment,
+                           size_t offset,
+                           BRFileServiceLogRecord *record) {
+    if (offset + FILE_SERVICE_LOG_RECORD_HEADER_BYTES > segment->size) return false;
+
+    const uint8_t *bytes = &segment->map[offset];
+
+    size_t typeLength  = UInt16GetLE (&bytes[6]);
+    size_t bytesCount  = UInt32GetLE (&bytes[8]);
+    size_t recordCount = FILE_SERVICE_LOG_RECORD_HEADER_BYTES + typeLength + bytesCount;
+
+    if (offset + recordCount > segment->size) return false;
+    if (UInt32GetLE (bytes) != BRMurmur3_32 (&bytes[4], recordCount - 4, 0)) return false;
+
+    record->kind       = bytes[4];
+    record->flags      = bytes[5];
+    record->type       = (const char *) &bytes[FILE_SERVICE_LOG_RECORD_HEADER_BYTES];
+    record->typeLength = typeLength;
+
+    record->entry.segment     = segment->number;
+    record->entry.offset      = offset;
+    record->entry.bytesOffset = offset + FILE_SERVICE_LOG_RECORD_HEADER_BYTES + typeLength;
+    record->entry.bytesCount  = bytesCount;
+    record->entry.recordCount = recordCount;
+    memcpy (record->entry.identifier.u8, &bytes[12], 32);
+    record->entry.sortKey     = (int64_t) UInt64GetLE (&bytes[44]);
+
+    return true;
+}
+
+static void
+fileServiceLogRecordApply (BRFileServiceLog *log,
+                           const BRFileServiceLogRecord *record) {
+    if (LOG_RECORD_COMMIT == record->kind) return;
+
+    char type[record->typeLength + 1];
+    memcpy (type, record->type, record->typeLength);
+    type[record->typeLength] = '\0';
+
+    BRFileServiceLogType *logType = fileServiceLogTypeLookup (log, type, true);
+
+    switch (record->kind) {
+        case LOG_RECORD_SAVE: {
+            BRFileServiceLogEntry *entry = malloc (sizeof (BRFileServiceLogEntry));
+            *entry = record->entry;
+            BRFileServiceLogEntry *previous = fileServiceLogIndexUpdate (log, logType, entry->identifier, entry);
+            if (NULL != previous) free (previous);
+            break;
+        }
+
+        case LOG_RECORD_REMOVE: {
+            BRFileServiceLogEntry *previous = fileServiceLogIndexUpdate (log, logType, record->entry.identifier, NULL);
+            if (NULL != previous) free (previous);
+            break;
+        }
+
+        case LOG_RECORD_CLEAR:
+            fileServiceLogAccountLiveAll (log, logType->entries, false);
+            BRSetFreeAll (logType->entries, fileServiceLogEntryRelease);
+            logType->entries = BRSetNew (fileServiceLogEntryHash, fileServiceLogEntryEq, FILE_SERVICE_LOG_INITIAL_ENTRY_COUNT);
+            break;
+
+        default:
+            break;
+    }
+}
+
+///
+/// Replay `segment` into the index.  Records after the last commit, including any partially
+/// written or corrupted record, are discarded and truncated from the segment.
+///
+static int
+fileServiceLogReplay (BRFileServiceLog *log,
+                      BRFileServiceLogSegment *segment) {
+    int status = fileServiceLogSegmentMap (segment, segment->size);
+    if (0 != status) return status;
+
+    BRArrayOf(BRFileServiceLogRecord) pending;
+    array_new (pending, 10);
+
+    size_t offset    = 0;
+    size_t committed = 0;
+
+    BRFileServiceLogRecord record;
+    while (fileServiceLogRecordParse (segment, offset, &record)) {
+        offset += record.entry.recordCount;
+        array_add (pending, record);
+
+        if (record.flags & LOG_RECORD_FLAG_COMMIT) {
+            for (size_t index = 0; index < array_count (pending); index++)
+                fileServiceLogRecordApply (log, &pending[index]);
+            array_clear (pending);
+            committed = offset;
+        }
+    }
+    array_free (pending);
+
+    if (committed != segment->size) {
+        if (0 != ftruncate (segment->fd, (off_t) committed)) return errno;
+        segment->size = committed;
+    }
+
+    return 0;
+}
+
+/// MARK: - Compaction
+
+static bool
+fileServiceLogNeedsCompaction (BRFileServiceLog *log) {
+    size_t size = 0, liveBytes = 0;
+    for (size_t index = 0; index < array_count (log->segments); index++) {
+        size      += log->segments[index].size;
+        liveBytes += log->segments[index].liveBytes;
+    }
+
+    return (size >= FILE_SERVICE_LOG_COMPACT_MIN_BYTES && 2 * liveBytes < size);
+}
+
+///
+/// Compact the oldest segment: copy its live records to the active segment and delete it.  Must
+/// be called with `log->lock` held, outside of any transaction.
+///
+static int
+fileServiceLogCompactOldest (BRFileServiceLog *log) {
+    int status;
+
+    // Never compact into the segment being compacted.
+    if (1 == array_count (log->segments)) {
+        status = fileServiceLogSegmentCreate (log);
+        if (0 != status) return status;
+    }
+
+    BRFileServiceLogSegment *oldest = &log->segments[0];
+
+    status = fileServiceLogSegmentMap (oldest, oldest->size);
+    if (0 != status) return status;
+
+    size_t activeSize = fileServiceLogSegmentActive(log)->size;
+
+    for (size_t typeIndex = 0; 0 == status && typeIndex < array_count (log->types); typeIndex++) {
+        BRFileServiceLogType *logType = &log->types[typeIndex];
+
+        for (BRFileServiceLogEntry *entry = BRSetIterate (logType->entries, NULL);
+             0 == status && NULL != entry;
+             entry = BRSetIterate (logType->entries, entry)) {
+            if (entry->segment != oldest->number) continue;
+
+            BRFileServiceLogEntry copy;
+            status = fileServiceLogAppend (log, LOG_RECORD_SAVE, 0,
+                                           logType->type,
+                                           entry->identifier,
+                                           entry->sortKey,
+                                           &oldest->map[entry->bytesOffset],
+                                           entry->bytesCount,
+                                           &copy);
+            if (0 != status) break;
+
+            // The entry stays in the set; only its location changes.
+            fileServiceLogAccountLive (log, entry, false);
+            *entry = copy;
+            fileServiceLogAccountLive (log, entry, true);
+        }
+    }
+
+    BRFileServiceLogSegment *active = fileServiceLogSegmentActive (log);
+
+    // Commit the copies, then make sure they are stored before deleting their originals.
+    if (0 == status && active->size != activeSize)
+        status = fileServiceLogAppend (log, LOG_RECORD_COMMIT, LOG_RECORD_FLAG_COMMIT,
+                                       NULL, UINT256_ZERO, FILE_SERVICE_BACKEND_SORT_KEY_NONE,
+                                       NULL, 0, NULL);
+
+    if (0 == status && 0 != fsync (active->fd))
+        status = errno;
+
+    if (0 != status) {
+        // The index may refer to copies in the active segment; those must stay.  Leave the
+        // oldest segment in place - it now holds only duplicates, replayed first.
+        return status;
+    }
+
+    char *path = fileServiceLogSegmentPath (log, oldest->number);
+    fileServiceLogSegmentClose (oldest);
+    unlink (path);
+    free (path);
+
+    array_rm (log->segments, 0);
+
+    return fileServiceLogSyncDirectory (log);
+}
+
+typedef void* (*ThreadRoutine) (void*);
+
+static void *
+fileServiceLogCompactThread (BRFileServiceLog *log) {
+    pthread_setname_brd (pthread_self(), FILE_SERVICE_LOG_COMPACT_THREAD_NAME);
+
+    pthread_mutex_lock (&log->lock);
+    while (!log->compactQuit) {
+        // Compact, one segment at a time, while not in a transaction.  On an error, stop; we'll
+        // try again later.  This runs before the first wait, as a log replayed on open might
+        // already need compaction.
+        while (!log->compactQuit &&
+               0 == array_count (log->savepoints) &&
+               fileServiceLogNeedsCompaction (log) &&
+               0 == fileServiceLogCompactOldest (log))
+            ;
+
+        // Wait for a commit that leaves the log needing compaction; see `fileServiceLogCommitted()`
+        if (!log->compactQuit)
+            pthread_cond_wait (&log->compactCond, &log->lock);
+    }
+    pthread_mutex_unlock (&log->lock);
+
+    return NULL;
+}
+
+/// Called, with `log->lock` held, once a write is committed.
+static void
+fileServiceLogCommitted (BRFileServiceLog *log) {
+    BRFileServiceLogSegment *active = fileServiceLogSegmentActive (log);
+
+    // Start a new segment once the active segment is full.  On an error, keep appending to the
+    // current one.
+    if (active->size >= FILE_SERVICE_LOG_SEGMENT_BYTES &&
+        0 == fileServiceLogSync (log, active->fd, true))
+        fileServiceLogSegmentCreate (log);
+
+    if (fileServiceLogNeedsCompaction (log))
+        pthread_cond_signal (&log->compactCond);
+}
+
+/// MARK: - Backend
+
+static char *
+fileServiceLogPath (const char *basePath,
+                    const char *currency,
+                    const char *network) {
+    return fileServiceCreateFilePath (basePath, currency, network, FILE_SERVICE_LOG_DIRNAME);
+}
+
+static void
+fileServiceLogRelease (BRFileServiceLog *log) {
+    if (NULL != log->segments) {
+        for (size_t index = 0; index < array_count (log->segments); index++)
+            fileServiceLogSegmentClose (&log->segments[index]);
+        array_free (log->segments);
+    }
+
+    if (NULL != log->types) {
+        for (size_t index = 0; index < array_count (log->types); index++) {
+            free (log->types[index].type);
+            BRSetFreeAll (log->types[index].entries, fileServiceLogEntryRelease);
+        }
+        array_free (log->types);
+    }
+
+    if (NULL != log->undos) {
+        fileServiceLogUndoRelease (log);
+        array_free (log->undos);
+    }
+
+    if (NULL != log->savepoints) array_free (log->savepoints);
+
+    pthread_cond_destroy  (&log->compactCond);
+    pthread_mutex_destroy (&log->lock);
+
+    free (log->path);
+    free (log);
+}
+
+static int
+fileServiceLogSegmentNumberCompare (const void *number1, const void *number2) {
+    uint32_t n1 = *(const uint32_t *) number1;
+    uint32_t n2 = *(const uint32_t *) number2;
+    return (n1 < n2 ? -1 : (n1 > n2 ? 1 : 0));
+}
+
+static BRFileServiceBackend
+fileServiceLogOpen (const char *basePath,
+                    const char *currency,
+                    const char *network,
+                    BRFileServiceBackendStatus *status) {
+    BRFileServiceLog *log = calloc (1, sizeof (BRFileServiceLog));
+
+    log->path       = fileServiceLogPath (basePath, currency, network);
+    log->durability = (BRFileServiceDurability) { false, FILE_SERVICE_SYNCHRONOUS_FULL, 0, 0 };
+
+    array_new (log->types,      FILE_SERVICE_LOG_INITIAL_TYPE_COUNT);
+    array_new (log->segments,   4);
+    array_new (log->savepoints, 4);
+    array_new (log->undos,      10);
+
+    pthread_mutex_init_brd (&log->lock, PTHREAD_MUTEX_NORMAL);
+    pthread_cond_init (&log->compactCond, NULL);
+
+    if (0 != mkdir (log->path, 0700) && EEXIST != errno) {
+        *status = errno;
+        fileServiceLogRelease (log);
+        return NULL;
+    }
+
+    // Find the segments, in order
+    DIR *dir = opendir (log->path);
+    if (NULL == dir) {
+        *status = errno;
+        fileServiceLogRelease (log);
+        return NULL;
+    }
+
+    BRArrayOf(uint32_t) numbers;
+    array_new (numbers, 4);
+
+    struct dirent *dirEntry;
+    while (NULL != (dirEntry = readdir (dir))) {
+        unsigned int number;
+        if (1 == sscanf (dirEntry->d_name, FILE_SERVICE_LOG_SEGMENT_FORMAT, &number) && 0 != number)
+            array_add (numbers, (uint32_t) number);
+    }
+    closedir (dir);
+
+    qsort (numbers, array_count (numbers), sizeof (uint32_t), fileServiceLogSegmentNumberCompare);
+
+    // Open and replay each segment
+    *status = 0;
+    for (size_t index = 0; 0 == *status && index < array_count (numbers); index++) {
+        char *path = fileServiceLogSegmentPath (log, numbers[index]);
+        int fd = open (path, O_RDWR);
+        free (path);
+
+        struct stat fdStat;
+        if (-1 == fd || 0 != fstat (fd, &fdStat)) {
+            *status = errno;
+            if (-1 != fd) close (fd);
+            break;
+        }
+
+        BRFileServiceLogSegment segment = { numbers[index], fd, NULL, 0, (size_t) fdStat.st_size, 0 };
+        array_add (log->segments, segment);
+
+        *status = fileServiceLogReplay (log, fileServiceLogSegmentActive (log));
+    }
+    array_free (numbers);
+
+    // Append to the last segment, which the replay left ending with a commit, unless full.
+    if (0 == *status &&
+        (0 == array_count (log->segments) ||
+         fileServiceLogSegmentActive(log)->size >= FILE_SERVICE_LOG_SEGMENT_BYTES))
+        *status = fileServiceLogSegmentCreate (log);
+
+    if (0 == *status &&
+        0 != pthread_create (&log->compactThread, NULL, (ThreadRoutine) fileServiceLogCompactThread, log))
+        *status = EAGAIN;
+
+    if (0 != *status) {
+        fileServiceLogRelease (log);
+        return NULL;
+    }
+
+    return log;
+}
+
+static BRFileServiceBackendStatus fileServiceLogCommit (BRFileServiceBackend backend);
+
+static void
+fileServiceLogClose (BRFileServiceBackend backend) {
+    BRFileServiceLog *log = backend;
+
+    // Commit any transaction left open; saves made within a batch are not discarded by a close.
+    while (0 != array_count (log->savepoints))
+        if (0 != fileServiceLogCommit (log)) break;
+
+    pthread_mutex_lock (&log->lock);
+    log->compactQuit = true;
+    pthread_cond_signal (&log->compactCond);
+    pthread_mutex_unlock (&log->lock);
+
+    pthread_join (log->compactThread, NULL);
+
+    // Ensure every commit is stored.
+    fsync (fileServiceLogSegmentActive(log)->fd);
+
+    fileServiceLogRelease (log);
+}
+
+static BRFileServiceError
+fileServiceLogError (BRFileServiceBackendStatus status) {
+    return (BRFileServiceError) {
+        FILE_SERVICE_UNIX,
+        { .unx = { status }}
+    };
+}
+
+static BRFileServiceBackendStatus
+fileServiceLogBegin (BRFileServiceBackend backend) {
+    BRFileServiceLog *log = backend;
+
+    pthread_mutex_lock (&log->lock);
+    BRFileServiceLogSavepoint savepoint = {
+        fileServiceLogSegmentActive(log)->size,
+        array_count (log->undos)
+    };
+    array_add (log->savepoints, savepoint);
+    pthread_mutex_unlock (&log->lock);
+
+    return 0;
+}
+
+static BRFileServiceBackendStatus
+fileServiceLogCommit (BRFileServiceBackend backend) {
+    BRFileServiceLog *log = backend;
+    int status = 0;
+
+    pthread_mutex_lock (&log->lock);
+    if (0 == array_count (log->savepoints)) {
+        pthread_mutex_unlock (&log->lock);
+        return EINVAL;
+    }
+
+    BRFileServiceLogSavepoint savepoint = log->savepoints[array_count (log->savepoints) - 1];
+
+    // Only the outermost transaction commits.
+    if (1 == array_count (log->savepoints)) {
+        if (fileServiceLogSegmentActive(log)->size != savepoint.size)
+            status = fileServiceLogAppend (log, LOG_RECORD_COMMIT, LOG_RECORD_FLAG_COMMIT,
+                                           NULL, UINT256_ZERO, FILE_SERVICE_BACKEND_SORT_KEY_NONE,
+                                           NULL, 0, NULL);
+        if (0 != status) {
+            // Still in the transaction; the caller will rollback.
+            pthread_mutex_unlock (&log->lock);
+            return status;
+        }
+
+        fileServiceLogUndoRelease (log);
+    }
+
+    array_rm_last (log->savepoints);
+    if (0 == array_count (log->savepoints))
+        fileServiceLogCommitted (log);
+
+    pthread_mutex_unlock (&log->lock);
+    return 0;
+}
+
+static void
+fileServiceLogRollback (BRFileServiceBackend backend) {
+    BRFileServiceLog *log = backend;
+
+    pthread_mutex_lock (&log->lock);
+    if (0 == array_count (log->savepoints)) {
+        pthread_mutex_unlock (&log->lock);
+        return;
+    }
+
+    BRFileServiceLogSavepoint savepoint = log->savepoints[array_count (log->savepoints) - 1];
+    array_rm_last (log->savepoints);
+
+    fileServiceLogUndoApply (log, savepoint.undoCount);
+
+    BRFileServiceLogSegment *active = fileServiceLogSegmentActive (log);
+    if (active->size != savepoint.size &&
+        0 == ftruncate (active->fd, (off_t) savepoint.size))
+        active->size = savepoint.size;
+
+    pthread_mutex_unlock (&log->lock);
+}
+
+static BRFileServiceBackendStatus
+fileServiceLogSave (BRFileServiceBackend backend,
+                    const char *type,
+                    UInt256 identifier,
+                    int64_t sortKey,
+                    const uint8_t *bytes,
+                    size_t bytesCount) {
+    BRFileServiceLog *log = backend;
+
+    pthread_mutex_lock (&log->lock);
+
+    BRFileServiceLogEntry *entry = malloc (sizeof (BRFileServiceLogEntry));
+    int status = fileServiceLogAppend (log, LOG_RECORD_SAVE, fileServiceLogRecordFlags (log),
+                                       type, identifier, sortKey, bytes, bytesCount, entry);
+    if (0 != status) {
+        free (entry);
+        pthread_mutex_unlock (&log->lock);
+        return status;
+    }
+
+    BRFileServiceLogType *logType = fileServiceLogTypeLookup (log, type, true);
+    BRFileServiceLogEntry *previous = fileServiceLogIndexUpdate (log, logType, identifier, entry);
+    fileServiceLogUndoAdd (log, logType, identifier, previous, NULL);
+
+    if (0 == array_count (log->savepoints))
+        fileServiceLogCommitted (log);
+
+    pthread_mutex_unlock (&log->lock);
+    return 0;
+}
+
+static BRFileServiceBackendStatus
+fileServiceLogRemove (BRFileServiceBackend backend,
+                      const char *type,
+                      UInt256 identifier) {
+    BRFileServiceLog *log = backend;
+
+    pthread_mutex_lock (&log->lock);
+
+    // Nothing to remove, nothing to write.
+    BRFileServiceLogType *logType = fileServiceLogTypeLookup (log, type, false);
+    BRFileServiceLogEntry key = { identifier };
+    if (NULL == logType || NULL == BRSetGet (logType->entries, &key)) {
+        pthread_mutex_unlock (&log->lock);
+        return 0;
+    }
+
+    int status = fileServiceLogAppend (log, LOG_RECORD_REMOVE, fileServiceLogRecordFlags (log),
+                                       type, identifier, FILE_SERVICE_BACKEND_SORT_KEY_NONE,
+                                       NULL, 0, NULL);
+    if (0 != status) {
+        pthread_mutex_unlock (&log->lock);
+        return status;
+    }
+
+    BRFileServiceLogEntry *previous = fileServiceLogIndexUpdate (log, logType, identifier, NULL);
+    fileServiceLogUndoAdd (log, logType, identifier, previous, NULL);
+
+    if (0 == array_count (log->savepoints))
+        fileServiceLogCommitted (log);
+
+    pthread_mutex_unlock (&log->lock);
+    return 0;
+}
+
+/// Must be called with `log->lock` held.
+static int
+fileServiceLogClearType (BRFileServiceLog *log,
+                         BRFileServiceLogType *logType) {
+    if (0 == BRSetCount (logType->entries)) return 0;
+
+    int status = fileServiceLogAppend (log, LOG_RECORD_CLEAR, fileServiceLogRecordFlags (log),
+                                       logType->type, UINT256_ZERO, FILE_SERVICE_BACKEND_SORT_KEY_NONE,
+                                       NULL, 0, NULL);
+    if (0 != status) return status;
+
+    BRSetOf(BRFileServiceLogEntry*) previousEntries = logType->entries;
+    fileServiceLogAccountLiveAll (log, previousEntries, false);
+    logType->entries = BRSetNew (fileServiceLogEntryHash, fileServiceLogEntryEq, FILE_SERVICE_LOG_INITIAL_ENTRY_COUNT);
+
+    fileServiceLogUndoAdd (log, logType, UINT256_ZERO, NULL, previousEntries);
+
+    if (0 == array_count (log->savepoints))
+        fileServiceLogCommitted (log);
+
+    return 0;
+}
+
+static BRFileServiceBackendStatus
+fileServiceLogClear (BRFileServiceBackend backend,
+                     const char *type) {
+    BRFileServiceLog *log = backend;
+
+    pthread_mutex_lock (&log->lock);
+    BRFileServiceLogType *logType = fileServiceLogTypeLookup (log, type, false);
+    int status = (NULL == logType ? 0 : fileServiceLogClearType (log, logType));
+    pthread_mutex_unlock (&log->lock);
+
+    return status;
+}
+
+static BRFileServiceBackendStatus
+fileServiceLogPurge (BRFileServiceBackend backend,
+                     const char **types,
+                     size_t typesCount) {
+    BRFileServiceLog *log = backend;
+    int status = 0;
+
+    pthread_mutex_lock (&log->lock);
+    for (size_t index = 0; 0 == status && index < array_count (log->types); index++) {
+        bool keep = false;
+        for (size_t typeIndex = 0; !keep && typeIndex < typesCount; typeIndex++)
+            keep = (0 == strcmp (types[typeIndex], log->types[index].type));
+
+        if (!keep)
+            status = fileServiceLogClearType (log, &log->types[index]);
+    }
+    pthread_mutex_unlock (&log->lock);
+
+    return status;
+}
+
+static bool
+fileServiceLogHasUnkeyed (BRFileServiceBackend backend,
+                          const char *type) {
+    BRFileServiceLog *log = backend;
+    bool hasUnkeyed = false;
+
+    pthread_mutex_lock (&log->lock);
+    BRFileServiceLogType *logType = fileServiceLogTypeLookup (log, type, false);
+    if (NULL != logType)
+        for (BRFileServiceLogEntry *entry = BRSetIterate (logType->entries, NULL);
+             !hasUnkeyed && NULL != entry;
+             entry = BRSetIterate (logType->entries, entry))
+            hasUnkeyed = (FILE_SERVICE_BACKEND_SORT_KEY_NONE == entry->sortKey);
+    pthread_mutex_unlock (&log->lock);
+
+    return hasUnkeyed;
+}
+
+static BRFileServiceBackendStatus
+fileServiceLogStats (BRFileServiceBackend backend,
+                     const char *type,
+                     size_t *entitiesCount,
+                     uint64_t *bytesCount) {
+    BRFileServiceLog *log = backend;
+
+    *entitiesCount = 0;
+    *bytesCount    = 0;
+
+    pthread_mutex_lock (&log->lock);
+    BRFileServiceLogType *logType = fileServiceLogTypeLookup (log, type, false);
+    if (NULL != logType) {
+        *entitiesCount = BRSetCount (logType->entries);
+        for (BRFileServiceLogEntry *entry = BRSetIterate (logType->entries, NULL);
+             NULL != entry;
+             entry = BRSetIterate (logType->entries, entry))
+            *bytesCount += entry->bytesCount;
+    }
+    pthread_mutex_unlock (&log->lock);
+
+    return FILE_SERVICE_BACKEND_OK;
+}
+
+static int
+fileServiceLogEntrySortKeyCompare (const void *entry1, const void *entry2) {
+    int64_t sortKey1 = (*(const BRFileServiceLogEntry **) entry1)->sortKey;
+    int64_t sortKey2 = (*(const BRFileServiceLogEntry **) entry2)->sortKey;
+    return (sortKey1 < sortKey2 ? -1 : (sortKey1 > sortKey2 ? 1 : 0));
+}
+
+static BRFileServiceBackendStatus
+fileServiceLogLoad (BRFileServiceBackend backend,
+                    const char *type,
+                    bool ordered,
+                    const int64_t *range,
+                    void *context,
+                    BRFileServiceBackendLoadHandler handler) {
+    BRFileServiceLog *log = backend;
+    int status = 0;
+
+    pthread_mutex_lock (&log->lock);
+
+    BRFileServiceLogType *logType = fileServiceLogTypeLookup (log, type, false);
+    if (NULL == logType) {
+        pthread_mutex_unlock (&log->lock);
+        return 0;
+    }
+
+    // Select the entities, in order if needed
+    size_t entriesCount = BRSetCount (logType->entries);
+    BRFileServiceLogEntry **entries = calloc (entriesCount + 1, sizeof (BRFileServiceLogEntry *));
+
+    size_t count = 0;
+    for (BRFileServiceLogEntry *entry = BRSetIterate (logType->entries, NULL);
+         NULL != entry;
+         entry = BRSetIterate (logType->entries, entry))
+        if (NULL == range ||
+            FILE_SERVICE_BACKEND_SORT_KEY_NONE == entry->sortKey ||
+            (range[0] <= entry->sortKey && entry->sortKey <= range[1]))
+            entries[count++] = entry;
+
+    if (ordered || NULL != range)
+        qsort (entries, count, sizeof (BRFileServiceLogEntry *), fileServiceLogEntrySortKeyCompare);
+
+    for (size_t index = 0; 0 == status && index < count; index++) {
+        BRFileServiceLogEntry *entry = entries[index];
+        BRFileServiceLogSegment *segment = fileServiceLogSegmentLookup (log, entry->segment);
+        if (NULL == segment) { status = EIO; break; }
+
+        status = fileServiceLogSegmentMap (segment, entry->bytesOffset + entry->bytesCount);
+        if (0 != status) break;
+
+        if (!handler (context, entry->identifier, entry->sortKey,
+                      &segment->map[entry->bytesOffset], entry->bytesCount))
+            break;
+    }
+
+    free (entries);
+    pthread_mutex_unlock (&log->lock);
+
+    return status;
+}
+
+static BRFileServiceBackendStatus
+fileServiceLogSetDurability (BRFileServiceBackend backend,
+                             BRFileServiceDurability durability) {
+    BRFileServiceLog *log = backend;
+
+    pthread_mutex_lock (&log->lock);
+    log->durability = durability;
+    pthread_mutex_unlock (&log->lock);
+
+    return 0;
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+static int
+fileServiceLogWipe (const char *basePath,
+                    const char *currency,
+                    const char *network) {
+    int result = 0; // 0 on success, errno on failure
+
+#if !defined(NEUTER_FILE_SERVICE)
+    char *path = fileServiceLogPath (basePath, currency, network);
+
+    DIR *dir = opendir (path);
+    if (NULL == dir) {
+        result = (ENOENT == errno ? 0 : errno);
+        free (path);
+        return result;
+    }
+
+    struct dirent *dirEntry;
+    while (NULL != (dirEntry = readdir (dir))) {
+        if (0 == strcmp (".", dirEntry->d_name) || 0 == strcmp ("..", dirEntry->d_name)) continue;
+
+        char filePath[strlen (path) + 1 + strlen (dirEntry->d_name) + 1];
+        sprintf (filePath, "%s/%s", path, dirEntry->d_name);
+        if (0 != remove (filePath) && 0 == result) result = errno;
+    }
+    closedir (dir);
+
+    if (0 != rmdir (path) && 0 == result) result = errno;
+    free (path);
+#endif
+
+    return result;
+}
+
+#if !defined(NEUTER_FILE_SERVICE)
+const BRFileServiceBackendHandlers fileServiceBackendHandlersLog = {
+    fileServiceLogOpen,
+    fileServiceLogClose,
+    fileServiceLogError,
+    fileServiceLogBegin,
+    fileServiceLogCommit,
+    fileServiceLogRollback,
+    fileServiceLogSave,
+    fileServiceLogRemove,
+    fileServiceLogClear,
+    fileServiceLogPurge,
+    fileServiceLogHasUnkeyed,
+    fileServiceLogLoad,
+    fileServiceLogStats,
+    fileServiceLogSetDurability,
+    fileServiceLogWipe
+};
+#else
+const BRFileServiceBackendHandlers fileServiceBackendHandlersLog = {
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    fileServiceLogWipe
+};
+#endif // !defined(NEUTER_FILE_SERVICE)
@@ -0,0 +1,1280 @@
+//
+//  BRFileServiceSQLite.c
+//  Core
+//
+//  Created by Richard Evers on 1/4/19.
+//  Copyright © 2019 breadwallet LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+
+#include "BRFileServiceBackend.h"
+#include "BRArray.h"
+#include "BROSCompat.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../vendor/sqlite3/sqlite3.h"
+typedef int sqlite3_status_code;
+
+#define FILE_SERVICE_SDB_FILENAME      "entities.db"
+
+// The milliseconds to wait for another connection to the same DB to release its lock.
+#define FILE_SERVICE_SDB_BUSY_TIMEOUT  (5000)
+
+#define FILE_SERVICE_SDB_ENTITY_TABLE     \
+"CREATE TABLE IF NOT EXISTS Entity(     \n\
+  Type      CHAR(64)    NOT NULL,       \n\
+  Hash      CHAR(64)    NOT NULL,       \n\
+  Data      BLOB        NOT NULL,       \n\
+  SortKey   INTEGER,                    \n\
+  PRIMARY KEY (Type, Hash));"
+
+#define FILE_SERVICE_SDB_ENTITY_HAS_SORT_KEY      \
+"SELECT SortKey FROM Entity LIMIT 0;"
+
+#define FILE_SERVICE_SDB_ENTITY_ADD_SORT_KEY      \
+"ALTER TABLE Entity ADD COLUMN SortKey INTEGER;"
+
+#define FILE_SERVICE_SDB_ENTITY_SORT_KEY_INDEX    \
+"CREATE INDEX IF NOT EXISTS EntitySortKey ON Entity (Type, SortKey);"
+
+typedef char FileServiceSQL[1024];
+
+#define FILE_SERVICE_SDB_INSERT_ENTITY    \
+"INSERT OR REPLACE INTO Entity (Type, Hash, Data, SortKey) VALUES (?, ?, ?, ?);"
+
+#define FILE_SERVICE_SDB_QUERY_ALL_ENTITY     \
+"SELECT Hash, Data, SortKey FROM Entity WHERE Type = ?;"
+
+#define FILE_SERVICE_SDB_QUERY_ORDERED_ENTITY     \
+"SELECT Hash, Data, SortKey FROM Entity WHERE Type = ? ORDER BY SortKey;"
+
+#define FILE_SERVICE_SDB_QUERY_RANGE_ENTITY     \
+"SELECT Hash, Data, SortKey FROM Entity WHERE Type = ? AND (SortKey IS NULL OR SortKey BETWEEN ? AND ?) ORDER BY SortKey;"
+
+#define FILE_SERVICE_SDB_QUERY_UNKEYED_ENTITY     \
+"SELECT 1 FROM Entity WHERE Type = ? AND SortKey IS NULL LIMIT 1;"
+
+#define FILE_SERVICE_SDB_QUERY_STATS_ENTITY     \
+"SELECT COUNT(*), IFNULL(SUM(LENGTH(Data)), 0) FROM Entity WHERE Type = ?;"
+
+#define FILE_SERVICE_SDB_DELETE_ENTITY     \
+"DELETE FROM Entity WHERE Type = ? AND Hash = ?;"
+
+#define FILE_SERVICE_SDB_DELETE_ALL_TYPE_ENTITY     \
+"DELETE FROM Entity WHERE Type = ?;"
+
+#if !defined(NEUTER_FILE_SERVICE)
+
+#if defined(DEBUG)
+static int needSQLiteCompileOptions = 1;
+#endif
+
+// HEX Decode - Cribbed from ethereum/util/BRUtilHex.c.  Only needed to read `HEADER_FORMAT_1`
+// entities, which were stored as hex-encoded TEXT.
+
+// Convert a char into uint8_t (decode)
+#define decodeChar(c)           ((uint8_t) _hexu(c))
+
+static void
+hexDecode (uint8_t *target, size_t targetLen, const char *source, size_t sourceLen) {
+    //
+    assert (0 == sourceLen % 2);
+    assert (2 * targetLen == sourceLen);
+
+    for (int i = 0; i < targetLen; i++) {
+        target[i] = (uint8_t) ((decodeChar(source[2*i]) << 4) | decodeChar(source[(2*i)+1]));
+    }
+}
+
+///
+/// The sqlite3 backend: one 'Entity' table, with one row per {Type, Hash}.
+///
+typedef struct {
+    sqlite3 *sdb;
+    sqlite3_stmt *sdbInsertStmt;
+    sqlite3_stmt *sdbSelectAllStmt;
+    sqlite3_stmt *sdbSelectOrderedStmt;
+    sqlite3_stmt *sdbSelectRangeStmt;
+    sqlite3_stmt *sdbSelectUnkeyedStmt;
+    sqlite3_stmt *sdbSelectStatsStmt;
+    sqlite3_stmt *sdbDeleteStmt;
+    sqlite3_stmt *sdbDeleteAllTypeStmt;
+
+    // The depth of nested transactions; see `fileServiceSQLiteBegin()`
+    size_t transactionDepth;
+} BRFileServiceSQLite;
+
+static void
+fileServiceSQLiteFinalizeStmt (sqlite3_stmt **stmt) {
+    if (NULL != stmt && NULL != *stmt) {
+        sqlite3_finalize (*stmt);
+        *stmt = NULL;
+    }
+}
+
+static void
+fileServiceSQLiteClose (BRFileServiceBackend backend) {
+    BRFileServiceSQLite *sqlite = backend;
+
+    // Commit any transaction left open; saves made within a batch are not discarded by a close.
+    for (; sqlite->transactionDepth > 0; sqlite->transactionDepth--)
+        sqlite3_exec (sqlite->sdb, "RELEASE FileService", NULL, NULL, NULL);
+
+    fileServiceSQLiteFinalizeStmt (&sqlite->sdbInsertStmt);
+    fileServiceSQLiteFinalizeStmt (&sqlite->sdbSelectAllStmt);
+    fileServiceSQLiteFinalizeStmt (&sqlite->sdbSelectOrderedStmt);
+    fileServiceSQLiteFinalizeStmt (&sqlite->sdbSelectRangeStmt);
+    fileServiceSQLiteFinalizeStmt (&sqlite->sdbSelectUnkeyedStmt);
+    fileServiceSQLiteFinalizeStmt (&sqlite->sdbSelectStatsStmt);
+    fileServiceSQLiteFinalizeStmt (&sqlite->sdbDeleteStmt);
+    fileServiceSQLiteFinalizeStmt (&sqlite->sdbDeleteAllTypeStmt);
+
+    if (NULL != sqlite->sdb) sqlite3_close (sqlite->sdb);
+    free (sqlite);
+}
+
+static BRFileServiceBackend
+fileServiceSQLiteOpenFailed (BRFileServiceSQLite *sqlite,
+                             sqlite3_status_code code,
+                             BRFileServiceBackendStatus *status) {
+    *status = (SQLITE_OK == code ? SQLITE_ERROR : code);
+    fileServiceSQLiteClose (sqlite);
+    return NULL;
+}
+
+static BRFileServiceSQLite *
+fileServiceSQLiteOpenPath (const char *sdbPath,
+                           BRFileServiceBackendStatus *status) {
+    // Require SQLite to support 'MULTI_THREADED' or 'SERIALIZED'.  We'll lock our connection.
+    // and thus 'MULTI_THREADED' is appropriate.
+    if (0 == sqlite3_threadsafe()) { *status = SQLITE_MISUSE; return NULL; }
+
+    BRFileServiceSQLite *sqlite = calloc (1, sizeof (BRFileServiceSQLite));
+
+    // Create/Open the SQLITE Database
+    sqlite3_status_code code = sqlite3_open (sdbPath, &sqlite->sdb);
+    if (SQLITE_OK != code)
+        return fileServiceSQLiteOpenFailed (sqlite, code, status);
+
+    // Wait out, rather than fail on, another connection's lock; see `BRFileServiceStore`.
+    sqlite3_busy_timeout (sqlite->sdb, FILE_SERVICE_SDB_BUSY_TIMEOUT);
+
+    // Create the SQLite 'Entity' Table
+    code = sqlite3_exec (sqlite->sdb, FILE_SERVICE_SDB_ENTITY_TABLE, NULL, NULL, NULL);
+    if (SQLITE_OK != code)
+        return fileServiceSQLiteOpenFailed (sqlite, code, status);
+
+    // Add the 'SortKey' column, if missing, to an 'Entity' table created before it existed.
+    // Existing entities will have a NULL 'SortKey'.
+    if (SQLITE_OK != sqlite3_exec (sqlite->sdb, FILE_SERVICE_SDB_ENTITY_HAS_SORT_KEY, NULL, NULL, NULL)) {
+        code = sqlite3_exec (sqlite->sdb, FILE_SERVICE_SDB_ENTITY_ADD_SORT_KEY, NULL, NULL, NULL);
+        if (SQLITE_OK != code)
+            return fileServiceSQLiteOpenFailed (sqlite, code, status);
+    }
+
+    // Create the 'SortKey' index, to order and to range-limit loads.
+    code = sqlite3_exec (sqlite->sdb, FILE_SERVICE_SDB_ENTITY_SORT_KEY_INDEX, NULL, NULL, NULL);
+    if (SQLITE_OK != code)
+        return fileServiceSQLiteOpenFailed (sqlite, code, status);
+
+    // Create the SQLITE Statements
+    struct {
+        const char *sql;
+        sqlite3_stmt **stmt;
+    } statements[] = {
+        { FILE_SERVICE_SDB_INSERT_ENTITY,           &sqlite->sdbInsertStmt        },
+        { FILE_SERVICE_SDB_QUERY_ALL_ENTITY,        &sqlite->sdbSelectAllStmt     },
+        { FILE_SERVICE_SDB_QUERY_ORDERED_ENTITY,    &sqlite->sdbSelectOrderedStmt },
+        { FILE_SERVICE_SDB_QUERY_RANGE_ENTITY,      &sqlite->sdbSelectRangeStmt   },
+        { FILE_SERVICE_SDB_QUERY_UNKEYED_ENTITY,    &sqlite->sdbSelectUnkeyedStmt },
+        { FILE_SERVICE_SDB_QUERY_STATS_ENTITY,      &sqlite->sdbSelectStatsStmt   },
+        { FILE_SERVICE_SDB_DELETE_ENTITY,           &sqlite->sdbDeleteStmt        },
+        { FILE_SERVICE_SDB_DELETE_ALL_TYPE_ENTITY,  &sqlite->sdbDeleteAllTypeStmt },
+    };
+
+    for (size_t index = 0; index < sizeof (statements) / sizeof (statements[0]); index++) {
+        code = sqlite3_prepare_v2 (sqlite->sdb, statements[index].sql, -1, statements[index].stmt, NULL);
+        if (SQLITE_OK != code)
+            return fileServiceSQLiteOpenFailed (sqlite, code, status);
+    }
+
+#  if defined(DEBUG)
+    if (needSQLiteCompileOptions) {
+        needSQLiteCompileOptions = 0;
+        printf ("SQLITE ThreadSafe Mutex: %d\n", sqlite3_threadsafe());
+        printf ("SQLITE Compile Options:\n");
+        const char *option = NULL;
+        for (int index = 0;
+             NULL != (option = sqlite3_compileoption_get(index));
+             index++) {
+            printf ("-DSQLITE_%s\n", option);
+        }
+    }
+#  endif
+
+    *status = SQLITE_OK;
+    return sqlite;
+}
+
+static BRFileServiceBackend
+fileServiceSQLiteOpen (const char *basePath,
+                       const char *currency,
+                       const char *network,
+                       BRFileServiceBackendStatus *status) {
+    char *sdbPath = fileServiceCreateFilePath (basePath, currency, network, FILE_SERVICE_SDB_FILENAME);
+    BRFileServiceSQLite *sqlite = fileServiceSQLiteOpenPath (sdbPath, status);
+    free (sdbPath);
+    return sqlite;
+}
+
+static BRFileServiceError
+fileServiceSQLiteError (BRFileServiceBackendStatus status) {
+    return (BRFileServiceError) {
+        FILE_SERVICE_SDB,
+        { .sdb = { status, sqlite3_errstr (status) }}
+    };
+}
+
+//
+// All DB transactions are SAVEPOINTs.  Outside of any DB transaction a SAVEPOINT behaves like
+// 'BEGIN' and its RELEASE like 'COMMIT'.  Inside of a batch (see `fileServiceBeginBatch()`) a
+// SAVEPOINT nests and its RELEASE defers the commit until the batch commits.  Thus a replace (or
+// a load's version update) works the same whether or not it is part of a batch.
+//
+static BRFileServiceBackendStatus
+fileServiceSQLiteBegin (BRFileServiceBackend backend) {
+    BRFileServiceSQLite *sqlite = backend;
+    sqlite3_status_code status = sqlite3_exec (sqlite->sdb, "SAVEPOINT FileService", NULL, NULL, NULL);
+    if (SQLITE_OK == status) sqlite->transactionDepth += 1;
+    return status;
+}
+
+static BRFileServiceBackendStatus
+fileServiceSQLiteCommit (BRFileServiceBackend backend) {
+    BRFileServiceSQLite *sqlite = backend;
+    sqlite3_status_code status = sqlite3_exec (sqlite->sdb, "RELEASE FileService", NULL, NULL, NULL);
+    if (SQLITE_OK == status) sqlite->transactionDepth -= 1;
+    return status;
+}
+
+static void
+fileServiceSQLiteRollback (BRFileServiceBackend backend) {
+    BRFileServiceSQLite *sqlite = backend;
+    sqlite3_exec (sqlite->sdb, "ROLLBACK TO FileService", NULL, NULL, NULL);
+    if (SQLITE_OK == sqlite3_exec (sqlite->sdb, "RELEASE FileService", NULL, NULL, NULL))
+        sqlite->transactionDepth -= 1;
+}
+
+static BRFileServiceBackendStatus
+fileServiceSQLiteSave (BRFileServiceBackend backend,
+                       const char *type,
+                       UInt256 identifier,
+                       int64_t sortKey,
+                       const uint8_t *bytes,
+                       size_t bytesCount) {
+    BRFileServiceSQLite *sqlite = backend;
+
+    // Hex-Encode the identifier
+    const char *hash = u256hex(identifier);
+
+    sqlite3_status_code status;
+
+    sqlite3_reset (sqlite->sdbInsertStmt);
+    sqlite3_clear_bindings(sqlite->sdbInsertStmt);
+
+    status = sqlite3_bind_text (sqlite->sdbInsertStmt, 1, type, -1, SQLITE_STATIC);
+    if (SQLITE_OK != status) return status;
+
+    status = sqlite3_bind_text (sqlite->sdbInsertStmt, 2, hash, -1, SQLITE_STATIC);
+    if (SQLITE_OK != status) return status;
+
+    status = sqlite3_bind_blob (sqlite->sdbInsertStmt, 3, bytes, (int) bytesCount, SQLITE_STATIC);
+    if (SQLITE_OK != status) return status;
+
+    status = (FILE_SERVICE_BACKEND_SORT_KEY_NONE == sortKey
+              ? sqlite3_bind_null  (sqlite->sdbInsertStmt, 4)
+              : sqlite3_bind_int64 (sqlite->sdbInsertStmt, 4, sortKey));
+    if (SQLITE_OK != status) return status;
+
+    status = sqlite3_step (sqlite->sdbInsertStmt);
+
+    // Ensure the 'implicit DB transaction' is committed.
+    sqlite3_reset (sqlite->sdbInsertStmt);
+
+    return (SQLITE_DONE == status ? SQLITE_OK : status);
+}
+
+static BRFileServiceBackendStatus
+fileServiceSQLiteRemove (BRFileServiceBackend backend,
+                         const char *type,
+                         UInt256 identifier) {
+    BRFileServiceSQLite *sqlite = backend;
+
+    // Hex-Encode identifier
+    const char *hash = u256hex(identifier);
+
+    sqlite3_status_code status;
+
+    sqlite3_reset (sqlite->sdbDeleteStmt);
+    sqlite3_clear_bindings (sqlite->sdbDeleteStmt);
+
+    status = sqlite3_bind_text (sqlite->sdbDeleteStmt, 1, type, -1, SQLITE_STATIC);
+    if (SQLITE_OK != status) return status;
+
+    status = sqlite3_bind_text (sqlite->sdbDeleteStmt, 2, hash, -1, SQLITE_STATIC);
+    if (SQLITE_OK != status) return status;
+
+    status = sqlite3_step (sqlite->sdbDeleteStmt);
+
+    // Ensure the 'implicit DB transaction' is committed.
+    sqlite3_reset (sqlite->sdbDeleteStmt);
+
+    return (SQLITE_DONE == status ? SQLITE_OK : status);
+}
+
+static BRFileServiceBackendStatus
+fileServiceSQLiteClear (BRFileServiceBackend backend,
+                        const char *type) {
+    BRFileServiceSQLite *sqlite = backend;
+
+    sqlite3_status_code status;
+
+    sqlite3_reset (sqlite->sdbDeleteAllTypeStmt);
+    sqlite3_clear_bindings (sqlite->sdbDeleteAllTypeStmt);
+
+    status = sqlite3_bind_text (sqlite->sdbDeleteAllTypeStmt, 1, type, -1, SQLITE_STATIC);
+    if (SQLITE_OK != status) return status;
+
+    status = sqlite3_step (sqlite->sdbDeleteAllTypeStmt);
+
+    // Ensure the 'implicit DB transaction' is committed.
+    sqlite3_reset (sqlite->sdbDeleteAllTypeStmt);
+
+    return (SQLITE_DONE == status ? SQLITE_OK : status);
+}
+
+static char *
+fileServiceSQLitePurgeCreateSQL (const char **types,
+                                 size_t typesCount) {
+    static char *sqlFormatter = "DELETE FROM Entity WHERE Type NOT IN (%s);";
+
+    char *sqlArgs;
+    size_t sqlArgsLength = 1;
+
+    char *sqlArgPrefix = "\"";
+
+    // Find the args length
+    for (size_t index = 0; index < typesCount; index++) {
+        sqlArgsLength += strlen (sqlArgPrefix);
+        sqlArgsLength += strlen (types[index]) + 2; // quotes
+        sqlArgPrefix = "\",\"";
+    }
+    sqlArgsLength += strlen ("\"");
+
+    sqlArgPrefix = "\"";
+
+    sqlArgs = malloc (sqlArgsLength);
+    sqlArgs[0] = '\0';
+    for (size_t index = 0; index < typesCount; index++) {
+        strcat (sqlArgs, sqlArgPrefix);
+        strcat (sqlArgs, types[index]);
+        sqlArgPrefix = "\",\"";
+    }
+    strcat (sqlArgs, "\"");
+
+    char *sql = NULL;
+    asprintf (&sql, sqlFormatter, sqlArgs);
+    free (sqlArgs);
+
+    return sql;
+}
+
+static BRFileServiceBackendStatus
+fileServiceSQLitePurge (BRFileServiceBackend backend,
+                        const char **types,
+                        size_t typesCount) {
+    BRFileServiceSQLite *sqlite = backend;
+
+    char *sql = fileServiceSQLitePurgeCreateSQL (types, typesCount);
+    printf ("DBG: FileServicePurge: SQL: %s\n", sql);
+
+    sqlite3_status_code status = sqlite3_exec (sqlite->sdb, sql, NULL, NULL, NULL);
+
+    free (sql);
+    return status;
+}
+
+static bool
+fileServiceSQLiteHasUnkeyed (BRFileServiceBackend backend,
+                             const char *type) {
+    BRFileServiceSQLite *sqlite = backend;
+
+    sqlite3_reset (sqlite->sdbSelectUnkeyedStmt);
+    sqlite3_clear_bindings (sqlite->sdbSelectUnkeyedStmt);
+
+    // On any error, assume there are unkeyed entities.
+    bool hasUnkeyed = (SQLITE_OK  != sqlite3_bind_text (sqlite->sdbSelectUnkeyedStmt, 1, type, -1, SQLITE_STATIC) ||
+                       SQLITE_DONE != sqlite3_step (sqlite->sdbSelectUnkeyedStmt));
+
+    sqlite3_reset (sqlite->sdbSelectUnkeyedStmt);
+    return hasUnkeyed;
+}
+
+static BRFileServiceBackendStatus
+fileServiceSQLiteLoad (BRFileServiceBackend backend,
+                       const char *type,
+                       bool ordered,
+                       const int64_t *range,
+                       void *context,
+                       BRFileServiceBackendLoadHandler handler) {
+    BRFileServiceSQLite *sqlite = backend;
+
+    sqlite3_status_code status;
+
+    // Choose the query.  The 'SortKey' index orders the entities.
+    sqlite3_stmt *stmt = (NULL != range ? sqlite->sdbSelectRangeStmt
+                          : (ordered ? sqlite->sdbSelectOrderedStmt
+                             : sqlite->sdbSelectAllStmt));
+
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+
+    status = sqlite3_bind_text (stmt, 1, type, -1, SQLITE_STATIC);
+    if (SQLITE_OK != status) return status;
+
+    if (NULL != range) {
+        status = sqlite3_bind_int64 (stmt, 2, range[0]);
+        if (SQLITE_OK != status) return status;
+
+        status = sqlite3_bind_int64 (stmt, 3, range[1]);
+        if (SQLITE_OK != status) return status;
+    }
+
+    // A buffer for hex-decoding HEADER_FORMAT_1 entities; grown as needed.
+    uint8_t  hexBytesBuffer[8196];
+    uint8_t *hexBytes = hexBytesBuffer;
+    size_t   hexBytesCapacity = 8196;
+
+    // Zero out the hexBytes memory to avoid subsequent Clang Static Analysis errors releted
+    // to dereferencing uninitialized memory.  We accept this minimal, extraneous function call.
+    memset(hexBytes, 0, hexBytesCapacity);
+
+    while (SQLITE_ROW == (status = sqlite3_step(stmt))) {
+        const char *hash = (const char *) sqlite3_column_text (stmt, 0);
+
+        if (NULL == hash || 64 != strlen (hash)) { status = SQLITE_CORRUPT; break; }
+
+        const uint8_t *dataBytes;
+        size_t dataBytesCount;
+
+        switch (sqlite3_column_type (stmt, 1)) {
+            case SQLITE_BLOB:
+                // HEADER_FORMAT_2 (or later); the bytes are directly available.
+                dataBytes      = sqlite3_column_blob  (stmt, 1);
+                dataBytesCount = (size_t) sqlite3_column_bytes (stmt, 1);
+                break;
+
+            case SQLITE_TEXT: {
+                // HEADER_FORMAT_1; the bytes are hex-encoded.
+                const char *data = (const char *) sqlite3_column_text (stmt, 1);
+                size_t dataCount = (size_t) sqlite3_column_bytes (stmt, 1);
+                assert (0 == dataCount % 2);  // Surely 'even'
+
+                // Ensure `hexBytes` is large enough for hex-decoded `data`
+                if ((dataCount/2) > hexBytesCapacity) {
+                    if (hexBytes != hexBytesBuffer) free (hexBytes);
+                    hexBytesCapacity = dataCount/2;
+                    hexBytes = malloc (hexBytesCapacity);
+                }
+
+                // Actually decode `data` into `hexBytes`
+                hexDecode (hexBytes, dataCount/2, data, dataCount);
+
+                dataBytes      = hexBytes;
+                dataBytesCount = dataCount/2;
+                break;
+            }
+
+            default:
+                dataBytes      = NULL;
+                dataBytesCount = 0;
+                break;
+        }
+
+        if (NULL == dataBytes) { status = SQLITE_CORRUPT; break; }
+
+        int64_t sortKey = (SQLITE_NULL == sqlite3_column_type (stmt, 2)
+                           ? FILE_SERVICE_BACKEND_SORT_KEY_NONE
+                           : sqlite3_column_int64 (stmt, 2));
+
+        if (!handler (context, uint256 (hash), sortKey, dataBytes, dataBytesCount)) {
+            status = SQLITE_DONE;
+            break;
+        }
+    }
+
+    // Ensure the 'implicit DB transaction' is committed.
+    sqlite3_reset (stmt);
+
+    if (hexBytes != hexBytesBuffer) free (hexBytes);
+
+    return (SQLITE_DONE == status ? SQLITE_OK : status);
+}
+
+static BRFileServiceBackendStatus
+fileServiceSQLiteStats (BRFileServiceBackend backend,
+                        const char *type,
+                        size_t *entitiesCount,
+                        uint64_t *bytesCount) {
+    BRFileServiceSQLite *sqlite = backend;
+    sqlite3_status_code status;
+
+    sqlite3_reset (sqlite->sdbSelectStatsStmt);
+    sqlite3_clear_bindings (sqlite->sdbSelectStatsStmt);
+
+    status = sqlite3_bind_text (sqlite->sdbSelectStatsStmt, 1, type, -1, SQLITE_STATIC);
+    if (SQLITE_OK != status) return status;
+
+    status = sqlite3_step (sqlite->sdbSelectStatsStmt);
+    if (SQLITE_ROW == status) {
+        *entitiesCount = (size_t)   sqlite3_column_int64 (sqlite->sdbSelectStatsStmt, 0);
+        *bytesCount    = (uint64_t) sqlite3_column_int64 (sqlite->sdbSelectStatsStmt, 1);
+        status = SQLITE_OK;
+    }
+
+    // Ensure the 'implicit DB transaction' is committed.
+    sqlite3_reset (sqlite->sdbSelectStatsStmt);
+
+    return status;
+}
+
+static BRFileServiceBackendStatus
+fileServiceSQLiteSetDurability (BRFileServiceBackend backend,
+                                BRFileServiceDurability durability) {
+    BRFileServiceSQLite *sqlite = backend;
+
+    const char *synchronous = (FILE_SERVICE_SYNCHRONOUS_OFF    == durability.synchronous ? "OFF"
+                               : (FILE_SERVICE_SYNCHRONOUS_NORMAL == durability.synchronous ? "NORMAL"
+                                  : "FULL"));
+
+    FileServiceSQL sql;
+    sprintf (sql, "PRAGMA journal_mode = %s; PRAGMA synchronous = %s; PRAGMA mmap_size = %llu;",
+             (durability.journalWAL ? "WAL" : "DELETE"),
+             synchronous,
+             (unsigned long long) durability.mmapSize);
+
+    if (0 != durability.cacheSize)
+        sprintf (&sql[strlen(sql)], " PRAGMA cache_size = -%llu;",
+                 (unsigned long long) durability.cacheSize);
+
+    return sqlite3_exec (sqlite->sdb, sql, NULL, NULL, NULL);
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+static int
+fileServiceSQLiteWipe (const char *basePath,
+                       const char *currency,
+                       const char *network) {
+    int result = 0; // 0 on success, errno on failure
+
+#if !defined(NEUTER_FILE_SERVICE)
+    // Locate the SQLITE Database
+    char *sdbPath = fileServiceCreateFilePath (basePath, currency, network, FILE_SERVICE_SDB_FILENAME);
+
+    // Remove it.
+    result  = (0 == remove (sdbPath) ? 0 : errno);
+    free (sdbPath);
+
+    // Remove the write-ahead log files, if any, of a DB using `journalWAL`.  If they exist but
+    // can't be removed, a DB recreated at `sdbPath` would be corrupted by them.
+    const char *suffixes[] = { "-wal", "-shm" };
+    for (size_t index = 0; index < sizeof (suffixes) / sizeof (char *); index++) {
+        char filename[strlen (FILE_SERVICE_SDB_FILENAME) + strlen (suffixes[index]) + 1];
+        sprintf (filename, "%s%s", FILE_SERVICE_SDB_FILENAME, suffixes[index]);
+
+        sdbPath = fileServiceCreateFilePath (basePath, currency, network, filename);
+        if (0 != remove (sdbPath) && ENOENT != errno && 0 == result) result = errno;
+        free (sdbPath);
+    }
+#endif
+
+    return result;
+}
+
+#if !defined(NEUTER_FILE_SERVICE)
+const BRFileServiceBackendHandlers fileServiceBackendHandlersSQLite = {
+    fileServiceSQLiteOpen,
+    fileServiceSQLiteClose,
+    fileServiceSQLiteError,
+    fileServiceSQLiteBegin,
+    fileServiceSQLiteCommit,
+    fileServiceSQLiteRollback,
+    fileServiceSQLiteSave,
+    fileServiceSQLiteRemove,
+    fileServiceSQLiteClear,
+    fileServiceSQLitePurge,
+    fileServiceSQLiteHasUnkeyed,
+    fileServiceSQLiteLoad,
+    fileServiceSQLiteStats,
+    fileServiceSQLiteSetDurability,
+    fileServiceSQLiteWipe
+};
+#else
+const BRFileServiceBackendHandlers fileServiceBackendHandlersSQLite = {
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    fileServiceSQLiteWipe
+};
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+// MARK: - Shared Store
+
+//
+// A `BRFileServiceStore` is one DB shared by the file services of many {currency, network}s.  A
+// file service opens a namespace of the store; its entity types are stored as
+// "<currency>-<network>/<type>".
+//
+// The store's write connection is used only by its writer thread.  A namespace queues its writes
+// as 'units' - each save, remove, clear and purge outside of a transaction is one unit, all those
+// of an outermost transaction are one unit - and the writer commits every queued unit in one DB
+// transaction.  Each unit is in its own SAVEPOINT so that a failed unit does not fail the others.
+// A namespace reads with its own connection, concurrently with the writer given the write-ahead
+// log, once the units already queued are written.  Within a transaction, a namespace does not
+// read its own, still queued, writes.
+//
+
+#define FILE_SERVICE_STORE_WRITER_THREAD_NAME   "Core File Service Store Writer"
+#define FILE_SERVICE_STORE_INITIAL_UNIT_COUNT   (20)
+#define FILE_SERVICE_STORE_INITIAL_WRITE_COUNT  (10)
+
+#if !defined(NEUTER_FILE_SERVICE)
+typedef enum {
+    FILE_SERVICE_STORE_WRITE_SAVE,
+    FILE_SERVICE_STORE_WRITE_REMOVE,
+    FILE_SERVICE_STORE_WRITE_CLEAR,
+    FILE_SERVICE_STORE_WRITE_EXEC
+} BRFileServiceStoreWriteType;
+
+typedef struct {
+    BRFileServiceStoreWriteType type;
+    char *entityType;           // Namespaced; for EXEC, the SQL
+    UInt256 identifier;
+    int64_t sortKey;
+    uint8_t *bytes;
+    size_t bytesCount;
+} BRFileServiceStoreWrite;
+
+static void
+fileServiceStoreWriteRelease (BRFileServiceStoreWrite *write) {
+    free (write->entityType);
+    if (NULL != write->bytes) free (write->bytes);
+}
+
+typedef struct BRFileServiceStoreNamespaceRecord *BRFileServiceStoreNamespace;
+
+typedef struct {
+    BRFileServiceStoreNamespace ns;
+    BRArrayOf(BRFileServiceStoreWrite) writes;
+} BRFileServiceStoreUnit;
+
+struct BRFileServiceStoreRecord {
+    char *sdbPath;
+
+    // The write connection; used by the writer thread, or to set the durability, with
+    // `writerLock` held.
+    BRFileServiceSQLite *writer;
+    pthread_mutex_t writerLock;
+
+    // The queued units.  These are protected by `lock`; never held while acquiring `writerLock`.
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    BRArrayOf(BRFileServiceStoreUnit) units;
+    uint64_t unitsQueued;
+    uint64_t unitsWritten;
+
+    // The owner's reference plus one per open namespace.
+    size_t refs;
+
+    bool quit;
+    pthread_t thread;
+};
+
+struct BRFileServiceStoreNamespaceRecord {
+    BRFileServiceStore store;
+    char *prefix;
+    BRFileServiceSQLite *reader;
+
+    // The writes of the open transaction and, for each nested `begin`, their count at that
+    // `begin`.  Like any backend state, these are serialized by the file service.
+    BRArrayOf(BRFileServiceStoreWrite) writes;
+    BRArrayOf(size_t) savepoints;
+
+    // The first failure of a written unit, not yet reported; protected by `store->lock`.
+    BRFileServiceBackendStatus status;
+};
+
+static void
+fileServiceStoreUnitRelease (BRFileServiceStoreUnit *unit) {
+    for (size_t index = 0; index < array_count (unit->writes); index++)
+        fileServiceStoreWriteRelease (&unit->writes[index]);
+    array_free (unit->writes);
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreWriteUnit (BRFileServiceSQLite *writer,
+                           BRFileServiceStoreUnit *unit) {
+    BRFileServiceBackendStatus status = fileServiceSQLiteBegin (writer);
+    if (SQLITE_OK != status) return status;
+
+    for (size_t index = 0; SQLITE_OK == status && index < array_count (unit->writes); index++) {
+        BRFileServiceStoreWrite *write = &unit->writes[index];
+        switch (write->type) {
+            case FILE_SERVICE_STORE_WRITE_SAVE:
+                status = fileServiceSQLiteSave (writer, write->entityType, write->identifier,
+                                                write->sortKey, write->bytes, write->bytesCount);
+                break;
+            case FILE_SERVICE_STORE_WRITE_REMOVE:
+                status = fileServiceSQLiteRemove (writer, write->entityType, write->identifier);
+                break;
+            case FILE_SERVICE_STORE_WRITE_CLEAR:
+                status = fileServiceSQLiteClear (writer, write->entityType);
+                break;
+            case FILE_SERVICE_STORE_WRITE_EXEC:
+                status = sqlite3_exec (writer->sdb, write->entityType, NULL, NULL, NULL);
+                break;
+        }
+    }
+
+    if (SQLITE_OK == status) status = fileServiceSQLiteCommit (writer);
+    if (SQLITE_OK != status) fileServiceSQLiteRollback (writer);
+
+    return status;
+}
+
+///
+/// Write `units` in a single DB transaction, filling `statuses` with the status of each unit.
+/// If the DB transaction fails, every unit fails.
+///
+static void
+fileServiceStoreWriteUnits (BRFileServiceStore store,
+                            BRArrayOf(BRFileServiceStoreUnit) units,
+                            BRFileServiceBackendStatus *statuses) {
+    size_t unitsCount = array_count (units);
+
+    pthread_mutex_lock (&store->writerLock);
+    BRFileServiceBackendStatus status = fileServiceSQLiteBegin (store->writer);
+
+    for (size_t index = 0; index < unitsCount; index++)
+        statuses[index] = (SQLITE_OK == status
+                           ? fileServiceStoreWriteUnit (store->writer, &units[index])
+                           : status);
+
+    if (SQLITE_OK == status) {
+        status = fileServiceSQLiteCommit (store->writer);
+        if (SQLITE_OK != status) {
+            fileServiceSQLiteRollback (store->writer);
+            for (size_t index = 0; index < unitsCount; index++)
+                if (SQLITE_OK == statuses[index]) statuses[index] = status;
+        }
+    }
+    pthread_mutex_unlock (&store->writerLock);
+}
+
+typedef void* (*ThreadRoutine) (void*);
+
+static void *
+fileServiceStoreWriterThread (BRFileServiceStore store) {
+    pthread_setname_brd (pthread_self(), FILE_SERVICE_STORE_WRITER_THREAD_NAME);
+
+    pthread_mutex_lock (&store->lock);
+    while (1) {
+        while (!store->quit && 0 == array_count (store->units))
+            pthread_cond_wait (&store->cond, &store->lock);
+
+        // Only quit once every queued unit is written.
+        if (0 == array_count (store->units)) break;
+
+        // Take all the queued units, from every namespace, as one group; units queued while
+        // this group is being written will form the next group.
+        BRArrayOf(BRFileServiceStoreUnit) units = store->units;
+        array_new (store->units, FILE_SERVICE_STORE_INITIAL_UNIT_COUNT);
+        pthread_mutex_unlock (&store->lock);
+
+        size_t unitsCount = array_count (units);
+        BRFileServiceBackendStatus *statuses = calloc (unitsCount, sizeof (BRFileServiceBackendStatus));
+        fileServiceStoreWriteUnits (store, units, statuses);
+
+        // Record each namespace's first failure.  A namespace is not closed until its units
+        // are written, so `ns` is valid until `unitsWritten` is updated.
+        pthread_mutex_lock (&store->lock);
+        for (size_t index = 0; index < unitsCount; index++)
+            if (SQLITE_OK != statuses[index] && SQLITE_OK == units[index].ns->status)
+                units[index].ns->status = statuses[index];
+        store->unitsWritten += unitsCount;
+        pthread_cond_broadcast (&store->cond);
+        pthread_mutex_unlock (&store->lock);
+
+        for (size_t index = 0; index < unitsCount; index++)
+            fileServiceStoreUnitRelease (&units[index]);
+        array_free (units);
+        free (statuses);
+
+        pthread_mutex_lock (&store->lock);
+    }
+    pthread_mutex_unlock (&store->lock);
+
+    return NULL;
+}
+
+static void
+fileServiceStoreEnqueue (BRFileServiceStore store,
+                         BRFileServiceStoreNamespace ns,
+                         BRArrayOf(BRFileServiceStoreWrite) writes) {
+    BRFileServiceStoreUnit unit = { ns, writes };
+
+    pthread_mutex_lock (&store->lock);
+    array_add (store->units, unit);
+    store->unitsQueued += 1;
+    pthread_cond_broadcast (&store->cond);
+    pthread_mutex_unlock (&store->lock);
+}
+
+static void
+fileServiceStoreFree (BRFileServiceStore store) {
+    if (NULL != store->writer) fileServiceSQLiteClose (store->writer);
+    if (NULL != store->units)  array_free (store->units);
+
+    pthread_cond_destroy  (&store->cond);
+    pthread_mutex_destroy (&store->lock);
+    pthread_mutex_destroy (&store->writerLock);
+
+    free (store->sdbPath);
+    free (store);
+}
+
+static char *
+fileServiceStoreCreatePath (const char *basePath) {
+    char *sdbPath = malloc (strlen (basePath) + 1 + strlen (FILE_SERVICE_SDB_FILENAME) + 1);
+    sprintf (sdbPath, "%s/%s", basePath, FILE_SERVICE_SDB_FILENAME);
+    return sdbPath;
+}
+
+extern BRFileServiceStore
+fileServiceStoreCreate (const char *basePath) {
+    if (NULL == basePath || 0 == strlen (basePath)) return NULL;
+
+    // Make directory if needed.
+    if (0 != mkdir (basePath, 0700) && EEXIST != errno) return NULL;
+
+    BRFileServiceStore store = calloc (1, sizeof (struct BRFileServiceStoreRecord));
+
+    pthread_mutex_init_brd (&store->writerLock, PTHREAD_MUTEX_NORMAL);
+    pthread_mutex_init_brd (&store->lock, PTHREAD_MUTEX_NORMAL);
+    pthread_cond_init (&store->cond, NULL);
+    array_new (store->units, FILE_SERVICE_STORE_INITIAL_UNIT_COUNT);
+
+    store->sdbPath = fileServiceStoreCreatePath (basePath);
+    store->refs    = 1;
+
+    // Open the write connection.  Reads concurrent with the writer require the write-ahead log.
+    BRFileServiceBackendStatus status;
+    store->writer = fileServiceSQLiteOpenPath (store->sdbPath, &status);
+    if (NULL == store->writer ||
+        SQLITE_OK != fileServiceSQLiteSetDurability (store->writer, FILE_SERVICE_DURABILITY_WAL)) {
+        fileServiceStoreFree (store);
+        return NULL;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init (&attr);
+    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setstacksize (&attr, 1024 * 1024);
+    int created = pthread_create (&store->thread, &attr, (ThreadRoutine) fileServiceStoreWriterThread, store);
+    pthread_attr_destroy (&attr);
+
+    if (0 != created) {
+        fileServiceStoreFree (store);
+        return NULL;
+    }
+
+    return store;
+}
+
+extern void
+fileServiceStoreRelease (BRFileServiceStore store) {
+    pthread_mutex_lock (&store->lock);
+    bool quit = (0 == --store->refs);
+    if (quit) {
+        // Nothing more will be queued; the writer writes the queued units and then exits.
+        store->quit = true;
+        pthread_cond_broadcast (&store->cond);
+    }
+    pthread_mutex_unlock (&store->lock);
+
+    if (quit) {
+        pthread_join (store->thread, NULL);
+        fileServiceStoreFree (store);
+    }
+}
+
+extern void
+fileServiceStoreFlush (BRFileServiceStore store) {
+    pthread_mutex_lock (&store->lock);
+    uint64_t unitsQueued = store->unitsQueued;
+    while (store->unitsWritten < unitsQueued)
+        pthread_cond_wait (&store->cond, &store->lock);
+    pthread_mutex_unlock (&store->lock);
+}
+
+// MARK: Store Namespace
+
+extern BRFileServiceBackend
+fileServiceStoreOpenNamespace (BRFileServiceStore store,
+                               const char *currency,
+                               const char *network,
+                               BRFileServiceBackendStatus *status) {
+    BRFileServiceStoreNamespace ns = calloc (1, sizeof (struct BRFileServiceStoreNamespaceRecord));
+
+    // Open the read connection
+    ns->reader = fileServiceSQLiteOpenPath (store->sdbPath, status);
+    if (NULL == ns->reader) { free (ns); return NULL; }
+
+    ns->store  = store;
+    ns->prefix = malloc (strlen (currency) + 1 + strlen (network) + 1 + 1);
+    sprintf (ns->prefix, "%s-%s/", currency, network);
+
+    array_new (ns->writes, FILE_SERVICE_STORE_INITIAL_WRITE_COUNT);
+    array_new (ns->savepoints, 2);
+    ns->status = SQLITE_OK;
+
+    pthread_mutex_lock (&store->lock);
+    store->refs += 1;
+    pthread_mutex_unlock (&store->lock);
+
+    *status = SQLITE_OK;
+    return ns;
+}
+
+static char *
+fileServiceStoreNamespaceType (BRFileServiceStoreNamespace ns,
+                               const char *type) {
+    char *nsType = malloc (strlen (ns->prefix) + strlen (type) + 1);
+    sprintf (nsType, "%s%s", ns->prefix, type);
+    return nsType;
+}
+
+/// Take, and thus report only once, the first failure of a written unit.
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceTakeStatus (BRFileServiceStoreNamespace ns) {
+    pthread_mutex_lock (&ns->store->lock);
+    BRFileServiceBackendStatus status = ns->status;
+    ns->status = SQLITE_OK;
+    pthread_mutex_unlock (&ns->store->lock);
+    return status;
+}
+
+static void
+fileServiceStoreNamespaceEnqueue (BRFileServiceStoreNamespace ns) {
+    if (0 == array_count (ns->writes)) return;
+
+    fileServiceStoreEnqueue (ns->store, ns, ns->writes);
+    array_new (ns->writes, FILE_SERVICE_STORE_INITIAL_WRITE_COUNT);
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceWrite (BRFileServiceStoreNamespace ns,
+                                BRFileServiceStoreWrite write) {
+    array_add (ns->writes, write);
+
+    // Outside of a transaction, each write is a unit of its own.
+    if (0 == array_count (ns->savepoints))
+        fileServiceStoreNamespaceEnqueue (ns);
+
+    return fileServiceStoreNamespaceTakeStatus (ns);
+}
+
+static void
+fileServiceStoreNamespaceClose (BRFileServiceBackend backend) {
+    BRFileServiceStoreNamespace ns = backend;
+    BRFileServiceStore store = ns->store;
+
+    // Commit any transaction left open, then wait for every unit to be written.
+    array_clear (ns->savepoints);
+    fileServiceStoreNamespaceEnqueue (ns);
+    fileServiceStoreFlush (store);
+
+    fileServiceSQLiteClose (ns->reader);
+    array_free (ns->writes);
+    array_free (ns->savepoints);
+    free (ns->prefix);
+    free (ns);
+
+    fileServiceStoreRelease (store);
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceBegin (BRFileServiceBackend backend) {
+    BRFileServiceStoreNamespace ns = backend;
+
+    BRFileServiceBackendStatus status = fileServiceStoreNamespaceTakeStatus (ns);
+    if (SQLITE_OK == status) array_add (ns->savepoints, array_count (ns->writes));
+    return status;
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceCommit (BRFileServiceBackend backend) {
+    BRFileServiceStoreNamespace ns = backend;
+
+    array_rm_last (ns->savepoints);
+    if (0 == array_count (ns->savepoints))
+        fileServiceStoreNamespaceEnqueue (ns);
+    return SQLITE_OK;
+}
+
+static void
+fileServiceStoreNamespaceRollback (BRFileServiceBackend backend) {
+    BRFileServiceStoreNamespace ns = backend;
+    if (0 == array_count (ns->savepoints)) return;
+
+    size_t writesCount = ns->savepoints[array_count (ns->savepoints) - 1];
+    for (size_t index = writesCount; index < array_count (ns->writes); index++)
+        fileServiceStoreWriteRelease (&ns->writes[index]);
+    array_set_count (ns->writes, writesCount);
+    array_rm_last (ns->savepoints);
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceSave (BRFileServiceBackend backend,
+                               const char *type,
+                               UInt256 identifier,
+                               int64_t sortKey,
+                               const uint8_t *bytes,
+                               size_t bytesCount) {
+    BRFileServiceStoreNamespace ns = backend;
+
+    // The write outlives `bytes`
+    uint8_t *bytesCopy = malloc (bytesCount);
+    memcpy (bytesCopy, bytes, bytesCount);
+
+    return fileServiceStoreNamespaceWrite (ns, (BRFileServiceStoreWrite) {
+        FILE_SERVICE_STORE_WRITE_SAVE,
+        fileServiceStoreNamespaceType (ns, type),
+        identifier,
+        sortKey,
+        bytesCopy,
+        bytesCount
+    });
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceRemove (BRFileServiceBackend backend,
+                                 const char *type,
+                                 UInt256 identifier) {
+    BRFileServiceStoreNamespace ns = backend;
+
+    return fileServiceStoreNamespaceWrite (ns, (BRFileServiceStoreWrite) {
+        FILE_SERVICE_STORE_WRITE_REMOVE,
+        fileServiceStoreNamespaceType (ns, type),
+        identifier
+    });
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceClear (BRFileServiceBackend backend,
+                                const char *type) {
+    BRFileServiceStoreNamespace ns = backend;
+
+    return fileServiceStoreNamespaceWrite (ns, (BRFileServiceStoreWrite) {
+        FILE_SERVICE_STORE_WRITE_CLEAR,
+        fileServiceStoreNamespaceType (ns, type)
+    });
+}
+
+///
+/// Create the SQL that deletes every entity of the `prefix` namespace whose type is not one of
+/// `types`.  You own the returned SQL.
+///
+static char *
+fileServiceStorePurgeCreateSQL (const char *prefix,
+                                const char **types,
+                                size_t typesCount) {
+    char *sql = sqlite3_mprintf ("DELETE FROM Entity WHERE substr(Type, 1, %d) = %Q",
+                                 (int) strlen (prefix), prefix);
+
+    for (size_t index = 0; index < typesCount; index++) {
+        char nsType[strlen (prefix) + strlen (types[index]) + 1];
+        sprintf (nsType, "%s%s", prefix, types[index]);
+
+        sql = sqlite3_mprintf ("%z%s%Q", sql, (0 == index ? " AND Type NOT IN (" : ", "), nsType);
+    }
+    sql = sqlite3_mprintf ("%z%s;", sql, (0 == typesCount ? "" : ")"));
+
+    char *result = strdup (sql);
+    sqlite3_free (sql);
+    return result;
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespacePurge (BRFileServiceBackend backend,
+                                const char **types,
+                                size_t typesCount) {
+    BRFileServiceStoreNamespace ns = backend;
+
+    return fileServiceStoreNamespaceWrite (ns, (BRFileServiceStoreWrite) {
+        FILE_SERVICE_STORE_WRITE_EXEC,
+        fileServiceStorePurgeCreateSQL (ns->prefix, types, typesCount)
+    });
+}
+
+static bool
+fileServiceStoreNamespaceHasUnkeyed (BRFileServiceBackend backend,
+                                     const char *type) {
+    BRFileServiceStoreNamespace ns = backend;
+    fileServiceStoreFlush (ns->store);
+
+    char nsType[strlen (ns->prefix) + strlen (type) + 1];
+    sprintf (nsType, "%s%s", ns->prefix, type);
+
+    return fileServiceSQLiteHasUnkeyed (ns->reader, nsType);
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceLoad (BRFileServiceBackend backend,
+                               const char *type,
+                               bool ordered,
+                               const int64_t *range,
+                               void *context,
+                               BRFileServiceBackendLoadHandler handler) {
+    BRFileServiceStoreNamespace ns = backend;
+    fileServiceStoreFlush (ns->store);
+
+    BRFileServiceBackendStatus status = fileServiceStoreNamespaceTakeStatus (ns);
+    if (SQLITE_OK != status) return status;
+
+    char nsType[strlen (ns->prefix) + strlen (type) + 1];
+    sprintf (nsType, "%s%s", ns->prefix, type);
+
+    return fileServiceSQLiteLoad (ns->reader, nsType, ordered, range, context, handler);
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceStats (BRFileServiceBackend backend,
+                                const char *type,
+                                size_t *entitiesCount,
+                                uint64_t *bytesCount) {
+    BRFileServiceStoreNamespace ns = backend;
+    fileServiceStoreFlush (ns->store);
+
+    char nsType[strlen (ns->prefix) + strlen (type) + 1];
+    sprintf (nsType, "%s%s", ns->prefix, type);
+
+    return fileServiceSQLiteStats (ns->reader, nsType, entitiesCount, bytesCount);
+}
+
+static BRFileServiceBackendStatus
+fileServiceStoreNamespaceSetDurability (BRFileServiceBackend backend,
+                                        BRFileServiceDurability durability) {
+    BRFileServiceStoreNamespace ns = backend;
+    BRFileServiceStore store = ns->store;
+
+    // Reads concurrent with the writer require the write-ahead log.
+    durability.journalWAL = true;
+
+    // Between the writer's DB transactions
+    pthread_mutex_lock (&store->writerLock);
+    BRFileServiceBackendStatus status = fileServiceSQLiteSetDurability (store->writer, durability);
+    pthread_mutex_unlock (&store->writerLock);
+
+    if (SQLITE_OK == status)
+        status = fileServiceSQLiteSetDurability (ns->reader, durability);
+
+    return status;
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
+
+static int
+fileServiceStoreNamespaceWipe (const char *basePath,
+                               const char *currency,
+                               const char *network) {
+    int result = 0; // 0 on success, errno on failure
+
+#if !defined(NEUTER_FILE_SERVICE)
+    char *sdbPath = fileServiceStoreCreatePath (basePath);
+
+    // Only an existing store has a namespace to remove.
+    sqlite3 *sdb = NULL;
+    if (SQLITE_OK == sqlite3_open_v2 (sdbPath, &sdb, SQLITE_OPEN_READWRITE, NULL)) {
+        sqlite3_busy_timeout (sdb, FILE_SERVICE_SDB_BUSY_TIMEOUT);
+
+        char prefix[strlen (currency) + 1 + strlen (network) + 1 + 1];
+        sprintf (prefix, "%s-%s/", currency, network);
+
+        char *sql = fileServiceStorePurgeCreateSQL (prefix, NULL, 0);
+        if (SQLITE_OK != sqlite3_exec (sdb, sql, NULL, NULL, NULL)) result = EIO;
+        free (sql);
+    }
+    sqlite3_close (sdb);
+
+    free (sdbPath);
+#endif
+
+    return result;
+}
+
+#if !defined(NEUTER_FILE_SERVICE)
+const BRFileServiceBackendHandlers fileServiceBackendHandlersStore = {
+    NULL,
+    fileServiceStoreNamespaceClose,
+    fileServiceSQLiteError,
+    fileServiceStoreNamespaceBegin,
+    fileServiceStoreNamespaceCommit,
+    fileServiceStoreNamespaceRollback,
+    fileServiceStoreNamespaceSave,
+    fileServiceStoreNamespaceRemove,
+    fileServiceStoreNamespaceClear,
+    fileServiceStoreNamespacePurge,
+    fileServiceStoreNamespaceHasUnkeyed,
+    fileServiceStoreNamespaceLoad,
+    fileServiceStoreNamespaceStats,
+    fileServiceStoreNamespaceSetDurability,
+    fileServiceStoreNamespaceWipe
+};
+#else
+const BRFileServiceBackendHandlers fileServiceBackendHandlersStore = {
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    fileServiceStoreNamespaceWipe
+};
+
+extern BRFileServiceStore
+fileServiceStoreCreate (const char *basePath) {
+    return NULL;
+}
+
+extern void
+fileServiceStoreRelease (BRFileServiceStore store) {
+}
+
+extern void
+fileServiceStoreFlush (BRFileServiceStore store) {
+}
+#endif // !defined(NEUTER_FILE_SERVICE)
@@ -9,6 +9,7 @@ package com.breadwallet.corecrypto;
 
 import com.breadwallet.crypto.CryptoApi;
 import com.breadwallet.crypto.Network;
+import com.breadwallet.crypto.PersistenceProfile;
 import com.breadwallet.crypto.Unit;
 import com.breadwallet.crypto.Wallet;
 import com.breadwallet.crypto.blockchaindb.BlockchainDb;
@@ -82,8 +83,9 @@ public final class CryptoApiProvider implements CryptoApi.Provider {
                                                     com.breadwallet.crypto.Account account,
                                                     boolean isMainnet,
                                                     String path,
-                                                    BlockchainDb query) {
-            return System.create(executor, listener, account, isMainnet, path, query);
+                                                    BlockchainDb query,
+                                                    PersistenceProfile persistenceProfile) {
+            return System.create(executor, listener, account, isMainnet, path, query, persistenceProfile);
         }
 
         @Override
@@ -35,6 +35,7 @@ import com.breadwallet.corenative.support.BRConstants;
 import com.breadwallet.corenative.utility.Cookie;
 import com.breadwallet.crypto.AddressScheme;
 import com.breadwallet.crypto.NetworkType;
+import com.breadwallet.crypto.PersistenceProfile;
 import com.breadwallet.crypto.SystemState;
 import com.breadwallet.crypto.TransferState;
 import com.breadwallet.crypto.WalletManagerMode;
@@ -178,6 +179,17 @@ final class System implements com.breadwallet.crypto.System {
                          boolean isMainnet,
                          String storagePath,
                          BlockchainDb query) {
+        return create(executor, listener, account, isMainnet, storagePath, query, PersistenceProfile.DURABLE);
+    }
+
+    /* package */
+    static System create(ScheduledExecutorService executor,
+                         SystemListener listener,
+                         com.breadwallet.crypto.Account account,
+                         boolean isMainnet,
+                         String storagePath,
+                         BlockchainDb query,
+                         PersistenceProfile persistenceProfile) {
         Account cryptoAccount = Account.from(account);
 
         storagePath = storagePath + (storagePath.endsWith(File.separator) ? "" : File.separator) + cryptoAccount.getFilesystemIdentifier();
@@ -207,6 +219,7 @@ final class System implements com.breadwallet.crypto.System {
                 isMainnet,
                 storagePath,
                 query,
+                persistenceProfile,
                 context,
                 cwmListener,
                 cwmClient);
@@ -354,6 +367,7 @@ final class System implements com.breadwallet.crypto.System {
                    boolean isMainnet,
                    String storagePath,
                    BlockchainDb query,
+                   PersistenceProfile persistenceProfile,
                    Cookie context,
                    BRCryptoListener cwmListener,
                    BRCryptoClient cwmClient) {
@@ -373,7 +387,8 @@ final class System implements com.breadwallet.crypto.System {
                 this.cwmListener,
                 this.account.getCoreBRCryptoAccount(),
                 storagePath,
-                isMainnet).get();
+                isMainnet,
+                Utilities.persistenceProfileToCrypto(persistenceProfile)).get();
     }
 
     @Override
@@ -11,6 +11,7 @@ import com.breadwallet.corenative.crypto.BRCryptoAddressScheme;
 import com.breadwallet.corenative.crypto.BRCryptoNetworkType;
 import com.breadwallet.corenative.crypto.BRCryptoPaymentProtocolError;
 import com.breadwallet.corenative.crypto.BRCryptoPaymentProtocolType;
+import com.breadwallet.corenative.crypto.BRCryptoPersistenceProfile;
 import com.breadwallet.corenative.crypto.BRCryptoStatus;
 import com.breadwallet.corenative.crypto.BRCryptoSystemState;
 import com.breadwallet.corenative.crypto.BRCryptoTransferAttributeValidationError;
@@ -25,6 +26,7 @@ import com.breadwallet.corenative.crypto.BRCryptoSyncStoppedReason;
 import com.breadwallet.crypto.AddressScheme;
 import com.breadwallet.crypto.NetworkType;
 import com.breadwallet.crypto.PaymentProtocolRequestType;
+import com.breadwallet.crypto.PersistenceProfile;
 import com.breadwallet.crypto.SystemState;
 import com.breadwallet.crypto.TransferConfirmation;
 import com.breadwallet.crypto.TransferDirection;
@@ -240,6 +242,16 @@ final class Utilities {
         }
     }
 
+    /* package */
+    static BRCryptoPersistenceProfile persistenceProfileToCrypto(PersistenceProfile profile) {
+        switch (profile) {
+            case DURABLE:  return BRCryptoPersistenceProfile.CRYPTO_PERSISTENCE_PROFILE_DURABLE;
+            case BALANCED: return BRCryptoPersistenceProfile.CRYPTO_PERSISTENCE_PROFILE_BALANCED;
+            case SHARED:   return BRCryptoPersistenceProfile.CRYPTO_PERSISTENCE_PROFILE_SHARED;
+            default: throw new IllegalArgumentException("Unsupported profile");
+        }
+    }
+
     /* package */
     static AddressScheme addressSchemeFromCrypto(BRCryptoAddressScheme scheme) {
         switch (scheme) {
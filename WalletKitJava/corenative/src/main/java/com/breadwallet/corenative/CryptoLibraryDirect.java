@@ -439,7 +439,8 @@ public final class CryptoLibraryDirect {
                                                     Pointer listener,
                                                     Pointer account,
                                                     String path,
-                                                    int onMainnet);
+                                                    int onMainnet,
+                                                    int persistenceProfile);
 
     public static native int cryptoSystemGetState (Pointer system);
     public static native int cryptoSystemOnMainnet (Pointer system);
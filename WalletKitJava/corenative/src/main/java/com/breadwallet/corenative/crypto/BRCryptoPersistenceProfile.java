@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2019 Breadwinner AG.  All right reserved.
+ *
+ * See the LICENSE file at the project root for license information.
+ * See the CONTRIBUTORS file at the project root for a list of contributors.
+ */
+package com.breadwallet.corenative.crypto;
+
+public enum BRCryptoPersistenceProfile {
+
+    CRYPTO_PERSISTENCE_PROFILE_DURABLE {
+        @Override
+        public int toCore() {
+            return CRYPTO_PERSISTENCE_PROFILE_DURABLE_VALUE;
+        }
+    },
+
+    CRYPTO_PERSISTENCE_PROFILE_BALANCED {
+        @Override
+        public int toCore() {
+            return CRYPTO_PERSISTENCE_PROFILE_BALANCED_VALUE;
+        }
+    },
+
+    CRYPTO_PERSISTENCE_PROFILE_SHARED {
+        @Override
+        public int toCore() {
+            return CRYPTO_PERSISTENCE_PROFILE_SHARED_VALUE;
+        }
+    };
+
+    private static final int CRYPTO_PERSISTENCE_PROFILE_DURABLE_VALUE  = 0;
+    private static final int CRYPTO_PERSISTENCE_PROFILE_BALANCED_VALUE = 1;
+    private static final int CRYPTO_PERSISTENCE_PROFILE_SHARED_VALUE   = 2;
+
+    public static BRCryptoPersistenceProfile fromCore(int nativeValue) {
+        switch (nativeValue) {
+            case CRYPTO_PERSISTENCE_PROFILE_DURABLE_VALUE:  return CRYPTO_PERSISTENCE_PROFILE_DURABLE;
+            case CRYPTO_PERSISTENCE_PROFILE_BALANCED_VALUE: return CRYPTO_PERSISTENCE_PROFILE_BALANCED;
+            case CRYPTO_PERSISTENCE_PROFILE_SHARED_VALUE:   return CRYPTO_PERSISTENCE_PROFILE_SHARED;
+            default: throw new IllegalArgumentException("Invalid core value");
+        }
+    }
+
+    public abstract int toCore();
+}
@@ -22,7 +22,8 @@ public class BRCryptoSystem extends PointerType {
                                                    BRCryptoListener listener,
                                                    BRCryptoAccount account,
                                                    String path,
-                                                   boolean onMainnet) {
+                                                   boolean onMainnet,
+                                                   BRCryptoPersistenceProfile persistenceProfile) {
 
         return Optional.fromNullable(
                 CryptoLibraryDirect.cryptoSystemCreate (
@@ -30,7 +31,8 @@ public class BRCryptoSystem extends PointerType {
                         listener.getPointer(),
                         account.getPointer(),
                         path,
-                        onMainnet ? 1 : 0)
+                        onMainnet ? 1 : 0,
+                        persistenceProfile.toCore())
                 )
                 .transform(BRCryptoSystem::new);
     }
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2019 Breadwinner AG.  All right reserved.
+ *
+ * See the LICENSE file at the project root for license information.
+ * See the CONTRIBUTORS file at the project root for a list of contributors.
+ */
+package com.breadwallet.crypto;
+
+/**
+ * A PersistenceProfile trades the durability of persistent storage for write latency.
+ *
+ * DURABLE:  Every write is synced to disk before it completes.
+ * BALANCED: Writes go to a write-ahead log, synced only on checkpoints.  Writes survive an App
+ *           crash but, on an OS crash or power loss, the latest might be lost (and then recovered
+ *           on the next sync).
+ * SHARED:   As BALANCED, but the system and every wallet manager share one database.
+ */
+public enum PersistenceProfile {
+    DURABLE,
+    BALANCED,
+    SHARED
+}
@@ -44,7 +44,24 @@ public interface System {
      * @param query the BlockchainDB query engine.
      */
     static System create(ScheduledExecutorService executor, SystemListener listener, Account account, boolean isMainnet, String storagePath, BlockchainDb query) {
-        return CryptoApi.getProvider().systemProvider().create(executor, listener, account, isMainnet,storagePath, query);
+        return create(executor, listener, account, isMainnet, storagePath, query, PersistenceProfile.DURABLE);
+    }
+
+    /**
+     * Create a new system.
+     *
+     * @param executor
+     * @param listener the listener for handling events.
+     * @param account the account, derived from a paper key, that will be used for all networks.
+     * @param isMainnet flag to indicate if the system is for mainnet or for testnet; as blockchains
+     *                  are announced, we'll filter them to be for mainent or testnet.
+     * @param storagePath the path to use for persistent storage of data, such as for blocks, peers, transactions and
+     *                    logs.
+     * @param query the BlockchainDB query engine.
+     * @param persistenceProfile the trade-off between durability and write latency for persistent storage.
+     */
+    static System create(ScheduledExecutorService executor, SystemListener listener, Account account, boolean isMainnet, String storagePath, BlockchainDb query, PersistenceProfile persistenceProfile) {
+        return CryptoApi.getProvider().systemProvider().create(executor, listener, account, isMainnet, storagePath, query, persistenceProfile);
     }
 
     /**
@@ -197,12 +197,16 @@ public final class System {
     ///   - listenerQueue: The queue to use when performing listen event handler callbacks.  If a
     ///       queue is not specficied (default to `nil`), then one will be provided.
     ///
+    ///   - persistenceProfile: The trade-off between durability and write latency for persistent
+    ///       storage.  Defaults to `.durable`.
+    ///
     internal init (client: SystemClient,
                    listener: SystemListener,
                    account: Account,
                    onMainnet: Bool,
                    path: String,
-                   listenerQueue: DispatchQueue? = nil) {
+                   listenerQueue: DispatchQueue? = nil,
+                   persistenceProfile: PersistenceProfile = .durable) {
 
         let basePath = path.hasSuffix("/") ? String(path.dropLast()) : path
         let uids     = account.fileSystemIdentifier
@@ -226,7 +230,8 @@ public final class System {
                                         self.cryptoListener,
                                         account.core,
                                         basePath,
-                                        onMainnet ? CRYPTO_TRUE : CRYPTO_FALSE)
+                                        onMainnet ? CRYPTO_TRUE : CRYPTO_FALSE,
+                                        persistenceProfile.core)
 
         // Add `system` to our known set of systems; this allows event callbacks from Core to
         // find the initiating Swift instance.
@@ -243,13 +248,15 @@ public final class System {
                                account: Account,
                                onMainnet: Bool,
                                path: String,
-                               listenerQueue: DispatchQueue? = nil) -> System {
+                               listenerQueue: DispatchQueue? = nil,
+                               persistenceProfile: PersistenceProfile = .durable) -> System {
         return System (client: client,
                        listener: listener,
                        account: account,
                        onMainnet: onMainnet,
                        path: path,
-                       listenerQueue: listenerQueue)
+                       listenerQueue: listenerQueue,
+                       persistenceProfile: persistenceProfile)
     }
 
     static func ensurePath (_ path: String) -> Bool {
@@ -1002,6 +1009,31 @@ public final class System {
     }
 }
 
+// MARK: - Persistence Profile
+
+///
+/// A PersistenceProfile trades the durability of persistent storage for write latency.
+///
+///  - durable:  Every write is synced to disk before it completes.
+///  - balanced: Writes go to a write-ahead log, synced only on checkpoints.  Writes survive an
+///              App crash but, on an OS crash or power loss, the latest might be lost (and then
+///              recovered on the next sync).
+///  - shared:   As `balanced`, but the system and every wallet manager share one database.
+///
+public enum PersistenceProfile {
+    case durable
+    case balanced
+    case shared
+
+    internal var core: BRCryptoPersistenceProfile {
+        switch self {
+        case .durable:  return CRYPTO_PERSISTENCE_PROFILE_DURABLE
+        case .balanced: return CRYPTO_PERSISTENCE_PROFILE_BALANCED
+        case .shared:   return CRYPTO_PERSISTENCE_PROFILE_SHARED
+        }
+    }
+}
+
 // MARK: - System State
 
 public enum SystemState {